@@ -0,0 +1,30 @@
+#version 450
+
+// Instanced variant of blinnPhong.vert. See cookTorranceInstanced.vert.
+// Pairs with blinnPhong.frag.
+
+layout( location = 0 ) in vec3 iPosition;
+layout( location = 1 ) in vec3 iNormal;
+layout( location = 2 ) in vec2 iTexCoord;
+layout( location = 4 ) in mat4 iModel;   // locations 4-7
+layout( location = 8 ) in mat4 iModelN;  // locations 8-11
+
+layout( location = 2 ) uniform mat4 uViewProj;
+
+out vec3 v2fPosition;
+out vec3 v2fNormal;
+out vec2 v2fTexCoord;
+
+// Depth-tested with GL_LEQUAL against the pre-pass (see depthOnly.vert).
+invariant gl_Position;
+
+void main()
+{
+	vec4 worldPos = iModel * vec4( iPosition, 1.0 );
+
+	v2fPosition = worldPos.xyz;
+	v2fNormal = normalize( mat3( iModelN ) * iNormal );
+	v2fTexCoord = iTexCoord;
+
+	gl_Position = uViewProj * worldPos;
+}
@@ -0,0 +1,34 @@
+#version 450
+
+// Instanced variant of cookTorranceBump.vert. See cookTorranceInstanced.vert.
+// Pairs with cookTorranceBump.frag.
+
+layout( location = 0 ) in vec3 iPosition;
+layout( location = 1 ) in vec3 iNormal;
+layout( location = 2 ) in vec2 iTexCoord;
+layout( location = 3 ) in vec4 iTangent; // xyz = tangent, w = handedness (0 = no bump mapping)
+layout( location = 4 ) in mat4 iModel;   // locations 4-7
+layout( location = 8 ) in mat4 iModelN;  // locations 8-11
+
+layout( location = 2 ) uniform mat4 uViewProj;
+
+out vec3 v2fPosition;
+out vec3 v2fNormal;
+out vec2 v2fTexCoord;
+out vec4 v2fTangent;
+
+// Depth-tested with GL_LEQUAL against the pre-pass (see depthOnly.vert).
+invariant gl_Position;
+
+void main()
+{
+	vec4 worldPos = iModel * vec4( iPosition, 1.0 );
+	mat3 normalMat = mat3( iModelN );
+
+	v2fPosition = worldPos.xyz;
+	v2fNormal = normalize( normalMat * iNormal );
+	v2fTexCoord = iTexCoord;
+	v2fTangent = vec4( normalize( mat3( iModel ) * iTangent.xyz ), iTangent.w );
+
+	gl_Position = uViewProj * worldPos;
+}
@@ -0,0 +1,191 @@
+#version 450
+
+// Cook-Torrance shading with clustered light lists (see
+// support/clustered_lights.hpp).
+//
+// Point and spot lights live in shader storage buffers of any size. The
+// fragment finds its cluster from its screen tile and its view depth
+// (exponential depth slices), and only evaluates the lights binned into that
+// cluster. Directional lights are few and still come from the uniform buffer.
+
+in vec3 v2fPosition;
+in vec3 v2fNormal;
+in vec2 v2fTexCoord;
+
+layout( location = 0 ) out vec4 oColor;
+
+layout( location = 3 ) uniform vec3 uCamPos;
+layout( location = 4 ) uniform vec3 uAmbient;
+layout( location = 8 ) uniform vec3 uEmissive;
+
+layout( location = 10 ) uniform mat4 uView;
+layout( location = 11 ) uniform uvec3 uClusterDims;
+layout( location = 12 ) uniform vec2 uTileSize;       // pixels
+layout( location = 13 ) uniform vec2 uSliceParams;    // slice = log(depth) * x + y
+
+layout( binding = 2 ) uniform sampler2D uAlbedoTex;
+layout( binding = 3 ) uniform sampler2D uMetallicTex;
+layout( binding = 4 ) uniform sampler2D uRoughnessTex;
+layout( binding = 5 ) uniform sampler2D uAmbientTex;
+layout( binding = 7 ) uniform sampler2D uEmissiveTex;
+layout( binding = 8 ) uniform sampler2D uMaskTex;
+
+struct DirLight
+{
+	vec3 dir;
+	vec3 col;
+};
+
+struct PointLight
+{
+	vec3 pos;
+	float rMax;
+	vec3 col;
+	vec3 atten;
+};
+
+struct SpotLight
+{
+	vec3 pos;
+	float cosInner;
+	vec3 dir;
+	float cosOuter;
+	vec3 col;
+	float rMax;
+	vec3 atten;
+};
+
+layout( std140, binding = 0 ) uniform DirLights
+{
+	DirLight dirLights[3];
+	int numDirLights;
+};
+
+layout( std430, binding = 3 ) readonly buffer PointLights
+{
+	PointLight pointLights[];
+};
+
+layout( std430, binding = 4 ) readonly buffer SpotLights
+{
+	SpotLight spotLights[];
+};
+
+layout( std430, binding = 5 ) readonly buffer Clusters
+{
+	uvec4 clusters[];   // offset, number of point lights, number of spot lights, unused
+};
+
+layout( std430, binding = 6 ) readonly buffer ClusterIndices
+{
+	uint clusterIndices[];
+};
+
+// Spot light shadows, packed into an atlas (see support/shadow_atlas.hpp).
+layout( std140, binding = 3 ) uniform SpotShadows
+{
+	mat4 spotShadowMats[10]; // world space to atlas coordinates
+	vec4 spotShadowTiles[10]; // atlas rectangle of each shadow map
+	int numSpotShadows;
+};
+
+layout( binding = 9 ) uniform sampler2DShadow uSpotShadowAtlas;
+
+const float kPi = 3.14159265;
+
+// Smooth falloff reaching 0 at rMax, see LightManager::calcAttenConsts().
+float attenuation( vec3 atten, float dist )
+{
+	return max( atten.y * exp( atten.x * dist * dist ) - atten.z, 0.0 );
+}
+
+// Fraction of the light of a spot light reaching a point. Lights without a
+// shadow map and points outside of the shadow frustum are fully lit. The point
+// is offset along the normal to avoid self-shadowing.
+float spotShadow( int light, vec3 position, vec3 n )
+{
+	if( light >= numSpotShadows )
+		return 1.0;
+	vec4 p = spotShadowMats[light] * vec4( position + n * 0.05, 1.0 );
+	if( p.w <= 0.0 )
+		return 1.0;
+	p.xyz /= p.w;
+	vec4 tile = spotShadowTiles[light];
+	if( any( lessThan( p.xy, tile.xy ) ) || any( greaterThan( p.xy, tile.zw ) ) )
+		return 1.0;
+	return texture( uSpotShadowAtlas, p.xyz );
+}
+
+vec3 cookTorrance( vec3 n, vec3 v, vec3 l, vec3 albedo, float metallic, float roughness )
+{
+	vec3 h = normalize( l + v );
+	float nl = max( dot( n, l ), 0.0 );
+	float nv = max( dot( n, v ), 1e-4 );
+	float nh = max( dot( n, h ), 0.0 );
+	float vh = max( dot( v, h ), 0.0 );
+
+	vec3 f0 = mix( vec3( 0.04 ), albedo, metallic );
+	vec3 fresnel = f0 + ( 1.0 - f0 ) * pow( 1.0 - vh, 5.0 );
+
+	float a2 = roughness * roughness * roughness * roughness;
+	float denom = nh * nh * ( a2 - 1.0 ) + 1.0;
+	float ndf = a2 / ( kPi * denom * denom );
+
+	float k = ( roughness + 1.0 ) * ( roughness + 1.0 ) / 8.0;
+	float geom = ( nl / ( nl * ( 1.0 - k ) + k ) ) * ( nv / ( nv * ( 1.0 - k ) + k ) );
+
+	vec3 specular = ndf * geom * fresnel / max( 4.0 * nl * nv, 1e-4 );
+	vec3 diffuse = ( 1.0 - fresnel ) * ( 1.0 - metallic ) * albedo / kPi;
+	return ( diffuse + specular ) * nl;
+}
+
+void main()
+{
+	vec3 albedo = texture( uAlbedoTex, v2fTexCoord ).rgb;
+	float metallic = texture( uMetallicTex, v2fTexCoord ).r;
+	float roughness = max( texture( uRoughnessTex, v2fTexCoord ).r, 0.05 );
+	float occlusion = texture( uAmbientTex, v2fTexCoord ).r;
+	vec3 emissive = texture( uEmissiveTex, v2fTexCoord ).rgb * uEmissive;
+
+	vec3 n = normalize( v2fNormal );
+	vec3 v = normalize( uCamPos - v2fPosition );
+
+	vec3 color = uAmbient * albedo * occlusion + emissive;
+
+	for( int i = 0; i < numDirLights; ++i )
+		color += dirLights[i].col * cookTorrance( n, v, normalize( -dirLights[i].dir ), albedo, metallic, roughness );
+
+	// Find the cluster of the fragment
+	float depth = -( uView * vec4( v2fPosition, 1.0 ) ).z;
+	uvec3 cell = uvec3( gl_FragCoord.xy / uTileSize, max( log( depth ) * uSliceParams.x + uSliceParams.y, 0.0 ) );
+	cell = min( cell, uClusterDims - 1u );
+	uvec4 cluster = clusters[( cell.z * uClusterDims.y + cell.y ) * uClusterDims.x + cell.x];
+
+	for( uint i = 0u; i < cluster.y; ++i )
+	{
+		PointLight light = pointLights[clusterIndices[cluster.x + i]];
+		vec3 toLight = light.pos - v2fPosition;
+		float dist = length( toLight );
+		if( dist >= light.rMax )
+			continue;
+		color += light.col * attenuation( light.atten, dist ) * cookTorrance( n, v, toLight / dist, albedo, metallic, roughness );
+	}
+
+	for( uint i = 0u; i < cluster.z; ++i )
+	{
+		uint index = clusterIndices[cluster.x + cluster.y + i];
+		SpotLight light = spotLights[index];
+		vec3 toLight = light.pos - v2fPosition;
+		float dist = length( toLight );
+		if( dist >= light.rMax )
+			continue;
+		vec3 l = toLight / dist;
+		float cone = smoothstep( light.cosOuter, light.cosInner, dot( -l, light.dir ) );
+		if( cone <= 0.0 )
+			continue;
+		cone *= spotShadow( int( index ), v2fPosition, n );
+		color += light.col * cone * attenuation( light.atten, dist ) * cookTorrance( n, v, l, albedo, metallic, roughness );
+	}
+
+	oColor = vec4( pow( color, vec3( 1.0 / 2.2 ) ), texture( uMaskTex, v2fTexCoord ).r );
+}
@@ -0,0 +1,30 @@
+#version 450
+
+// Vertex shader of the clustered lighting path (see support/clustered_lights.hpp).
+// Same interface as cookTorrance.vert; pairs with cookTorranceClustered.frag.
+
+layout( location = 0 ) in vec3 iPosition;
+layout( location = 1 ) in vec3 iNormal;
+layout( location = 2 ) in vec2 iTexCoord;
+
+layout( location = 0 ) uniform mat4 uModel;
+layout( location = 1 ) uniform mat4 uModelN;
+layout( location = 2 ) uniform mat4 uViewProj;
+
+out vec3 v2fPosition;
+out vec3 v2fNormal;
+out vec2 v2fTexCoord;
+
+// Depth-tested with GL_LEQUAL against the pre-pass (see depthOnly.vert).
+invariant gl_Position;
+
+void main()
+{
+	vec4 worldPos = uModel * vec4( iPosition, 1.0 );
+
+	v2fPosition = worldPos.xyz;
+	v2fNormal = normalize( mat3( uModelN ) * iNormal );
+	v2fTexCoord = iTexCoord;
+
+	gl_Position = uViewProj * worldPos;
+}
@@ -0,0 +1,204 @@
+#version 450
+
+// Cook-Torrance shading with per-object light lists (see
+// support/object_lights.hpp).
+//
+// The lights come from the same uniform buffers as cookTorrance.frag, but
+// rather than looping over all of them, the fragment only evaluates the point
+// and spot lights the CPU found to reach the object being drawn. The indices
+// are set per draw, points first.
+//
+// Materials without some of the textures are drawn with variants of this
+// shader compiled with the defines of support/shader_permutations.hpp, which
+// skip the texture reads:
+//  - NO_UVS: untextured (white albedo, dielectric, smooth, no emission);
+//  - NO_EMISSIVE_MAP: the emission is the material constant;
+//  - NO_MASK: fully opaque;
+//  - NO_AMBIENT_OCCLUSION_MAP: no ambient occlusion.
+
+in vec3 v2fPosition;
+in vec3 v2fNormal;
+in vec2 v2fTexCoord;
+
+layout( location = 0 ) out vec4 oColor;
+
+layout( location = 3 ) uniform vec3 uCamPos;
+layout( location = 4 ) uniform vec3 uAmbient;
+layout( location = 8 ) uniform vec3 uEmissive;
+
+layout( location = 14 ) uniform ivec2 uLightCounts;   // number of point and spot lights reaching the object
+layout( location = 15 ) uniform int uLightIndices[20]; // point light indices, then spot light indices
+
+layout( binding = 2 ) uniform sampler2D uAlbedoTex;
+layout( binding = 3 ) uniform sampler2D uMetallicTex;
+layout( binding = 4 ) uniform sampler2D uRoughnessTex;
+layout( binding = 5 ) uniform sampler2D uAmbientTex;
+layout( binding = 7 ) uniform sampler2D uEmissiveTex;
+layout( binding = 8 ) uniform sampler2D uMaskTex;
+
+struct DirLight
+{
+	vec3 dir;
+	vec3 col;
+};
+
+struct PointLight
+{
+	vec3 pos;
+	float rMax;
+	vec3 col;
+	vec3 atten;
+};
+
+struct SpotLight
+{
+	vec3 pos;
+	float cosInner;
+	vec3 dir;
+	float cosOuter;
+	vec3 col;
+	float rMax;
+	vec3 atten;
+};
+
+layout( std140, binding = 0 ) uniform DirLights
+{
+	DirLight dirLights[3];
+	int numDirLights;
+};
+
+layout( std140, binding = 1 ) uniform PointLights
+{
+	PointLight pointLights[10];
+	int numPointLights;
+};
+
+layout( std140, binding = 2 ) uniform SpotLights
+{
+	SpotLight spotLights[10];
+	int numSpotLights;
+};
+
+// Spot light shadows, packed into an atlas (see support/shadow_atlas.hpp).
+layout( std140, binding = 3 ) uniform SpotShadows
+{
+	mat4 spotShadowMats[10]; // world space to atlas coordinates
+	vec4 spotShadowTiles[10]; // atlas rectangle of each shadow map
+	int numSpotShadows;
+};
+
+layout( binding = 9 ) uniform sampler2DShadow uSpotShadowAtlas;
+
+const float kPi = 3.14159265;
+
+// Smooth falloff reaching 0 at rMax, see LightManager::calcAttenConsts().
+float attenuation( vec3 atten, float dist )
+{
+	return max( atten.y * exp( atten.x * dist * dist ) - atten.z, 0.0 );
+}
+
+// Fraction of the light of a spot light reaching a point. Lights without a
+// shadow map and points outside of the shadow frustum are fully lit. The point
+// is offset along the normal to avoid self-shadowing.
+float spotShadow( int light, vec3 position, vec3 n )
+{
+	if( light >= numSpotShadows )
+		return 1.0;
+	vec4 p = spotShadowMats[light] * vec4( position + n * 0.05, 1.0 );
+	if( p.w <= 0.0 )
+		return 1.0;
+	p.xyz /= p.w;
+	vec4 tile = spotShadowTiles[light];
+	if( any( lessThan( p.xy, tile.xy ) ) || any( greaterThan( p.xy, tile.zw ) ) )
+		return 1.0;
+	return texture( uSpotShadowAtlas, p.xyz );
+}
+
+vec3 cookTorrance( vec3 n, vec3 v, vec3 l, vec3 albedo, float metallic, float roughness )
+{
+	vec3 h = normalize( l + v );
+	float nl = max( dot( n, l ), 0.0 );
+	float nv = max( dot( n, v ), 1e-4 );
+	float nh = max( dot( n, h ), 0.0 );
+	float vh = max( dot( v, h ), 0.0 );
+
+	vec3 f0 = mix( vec3( 0.04 ), albedo, metallic );
+	vec3 fresnel = f0 + ( 1.0 - f0 ) * pow( 1.0 - vh, 5.0 );
+
+	float a2 = roughness * roughness * roughness * roughness;
+	float denom = nh * nh * ( a2 - 1.0 ) + 1.0;
+	float ndf = a2 / ( kPi * denom * denom );
+
+	float k = ( roughness + 1.0 ) * ( roughness + 1.0 ) / 8.0;
+	float geom = ( nl / ( nl * ( 1.0 - k ) + k ) ) * ( nv / ( nv * ( 1.0 - k ) + k ) );
+
+	vec3 specular = ndf * geom * fresnel / max( 4.0 * nl * nv, 1e-4 );
+	vec3 diffuse = ( 1.0 - fresnel ) * ( 1.0 - metallic ) * albedo / kPi;
+	return ( diffuse + specular ) * nl;
+}
+
+void main()
+{
+#ifdef NO_UVS
+	vec3 albedo = vec3( 1.0 );
+	float metallic = 0.0;
+	float roughness = 0.05;
+	float occlusion = 1.0;
+	vec3 emissive = vec3( 0.0 );
+#else
+	vec3 albedo = texture( uAlbedoTex, v2fTexCoord ).rgb;
+	float metallic = texture( uMetallicTex, v2fTexCoord ).r;
+	float roughness = max( texture( uRoughnessTex, v2fTexCoord ).r, 0.05 );
+#	ifdef NO_AMBIENT_OCCLUSION_MAP
+	float occlusion = 1.0;
+#	else
+	float occlusion = texture( uAmbientTex, v2fTexCoord ).r;
+#	endif
+#	ifdef NO_EMISSIVE_MAP
+	vec3 emissive = uEmissive;
+#	else
+	vec3 emissive = texture( uEmissiveTex, v2fTexCoord ).rgb * uEmissive;
+#	endif
+#endif
+
+	vec3 n = normalize( v2fNormal );
+	vec3 v = normalize( uCamPos - v2fPosition );
+
+	vec3 color = uAmbient * albedo * occlusion + emissive;
+
+	for( int i = 0; i < numDirLights; ++i )
+		color += dirLights[i].col * cookTorrance( n, v, normalize( -dirLights[i].dir ), albedo, metallic, roughness );
+
+	for( int i = 0; i < uLightCounts.x; ++i )
+	{
+		PointLight light = pointLights[uLightIndices[i]];
+		vec3 toLight = light.pos - v2fPosition;
+		float dist = length( toLight );
+		if( dist >= light.rMax )
+			continue;
+		color += light.col * attenuation( light.atten, dist ) * cookTorrance( n, v, toLight / dist, albedo, metallic, roughness );
+	}
+
+	for( int i = 0; i < uLightCounts.y; ++i )
+	{
+		int index = uLightIndices[uLightCounts.x + i];
+		SpotLight light = spotLights[index];
+		vec3 toLight = light.pos - v2fPosition;
+		float dist = length( toLight );
+		if( dist >= light.rMax )
+			continue;
+		vec3 l = toLight / dist;
+		float cone = smoothstep( light.cosOuter, light.cosInner, dot( -l, light.dir ) );
+		if( cone <= 0.0 )
+			continue;
+		cone *= spotShadow( index, v2fPosition, n );
+		color += light.col * cone * attenuation( light.atten, dist ) * cookTorrance( n, v, l, albedo, metallic, roughness );
+	}
+
+#if defined( NO_MASK ) || defined( NO_UVS )
+	float alpha = 1.0;
+#else
+	float alpha = texture( uMaskTex, v2fTexCoord ).r;
+#endif
+	oColor = vec4( pow( color, vec3( 1.0 / 2.2 ) ), alpha );
+}
@@ -0,0 +1,79 @@
+#version 450
+
+// First lighting pass of the deferred path (see support/deferred.hpp): a
+// full-screen pass adding ambient, emitted and directional light for every
+// covered pixel. Point and spot lights are added on top by light volumes
+// (deferredLightVolume.frag). Output is linear radiance.
+
+in vec2 v2fUv;
+
+layout( location = 0 ) out vec4 oColor;
+
+layout( location = 0 ) uniform mat4 uInvViewProj;
+layout( location = 3 ) uniform vec3 uCamPos;
+layout( location = 4 ) uniform vec3 uAmbient;
+
+layout( binding = 0 ) uniform sampler2D uAlbedoTex;
+layout( binding = 1 ) uniform sampler2D uNormalTex;
+layout( binding = 2 ) uniform sampler2D uMaterialTex;
+layout( binding = 3 ) uniform sampler2D uEmissiveTex;
+layout( binding = 4 ) uniform sampler2D uDepthTex;
+
+struct DirLight
+{
+	vec3 dir;
+	vec3 col;
+};
+
+layout( std140, binding = 0 ) uniform DirLights
+{
+	DirLight dirLights[3];
+	int numDirLights;
+};
+
+const float kPi = 3.14159265;
+
+vec3 cookTorrance( vec3 n, vec3 v, vec3 l, vec3 albedo, float metallic, float roughness )
+{
+	vec3 h = normalize( l + v );
+	float nl = max( dot( n, l ), 0.0 );
+	float nv = max( dot( n, v ), 1e-4 );
+	float nh = max( dot( n, h ), 0.0 );
+	float vh = max( dot( v, h ), 0.0 );
+
+	vec3 f0 = mix( vec3( 0.04 ), albedo, metallic );
+	vec3 fresnel = f0 + ( 1.0 - f0 ) * pow( 1.0 - vh, 5.0 );
+
+	float a2 = roughness * roughness * roughness * roughness;
+	float denom = nh * nh * ( a2 - 1.0 ) + 1.0;
+	float ndf = a2 / ( kPi * denom * denom );
+
+	float k = ( roughness + 1.0 ) * ( roughness + 1.0 ) / 8.0;
+	float geom = ( nl / ( nl * ( 1.0 - k ) + k ) ) * ( nv / ( nv * ( 1.0 - k ) + k ) );
+
+	vec3 specular = ndf * geom * fresnel / max( 4.0 * nl * nv, 1e-4 );
+	vec3 diffuse = ( 1.0 - fresnel ) * ( 1.0 - metallic ) * albedo / kPi;
+	return ( diffuse + specular ) * nl;
+}
+
+void main()
+{
+	ivec2 pixel = ivec2( gl_FragCoord.xy );
+	float depth = texelFetch( uDepthTex, pixel, 0 ).r;
+	if( depth >= 1.0 )
+		discard; // background keeps the clear colour
+
+	vec4 albedoAo = texelFetch( uAlbedoTex, pixel, 0 );
+	vec3 n = texelFetch( uNormalTex, pixel, 0 ).xyz;
+	vec2 metalRough = texelFetch( uMaterialTex, pixel, 0 ).rg;
+
+	vec4 world = uInvViewProj * vec4( v2fUv * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0 );
+	vec3 position = world.xyz / world.w;
+	vec3 v = normalize( uCamPos - position );
+
+	vec3 color = uAmbient * albedoAo.rgb * albedoAo.a + texelFetch( uEmissiveTex, pixel, 0 ).rgb;
+	for( int i = 0; i < numDirLights; ++i )
+		color += dirLights[i].col * cookTorrance( n, v, normalize( -dirLights[i].dir ), albedoAo.rgb, metalRough.r, metalRough.g );
+
+	oColor = vec4( color, 1.0 );
+}
@@ -0,0 +1,39 @@
+#version 450
+
+// G-buffer pass of the deferred path (see support/deferred.hpp).
+// Writes the PBR surface parameters; lighting happens later, once per pixel.
+//  - 0: albedo (rgb) and ambient occlusion (a);
+//  - 1: world space normal (rgb);
+//  - 2: metallic (r) and roughness (g);
+//  - 3: emitted radiance (rgb).
+
+in vec3 v2fPosition;
+in vec3 v2fNormal;
+in vec2 v2fTexCoord;
+
+layout( location = 0 ) out vec4 oAlbedo;
+layout( location = 1 ) out vec4 oNormal;
+layout( location = 2 ) out vec4 oMaterial;
+layout( location = 3 ) out vec4 oEmissive;
+
+layout( location = 3 ) uniform vec3 uCamPos; // set by Mesh for every program; unused here
+layout( location = 8 ) uniform vec3 uEmissive;
+
+layout( binding = 2 ) uniform sampler2D uAlbedoTex;
+layout( binding = 3 ) uniform sampler2D uMetallicTex;
+layout( binding = 4 ) uniform sampler2D uRoughnessTex;
+layout( binding = 5 ) uniform sampler2D uAmbientTex;
+layout( binding = 7 ) uniform sampler2D uEmissiveTex;
+layout( binding = 8 ) uniform sampler2D uMaskTex;
+
+void main()
+{
+	// The G-buffer holds opaque surfaces only
+	if( texture( uMaskTex, v2fTexCoord ).r < 0.5 )
+		discard;
+
+	oAlbedo = vec4( texture( uAlbedoTex, v2fTexCoord ).rgb, texture( uAmbientTex, v2fTexCoord ).r );
+	oNormal = vec4( normalize( v2fNormal ), 0.0 );
+	oMaterial = vec4( texture( uMetallicTex, v2fTexCoord ).r, max( texture( uRoughnessTex, v2fTexCoord ).r, 0.05 ), 0.0, 0.0 );
+	oEmissive = vec4( texture( uEmissiveTex, v2fTexCoord ).rgb * uEmissive, 0.0 );
+}
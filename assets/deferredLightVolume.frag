@@ -0,0 +1,146 @@
+#version 450
+
+// Adds the light of one point or spot light to the pixels covered by its
+// volume (see deferredLightVolume.vert). Blended additively on top of
+// deferredAmbient.frag; output is linear radiance.
+
+flat in int v2fLight;
+
+layout( location = 0 ) out vec4 oColor;
+
+layout( location = 0 ) uniform mat4 uInvViewProj;
+layout( location = 3 ) uniform vec3 uCamPos;
+layout( location = 5 ) uniform vec2 uScreenSize;
+layout( location = 6 ) uniform int uLightType; // 0 = point, 1 = spot
+
+layout( binding = 0 ) uniform sampler2D uAlbedoTex;
+layout( binding = 1 ) uniform sampler2D uNormalTex;
+layout( binding = 2 ) uniform sampler2D uMaterialTex;
+layout( binding = 4 ) uniform sampler2D uDepthTex;
+
+struct PointLight
+{
+	vec3 pos;
+	float rMax;
+	vec3 col;
+	vec3 atten;
+};
+
+struct SpotLight
+{
+	vec3 pos;
+	float cosInner;
+	vec3 dir;
+	float cosOuter;
+	vec3 col;
+	float rMax;
+	vec3 atten;
+};
+
+layout( std430, binding = 3 ) readonly buffer PointLights
+{
+	PointLight pointLights[];
+};
+
+layout( std430, binding = 4 ) readonly buffer SpotLights
+{
+	SpotLight spotLights[];
+};
+
+// Spot light shadows, packed into an atlas (see support/shadow_atlas.hpp).
+layout( std140, binding = 3 ) uniform SpotShadows
+{
+	mat4 spotShadowMats[10]; // world space to atlas coordinates
+	vec4 spotShadowTiles[10]; // atlas rectangle of each shadow map
+	int numSpotShadows;
+};
+
+layout( binding = 9 ) uniform sampler2DShadow uSpotShadowAtlas;
+
+const float kPi = 3.14159265;
+
+// Smooth falloff reaching 0 at rMax, see LightManager::calcAttenConsts().
+float attenuation( vec3 atten, float dist )
+{
+	return max( atten.y * exp( atten.x * dist * dist ) - atten.z, 0.0 );
+}
+
+// Fraction of the light of a spot light reaching a point. Lights without a
+// shadow map and points outside of the shadow frustum are fully lit. The point
+// is offset along the normal to avoid self-shadowing.
+float spotShadow( int light, vec3 position, vec3 n )
+{
+	if( light >= numSpotShadows )
+		return 1.0;
+	vec4 p = spotShadowMats[light] * vec4( position + n * 0.05, 1.0 );
+	if( p.w <= 0.0 )
+		return 1.0;
+	p.xyz /= p.w;
+	vec4 tile = spotShadowTiles[light];
+	if( any( lessThan( p.xy, tile.xy ) ) || any( greaterThan( p.xy, tile.zw ) ) )
+		return 1.0;
+	return texture( uSpotShadowAtlas, p.xyz );
+}
+
+vec3 cookTorrance( vec3 n, vec3 v, vec3 l, vec3 albedo, float metallic, float roughness )
+{
+	vec3 h = normalize( l + v );
+	float nl = max( dot( n, l ), 0.0 );
+	float nv = max( dot( n, v ), 1e-4 );
+	float nh = max( dot( n, h ), 0.0 );
+	float vh = max( dot( v, h ), 0.0 );
+
+	vec3 f0 = mix( vec3( 0.04 ), albedo, metallic );
+	vec3 fresnel = f0 + ( 1.0 - f0 ) * pow( 1.0 - vh, 5.0 );
+
+	float a2 = roughness * roughness * roughness * roughness;
+	float denom = nh * nh * ( a2 - 1.0 ) + 1.0;
+	float ndf = a2 / ( kPi * denom * denom );
+
+	float k = ( roughness + 1.0 ) * ( roughness + 1.0 ) / 8.0;
+	float geom = ( nl / ( nl * ( 1.0 - k ) + k ) ) * ( nv / ( nv * ( 1.0 - k ) + k ) );
+
+	vec3 specular = ndf * geom * fresnel / max( 4.0 * nl * nv, 1e-4 );
+	vec3 diffuse = ( 1.0 - fresnel ) * ( 1.0 - metallic ) * albedo / kPi;
+	return ( diffuse + specular ) * nl;
+}
+
+void main()
+{
+	ivec2 pixel = ivec2( gl_FragCoord.xy );
+	float depth = texelFetch( uDepthTex, pixel, 0 ).r;
+	if( depth >= 1.0 )
+		discard;
+
+	vec3 albedo = texelFetch( uAlbedoTex, pixel, 0 ).rgb;
+	vec3 n = texelFetch( uNormalTex, pixel, 0 ).xyz;
+	vec2 metalRough = texelFetch( uMaterialTex, pixel, 0 ).rg;
+
+	vec2 uv = gl_FragCoord.xy / uScreenSize;
+	vec4 world = uInvViewProj * vec4( uv * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0 );
+	vec3 position = world.xyz / world.w;
+	vec3 v = normalize( uCamPos - position );
+
+	vec3 lightPos, lightCol, atten;
+	float rMax, cone = 1.0;
+	if( uLightType == 0 )
+	{
+		PointLight light = pointLights[v2fLight];
+		lightPos = light.pos; lightCol = light.col; atten = light.atten; rMax = light.rMax;
+	}
+	else
+	{
+		SpotLight light = spotLights[v2fLight];
+		lightPos = light.pos; lightCol = light.col; atten = light.atten; rMax = light.rMax;
+		cone = smoothstep( light.cosOuter, light.cosInner, dot( normalize( position - light.pos ), light.dir ) );
+	}
+
+	vec3 toLight = lightPos - position;
+	float dist = length( toLight );
+	if( dist >= rMax || cone <= 0.0 )
+		discard;
+	if( uLightType != 0 )
+		cone *= spotShadow( v2fLight, position, n );
+
+	oColor = vec4( lightCol * cone * attenuation( atten, dist ) * cookTorrance( n, v, toLight / dist, albedo, metalRough.r, metalRough.g ), 1.0 );
+}
@@ -0,0 +1,51 @@
+#version 450
+
+// Light volumes of the deferred path (see support/deferred.hpp). A unit
+// proxy sphere is instanced once per light, moved to the light position and
+// scaled to its range, so that only pixels within reach of the light run
+// deferredLightVolume.frag.
+
+layout( location = 0 ) in vec3 iPosition;
+
+layout( location = 2 ) uniform mat4 uViewProj;
+layout( location = 6 ) uniform int uLightType; // 0 = point, 1 = spot
+
+struct PointLight
+{
+	vec3 pos;
+	float rMax;
+	vec3 col;
+	vec3 atten;
+};
+
+struct SpotLight
+{
+	vec3 pos;
+	float cosInner;
+	vec3 dir;
+	float cosOuter;
+	vec3 col;
+	float rMax;
+	vec3 atten;
+};
+
+layout( std430, binding = 3 ) readonly buffer PointLights
+{
+	PointLight pointLights[];
+};
+
+layout( std430, binding = 4 ) readonly buffer SpotLights
+{
+	SpotLight spotLights[];
+};
+
+flat out int v2fLight;
+
+void main()
+{
+	vec3 center = uLightType == 0 ? pointLights[gl_InstanceID].pos : spotLights[gl_InstanceID].pos;
+	float radius = uLightType == 0 ? pointLights[gl_InstanceID].rMax : spotLights[gl_InstanceID].rMax;
+
+	v2fLight = gl_InstanceID;
+	gl_Position = uViewProj * vec4( center + iPosition * radius, 1.0 );
+}
@@ -0,0 +1,17 @@
+#version 450
+
+// Last pass of the deferred path (see support/deferred.hpp): converts the
+// accumulated linear radiance to display values, as the forward shaders do
+// at the end of their lighting.
+
+in vec2 v2fUv;
+
+layout( location = 0 ) out vec4 oColor;
+
+layout( binding = 0 ) uniform sampler2D uRadianceTex;
+
+void main()
+{
+	vec3 radiance = texelFetch( uRadianceTex, ivec2( gl_FragCoord.xy ), 0 ).rgb;
+	oColor = vec4( pow( radiance, vec3( 1.0 / 2.2 ) ), 1.0 );
+}
@@ -0,0 +1,8 @@
+#version 450
+
+// Fragment shader of the depth pre-pass. Colour writes are masked off, so
+// nothing is output; only the fixed-function depth is written.
+
+void main()
+{
+}
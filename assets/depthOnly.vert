@@ -0,0 +1,25 @@
+#version 450
+
+// Position-only vertex shader for the depth pre-pass (see main.cpp).
+//
+// The lighting pass re-draws the same geometry with GL_LEQUAL and no depth
+// writes, so the position must be computed with exactly the same expression
+// as in the lighting vertex shaders: worldPos = model * pos, then
+// viewProj * worldPos. Shaders that also declare gl_Position invariant get
+// the exact same depth; GL_LEQUAL keeps the others from being dropped.
+
+layout( location = 0 ) in vec3 iPosition;
+
+layout( location = 0 ) uniform mat4 uModel;
+layout( location = 2 ) uniform mat4 uViewProj;
+
+// The pre-pass depth must match the lighting pass bit for bit, which GLSL only
+// promises across programs for invariant outputs.
+invariant gl_Position;
+
+void main()
+{
+	vec4 worldPos = uModel * vec4( iPosition, 1.0 );
+
+	gl_Position = uViewProj * worldPos;
+}
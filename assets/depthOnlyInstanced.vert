@@ -0,0 +1,19 @@
+#version 450
+
+// Instanced variant of depthOnly.vert. The per-instance model matrix is read
+// from vertex attributes, as in cookTorranceInstanced.vert.
+
+layout( location = 0 ) in vec3 iPosition;
+layout( location = 4 ) in mat4 iModel;   // locations 4-7
+
+layout( location = 2 ) uniform mat4 uViewProj;
+
+// Must match the lighting pass exactly (see depthOnly.vert).
+invariant gl_Position;
+
+void main()
+{
+	vec4 worldPos = iModel * vec4( iPosition, 1.0 );
+
+	gl_Position = uViewProj * worldPos;
+}
@@ -0,0 +1,13 @@
+#version 450
+
+// Full-screen triangle generated from gl_VertexID; draw 3 vertices with no
+// vertex buffers. The triangle covers the viewport, with uv in [0,1] on it.
+
+out vec2 v2fUv;
+
+void main()
+{
+	vec2 pos = vec2( ( gl_VertexID << 1 ) & 2, gl_VertexID & 2 );
+	v2fUv = pos;
+	gl_Position = vec4( pos * 2.0 - 1.0, 0.0, 1.0 );
+}
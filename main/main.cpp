@@ -9,10 +9,18 @@
 
 #include <typeinfo>
 #include <stdexcept>
+#include <algorithm>
+#include <atomic>
 
 #include <cstdio>
 #include <cstdlib>
+#include <cstddef>
 #include <cmath>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
 #include <stb_image.h>
 
 #include "../support/error.hpp"
@@ -21,11 +29,31 @@
 #include "../support/debug_output.hpp"
 #include "../support/window.hpp"
 #include "../support/camera.hpp"
+#include "../support/camera_path.hpp"
+#include "../support/benchmark.hpp"
+#include "../support/simulation.hpp"
+#include "../support/scene_graph.hpp"
 #include "../support/lights.hpp"
 #include "../support/material.hpp"
 #include "../support/buffer.hpp"
 #include "../support/texture.hpp"
 #include "../support/mesh.hpp"
+#include "../support/instance_buffer.hpp"
+#include "../support/gpu_culling.hpp"
+#include "../support/culling.hpp"
+#include "../support/hiz.hpp"
+#include "../support/gpu_timer.hpp"
+#include "../support/clustered_lights.hpp"
+#include "../support/deferred.hpp"
+#include "../support/object_lights.hpp"
+#include "../support/shadow_atlas.hpp"
+#include "../support/shader_permutations.hpp"
+#include "../support/program_cache.hpp"
+#include "../support/frame_pacer.hpp"
+#include "../support/gpu_profiler.hpp"
+#include "../support/cpu_profiler.hpp"
+#include "../support/gl_sync.hpp"
+#include "../support/stream_buffer.hpp"
 
 #include "../vmlib/vec4.hpp"
 #include "../vmlib/mat44.hpp"
@@ -73,23 +101,304 @@ namespace
 		return angleInDeg * 0.01745329f; // angleInDeg * pi/180 (precomputed)
 	}
 	constexpr float kPi_ = 3.1415926f;
+
+	// Command line options
+	struct Options
+	{
+		bool headless = false;// hidden window, rendering into an offscreen framebuffer (for CI runs without a display)
+		int width = 1280;
+		int height = 720;
+		long long frames = 0;// stop after this many frames; 0 runs until the window is closed (300 frames when headless)
+		std::string output;// write the last frame to this .ppm or .png file
+
+		// Benchmark: the camera follows a path, the animation advances by a fixed dt, and the frame times are measured after
+		// a warm-up. --frames is then the number of measured frames (by default, as many as the path lasts).
+		bool benchmark = false;
+		long long warmup = 60;
+		std::string cameraPath;// recorded path to follow instead of the scripted tour
+		std::string benchmarkOutput = "benchmark.json";
+		std::string baseline;// results of an earlier run; the run fails when it is slower by more than the threshold
+		double threshold = 0.1;
+	};
+
+	// Fixed time step of the animation in benchmark mode
+	constexpr float kBenchmarkDt = 1.0f / 60.0f;
+
+	// Animated part of the scene: the targets, the sword above the mystery box and the creeper. It is advanced by the
+	// simulation in fixed steps, and the frames draw a blend of its last two states.
+	struct SceneAnimation
+	{
+		float elapsed = 0.0f;// simulated time, also drives the stress lights
+		// target 1
+		float time = 0.0f;// only advances while the targets move
+		float yPos1 = 0.0f;
+		float xPos1 = 0.0f;
+		float RightLeftT = 1.0f; //movement right or left
+		// traget 1-2
+		float yPos12 = 0.0f;
+		// target 2
+		float zPos2 = -69.0f;
+		float xPos2 = 0.0f;
+		float FrondBack = 0.0f; //movement front or back
+		float RightLeft = -1.0f; //movement right or left
+		// target 2 -2
+		float zPos22 = -69.0f;
+		float xPos22 = 0.0f;
+		// mesterybox
+		float boxR = 1.f; //rotation (cw or not cw)
+		float angleM = 0.0f; //rotation angle
+		float boxM = 1.f; //movement up or down
+		float boxYpos = 0.f;
+		// creeper
+		float angleC = 0.f;
+		float partsC = 1.0f; // legs and head movements
+		float zPosC = -10.0f;
+		float xPosC = -5.0f;
+		bool jump = false;
+		float yPosC = 0.0f;
+		float FrondBackC = 0.0f; //movement front or back
+		float RightLeftC = -1.0f; //movement right or left
+		float creeperdir = -0.5f; //where the creeper looks
+	};
+
+	// Settings of the animation changed by the UI, read by the simulation steps
+	struct AnimationControls
+	{
+		std::atomic<float> targetSpeed{ 10.0f };// for all targets
+		std::atomic<bool> targetsActive{ true };
+		std::atomic<bool> jump{ false };// the next step starts a creeper jump
+	};
+
+	constexpr float kSimulationDt = 1.0f / 120.0f;
+	constexpr float kCreeperJumpSpeed = 6.0f;// units per second, up and down
+
+	void stepAnimation(SceneAnimation& a, AnimationControls& controls, float dt)
+	{
+		if (controls.targetsActive.load(std::memory_order_relaxed)) {
+			const float targetSpeed = controls.targetSpeed.load(std::memory_order_relaxed);
+
+			//## target 1
+			a.time += dt;
+			a.yPos1 = sin(a.time) * 3;
+			a.xPos1 += dt * targetSpeed * a.RightLeftT;
+			// RightLeft movement
+			if (a.xPos1 > 22.2f) { a.RightLeftT = -1; }
+			if (a.xPos1 < -27.2f) { a.RightLeftT = 1; }
+			//## target 1-2
+			a.yPos12 = cos(a.time) * 4;
+
+			//## target 2
+			a.zPos2 += dt * targetSpeed * a.FrondBack;
+			a.xPos2 += dt * targetSpeed * a.RightLeft;
+			a.zPos22 += dt * targetSpeed * -a.FrondBack;
+			a.xPos22 += dt * targetSpeed * -a.RightLeft;
+			// squared movement
+			if (a.zPos2 < -73.0f) { a.RightLeft = 1; a.FrondBack = 0; }
+			if (a.zPos2 > -69.0f) { a.RightLeft = -1; a.FrondBack = 0; }
+			if (a.xPos2 < -18.0f && !(a.zPos2 < -73.0f)) { a.FrondBack = -1; a.RightLeft = 0; }
+			if (a.xPos2 > 18.f && !(a.zPos2 > -69.0f)) { a.FrondBack = 1; a.RightLeft = 0; }
+		}
+		a.elapsed += dt;
+
+		//## mesterybox (sword)
+		a.angleM += dt * kPi_ * 0.1f * a.boxR;
+		if (a.angleM >= 0.3f) { a.boxR = -1; }
+		else if (a.angleM <= -0.3f) { a.boxR = 1; }
+		a.boxYpos += dt * 0.7f * a.boxM;
+		if (a.boxYpos > 1.2f) { a.boxM = -1; }
+		else if (a.boxYpos < 0.3f) { a.boxM = 1.0f; }
+
+		//## Creeper
+		// creeper jupm
+		if (controls.jump.exchange(false, std::memory_order_relaxed))
+			a.jump = true;
+		if (a.jump)
+		{
+			a.yPosC += dt * kCreeperJumpSpeed;
+			if (a.yPosC > 1.5f)
+				a.jump = false;
+		}
+		else if (a.yPosC > 0.0f)
+			a.yPosC = std::max(a.yPosC - dt * kCreeperJumpSpeed, 0.0f);
+		// head and legs animation
+		a.angleC += dt * kPi_ * 0.3f * a.partsC;
+		if (a.angleC >= 0.3f) { a.partsC = -1; }
+		else if (a.angleC <= -0.3f) { a.partsC = 1; }
+		// move around
+		a.zPosC += dt * 7 * a.FrondBackC;
+		a.xPosC += dt * 7 * a.RightLeftC;
+		// creeper path
+		if (a.zPosC < -40.0f) { a.RightLeftC = 1; a.FrondBackC = 0; a.creeperdir = 0.5; }
+		if (a.zPosC > -28.0f) { a.RightLeftC = -1; a.FrondBackC = 0; a.creeperdir = -0.5; }
+		if (a.xPosC < -12.0f && !(a.zPosC < -40.0f)) { a.FrondBackC = -1; a.RightLeftC = 0; a.creeperdir = 1; }
+		if (a.xPosC > 2.f && a.xPosC < 3.f && !(a.zPosC < -40.0f)) { a.FrondBackC = 1; a.RightLeftC = 0; a.creeperdir = 0; }
+		if (a.zPosC > -10.0f && a.xPosC > 2.f && a.xPosC < 3.f) { a.RightLeftC = -1; a.FrondBackC = 0; a.creeperdir = -0.5; }
+		if (a.xPosC > 15.f && !(a.zPosC > -28.0f)) { a.FrondBackC = 1; a.RightLeftC = 0; a.creeperdir = 0; }
+	}
+
+	// State drawn between two steps. The positions and angles are blended; the directions and the creeper's heading are
+	// taken from the newer state.
+	SceneAnimation blendAnimation(const SceneAnimation& from, const SceneAnimation& to, float alpha)
+	{
+		auto mix = [alpha](float a, float b) { return a + (b - a) * alpha; };
+		SceneAnimation a = to;
+		a.elapsed = mix(from.elapsed, to.elapsed);
+		a.time = mix(from.time, to.time);
+		a.yPos1 = mix(from.yPos1, to.yPos1);
+		a.xPos1 = mix(from.xPos1, to.xPos1);
+		a.yPos12 = mix(from.yPos12, to.yPos12);
+		a.zPos2 = mix(from.zPos2, to.zPos2);
+		a.xPos2 = mix(from.xPos2, to.xPos2);
+		a.zPos22 = mix(from.zPos22, to.zPos22);
+		a.xPos22 = mix(from.xPos22, to.xPos22);
+		a.angleM = mix(from.angleM, to.angleM);
+		a.boxYpos = mix(from.boxYpos, to.boxYpos);
+		a.angleC = mix(from.angleC, to.angleC);
+		a.zPosC = mix(from.zPosC, to.zPosC);
+		a.xPosC = mix(from.xPosC, to.xPosC);
+		a.yPosC = mix(from.yPosC, to.yPosC);
+		return a;
+	}
+
+	// Scripted tour of the arena for benchmark runs: down the left side, across the far end, past the sword and back
+	const CameraKey kBenchmarkTour[] = {
+		{ 0.0f, { 0.0f, 5.0f, -3.0f }, 3.1416f, 1.5708f },
+		{ 3.0f, { -12.0f, 5.0f, -18.0f }, 3.64f, 1.60f },
+		{ 6.0f, { -18.0f, 7.0f, -40.0f }, 2.74f, 1.75f },
+		{ 9.0f, { -5.0f, 8.0f, -65.0f }, 2.20f, 1.70f },
+		{ 12.0f, { 15.0f, 5.0f, -60.0f }, 1.20f, 1.65f },
+		{ 15.0f, { 18.0f, 4.0f, -42.0f }, 2.30f, 1.80f },
+		{ 18.0f, { 12.0f, 6.0f, -22.0f }, 3.80f, 1.60f },
+		{ 21.0f, { 0.0f, 5.0f, -8.0f }, 3.1416f, 1.5708f },
+	};
+
+	Options parseOptions(int argc, char** argv)
+	{
+		Options options;
+		for (int i = 1; i < argc; i++)
+		{
+			const char* arg = argv[i];
+			bool hasValue = i + 1 < argc;
+			if (std::strcmp(arg, "--headless") == 0)
+				options.headless = true;
+			else if (std::strcmp(arg, "--size") == 0 && hasValue)
+			{
+				if (std::sscanf(argv[++i], "%dx%d", &options.width, &options.height) != 2 || options.width <= 0 || options.height <= 0)
+					throw Error("Invalid size '%s', expected <width>x<height>", argv[i]);
+			}
+			else if (std::strcmp(arg, "--frames") == 0 && hasValue)
+				options.frames = std::atoll(argv[++i]);
+			else if (std::strcmp(arg, "--output") == 0 && hasValue)
+				options.output = argv[++i];
+			else if (std::strcmp(arg, "--benchmark") == 0)
+				options.benchmark = true;
+			else if (std::strcmp(arg, "--warmup") == 0 && hasValue)
+				options.warmup = std::max(0LL, std::atoll(argv[++i]));
+			else if (std::strcmp(arg, "--camera-path") == 0 && hasValue)
+				options.cameraPath = argv[++i];
+			else if (std::strcmp(arg, "--benchmark-output") == 0 && hasValue)
+				options.benchmarkOutput = argv[++i];
+			else if (std::strcmp(arg, "--baseline") == 0 && hasValue)
+				options.baseline = argv[++i];
+			else if (std::strcmp(arg, "--threshold") == 0 && hasValue)
+				options.threshold = std::atof(argv[++i]);
+			else
+				throw Error("Unknown argument '%s'\nUsage: %s [--headless] [--size <width>x<height>] [--frames <count>] [--output <file.ppm|file.png>]\n"
+					"  [--benchmark [--warmup <frames>] [--camera-path <file>] [--benchmark-output <file.json>] [--baseline <file.json>] [--threshold <fraction>]]",
+					arg, argv[0]);
+		}
+		if (options.headless && !options.benchmark && options.frames <= 0)
+			options.frames = 300;
+		return options;
+	}
 }
 
-int main()
+int main(int argc, char** argv)
 try
 {
-	Window window(1280, 720, kWindowTitle);
+	const Options options = parseOptions(argc, argv);
+
+	// Time to first frame, reported once the first frame is presented. Linked programs are kept on disk, so only the first
+	// launch (or one after shader or driver changes) compiles them.
+	const Clock::time_point startTime = Clock::now();
+	bool firstFrameReported = false;
+	CPU_THREAD_NAME("Main");
+
+	Window window(options.width, options.height, kWindowTitle, false, options.headless);
+	ProgramBinaryCache programCache("./assets/shader_cache");
+	ShaderProgram::setBinaryCache(&programCache);
 	ShaderProgram prog({{GL_VERTEX_SHADER, "./assets/blinnPhong.vert"},
-						{GL_FRAGMENT_SHADER, "./assets/blinnPhong.frag"}});
+						{GL_FRAGMENT_SHADER, "./assets/blinnPhong.frag"}}, {}, true);
 	ShaderProgram progPbr({ {GL_VERTEX_SHADER, "./assets/cookTorrance.vert"},
-						{GL_FRAGMENT_SHADER, "./assets/cookTorrance.frag"} });
+						{GL_FRAGMENT_SHADER, "./assets/cookTorrance.frag"} }, {}, true);
 	ShaderProgram progPbrBump({ {GL_VERTEX_SHADER, "./assets/cookTorranceBump.vert"},
-						{GL_FRAGMENT_SHADER, "./assets/cookTorranceBump.frag"} });
+						{GL_FRAGMENT_SHADER, "./assets/cookTorranceBump.frag"} }, {}, true);
+	ShaderProgram progInstanced({ {GL_VERTEX_SHADER, "./assets/blinnPhongInstanced.vert"},
+						{GL_FRAGMENT_SHADER, "./assets/blinnPhong.frag"} }, {}, true);
+	ShaderProgram progPbrInstanced({ {GL_VERTEX_SHADER, "./assets/cookTorranceInstanced.vert"},
+						{GL_FRAGMENT_SHADER, "./assets/cookTorrance.frag"} }, {}, true);
+	ShaderProgram progPbrBumpInstanced({ {GL_VERTEX_SHADER, "./assets/cookTorranceBumpInstanced.vert"},
+						{GL_FRAGMENT_SHADER, "./assets/cookTorranceBump.frag"} }, {}, true);
+	ShaderProgram progCull({ {GL_COMPUTE_SHADER, "./assets/frustumCull.comp"} }, {}, true);
+	ShaderProgram progHiZ({ {GL_COMPUTE_SHADER, "./assets/hizReduce.comp"} }, {}, true);
+	ShaderProgram progDepth({ {GL_VERTEX_SHADER, "./assets/depthOnly.vert"},
+						{GL_FRAGMENT_SHADER, "./assets/depthOnly.frag"} }, {}, true);
+	ShaderProgram progDepthInstanced({ {GL_VERTEX_SHADER, "./assets/depthOnlyInstanced.vert"},
+						{GL_FRAGMENT_SHADER, "./assets/depthOnly.frag"} }, {}, true);
 	RenderSettings pbrPrograms(LightModel::PBR);
 	pbrPrograms.setProgram(RenderSettings::STANDARD, &progPbr);
 	pbrPrograms.setProgram(RenderSettings::BUMP_MAP, &progPbrBump);
+	pbrPrograms.setProgram(RenderSettings::INSTANCED, &progPbrInstanced);
+	pbrPrograms.setProgram(RenderSettings::INSTANCED_BUMP_MAP, &progPbrBumpInstanced);
+	pbrPrograms.setProgram(RenderSettings::DEPTH_ONLY, &progDepth);
+	pbrPrograms.setProgram(RenderSettings::DEPTH_ONLY_INSTANCED, &progDepthInstanced);
+	ShaderProgram progPbrClustered({ {GL_VERTEX_SHADER, "./assets/cookTorranceClustered.vert"},
+						{GL_FRAGMENT_SHADER, "./assets/cookTorranceClustered.frag"} }, {}, true);
+	ShaderProgram progPbrClusteredInstanced({ {GL_VERTEX_SHADER, "./assets/cookTorranceInstanced.vert"},
+						{GL_FRAGMENT_SHADER, "./assets/cookTorranceClustered.frag"} }, {}, true);
+	RenderSettings pbrClusteredPrograms(LightModel::PBR);
+	pbrClusteredPrograms.setProgram(RenderSettings::STANDARD, &progPbrClustered);
+	pbrClusteredPrograms.setProgram(RenderSettings::INSTANCED, &progPbrClusteredInstanced);
+	pbrClusteredPrograms.setProgram(RenderSettings::DEPTH_ONLY, &progDepth);
+	pbrClusteredPrograms.setProgram(RenderSettings::DEPTH_ONLY_INSTANCED, &progDepthInstanced);
+	LightManager lightManager;
+	// The light list programs are specialized per material (see shader_permutations.hpp); the variants are compiled on first use
+	ShaderPermutations lightListVariants([&lightManager](ShaderProgram& program) {
+		lightManager.setAmbientLight({ 0.09f, 0.09f, 0.09f }, program);
+	});
+	RenderSettings pbrLightListPrograms(LightModel::PBR);
+	pbrLightListPrograms.setPermutations(RenderSettings::STANDARD, &lightListVariants, { {GL_VERTEX_SHADER, "./assets/cookTorrance.vert"},
+						{GL_FRAGMENT_SHADER, "./assets/cookTorranceLightList.frag"} });
+	pbrLightListPrograms.setPermutations(RenderSettings::INSTANCED, &lightListVariants, { {GL_VERTEX_SHADER, "./assets/cookTorranceInstanced.vert"},
+						{GL_FRAGMENT_SHADER, "./assets/cookTorranceLightList.frag"} });
+	pbrLightListPrograms.setProgram(RenderSettings::DEPTH_ONLY, &progDepth);
+	pbrLightListPrograms.setProgram(RenderSettings::DEPTH_ONLY_INSTANCED, &progDepthInstanced);
+	ShaderProgram progDeferredGeometry({ {GL_VERTEX_SHADER, "./assets/deferredGeometry.vert"},
+						{GL_FRAGMENT_SHADER, "./assets/deferredGeometry.frag"} }, {}, true);
+	ShaderProgram progDeferredGeometryInstanced({ {GL_VERTEX_SHADER, "./assets/cookTorranceInstanced.vert"},
+						{GL_FRAGMENT_SHADER, "./assets/deferredGeometry.frag"} }, {}, true);
+	ShaderProgram progDeferredAmbient({ {GL_VERTEX_SHADER, "./assets/fullscreen.vert"},
+						{GL_FRAGMENT_SHADER, "./assets/deferredAmbient.frag"} }, {}, true);
+	ShaderProgram progDeferredLightVolume({ {GL_VERTEX_SHADER, "./assets/deferredLightVolume.vert"},
+						{GL_FRAGMENT_SHADER, "./assets/deferredLightVolume.frag"} }, {}, true);
+	ShaderProgram progDeferredResolve({ {GL_VERTEX_SHADER, "./assets/fullscreen.vert"},
+						{GL_FRAGMENT_SHADER, "./assets/deferredResolve.frag"} }, {}, true);
+	RenderSettings pbrDeferredPrograms(LightModel::PBR);
+	pbrDeferredPrograms.setProgram(RenderSettings::STANDARD, &progDeferredGeometry);
+	pbrDeferredPrograms.setProgram(RenderSettings::INSTANCED, &progDeferredGeometryInstanced);
+	pbrDeferredPrograms.setProgram(RenderSettings::DEPTH_ONLY, &progDepth);
+	pbrDeferredPrograms.setProgram(RenderSettings::DEPTH_ONLY_INSTANCED, &progDepthInstanced);
 	RenderSettings blinnPhong(LightModel::BlinnPhong);
 	blinnPhong.setProgram(RenderSettings::STANDARD, &prog);
+	blinnPhong.setProgram(RenderSettings::INSTANCED, &progInstanced);
+	blinnPhong.setProgram(RenderSettings::DEPTH_ONLY, &progDepth);
+	blinnPhong.setProgram(RenderSettings::DEPTH_ONLY_INSTANCED, &progDepthInstanced);
+
+	// The programs above are compiled in parallel where the driver supports it; wait for all of them
+	for (ShaderProgram* program : { &prog, &progPbr, &progPbrBump, &progInstanced, &progPbrInstanced, &progPbrBumpInstanced,
+		&progCull, &progHiZ, &progDepth, &progDepthInstanced, &progPbrClustered, &progPbrClusteredInstanced,
+		&progDeferredGeometry, &progDeferredGeometryInstanced, &progDeferredAmbient, &progDeferredLightVolume, &progDeferredResolve })
+		program->finish();
 
 	Camera camera;
 	State state(&pbrPrograms, &camera);
@@ -123,6 +432,15 @@ try
 	vao.addAttribF(2, 2, 6 * sizeof(GL_FLOAT)); // tex coords, automatically enabled and bound to idx 2
 	vao.addAttribF(3, 4, 8 * sizeof(GL_FLOAT), true, true); // vertex tangent, used for bump mapping
 
+	// Same layout plus per-instance model and normal matrices, used for meshes drawn several times per frame
+	VertexArrayObject vaoInstanced;
+	vaoInstanced.addAttribF(0, 3, 0);
+	vaoInstanced.addAttribF(1, 3, 3 * sizeof(GL_FLOAT));
+	vaoInstanced.addAttribF(2, 2, 6 * sizeof(GL_FLOAT));
+	vaoInstanced.addAttribF(3, 4, 8 * sizeof(GL_FLOAT), true, true);
+	vaoInstanced.addInstanceAttribMat4F(ATTRIB_LOCATION_INSTANCE_MODEL, offsetof(InstanceData, modelMat), BINDING_POINT_INSTANCE);
+	vaoInstanced.addInstanceAttribMat4F(ATTRIB_LOCATION_INSTANCE_MODEL_N, offsetof(InstanceData, modelMatN), BINDING_POINT_INSTANCE);
+
 	// imgui inti
 	IMGUI_CHECKVERSION();
 	ImGui::CreateContext();
@@ -265,10 +583,15 @@ try
 		degToRad(40.0f),
 		degToRad(60.0f),
 		10.0f };
-	LightManager lightManager;
 	lightManager.setAmbientLight({0.2f, 0.2f, 0.2f}, prog);
+	lightManager.setAmbientLight({0.2f, 0.2f, 0.2f}, progInstanced);
 	lightManager.setAmbientLight({ 0.09f, 0.09f, 0.09f }, progPbr);
 	lightManager.setAmbientLight({ 0.09f, 0.09f, 0.09f }, progPbrBump);
+	lightManager.setAmbientLight({ 0.09f, 0.09f, 0.09f }, progPbrInstanced);
+	lightManager.setAmbientLight({ 0.09f, 0.09f, 0.09f }, progPbrBumpInstanced);
+	lightManager.setAmbientLight({ 0.09f, 0.09f, 0.09f }, progPbrClustered);
+	lightManager.setAmbientLight({ 0.09f, 0.09f, 0.09f }, progPbrClusteredInstanced);
+	lightManager.setAmbientLight({ 0.09f, 0.09f, 0.09f }, progDeferredAmbient);
 	lightManager.addPointLight(pointLightSword,2);
 	lightManager.addSpotLight(spotLight1,2);
 	lightManager.addSpotLight(spotLight2,2);
@@ -278,48 +601,214 @@ try
 	lightManager.addSpotLight(spotLightSword, 2);
 	
 	
-	// mesterybox
-	float boxR = 1.f; //rotation (cw or not cw)
-	float angleM = 0.0f; //rotation angle
-	float boxM = 1.f; //movement up or down
-	float boxYpos = 0.f;
-	// target 1
-	float yPos1 = 0.0f;
-	float xPos1 = 0.0f;
-	float RightLeftT = 1.0f; //movement right or left
-	// traget 1-2
-	float yPos12 = 0.0f;
-	// target 2
-	float zPos2 = -69.0f;
-	float xPos2 = 0.0f;
-	float FrondBack = 0.0f; //movement front or back
-	float RightLeft = -1.0f; //movement right or left
-	// target 2 -2
-	float zPos22 = -69.0f;
-	float xPos22 = 0.0f;
-
-	float targetSpeed = 10; // for all targets
-	// creeper
-	float angleC = 0.f;
-	float partsC = 1.0f; // legs and head movements
-	float zPosC = -10.0f;
-	float xPosC = -5.0f;
-	bool jump = false;
-	float yPosC = 0.0f;
-	float FrondBackC = 0.0f; //movement front or back
-	float RightLeftC = -1.0f; //movement right or left
-	float creeperdir = -0.5f; //where the creeper looks
-
-	float time = 0;
+	// Animation: simulated in fixed steps, on a thread of its own unless a benchmark runs (the steps then follow the fixed dt
+	// of the frames, on the render thread, so that every run draws the same states)
+	AnimationControls animationControls;
+	FixedStepSimulation<SceneAnimation> simulation(SceneAnimation{}, kSimulationDt,
+		[&animationControls](SceneAnimation& animation, float dt) { stepAnimation(animation, animationControls, dt); });
+	bool simulationThread = !options.benchmark;
+
+	// Instance lists for meshes drawn more than once.
+	// Lights, light bulbs, wooden boxes and chairs never move, so their instances are uploaded once here.
+	InstanceBuffer lightInstances(5);
+	InstanceBuffer lightbulbInstances(5);
+	InstanceBuffer boxWoodInstances(3);
+	InstanceBuffer chairInstances(2);
+	InstanceBuffer targetInstances(2);
+	InstanceBuffer target2Instances(2);
+	InstanceBuffer creeperlegInstances(4);
+	GpuFrustumCuller boxWoodCuller(&progCull);
+	GpuFrustumCuller chairCuller(&progCull);
+	GpuFrustumCuller targetCuller(&progCull);
+	GpuFrustumCuller target2Culler(&progCull);
+	GpuFrustumCuller lightCuller(&progCull);
+	GpuFrustumCuller creeperlegCuller(&progCull);
+	GpuFrustumCuller lightbulbCuller(&progCull);
+	bool gpuCulling = false;
+	FrustumCuller frustumCuller(16);
+	CullStats cullStats{};
+	bool cpuCulling = true;
+	HiZBuffer hiz(&progHiZ);
+	bool occlusionCulling = false;
+	GpuTimer opaqueTimerNoPrePass;
+	GpuTimer opaqueTimerPrePass;
+	bool depthPrePass = false;
+
+	// Clustered lighting, with an optional stress scene of many small moving point lights spread over the arena.
+	// The scene lights stay in place; the stress lights are added after the sword light.
+	struct StressLight {
+		Vec3f center;
+		Vec3f col;
+		float orbit;
+		float phase;
+	};
+	ClusteredLights clusteredLights;
+	bool clusteredLighting = false;
+	int stressLightCount = 0;
+	int stressLightsActive = 0;
+	int stressLightFirstIdx = 0;
+	std::vector<StressLight> stressLights;
+
+	// Render path: forward shading with either light model, or deferred shading (PBR). The stress lights are used by the
+	// clustered forward path and the deferred path.
+	enum RenderPath { RENDER_FORWARD_PBR, RENDER_FORWARD_BLINN_PHONG, RENDER_DEFERRED_PBR };
+	int renderPath = RENDER_FORWARD_PBR;
+	DeferredRenderer deferredRenderer(&progDeferredAmbient, &progDeferredLightVolume, &progDeferredResolve);
+	deferredRenderer.setBackground({ 0.2f, 0.2f, 0.2f });//matches glClearColor
+	GpuTimer deferredGeometryTimer;
+	GpuTimer deferredLightingTimer;
+
+	// Per-object light lists for the (non-clustered) forward PBR path
+	ObjectLightLists objectLightLists;
+	bool perObjectLights = false;
+
+	// Spot light shadows. The lights, the arena and the furniture never move, so by default their shadow maps are cached and
+	// only the targets, the creeper and the sword are drawn into them every frame.
+	SpotShadowAtlas spotShadows(512);
+	bool spotShadowsEnabled = true;
+	bool cacheStaticCasters = true;
+	GpuTimer shadowTimerCached;
+	GpuTimer shadowTimerUncached;
+
+	// Frame pacing: present mode, frame limiter, frames in flight and per-frame latency
+	FramePacer framePacer(2);
+	// Headless and benchmark runs measure the rendering only, so nothing waits for a vertical blank
+	int presentMode = static_cast<int>(options.headless || options.benchmark ? PresentMode::UNLOCKED : PresentMode::VSYNC);
+	float targetFps = 60.f;
+	framePacer.setMode(static_cast<PresentMode>(presentMode), targetFps);
+	int framesInFlight = framePacer.getMaxFramesInFlight();
+	std::vector<float> frameTimes;
+
+	// GPU profiler: zones around the passes, and optionally around every draw
+	GpuProfiler gpuProfiler;
+	bool gpuProfilerEnabled = true;
+	bool profilePerDraw = false;
+	int csvCaptureCount = 0;
+#if CPU_PROFILER
+	int cpuTraceCount = 0;
+#endif
+
+	// Synchronous GL calls: counted per call site while tracking is on. With deferred error checks, the checkpoints of a
+	// frame are only checked once, at its end.
+	bool trackGlSync = false;
+	bool deferredGlErrors = false;
+
+	// Screenshots (P) are read back and written asynchronously by the window
+	int screenshotFormat = static_cast<int>(ImageFormat::PPM);
+	// Recordings capture every frame through the same path, into a ring of readback buffers written by a pool of threads
+	int recordFormat = static_cast<int>(ImageFormat::RAW);
+	int recordSlots = 8;
+	int recordingCount = 0;
+
+	// Per-frame data (the instances rebuilt every frame, the light data of the clustered and deferred paths) is written into
+	// a persistently mapped buffer with a region per frame in flight, instead of being copied by the driver.
+	StreamBuffer streamBuffer(1 << 20, 4);
+	bool streamUploads = true;
+	clusteredLights.setStreamBuffer(&streamBuffer);
+	deferredRenderer.setStreamBuffer(&streamBuffer);
+	auto uploadInstances = [&](InstanceBuffer& instances) {
+		if (streamUploads) instances.upload(streamBuffer);
+		else instances.upload();
+	};
+	// Transforms of the objects drawn one at a time and of the moving instances. Only the animated nodes change afterwards;
+	// the creeper's head and legs follow its body.
+	SceneGraph sceneGraph;
+	auto uniformScale = [](float s) { return Vec3f{ s, s, s }; };
+	const SceneGraph::NodeId arenaNode = sceneGraph.addNode(SceneGraph::NO_PARENT, { 0.f, 0.f, 0.f }, kIdentity44f, uniformScale(0.9f));
+	const SceneGraph::NodeId roofNode = sceneGraph.addNode(SceneGraph::NO_PARENT, { 0.f, 13.f, 0.f }, kIdentity44f, uniformScale(0.9f));
+	const SceneGraph::NodeId floorNode = sceneGraph.addNode(SceneGraph::NO_PARENT, { 0.f, 0.f, 0.f }, kIdentity44f, uniformScale(0.9f));
+	const SceneGraph::NodeId element1Node = sceneGraph.addNode(SceneGraph::NO_PARENT, { 17.f, 2.1f, -17.f }, kIdentity44f, { 2.3f, 2.0f, 2.3f });
+	const SceneGraph::NodeId element3Node = sceneGraph.addNode(SceneGraph::NO_PARENT, { -17.f, 0.f, -20.f });
+	const SceneGraph::NodeId element4Node = sceneGraph.addNode(SceneGraph::NO_PARENT, { 15.f, 0.f, -35.f }, kIdentity44f, uniformScale(1.5f));
+	const SceneGraph::NodeId oldboxNode = sceneGraph.addNode(SceneGraph::NO_PARENT, { 25.5f, 0.0f, -50.f }, make_rotation_y(-1.57f), uniformScale(6.f));
+	const SceneGraph::NodeId swordNode = sceneGraph.addNode(SceneGraph::NO_PARENT, { 25.5f, 2.3f, -50.f }, kIdentity44f, uniformScale(0.07f));
+	const SceneGraph::NodeId tableNode = sceneGraph.addNode(SceneGraph::NO_PARENT, { -25.f, 0.f, -60.f }, kIdentity44f, uniformScale(0.007f));
+	const SceneGraph::NodeId targetNode = sceneGraph.addNode(SceneGraph::NO_PARENT, { 0.f, 7.f, -76.4f }, make_rotation_y(-1.57f), uniformScale(0.9f));
+	const SceneGraph::NodeId target12Node = sceneGraph.addNode(SceneGraph::NO_PARENT, { 5.f, 7.f, -76.4f }, make_rotation_y(-1.57f), uniformScale(0.9f));
+	const SceneGraph::NodeId target2Node = sceneGraph.addNode(SceneGraph::NO_PARENT, { 0.f, 0.f, -69.f }, kIdentity44f, uniformScale(0.7f));
+	const SceneGraph::NodeId target22Node = sceneGraph.addNode(SceneGraph::NO_PARENT, { 0.f, 0.f, -72.5f }, kIdentity44f, uniformScale(0.7f));
+	const SceneGraph::NodeId creeperbodyNode = sceneGraph.addNode(SceneGraph::NO_PARENT, { -5.f, 1.6f, -10.f }, kIdentity44f, uniformScale(2.f));
+	const SceneGraph::NodeId creeperheadNode = sceneGraph.addNode(creeperbodyNode, { 0.0f, 1.4f, 0.0f });
+	const SceneGraph::NodeId creeperlegNodes[] = {
+		sceneGraph.addNode(creeperbodyNode, { 0.25f, 0.f, 0.2f }),// front left
+		sceneGraph.addNode(creeperbodyNode, { -0.25f, 0.f, 0.2f }),// front right
+		sceneGraph.addNode(creeperbodyNode, { 0.25f, 0.f, -0.2f }),// back left
+		sceneGraph.addNode(creeperbodyNode, { -0.25f, 0.f, -0.2f }),// back right
+	};
+	const SceneGraph::NodeId glassNode = sceneGraph.addNode(SceneGraph::NO_PARENT, { -7.7f, 6.5f, -25.f });
+	{
+		// Instances that never move: their lists are filled and uploaded once
+		const Vec3f lightPositions[] = { { -20.0f, 13.f, -8.f }, { +20.0f, 13.f, -8.f }, { -20.0f, 13.f, -68.4f }, { +20.0f, 13.f, -68.4f },
+			{ 0.0f, 16.f, -38.2f } };
+		std::vector<SceneGraph::NodeId> lightNodes, lightbulbNodes, boxWoodNodes, chairNodes;
+		for (const Vec3f& pos : lightPositions)
+		{
+			lightNodes.push_back(sceneGraph.addNode(SceneGraph::NO_PARENT, pos));
+			// lightbulbs, upside down just below the lights
+			lightbulbNodes.push_back(sceneGraph.addNode(SceneGraph::NO_PARENT, pos + Vec3f{ 0.f, 0.2f, 0.f }, make_rotation_z(kPi_), uniformScale(0.05f)));
+		}
+		// boxWood 1-3
+		for (const Vec3f& pos : { Vec3f{ -27.f, 0.0f, -50.f }, Vec3f{ -27.f, 0.0f, -46.f }, Vec3f{ -27.f, 3.9f, -46.f } })
+			boxWoodNodes.push_back(sceneGraph.addNode(SceneGraph::NO_PARENT, pos, make_rotation_y(1.57f), uniformScale(3.0f)));
+		// chairs
+		chairNodes.push_back(sceneGraph.addNode(SceneGraph::NO_PARENT, { -23.f, 0, -67.f }, make_rotation_y(0.8f * kPi_), uniformScale(0.06f)));
+		chairNodes.push_back(sceneGraph.addNode(SceneGraph::NO_PARENT, { -21.f, 0, -61.f }, make_rotation_y(0.5f * kPi_), uniformScale(0.06f)));
+		sceneGraph.update();
+
+		auto fillInstances = [&sceneGraph](InstanceBuffer& instances, const std::vector<SceneGraph::NodeId>& nodes) {
+			for (SceneGraph::NodeId node : nodes)
+				instances.add(sceneGraph.getWorld(node), sceneGraph.getNormal(node));
+			instances.upload();
+		};
+		fillInstances(lightInstances, lightNodes);
+		fillInstances(lightbulbInstances, lightbulbNodes);
+		fillInstances(boxWoodInstances, boxWoodNodes);
+		fillInstances(chairInstances, chairNodes);
+	}
+
+
+	// Camera paths: followed in benchmark mode, and recorded from the camera on request (a key every kRecordInterval seconds)
+	CameraPath cameraPath;
+	bool recordingPath = false;
+	float pathRecordStart = 0.f;
+	int savedPathCount = 0;
+	constexpr float kRecordInterval = 0.25f;
+	std::unique_ptr<Benchmark> benchmark;
+	if (options.benchmark)
+	{
+		if (options.cameraPath.empty())
+			for (const CameraKey& key : kBenchmarkTour)
+				cameraPath.addKey(key);
+		else
+			cameraPath.load(options.cameraPath);
+		long long measured = options.frames > 0 ? options.frames : std::max(1LL, static_cast<long long>(cameraPath.getDuration() / kBenchmarkDt));
+		benchmark = std::make_unique<Benchmark>(options.warmup, measured, kBenchmarkDt);
+		state.setFixedDt(kBenchmarkDt);
+		std::printf("Benchmark: %lld warm-up frames, %lld measured frames, camera path of %zu keys over %.1f s\n", options.warmup, measured,
+			cameraPath.size(), cameraPath.getDuration());
+	}
+	// Last frame of the run, 0 for none. A benchmark keeps going afterwards until the GPU times of its frames are known.
+	const long long lastFrame = benchmark ? static_cast<long long>(benchmark->getTotalFrames()) : options.frames;
+
+	float frameClock = 0;// sum of the dt of the frames, times the recorded camera paths
 	camera.setPosition({0.0f, 5.0f, -3.0f});
 	state.updateClock();
 	
 	vao.bind(); // bind vertex array to make vertex data (pos, normals, uvs) available
+	if (simulationThread)
+		simulation.start();
 	// Main loop
-	while (!window.IsClosed())
+	long long frameCount = 0;
+	while (!window.IsClosed() && (benchmark ? !benchmark->isComplete() : (options.frames <= 0 || frameCount < options.frames)))
 	{
+		CPU_ZONE("Frame");
+		framePacer.beginFrame();
+		streamBuffer.beginFrame();
+		GlSyncTracker::beginFrame();
 		if (!window.isMinimized())
 		{
+			gpuProfiler.beginFrame();
+			CPU_ZONE_BEGIN("ImGui");
 			//imgui 
 			ImGui_ImplOpenGL3_NewFrame();
 			ImGui_ImplGlfw_NewFrame();
@@ -328,17 +817,17 @@ try
 			ImGui::Begin("Game settings and Keybindings");
 			ImGui::Text("Chose a level:");
 			if (ImGui::Button("Easy"))
-				targetSpeed = 10;
+				animationControls.targetSpeed = 10;
 			if (ImGui::Button("Medium"))
-				targetSpeed = 17.5;
+				animationControls.targetSpeed = 17.5;
 			if (ImGui::Button("Hard"))
-				targetSpeed = 25;
+				animationControls.targetSpeed = 25;
 			ImGui::Text("This changes the speed of the targets");
 			ImGui::Text("Default level is easy");
 
 			ImGui::Text("\nMake the creeper jump:");
 			if (ImGui::Button("Jump"))
-				jump = true;
+				animationControls.jump = true;
 
 			ImGui::Text("\nKeybindings:");
 			ImGui::Text("WASD + EQ - navigation");
@@ -348,180 +837,284 @@ try
 			ImGui::Text("F - fullscreen");
 			ImGui::Text("P - screenshot");
 			ImGui::Text("Enter - pause the targets");
-			ImGui::End();
+			const char* screenshotFormats[] = { "PPM", "PNG" };
+			if (ImGui::Combo("Screenshot format", &screenshotFormat, screenshotFormats, IM_ARRAYSIZE(screenshotFormats)))
+				window.setScreenshotFormat(static_cast<ImageFormat>(screenshotFormat));
+			if (window.getFrameCapture().getPendingCount() > 0)
+				ImGui::Text("Writing %zu screenshot(s)...", window.getFrameCapture().getPendingCount());
+
+			ImGui::Text("\nRendering:");
+			ImGui::Checkbox("CPU frustum culling", &cpuCulling);
+			ImGui::Text("Culled objects: %zu / %zu", cullStats.objectsCulled, cullStats.objectsTested);
+			ImGui::Text("Scene graph: %zu of %zu transforms updated", sceneGraph.getLastUpdateCount(), sceneGraph.size());
+			ImGui::Checkbox("Hi-Z occlusion culling", &occlusionCulling);
+			if (occlusionCulling)
+				ImGui::Text("Occluded objects: %zu (depth %dx%d)", cullStats.objectsOccluded, hiz.getReadbackWidth(), hiz.getReadbackHeight());
+			ImGui::Text("Culled triangles: %zu / %zu", cullStats.trianglesCulled, cullStats.trianglesCulled + cullStats.trianglesSubmitted);
+			ImGui::Checkbox("GPU frustum culling (instanced meshes)", &gpuCulling);
+			const char* renderPaths[] = { "Forward PBR", "Forward Blinn-Phong", "Deferred PBR" };
+			if (ImGui::Combo("Renderer", &renderPath, renderPaths, IM_ARRAYSIZE(renderPaths)))
+			{
+				// The forward timers are shared by the forward paths, so start over rather than mixing them
+				opaqueTimerNoPrePass.reset();
+				opaqueTimerPrePass.reset();
+			}
+			if (renderPath != RENDER_DEFERRED_PBR)
+				ImGui::Checkbox("Depth pre-pass", &depthPrePass);
+			if (renderPath == RENDER_FORWARD_PBR)
+				ImGui::Checkbox("Clustered lighting (PBR)", &clusteredLighting);
+			if (renderPath == RENDER_DEFERRED_PBR || (renderPath == RENDER_FORWARD_PBR && (clusteredLighting || perObjectLights)))
+			{
+				ImGui::Checkbox("Spot shadows", &spotShadowsEnabled);
+				if (spotShadowsEnabled)
+				{
+					ImGui::Checkbox("Cache static shadow casters", &cacheStaticCasters);
+					ImGui::Text("Shadow GPU time: %.3f ms cached, %.3f ms uncached (static casters drawn %zu times)",
+						shadowTimerCached.getMilliseconds(), shadowTimerUncached.getMilliseconds(), spotShadows.getStaticRenderCount());
+				}
+			}
+			if (renderPath == RENDER_FORWARD_PBR && !clusteredLighting)
+			{
+				ImGui::Checkbox("Per-object light lists", &perObjectLights);
+				const LightListStats& lightStats = objectLightLists.getStats();
+				if (perObjectLights)
+				{
+					ImGui::Text("Point/spot lights per object: %.2f of %zu (%zu lists)", lightStats.averageLightsPerObject(),
+						lightStats.lightsAvailable, lightStats.objects);
+					ImGui::Text("Live shader variants: %zu (%zu compiling)", lightListVariants.getNumVariants(),
+						lightListVariants.getNumPending());
+				}
+			}
+			bool stressScene = (renderPath == RENDER_FORWARD_PBR && clusteredLighting) || renderPath == RENDER_DEFERRED_PBR;
+			if (stressScene)
+			{
+				ImGui::SliderInt("Stress lights", &stressLightCount, 0, 4096);
+				ImGui::Text("Lights: %zu point, %zu spot", lightManager.getPointLights().size(), lightManager.getSpotLights().size());
+			}
+			if (renderPath == RENDER_FORWARD_PBR && clusteredLighting)
+			{
+				ImGui::Text("Binning %.3f ms; cluster light indices: %zu (max %zu per cluster)", clusteredLights.getBinningMs(),
+					clusteredLights.getNumIndices(), clusteredLights.getMaxLightsPerCluster());
+			}
+			ImGui::Text("Forward opaque GPU time: %.3f ms without pre-pass, %.3f ms with pre-pass",
+				opaqueTimerNoPrePass.getMilliseconds(), opaqueTimerPrePass.getMilliseconds());
+			if (opaqueTimerNoPrePass.hasData() && opaqueTimerPrePass.hasData())
+				ImGui::Text("Pre-pass saves %.3f ms", opaqueTimerNoPrePass.getMilliseconds() - opaqueTimerPrePass.getMilliseconds());
+			ImGui::Text("Deferred GPU time: %.3f ms geometry + %.3f ms lighting (%zu light volumes)",
+				deferredGeometryTimer.getMilliseconds(), deferredLightingTimer.getMilliseconds(), deferredRenderer.getNumLightVolumes());
+			if (gpuCulling)
+			{
+				unsigned int visible = boxWoodCuller.getVisibleCount() + chairCuller.getVisibleCount() + targetCuller.getVisibleCount()
+					+ target2Culler.getVisibleCount() + lightCuller.getVisibleCount() + creeperlegCuller.getVisibleCount()
+					+ lightbulbCuller.getVisibleCount();
+				size_t total = boxWoodInstances.size() + chairInstances.size() + targetInstances.size() + target2Instances.size()
+					+ lightInstances.size() + creeperlegInstances.size() + lightbulbInstances.size();
+				ImGui::Text("Visible instances: %u / %zu (%s)", visible, total,
+					boxWoodCuller.isCompacting() ? "compacted, indirect count" : "fixed slots, indirect");
+			}
 
+			ImGui::Text("\nFrame pacing:");
+			const char* presentModes[] = { "V-Sync", "Unlocked", "Fixed FPS", "Adaptive V-Sync" };
+			bool pacingChanged = ImGui::Combo("Present mode", &presentMode, presentModes, IM_ARRAYSIZE(presentModes));
+			if (presentMode == static_cast<int>(PresentMode::FIXED))
+				pacingChanged |= ImGui::SliderFloat("Target FPS", &targetFps, 10.f, 500.f, "%.0f");
+			if (presentMode == static_cast<int>(PresentMode::ADAPTIVE) && !framePacer.isAdaptiveSupported())
+				ImGui::Text("Adaptive v-sync is not supported, using v-sync");
+			if (pacingChanged)
+				framePacer.setMode(static_cast<PresentMode>(presentMode), targetFps);
+			if (ImGui::SliderInt("Frames in flight", &framesInFlight, 1, 4))
+				framePacer.setMaxFramesInFlight(framesInFlight);
+			FrameTiming frameAvg = framePacer.getAverage();
+			ImGui::Text("Frame %.2f ms: CPU %.2f, swap %.2f, wait %.2f; GPU %.2f ms", frameAvg.frameMs, frameAvg.cpuMs,
+				frameAvg.swapMs, frameAvg.waitMs, frameAvg.gpuMs);
+			ImGui::Text("Input to present latency: %.2f ms (last %.2f ms)", frameAvg.latencyMs, framePacer.getLatest().latencyMs);
+			framePacer.getFrameTimes(frameTimes);
+			if (!frameTimes.empty())
+				ImGui::PlotLines("Frame times (ms)", frameTimes.data(), static_cast<int>(frameTimes.size()), 0, nullptr, 0.f, 50.f, ImVec2(0.f, 60.f));
 
-			state.updateClock();
-			if (state.animationActive) {
-				// Animatio
-
-				//## target 1
-				time += state.dt();
-				yPos1 = sin(time) * 3;
-				xPos1 += state.dt() * targetSpeed * RightLeftT;
-				// RightLeft movement
-				if (xPos1 > 22.2f) { RightLeftT = -1; }
-				if (xPos1 < -27.2f) { RightLeftT = 1; }
-				//## target 1-2
-				yPos12 = cos(time) * 4;
-
-				//## target 2
-				zPos2 += state.dt() * targetSpeed * FrondBack;
-				xPos2 += state.dt() * targetSpeed * RightLeft;
-				zPos22 += state.dt() * targetSpeed * -FrondBack;
-				xPos22 += state.dt() * targetSpeed * -RightLeft;
-				// squared movement
-				if (zPos2 < -73.0f) { RightLeft = 1; FrondBack = 0; }
-				if (zPos2 > -69.0f) { RightLeft = -1; FrondBack = 0; }
-				if (xPos2 < -18.0f && !(zPos2 < -73.0f)) { FrondBack = -1; RightLeft = 0; }
-				if (xPos2 > 18.f && !(zPos2 > -69.0f)) { FrondBack = 1; RightLeft = 0; }
+			ImGui::Text("\nSimulation (%.0f Hz):", 1.0f / simulation.getStepSeconds());
+			if (!benchmark && ImGui::Checkbox("Simulation thread", &simulationThread))
+			{
+				if (simulationThread)
+					simulation.start();
+				else
+					simulation.stop();
+			}
+			ImGui::Text("%llu steps, %.4f ms per step, %llu dropped", simulation.getSteps(), simulation.getStepMs(),
+				simulation.getDroppedSteps());
+
+			ImGui::Text("\nFrame recording:");
+			FrameCapture& frameCapture = window.getFrameCapture();
+			const char* recordFormats[] = { "PPM sequence", "PNG sequence", "Raw RGB" };
+			if (!frameCapture.isRecording())
+			{
+				ImGui::Combo("Recording format", &recordFormat, recordFormats, IM_ARRAYSIZE(recordFormats));
+				ImGui::SliderInt("Readback slots", &recordSlots, 2, 16);
+				if (ImGui::Button("Start recording"))
+					frameCapture.startRecording("rec_" + std::to_string(recordingCount++), static_cast<ImageFormat>(recordFormat), recordSlots);
 			}
-			//## mesterybox (sword)
-			angleM += state.dt() * kPi_ * 0.1f * boxR;
-			if (angleM >= 0.3f) { boxR = -1; }
-			else if (angleM <= -0.3f) { boxR = 1; }
-			boxYpos += state.dt() * 0.7 * boxM;
-			if (boxYpos > 1.2f) { boxM = -1; }
-			else if (boxYpos < 0.3f) { boxM = 1.0f; }
-
-			//## Creeper
-			// creeper jupm
-			if (jump == true)
+			else if (ImGui::Button("Stop recording"))
+				frameCapture.stopRecording();
+			RecordingStats recordStats = frameCapture.getRecordingStats();
+			if (recordStats.framesCaptured > 0 || recordStats.framesDropped > 0)
 			{
-				yPosC += 0.1;
-				if (yPosC > 1.5)
-					jump = false;
+				ImGui::Text("Captured %zu, written %zu, dropped %zu frames", recordStats.framesCaptured, recordStats.framesWritten,
+					recordStats.framesDropped);
+				ImGui::Text("Slots in use %zu / %zu; %.2f ms per frame per writer, %.1f MB/s", recordStats.framesInFlight, recordStats.slots,
+					recordStats.writeMs, recordStats.megabytesPerSecond);
 			}
-			else if (yPosC > 0.0)
-				yPosC -= 0.1;
-			// head and legs animation
-			angleC += state.dt() * kPi_ * 0.3f * partsC;
-			if (angleC >= 0.3f) { partsC = -1; }
-			else if (angleC <= -0.3f) { partsC = 1; }
-			// move around
-			zPosC += state.dt() * 7 * FrondBackC;
-			xPosC += state.dt() * 7 * RightLeftC;
-			// creeper path
-			if (zPosC < -40.0f) { RightLeftC = 1; FrondBackC = 0; creeperdir = 0.5; }
-			if (zPosC > -28.0f) { RightLeftC = -1; FrondBackC = 0; creeperdir = -0.5; }
-			if (xPosC < -12.0f && !(zPosC < -40.0f)) { FrondBackC = -1; RightLeftC = 0; creeperdir = 1; }
-			if (xPosC > 2.f && xPosC < 3.f && !(zPosC < -40.0f)) { FrondBackC = 1; RightLeftC = 0; creeperdir = 0; }
-			if (zPosC > -10.0f && xPosC > 2.f && xPosC < 3.f) { RightLeftC = -1; FrondBackC = 0; creeperdir = -0.5; }
-			if (xPosC > 15.f && !(zPosC > -28.0f)) { FrondBackC = 1; RightLeftC = 0; creeperdir = 0; }
+
+			ImGui::Text("\nCamera path (for --benchmark --camera-path):");
+			if (benchmark)
+				ImGui::Text("Benchmark running: frame %lld of %llu", frameCount, benchmark->getTotalFrames());
+			else if (!recordingPath)
+			{
+				if (ImGui::Button("Record camera path"))
+				{
+					cameraPath.clear();
+					cameraPath.record(camera, 0.f);
+					pathRecordStart = frameClock;
+					recordingPath = true;
+				}
+			}
+			else if (ImGui::Button("Stop and save camera path"))
+			{
+				recordingPath = false;
+				std::string pathFile = "camera_path_" + std::to_string(savedPathCount++) + ".txt";
+				try
+				{
+					cameraPath.save(pathFile);
+					std::printf("Camera path of %zu keys (%.1f s) saved to '%s'\n", cameraPath.size(), cameraPath.getDuration(), pathFile.c_str());
+				}
+				catch (std::exception const& eErr)
+				{
+					std::fprintf(stderr, "%s\n", eErr.what());
+				}
+			}
+			if (recordingPath)
+				ImGui::Text("Recording: %zu keys, %.1f s", cameraPath.size(), cameraPath.getDuration());
+
+			ImGui::Text("\nStreaming uploads:");
+			if (ImGui::Checkbox("Persistent-mapped stream buffer", &streamUploads))
+			{
+				clusteredLights.setStreamBuffer(streamUploads ? &streamBuffer : nullptr);
+				deferredRenderer.setStreamBuffer(streamUploads ? &streamBuffer : nullptr);
+			}
+			ImGui::Text("Last frame %.1f KiB, peak %.1f KiB of %d x %.1f KiB; %zu stalls", streamBuffer.getLastFrameBytes() / 1024.0,
+				streamBuffer.getPeakFrameBytes() / 1024.0, streamBuffer.getNumRegions(), streamBuffer.getRegionSize() / 1024.0,
+				streamBuffer.getStalls());
+
+			ImGui::Text("\nGPU profiler:");
+			if (ImGui::Checkbox("Enabled", &gpuProfilerEnabled))
+				gpuProfiler.setEnabled(gpuProfilerEnabled);
+			ImGui::SameLine();
+			ImGui::Checkbox("Per-draw zones", &profilePerDraw);
+			ImGui::SameLine();
+			if (ImGui::Button(gpuProfiler.isWritingCsv() ? "Stop CSV" : "Start CSV"))
+			{
+				if (gpuProfiler.isWritingCsv())
+					gpuProfiler.stopCsv();
+				else
+				{
+					std::string csvPath = "gpu_profile_" + std::to_string(csvCaptureCount++) + ".csv";
+					if (!gpuProfiler.startCsv(csvPath))
+						std::fprintf(stderr, "Cannot write GPU profile to '%s'\n", csvPath.c_str());
+				}
+			}
+			ImGui::Text("Zone (avg / last ms), %zu frames dropped", gpuProfiler.getDroppedFrames());
+			for (const GpuProfiler::ZoneStats& zone : gpuProfiler.getZones())
+				ImGui::Text("%*s%s: %.3f / %.3f", 2 * zone.depth, "", zone.name, zone.avgMs, zone.lastMs);
+			ImGui::Text("\nGL synchronization:");
+			if (ImGui::Checkbox("Count synchronous GL calls", &trackGlSync))
+				GlSyncTracker::setEnabled(trackGlSync);
+			ImGui::SameLine();
+			if (ImGui::Checkbox("Deferred GL error checks", &deferredGlErrors))
+				detail::set_deferred_gl_errors(deferredGlErrors);
+			if (trackGlSync)
+			{
+				std::vector<GlSyncTracker::CallSite> syncSites = GlSyncTracker::getCallSites();
+				ImGui::Text("Synchronous calls last frame: %zu (%zu call sites seen)", GlSyncTracker::getLastFrameCount(), syncSites.size());
+				for (size_t i = 0; i < syncSites.size() && i < 8; i++)
+				{
+					ImGui::Text("%zu (%zu total) %s at %s", syncSites[i].lastFrameCount, syncSites[i].totalCount, syncSites[i].function,
+						GlSyncTracker::describe(syncSites[i].address).c_str());
+				}
+				if (ImGui::Button("Print all call sites"))
+				{
+					for (const GlSyncTracker::CallSite& site : syncSites)
+						std::printf("%zu last frame, %zu total: %s at %s\n", site.lastFrameCount, site.totalCount, site.function,
+							GlSyncTracker::describe(site.address).c_str());
+				}
+			}
+#if CPU_PROFILER
+			ImGui::Text("\nCPU profiler:");
+			if (ImGui::Button("Restart capture"))
+				CpuProfiler::startCapture();
+			ImGui::SameLine();
+			if (ImGui::Button("Write Chrome trace"))
+			{
+				std::string tracePath = "cpu_trace_" + std::to_string(cpuTraceCount++) + ".json";
+				if (CpuProfiler::writeChromeTrace(tracePath))
+					std::printf("CPU trace written to '%s'\n", tracePath.c_str());
+				else
+					std::fprintf(stderr, "Cannot write CPU trace to '%s'\n", tracePath.c_str());
+			}
+#endif
+			ImGui::End();
+			CPU_ZONE_END();
+
+			// Programs reloaded with R, and new shader variants, replace the old ones once compiled
+			for (RenderSettings* settings : { &pbrPrograms, &pbrClusteredPrograms, &pbrLightListPrograms, &pbrDeferredPrograms, &blinnPhong })
+				settings->pollPrograms();
+
+			CPU_ZONE_BEGIN("Animation");
+			state.updateClock();
+			frameClock += state.dt();
+			// The benchmark path starts after the warm-up, which renders its first view
+			if (benchmark)
+				cameraPath.apply(camera, std::max(0LL, frameCount - static_cast<long long>(benchmark->getWarmupFrames())) * kBenchmarkDt);
+			else if (recordingPath && frameClock - pathRecordStart >= cameraPath.getDuration() + kRecordInterval)
+				cameraPath.record(camera, frameClock - pathRecordStart);
+			// Without the thread, the steps that fit in the frame time run here
+			animationControls.targetsActive.store(state.animationActive, std::memory_order_relaxed);
+			if (!simulation.isRunning())
+				simulation.advance(state.dt());
+			const SimulationSnapshot<SceneAnimation>& snapshot = simulation.snapshot();
+			const SceneAnimation anim = blendAnimation(snapshot.previous, snapshot.current, simulation.getAlpha(snapshot));
+			CPU_ZONE_END();
 
 			// Update: compute matrices
-			// arena
-			Mat44f model2world3 = make_translation({ 0.f, 0.f, 0.f }) * make_scaling(0.9f, 0.9f, 0.9f);
-			float denom3 = 1.0f / 0.9f;
-			Mat44f model2world3N = make_scaling(denom3, denom3, denom3); // S^-1
-			// roof
-			Mat44f model2worldroof = make_translation({ 0.f, 13.f, 0.f }) * make_scaling(0.9f, 0.9f, 0.9f);
-			Mat44f model2worldroofN = model2world3N;
-			// floor
-			Mat44f model2worldfloor = make_translation({ 0.f, 0.f, 0.f }) * make_scaling(0.9f, 0.9f, 0.9f);
-			Mat44f model2worldfloorN = model2world3N;
-			// element 1
-			Mat44f model2world4 = make_translation({ 17.f, 2.1f, -17.f }) * make_scaling(2.3f, 2.0f, 2.3f);
-			float denom4 = 1.0f / 2.3f;
-			Mat44f model2world4N = make_scaling(denom3, 1.0 / 2.0f, denom3); // S^-1
-			// element3
-			Mat44f model2world5 = make_translation({ -17.f, 0.f, -20.f });
-			// element4
-			Mat44f model2world6 = make_translation({ 15.f, 0.f, -35.f }) * make_scaling(1.5f, 1.5f, 1.5f);
-			float denom = 1.0f / 1.5f;
-			Mat44f model2world6N = make_scaling(denom, denom, denom); // S^-1
-			// oldbox
-			Mat44f model2worldoldboxMesh = make_translation({ 25.5f, 0.0f, -50.f }) * make_rotation_y(-1.57f) * make_scaling(6.f, 6.f, 6.f);
-			float denom5 = 1.0f / 6.f;
-			Mat44f model2worldoldboxMeshN = make_scaling(denom5, denom5, denom5) * make_rotation_y(-1.57f); // S^-1
-			// sword
-			Mat44f model2worldsword = make_translation({ 25.5f, boxYpos + 2.3f, -50.f }) * make_rotation_y(angleM - 1.5) * make_rotation_x(kPi_ * 0.3f) * make_scaling(0.07f, 0.07f, 0.07f);
-			float denom51 = 1.0f / 0.07f;
-			Mat44f model2worldswordN = make_scaling(denom51, denom51, denom51) * make_rotation_y(angleM - 1.5f) * make_rotation_x(kPi_ * 0.45f); // S^-1
-			// boxWood 1
-			Mat44f model2worldboxWood1Mesh = make_translation({ -27.f, 0.0f, -50.f }) * make_scaling(3.0f, 3.0f, 3.0f) * make_rotation_y(1.57f);
-			float denom6 = 1.0f / 3.0f;
-			Mat44f model2worldboxWoodMeshN = make_scaling(denom6, denom6, denom6) * make_rotation_y(1.57f); // S^-1
-			// boxWood 2
-			Mat44f model2worldboxWood2Mesh = make_translation({ -27.f, 0.0f, -46.f }) * make_scaling(3.0f, 3.0f, 3.0f) * make_rotation_y(1.57f);
-			// boxWood 3
-			Mat44f model2worldboxWood3Mesh = make_translation({ -27.f, 3.9f, -46.f }) * make_scaling(3.0f, 3.0f, 3.0f) * make_rotation_y(1.57f);
-			// table
-			Mat44f model2worldtableMesh = make_translation({ -25.f, 0, -60.f }) * make_scaling(0.007f, 0.007f, 0.007f);
-			float denom7 = 1.0f / 0.007f;
-			Mat44f model2worldtableMeshN = make_scaling(denom7, denom7, denom7); // S^-1
-			// chair
-			Mat44f model2worldchairMesh = make_translation({ -23.f, 0, -67.f }) * make_scaling(0.06f, 0.06f, 0.06f) * make_rotation_y(0.8f * kPi_);
-			float denom8 = 1.0f / 0.06f;
-			Mat44f model2worldchairMeshN = make_scaling(denom8, denom8, denom8) * make_scaling(0.1f, 0.1f, 0.1f) * make_rotation_y(0.8f * kPi_); // S^-1
-			// chair 2
-			Mat44f model2worldchair2 = make_translation({ -21.f, 0, -61.f }) * make_scaling(0.06f, 0.06f, 0.06f) * make_rotation_y(0.5f * kPi_);;
-			float denom81 = 1.0f / 0.06f;
-			Mat44f model2worldchair2N = make_scaling(denom81, denom81, denom81) * make_scaling(0.1f, 0.1f, 0.1f) * make_rotation_y(2.5f); // S^-1
-			// taget 11
-			Mat44f model2worldtarget = make_translation({ xPos1, yPos1 + 7, -76.4f }) * make_scaling(0.9f, 0.9f, 0.9f) * make_rotation_y(-1.57);
-			float denom9 = 1.0f / 0.9f;
-			Mat44f model2worldtargetN = make_scaling(denom9, denom9, denom9) * make_rotation_y(-1.57); // S^-1
-			// taget 12
-			Mat44f model2worldtarget12 = make_translation({ xPos1 + 5, yPos12 + 7, -76.4f }) * make_scaling(0.9f, 0.9f, 0.9f) * make_rotation_y(-1.57f);
-			// taget2
-			Mat44f model2worldtarget2 = make_translation({ xPos2, 0.f, zPos2 }) * make_scaling(0.7f, 0.7f, 0.7f);
-			float denom10 = 1.0f / 0.7f;
-			Mat44f model2worldtarget2N = make_scaling(denom10, denom10, denom10); // S^-1
-			// taget2-2
-			Mat44f model2worldtarget22 = make_translation({ xPos22, 0.f, zPos22 - 3.5f }) * make_scaling(0.7f, 0.7f, 0.7f);
-			// light1
-			Mat44f model2worldlight = make_translation({ -20.0f, 13.f, -8.f });
-			// light2
-			Mat44f model2worldlight2 = make_translation({ +20.0f, 13.f, -8.f });
-			// light3
-			Mat44f model2worldlight3 = make_translation({ -20.0f, 13.f, -68.4f });
-			// light4
-			Mat44f model2worldlight4 = make_translation({ +20.0f, 13.f, -68.4f });
-			// light5
-			Mat44f model2worldlight5 = make_translation({ 0.0f, 16.f, -38.2f });
-			// lightbulb1
-			Mat44f flipUp = make_rotation_z(kPi_);
-			Mat44f model2worldlightbulb1 = make_translation({ -20.0f, 13.2f, -8.f }) * flipUp * make_scaling(0.05f, 0.05f, 0.05f);
-			float denom1light = 1.f / 0.05f;
-			Mat44f model2worldlightbulbN = make_scaling(denom1light, denom1light, denom1light) * flipUp;
-			// lightbulb2
-			Mat44f model2worldlightbulb2 = make_translation({ +20.0f, 13.2f, -8.f }) * flipUp * make_scaling(0.05f, 0.05f, 0.05f);
-			// lightbulb3
-			Mat44f model2worldlightbulb3 = make_translation({ -20.0f, 13.2f, -68.4f }) * flipUp * make_scaling(0.05f, 0.05f, 0.05f);
-			// lightbulb4
-			Mat44f model2worldlightbulb4 = make_translation({ +20.0f, 13.2f, -68.4f }) * flipUp * make_scaling(0.05f, 0.05f, 0.05f);
-			// lightbulb5
-			Mat44f model2worldlightbulb5 = make_translation({ 0.0f, 16.2f, -38.2f }) * flipUp * make_scaling(0.05f, 0.05f, 0.05f);
-			// ################################################################# Creeper
-			// creeperbody
-			Mat44f model2worldcreeperbody = make_translation({ xPosC, 1.6f+yPosC, zPosC }) * make_scaling(2.f, 2.f, 2.f) * make_rotation_y(creeperdir * kPi_);
-			float denom11 = 1.0f / 2.f;
-			Mat44f model2worldcreeperbodyN = make_scaling(denom11, denom11, denom11) * make_rotation_y(creeperdir * kPi_); // S^-1
-			// creeperhead
-			Mat44f model2worldcreeperhead = model2worldcreeperbody * make_translation({ 0.0f, 1.4f, 0.0f }) * make_rotation_y(kPi_ + angleC * 0.3f);
-			Mat44f model2worldcreeperheadN = model2worldcreeperbodyN * make_rotation_y(kPi_ + angleC * 0.3f); // S^-1
-			//// legs
-			// creeperleg FrontLeft
-			Mat44f model2worldcreeperlegFL = model2worldcreeperbody * make_translation({ 0.25f, 0.f, 0.2f }) * make_rotation_x(angleC);
-			Mat44f model2worldcreeperlegFLN = model2worldcreeperbodyN * make_rotation_x(angleC); // S^-1
-			// creeperleg FrontRight
-			Mat44f model2worldcreeperlegFR = model2worldcreeperbody * make_translation({ -0.25f, 0.f, 0.2f }) * make_rotation_x(-angleC);
-			Mat44f model2worldcreeperlegFRN = model2worldcreeperbodyN * make_rotation_x(-angleC); // S^-1
-			// creeperleg backLeft
-			Mat44f model2worldcreeperlegBL = model2worldcreeperbody * make_translation({ 0.25f, 0.f, -0.2f }) * make_rotation_x(-angleC) * make_rotation_y(kPi_);
-			Mat44f model2worldcreeperlegBLN = model2worldcreeperbodyN * make_rotation_x(-angleC); // S^-1
-			// creeperleg backLeft
-			Mat44f model2worldcreeperlegBR = model2worldcreeperbody * make_translation({ -0.25f, 0.f, -0.2f }) * make_rotation_x(angleC) * make_rotation_y(kPi_);
-			Mat44f model2worldcreeperlegBRN = model2worldcreeperbodyN * make_rotation_x(angleC); // S^-1
-		
-			//glass
-			Mat44f model2worldglass = make_translation({ -7.7f,6.5f,-25.f });
-
-			//crack on wall
-			Mat44f model2worldcrack = make_translation({ 28.5f, 5.0f, -25.f })*make_scaling(3.0f,3.0f,3.0f);
-			float denomCrack = 1.0 / 3.0f;
-			Mat44f model2worldcraskN = make_scaling(denomCrack, denomCrack, denomCrack);
+			CPU_ZONE_BEGIN("Matrices");
+			// Only the animated nodes are set. The graph recomputes the ones that moved and their children; the static
+			// objects keep the matrices computed on the first frame.
+			sceneGraph.setTranslation(swordNode, { 25.5f, anim.boxYpos + 2.3f, -50.f });
+			sceneGraph.setRotation(swordNode, make_rotation_y(anim.angleM - 1.5f) * make_rotation_x(kPi_ * 0.3f));
+			sceneGraph.setTranslation(targetNode, { anim.xPos1, anim.yPos1 + 7, -76.4f });
+			sceneGraph.setTranslation(target12Node, { anim.xPos1 + 5, anim.yPos12 + 7, -76.4f });
+			sceneGraph.setTranslation(target2Node, { anim.xPos2, 0.f, anim.zPos2 });
+			sceneGraph.setTranslation(target22Node, { anim.xPos22, 0.f, anim.zPos22 - 3.5f });
+			sceneGraph.setTranslation(creeperbodyNode, { anim.xPosC, 1.6f + anim.yPosC, anim.zPosC });
+			sceneGraph.setRotation(creeperbodyNode, make_rotation_y(anim.creeperdir * kPi_));
+			sceneGraph.setRotation(creeperheadNode, make_rotation_y(kPi_ + anim.angleC * 0.3f));
+			sceneGraph.setRotation(creeperlegNodes[0], make_rotation_x(anim.angleC));// front left
+			sceneGraph.setRotation(creeperlegNodes[1], make_rotation_x(-anim.angleC));// front right
+			sceneGraph.setRotation(creeperlegNodes[2], make_rotation_x(-anim.angleC) * make_rotation_y(kPi_));// back left
+			sceneGraph.setRotation(creeperlegNodes[3], make_rotation_x(anim.angleC) * make_rotation_y(kPi_));// back right
+			sceneGraph.update();
+
+			targetInstances.clear();
+			targetInstances.add(sceneGraph.getWorld(targetNode), sceneGraph.getNormal(targetNode));
+			targetInstances.add(sceneGraph.getWorld(target12Node), sceneGraph.getNormal(target12Node));
+			uploadInstances(targetInstances);
+			target2Instances.clear();
+			target2Instances.add(sceneGraph.getWorld(target2Node), sceneGraph.getNormal(target2Node));
+			target2Instances.add(sceneGraph.getWorld(target22Node), sceneGraph.getNormal(target22Node));
+			uploadInstances(target2Instances);
+			creeperlegInstances.clear();
+			for (SceneGraph::NodeId leg : creeperlegNodes)
+				creeperlegInstances.add(sceneGraph.getWorld(leg), sceneGraph.getNormal(leg));
+			uploadInstances(creeperlegInstances);
+			CPU_ZONE_END();
 
 			Mat44f world2camera = camera.getViewMatrix();
 			Mat44f projection = make_perspective_projection(
@@ -530,6 +1123,63 @@ try
 				0.1f, 100.0f);
 			Mat44f viewProj = projection * world2camera;
 
+			// Rebuild the stress lights when their number changed, then move them and, for the clustered path, bin all lights
+			// into the clusters. The deferred path draws a light volume per light instead.
+			// Outside of the stress scene the stress lights are removed, as the other paths read the same light buffer.
+			const bool deferred = renderPath == RENDER_DEFERRED_PBR;
+			const bool clustered = renderPath == RENDER_FORWARD_PBR && clusteredLighting;
+			const bool lightLists = renderPath == RENDER_FORWARD_PBR && !clusteredLighting && perObjectLights;
+			const int stressLightsWanted = (clustered || deferred) ? stressLightCount : 0;
+			if (stressLightsWanted != stressLightsActive)
+			{
+				lightManager.clearPointLights();
+				lightManager.addPointLight(pointLightSword, 2);
+				stressLightFirstIdx = static_cast<int>(lightManager.getPointLights().size());
+
+				std::mt19937 rng(1234);
+				std::uniform_real_distribution<float> unit(0.f, 1.f);
+				stressLights.resize(stressLightsWanted);
+				for (auto& light : stressLights)
+				{
+					light.center = { -30.f + 60.f * unit(rng), 1.f + 10.f * unit(rng), -80.f + 80.f * unit(rng) };
+					light.col = { 0.2f + 0.8f * unit(rng), 0.2f + 0.8f * unit(rng), 0.2f + 0.8f * unit(rng) };
+					light.orbit = 0.5f + 3.f * unit(rng);
+					light.phase = 2.f * kPi_ * unit(rng);
+					lightManager.addPointLight({ light.center, light.col, 4.f }, 2);
+				}
+				stressLightsActive = stressLightsWanted;
+			}
+
+			for (int i = 0; i < stressLightsActive; i++)
+			{
+				const StressLight& light = stressLights[i];
+				float angle = light.phase + anim.elapsed;
+				Vec3f pos = light.center + Vec3f{ light.orbit * std::cos(angle), 0.f, light.orbit * std::sin(angle) };
+				lightManager.editPointLight(stressLightFirstIdx + i, { pos, light.col, 4.f }, 2);
+			}
+			if (clustered)
+			{
+				GpuProfiler::Zone zone(gpuProfiler, "Light binning");
+				int fbWidth = 0, fbHeight = 0;
+				window.getFramebufferSize(fbWidth, fbHeight);
+				clusteredLights.update(lightManager, world2camera, camera.getVerticalFOV(), window.getAspectRatio(), 0.1f, 100.0f,
+					fbWidth, fbHeight);
+				clusteredLights.setUniforms(progPbrClustered);
+				clusteredLights.setUniforms(progPbrClusteredInstanced);
+			}
+			if (deferred)
+				state.programs = &pbrDeferredPrograms;
+			else if (renderPath == RENDER_FORWARD_BLINN_PHONG)
+				state.programs = &blinnPhong;
+			else if (clustered)
+				state.programs = &pbrClusteredPrograms;
+			else
+				state.programs = lightLists ? &pbrLightListPrograms : &pbrPrograms;
+
+			// Each draw of the light list programs is preceded by the assignment of the lights reaching the object
+			if (lightLists) objectLightLists.begin(lightManager);
+			state.objectLights = lightLists ? &objectLightLists : nullptr;
+
 			// Draw scene
 			OGL_CHECKPOINT_DEBUG();
 
@@ -539,265 +1189,311 @@ try
 			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 			
-			// We want to draw with our program..
-			{ // arena
-				MeshUniforms uniforms{};
-				uniforms.modelMat = &model2world3;
-				uniforms.modelMatN = &model2world3N;
-				uniforms.viewProjMat = &viewProj;
-				arenaMesh->draw(state, vao, uniforms);
-			}
-			{ // roof
-				MeshUniforms uniforms{};
-				uniforms.modelMat = &model2worldroof;
-				uniforms.modelMatN = &model2worldroofN;
-				uniforms.viewProjMat = &viewProj;
-				roofMesh->draw(state, vao, uniforms);
-			}
-			
-			{ // floor
-				MeshUniforms uniforms{};
-				uniforms.modelMat = &model2worldfloor;
-				uniforms.modelMatN = &model2worldfloorN;
-				uniforms.viewProjMat = &viewProj;
-				floorMesh->draw(state, vao, uniforms);
-			}
-			
-			{ // elemnet 1
-				MeshUniforms uniforms{};
-				uniforms.modelMat = &model2world4;
-				uniforms.modelMatN = &model2world4N;
-				uniforms.viewProjMat = &viewProj;
-				element1Mesh.draw(state, vao, uniforms);
-			}
-			{ // elemnet 3
-				MeshUniforms uniforms{};
-				uniforms.modelMat = &model2world5;
-				uniforms.modelMatN = &model2world5;
-				uniforms.viewProjMat = &viewProj;
-				element3Mesh->draw(state, vao, uniforms);
-			}
-			{ // elemnet 4
-				MeshUniforms uniforms{};
-				uniforms.modelMat = &model2world6;
-				uniforms.modelMatN = &model2world6N;
-				uniforms.viewProjMat = &viewProj;
-				element4Mesh->draw(state, vao, uniforms);
-			}
-			
-			{ // old box
-				MeshUniforms uniforms{};
-				uniforms.modelMat = &model2worldoldboxMesh;
-				uniforms.modelMatN = &model2worldoldboxMesh;
-				uniforms.viewProjMat = &viewProj;
-				oldboxMesh->draw(state, vao, uniforms);
-			}
-			{ // sword
-				MeshUniforms uniforms{};
-				uniforms.modelMat = &model2worldsword;
-				uniforms.modelMatN = &model2worldswordN;
-				uniforms.viewProjMat = &viewProj;
-				swordMesh->draw(state, vao, uniforms);
-			}
-			{ // wooden box 1
-				MeshUniforms uniforms{};
-				uniforms.modelMat = &model2worldboxWood1Mesh;
-				uniforms.modelMatN = &model2worldboxWoodMeshN;
-				uniforms.viewProjMat = &viewProj;
-				boxWoodMesh->draw(state, vao, uniforms);
-			}
-			{ // wooden box 2
-				MeshUniforms uniforms{};
-				uniforms.modelMat = &model2worldboxWood2Mesh;
-				uniforms.modelMatN = &model2worldboxWoodMeshN;
-				uniforms.viewProjMat = &viewProj;
-				boxWoodMesh->draw(state, vao, uniforms);
-			}
-			{ // wooden box 3
-				MeshUniforms uniforms{};
-				uniforms.modelMat = &model2worldboxWood3Mesh;
-				uniforms.modelMatN = &model2worldboxWoodMeshN;
-				uniforms.viewProjMat = &viewProj;
-				boxWoodMesh->draw(state, vao, uniforms);
-			}
-			{ // table
-				MeshUniforms uniforms{};
-				uniforms.modelMat = &model2worldtableMesh;
-				uniforms.modelMatN = &model2worldtableMesh;
-				uniforms.viewProjMat = &viewProj;
-				tableMesh->draw(state, vao, uniforms);
-			}
-			
-			{ // chair
-				MeshUniforms uniforms{};
-				uniforms.modelMat = &model2worldchairMesh;
-				uniforms.modelMatN = &model2worldchairMeshN;
-				uniforms.viewProjMat = &viewProj;
-				chairMesh->draw(state, vao, uniforms);
-			}
-			{ // chair
-				MeshUniforms uniforms{};
-				uniforms.modelMat = &model2worldchair2;
-				uniforms.modelMatN = &model2worldchair2N;
-				uniforms.viewProjMat = &viewProj;
-				chairMesh->draw(state, vao, uniforms);
-			}
-			
-			{ // target 1
-				MeshUniforms uniforms{};
-				uniforms.modelMat = &model2worldtarget;
-				uniforms.modelMatN = &model2worldtargetN;
-				uniforms.viewProjMat = &viewProj;
-				targetMesh->draw(state, vao, uniforms);
-			}
-			{ // target 1-2
-				MeshUniforms uniforms{};
-				uniforms.modelMat = &model2worldtarget12;
-				uniforms.modelMatN = &model2worldtargetN;
-				uniforms.viewProjMat = &viewProj;
-				targetMesh->draw(state, vao, uniforms);
-			}
-			{ // target 2
-				MeshUniforms uniforms{};
-				uniforms.modelMat = &model2worldtarget2;
-				uniforms.modelMatN = &model2worldtarget2N;
-				uniforms.viewProjMat = &viewProj;
-				target2Mesh->draw(state, vao, uniforms);
-			}
-			{ // target 2-2
-				MeshUniforms uniforms{};
-				uniforms.modelMat = &model2worldtarget22;
-				uniforms.modelMatN = &model2worldtarget2N;
-				uniforms.viewProjMat = &viewProj;
-				target2Mesh->draw(state, vao, uniforms);
-			}
-			{ // light 1
-				MeshUniforms uniforms{};
-				uniforms.modelMat = &model2worldlight;
-				uniforms.modelMatN = &model2worldlight;
-				uniforms.viewProjMat = &viewProj;
-				lightMesh->draw(state, vao, uniforms);
-			}
-			{ // light 2
-				MeshUniforms uniforms{};
-				uniforms.modelMat = &model2worldlight2;
-				uniforms.modelMatN = &model2worldlight2;
-				uniforms.viewProjMat = &viewProj;
-				lightMesh->draw(state, vao, uniforms);
-			}
-			{ // light 3
-				MeshUniforms uniforms{};
-				uniforms.modelMat = &model2worldlight3;
-				uniforms.modelMatN = &model2worldlight3;
-				uniforms.viewProjMat = &viewProj;
-				lightMesh->draw(state, vao, uniforms);
-			}
-			{ // light 4
-				MeshUniforms uniforms{};
-				uniforms.modelMat = &model2worldlight4;
-				uniforms.modelMatN = &model2worldlight4;
-				uniforms.viewProjMat = &viewProj;
-				lightMesh->draw(state, vao, uniforms);
-			}
-			{ // light 5
-				MeshUniforms uniforms{};
-				uniforms.modelMat = &model2worldlight5;
-				uniforms.modelMatN = &model2worldlight5;
-				uniforms.viewProjMat = &viewProj;
-				lightMesh->draw(state, vao, uniforms);
-			}
-			{ // creeperbody
-				MeshUniforms uniforms{};
-				uniforms.modelMat = &model2worldcreeperbody;
-				uniforms.modelMatN = &model2worldcreeperbodyN;
-				uniforms.viewProjMat = &viewProj;
-				creeperbodyMesh->draw(state, vao, uniforms);
-			}
-			{ // creeperhead
-				MeshUniforms uniforms{};
-				uniforms.modelMat = &model2worldcreeperhead;
-				uniforms.modelMatN = &model2worldcreeperheadN;
-				uniforms.viewProjMat = &viewProj;
-				creeperheadMesh->draw(state, vao, uniforms);
-			}
-			{ // creeperleg FL
-				MeshUniforms uniforms{};
-				uniforms.modelMat = &model2worldcreeperlegFL;
-				uniforms.modelMatN = &model2worldcreeperlegFLN;
-				uniforms.viewProjMat = &viewProj;
-				creeperlegMesh->draw(state, vao, uniforms);
-			}
-			{ // creeperleg FR
-				MeshUniforms uniforms{};
-				uniforms.modelMat = &model2worldcreeperlegFR;
-				uniforms.modelMatN = &model2worldcreeperlegFRN;
-				uniforms.viewProjMat = &viewProj;
-				creeperlegMesh->draw(state, vao, uniforms);
-			}
-			{ // creeperleg BL
-				MeshUniforms uniforms{};
-				uniforms.modelMat = &model2worldcreeperlegBL;
-				uniforms.modelMatN = &model2worldcreeperlegBLN;
-				uniforms.viewProjMat = &viewProj;
-				creeperlegMesh->draw(state, vao, uniforms);
-			}
-			{ // creeperleg BR
-				MeshUniforms uniforms{};
-				uniforms.modelMat = &model2worldcreeperlegBR;
-				uniforms.modelMatN = &model2worldcreeperlegBRN;
-				uniforms.viewProjMat = &viewProj;
-				creeperlegMesh->draw(state, vao, uniforms);
+			// Objects drawn one at a time. Their world-space bounding spheres are tested against the view frustum in
+			// batches first, and only the visible ones are drawn (large multi-material meshes such as the arena are then
+			// also culled per face group).
+			// The shadow caster set of an item decides when it is drawn into the spot light shadow maps. The roof is above the
+			// lights, and the glass plane is transparent.
+			enum ShadowCaster { CASTER_NONE, CASTER_STATIC, CASTER_DYNAMIC };
+			struct DrawItem {
+				const char* name;
+				Mesh* mesh;
+				const Mat44f* modelMat;
+				const Mat44f* modelMatN;
+				ShadowCaster caster;
+			};
+			auto nodeItem = [&sceneGraph](const char* name, Mesh* mesh, SceneGraph::NodeId node, ShadowCaster caster) {
+				return DrawItem{ name, mesh, &sceneGraph.getWorld(node), &sceneGraph.getNormal(node), caster };
+			};
+			const DrawItem drawItems[] = {
+				nodeItem("Arena", arenaMesh, arenaNode, CASTER_STATIC),
+				nodeItem("Roof", roofMesh, roofNode, CASTER_NONE),
+				nodeItem("Floor", floorMesh, floorNode, CASTER_STATIC),
+				nodeItem("Element 1", &element1Mesh, element1Node, CASTER_STATIC),
+				nodeItem("Element 3", element3Mesh, element3Node, CASTER_STATIC),
+				nodeItem("Element 4", element4Mesh, element4Node, CASTER_STATIC),
+				nodeItem("Old box", oldboxMesh, oldboxNode, CASTER_STATIC),
+				nodeItem("Sword", swordMesh, swordNode, CASTER_DYNAMIC),
+				nodeItem("Table", tableMesh, tableNode, CASTER_STATIC),
+				nodeItem("Creeper body", creeperbodyMesh, creeperbodyNode, CASTER_DYNAMIC),
+				nodeItem("Creeper head", creeperheadMesh, creeperheadNode, CASTER_DYNAMIC),
+				nodeItem("Glass plane", planeMesh, glassNode, CASTER_NONE),//transparent, drawn last
+			};
+			constexpr size_t kNumDrawItems = sizeof(drawItems) / sizeof(drawItems[0]);
+
+			cullStats = CullStats{};
+			frustumCuller.begin(viewProj);
+			for (const DrawItem& item : drawItems)
+				frustumCuller.add(transform_sphere(*item.modelMat, item.mesh->boundingSphere));
+			if (cpuCulling) frustumCuller.cull();
+			if (occlusionCulling) hiz.update();
+
+			bool itemVisible[kNumDrawItems];
+			for (size_t i = 0; i < kNumDrawItems; i++)
+			{
+				const DrawItem& item = drawItems[i];
+				cullStats.objectsTested++;
+				itemVisible[i] = false;
+				if (cpuCulling && !frustumCuller.isVisible(i))
+					cullStats.objectsCulled++;
+				else if (occlusionCulling && hiz.isOccluded(transform_aabb(*item.modelMat, item.mesh->bounds), viewProj))
+					cullStats.objectsOccluded++;
+				else
+					itemVisible[i] = true;
+				if (!itemVisible[i]) cullStats.trianglesCulled += item.mesh->getNumTriangles();
 			}
-			{// plane
+
+			auto drawItem = [&](size_t idx, bool depthOnly) {
+				const DrawItem& item = drawItems[idx];
+				if (!itemVisible[idx]) return;
+				GpuProfiler::Zone zone(gpuProfiler, item.name, profilePerDraw);
 				MeshUniforms uniforms{};
-				uniforms.modelMat = &model2worldglass;
-				uniforms.modelMatN = &model2worldglass;
+				uniforms.modelMat = item.modelMat;
+				uniforms.modelMatN = item.modelMatN;
 				uniforms.viewProjMat = &viewProj;
-				planeMesh->draw(state, vao, uniforms);
+				uniforms.frustum = cpuCulling ? &frustumCuller.getFrustum() : nullptr;
+				if (depthOnly)
+					item.mesh->drawDepth(state, vao, uniforms);
+				else
+				{
+					if (state.objectLights) objectLightLists.assign(transform_aabb(*item.modelMat, item.mesh->bounds));
+					uniforms.stats = &cullStats;
+					item.mesh->draw(state, vao, uniforms);
+				}
+			};
+
+			// Meshes drawn several times: one instanced draw per face group.
+			// With GPU culling on, the instances are first culled by a compute shader that writes the indirect draws. The
+			// commands are reused by the shading pass when the depth pre-pass already culled.
+			const bool prePass = depthPrePass && !deferred;//the deferred path has no pre-pass
+			auto drawInstancedMesh = [&](const char* name, Mesh* mesh, InstanceBuffer& instances, GpuFrustumCuller& culler, bool depthOnly) {
+				GpuProfiler::Zone zone(gpuProfiler, name, profilePerDraw);
+				// All instances share one draw, so they share the lights reaching any of them
+				if (!depthOnly && state.objectLights && instances.size() > 0)
+				{
+					Aabb box = transform_aabb(transpose(instances[0].modelMat), mesh->bounds);
+					for (size_t i = 1; i < instances.size(); i++)
+					{
+						Aabb instanceBox = transform_aabb(transpose(instances[i].modelMat), mesh->bounds);
+						expand(box, instanceBox.min);
+						expand(box, instanceBox.max);
+					}
+					objectLightLists.assign(box);
+				}
+				if (gpuCulling)
+				{
+					if (depthOnly || !prePass) culler.cull(*mesh, instances, viewProj);
+					if (depthOnly)
+						culler.drawDepth(state, vaoInstanced, *mesh, instances, viewProj);
+					else
+						culler.draw(state, vaoInstanced, *mesh, instances, viewProj);
+				}
+				else if (depthOnly)
+					mesh->drawDepthInstanced(state, vaoInstanced, instances, viewProj);
+				else
+					mesh->drawInstanced(state, vaoInstanced, instances, viewProj);
+			};
+
+			// All opaque geometry
+			auto drawOpaque = [&](bool depthOnly) {
+				vao.bind();
+				for (size_t i = 0; i + 1 < kNumDrawItems; i++)
+					drawItem(i, depthOnly);
+				vaoInstanced.bind();
+				drawInstancedMesh("Wooden boxes", boxWoodMesh, boxWoodInstances, boxWoodCuller, depthOnly);
+				drawInstancedMesh("Chairs", chairMesh, chairInstances, chairCuller, depthOnly);
+				drawInstancedMesh("Targets", targetMesh, targetInstances, targetCuller, depthOnly);
+				drawInstancedMesh("Targets 2", target2Mesh, target2Instances, target2Culler, depthOnly);
+				drawInstancedMesh("Lights", lightMesh, lightInstances, lightCuller, depthOnly);
+				drawInstancedMesh("Creeper legs", creeperlegMesh, creeperlegInstances, creeperlegCuller, depthOnly);
+				vao.bind();
+			};
+
+			// Shadow casters are drawn without camera culling, since they can cast shadows into the view from outside of it
+			auto drawShadowCasters = [&](const Mat44f& lightViewProj, bool staticCasters) {
+				const ShadowCaster casters = staticCasters ? CASTER_STATIC : CASTER_DYNAMIC;
+				vao.bind();
+				for (const DrawItem& item : drawItems)
+				{
+					if (item.caster != casters) continue;
+					MeshUniforms uniforms{};
+					uniforms.modelMat = item.modelMat;
+					uniforms.viewProjMat = &lightViewProj;
+					item.mesh->drawDepth(state, vao, uniforms);
+				}
+				vaoInstanced.bind();
+				if (staticCasters)
+				{
+					boxWoodMesh->drawDepthInstanced(state, vaoInstanced, boxWoodInstances, lightViewProj);
+					chairMesh->drawDepthInstanced(state, vaoInstanced, chairInstances, lightViewProj);
+				}
+				else
+				{
+					targetMesh->drawDepthInstanced(state, vaoInstanced, targetInstances, lightViewProj);
+					target2Mesh->drawDepthInstanced(state, vaoInstanced, target2Instances, lightViewProj);
+					creeperlegMesh->drawDepthInstanced(state, vaoInstanced, creeperlegInstances, lightViewProj);
+				}
+				vao.bind();
+			};
+
+			// Only the shaders of the clustered, light list and deferred paths read the shadow maps
+			const bool shadows = spotShadowsEnabled && (clustered || lightLists || deferred);
+			if (shadows)
+			{
+				GpuTimer& shadowTimer = cacheStaticCasters ? shadowTimerCached : shadowTimerUncached;
+				GpuProfiler::Zone zone(gpuProfiler, "Spot shadows");
+				int fbWidth = 0, fbHeight = 0;
+				window.getFramebufferSize(fbWidth, fbHeight);
+				shadowTimer.begin();
+				spotShadows.update(lightManager, cacheStaticCasters, drawShadowCasters, fbWidth, fbHeight, window.getFramebuffer());
+				shadowTimer.end();
 			}
-			{// libhtbulb 1
-				MeshUniforms uniforms{};
-				uniforms.modelMat = &model2worldlightbulb1;
-				uniforms.modelMatN = &model2worldlightbulbN;
-				uniforms.viewProjMat = &viewProj;
-				lightbulbMesh->draw(state, vao, uniforms);
+			else
+				spotShadows.disable();
+			spotShadows.bind();
+
+			if (deferred)
+			{
+				// Deferred: opaque geometry fills the G-buffer, then the lighting runs once per pixel. Everything drawn
+				// afterwards (transparent plane, light bulbs) is forward shaded on top of the resolved image.
+				int fbWidth = 0, fbHeight = 0;
+				window.getFramebufferSize(fbWidth, fbHeight);
+				deferredGeometryTimer.begin();
+				{
+					GpuProfiler::Zone zone(gpuProfiler, "Deferred geometry");
+					deferredRenderer.beginGeometryPass(fbWidth, fbHeight);
+					drawOpaque(false);
+				}
+				deferredGeometryTimer.end();
+
+				deferredLightingTimer.begin();
+				{
+					GpuProfiler::Zone zone(gpuProfiler, "Deferred lighting");
+					deferredRenderer.lightingPass(lightManager, viewProj, camera.getPosition());
+					deferredRenderer.resolve();
+				}
+				deferredLightingTimer.end();
+				state.programs = &pbrPrograms;
+				vao.bind();
 			}
-			{// libhtbulb 2
-				MeshUniforms uniforms{};
-				uniforms.modelMat = &model2worldlightbulb2;
-				uniforms.modelMatN = &model2worldlightbulbN;
-				uniforms.viewProjMat = &viewProj;
-				lightbulbMesh->draw(state, vao, uniforms);
+			else
+			{
+				// With the depth pre-pass, opaque geometry is first drawn depth-only, and the shading pass then only runs the
+				// lighting for the nearest fragment (GL_LEQUAL, no depth writes). GL_EQUAL would need every shading program to
+				// declare gl_Position invariant, which the default forward shaders do not. The time of both passes is compared
+				// against the time of the single pass without pre-pass.
+				GpuTimer& opaqueTimer = depthPrePass ? opaqueTimerPrePass : opaqueTimerNoPrePass;
+				opaqueTimer.begin();
+				if (depthPrePass)
+				{
+					GpuProfiler::Zone zone(gpuProfiler, "Depth pre-pass");
+					glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+					drawOpaque(true);
+					glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+					glDepthFunc(GL_LEQUAL);
+					glDepthMask(GL_FALSE);
+				}
+				{
+					GpuProfiler::Zone zone(gpuProfiler, "Opaque");
+					drawOpaque(false);
+				}
+				if (depthPrePass)
+				{
+					glDepthFunc(GL_LESS);
+					glDepthMask(GL_TRUE);
+				}
+				opaqueTimer.end();
 			}
-			{// libhtbulb 3
-				MeshUniforms uniforms{};
-				uniforms.modelMat = &model2worldlightbulb3;
-				uniforms.modelMatN = &model2worldlightbulbN;
-				uniforms.viewProjMat = &viewProj;
-				lightbulbMesh->draw(state, vao, uniforms);
+
+			// The opaque depth is the occluder set for the following frames
+			if (occlusionCulling)
+			{
+				GpuProfiler::Zone zone(gpuProfiler, "Hi-Z capture");
+				int fbWidth = 0, fbHeight = 0;
+				window.getFramebufferSize(fbWidth, fbHeight);
+				hiz.capture(fbWidth, fbHeight, viewProj);
 			}
-			{// libhtbulb 4
-				MeshUniforms uniforms{};
-				uniforms.modelMat = &model2worldlightbulb4;
-				uniforms.modelMatN = &model2worldlightbulbN;
-				uniforms.viewProjMat = &viewProj;
-				lightbulbMesh->draw(state, vao, uniforms);
+
+			{
+				GpuProfiler::Zone zone(gpuProfiler, "Forward overlay");
+				drawItem(kNumDrawItems - 1, false);// plane
+
+				vaoInstanced.bind();
+				drawInstancedMesh("Light bulbs", lightbulbMesh, lightbulbInstances, lightbulbCuller, false);
+				vao.bind();
 			}
-			{// libhtbulb 5
-				MeshUniforms uniforms{};
-				uniforms.modelMat = &model2worldlightbulb5;
-				uniforms.modelMatN = &model2worldlightbulbN;
-				uniforms.viewProjMat = &viewProj;
-				lightbulbMesh->draw(state, vao, uniforms);
+
+			if (deferred)
+			{
+				GpuProfiler::Zone zone(gpuProfiler, "Deferred present");
+				deferredRenderer.present(window.getFramebuffer());
 			}
 
-			ImGui::Render();
-			ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+			{
+				CPU_ZONE("ImGui render");
+				GpuProfiler::Zone zone(gpuProfiler, "ImGui");
+				ImGui::Render();
+				ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+			}
+			gpuProfiler.endFrame();
+			if (deferredGlErrors) OGL_CHECKPOINT_FLUSH();
 
 			OGL_CHECKPOINT_DEBUG();
 		}
 
-		window.updateWindow();
+		frameCount++;
+		if (frameCount == lastFrame && !options.output.empty())
+		{
+			bool png = options.output.size() >= 4 && options.output.compare(options.output.size() - 4, 4, ".png") == 0;
+			window.getFrameCapture().request(options.output, png ? ImageFormat::PNG : ImageFormat::PPM);
+		}
+		streamBuffer.endFrame();
+		CPU_ZONE_BEGIN("Present");
+		framePacer.endFrame(window);
+		CPU_ZONE_END();
+		if (benchmark) benchmark->addFrames(framePacer.getFinishedFrames());
+		CPU_ZONE_BEGIN("Poll events");
+		window.pollEvents();
+		CPU_ZONE_END();
+
+		if (!firstFrameReported)
+		{
+			float ms = std::chrono::duration_cast<std::chrono::duration<float, std::milli>>(Clock::now() - startTime).count();
+			std::printf("Time to first frame: %.1f ms (programs: %zu from the binary cache, %zu compiled, %zu binaries rejected)\n",
+				ms, programCache.getHits(), programCache.getMisses(), programCache.getRejected());
+			firstFrameReported = true;
+		}
+	}
+	int exitCode = 0;
+	if (benchmark && benchmark->isComplete())
+	{
+		benchmark->writeJson(options.benchmarkOutput);
+		const char* names[] = { "frame", "CPU", "GPU" };
+		const BenchmarkStats stats[] = { benchmark->getFrameStats(), benchmark->getCpuStats(), benchmark->getGpuStats() };
+		for (int i = 0; i < 3; i++)
+			std::printf("%-5s ms: min %.3f, mean %.3f, p50 %.3f, p95 %.3f, p99 %.3f, max %.3f\n", names[i], stats[i].min, stats[i].mean,
+				stats[i].p50, stats[i].p95, stats[i].p99, stats[i].max);
+		std::printf("Benchmark results written to '%s'\n", options.benchmarkOutput.c_str());
+		if (!options.baseline.empty())
+		{
+			std::vector<std::string> regressions = benchmark->compare(options.baseline, options.threshold);
+			for (const std::string& regression : regressions)
+				std::fprintf(stderr, "Regression: %s\n", regression.c_str());
+			if (!regressions.empty())
+			{
+				std::fprintf(stderr, "Benchmark is more than %.1f%% slower than '%s'\n", options.threshold * 100.0, options.baseline.c_str());
+				exitCode = 1;
+			}
+			else
+				std::printf("No regression against '%s' (threshold %.1f%%)\n", options.baseline.c_str(), options.threshold * 100.0);
+		}
+	}
+	else if (options.frames > 0)
+	{
+		float seconds = std::chrono::duration_cast<Secondsf>(Clock::now() - startTime).count();
+		FrameTiming frameAvg = framePacer.getAverage();
+		std::printf("%lld frames in %.2f s; average frame %.2f ms (CPU %.2f ms, GPU %.2f ms)\n", frameCount, seconds,
+			frameAvg.frameMs, frameAvg.cpuMs, frameAvg.gpuMs);
 	}
 	ImGui_ImplOpenGL3_Shutdown();
 	ImGui_ImplGlfw_Shutdown();
@@ -805,7 +1501,7 @@ try
 
 	// Cleanup.
 	// TODO ensure that all OpenGL objects are freed BEFORE the context is ternimated!
-	return 0;
+	return exitCode;
 }
 catch (std::exception const &eErr)
 {
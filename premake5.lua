@@ -1,3 +1,8 @@
+newoption {
+	trigger = "cpu-profiler",
+	description = "Keep the CPU profiler zones in release builds (they are always on in debug builds)"
+}
+
 workspace "COMP3811-cw2"
 	language "C++"
 	cppdialect "C++17"
@@ -57,11 +62,16 @@ workspace "COMP3811-cw2"
 	filter "debug"
 		symbols "On"
 		defines { "_DEBUG=1" }
+		defines { "CPU_PROFILER=1" }
 
 	filter "release"
 		optimize "On"
 		defines { "NDEBUG=1" }
 
+	-- The CPU profiler zones (support/cpu_profiler.hpp) are compiled out of release builds unless requested
+	filter { "release", "options:cpu-profiler" }
+		defines { "CPU_PROFILER=1" }
+
 	filter "*"
 
 
@@ -89,6 +99,12 @@ project "main"
 	links "x-glad"
 	links "x-glfw"
 
+	-- Headless rendering (support/window.cpp) creates its context through EGL
+	filter "system:linux"
+		links "EGL"
+
+	filter "*"
+
 	files( sources )
 
 project "main-shaders"
@@ -132,4 +148,31 @@ project "vmlib"
 
 	files( sources )
 
+-- Microbenchmark of the SIMD kernels of vmlib against the scalar code (run the release build)
+project "vmlib-bench"
+	local sources = { 
+		"vmlib-bench/**.cpp",
+		"vmlib-bench/**.hpp"
+	}
+
+	kind "ConsoleApp"
+	location "vmlib-bench"
+
+	files( sources )
+
+	links "vmlib"
+
+project "vmlib-check"
+	local sources = { 
+		"vmlib-check/**.cpp",
+		"vmlib-check/**.hpp"
+	}
+
+	kind "ConsoleApp"
+	location "vmlib-check"
+
+	files( sources )
+
+	links "vmlib"
+
 --EOF
@@ -0,0 +1,132 @@
+#include "benchmark.hpp"
+#include"error.hpp"
+#include<algorithm>
+#include<cmath>
+#include<cstdio>
+#include<cstdlib>
+#include<fstream>
+#include<sstream>
+
+namespace {
+	const char* STAT_NAMES[] = { "min", "mean", "p50", "p95", "p99", "max" };
+
+	double statValue(const BenchmarkStats& stats, size_t index) {
+		const double values[] = { stats.min, stats.mean, stats.p50, stats.p95, stats.p99, stats.max };
+		return values[index];
+	}
+
+	void writeStats(std::FILE* file, const char* name, const BenchmarkStats& stats, bool last) {
+		std::fprintf(file, "  \"%s\": {", name);
+		for (size_t i = 0; i < 6; i++)
+			std::fprintf(file, " \"%s\": %.4f%s", STAT_NAMES[i], statValue(stats, i), i + 1 < 6 ? "," : "");
+		std::fprintf(file, " }%s\n", last ? "" : ",");
+	}
+
+	//Value of "key" in the object "section" of a results file. Only the layout written by writeJson() is supported.
+	bool findStat(const std::string& json, const char* section, const char* key, double& value) {
+		size_t start = json.find(std::string("\"") + section + "\"");
+		if (start == std::string::npos) return false;
+		size_t end = json.find('}', start);
+		size_t at = json.find(std::string("\"") + key + "\"", start);
+		if (at == std::string::npos || at > end) return false;
+		at = json.find(':', at);
+		if (at == std::string::npos || at > end) return false;
+		char* parsed = nullptr;
+		value = std::strtod(json.c_str() + at + 1, &parsed);
+		return parsed != json.c_str() + at + 1;
+	}
+}
+
+Benchmark::Benchmark(unsigned long long warmup, unsigned long long frames, double fixedDt) : warmupFrames(warmup), measuredFrames(frames),
+	dt(fixedDt), frameMs(frames, 0.0), cpuMs(frames, 0.0), gpuMs(frames, 0.0), finished(frames, false), numFinished(0) {
+	if (frames == 0) throw Error("A benchmark needs at least one measured frame");
+}
+
+void Benchmark::addFrames(const std::vector<FrameTiming>& timings) {
+	for (const FrameTiming& timing : timings) {
+		if (timing.frame < warmupFrames || timing.frame >= warmupFrames + measuredFrames) continue;
+		size_t i = static_cast<size_t>(timing.frame - warmupFrames);
+		if (finished[i]) continue;
+		frameMs[i] = timing.frameMs;
+		cpuMs[i] = timing.cpuMs;
+		gpuMs[i] = timing.gpuMs;
+		finished[i] = true;
+		numFinished++;
+	}
+}
+
+BenchmarkStats Benchmark::computeStats(std::vector<double> samples) {
+	BenchmarkStats stats{};
+	if (samples.empty()) return stats;
+	std::sort(samples.begin(), samples.end());
+	auto percentile = [&samples](double p) {
+		size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * samples.size()));
+		return samples[std::clamp<size_t>(rank, 1, samples.size()) - 1];
+	};
+	double sum = 0.0;
+	for (double sample : samples) sum += sample;
+	stats.min = samples.front();
+	stats.mean = sum / samples.size();
+	stats.p50 = percentile(50.0);
+	stats.p95 = percentile(95.0);
+	stats.p99 = percentile(99.0);
+	stats.max = samples.back();
+	return stats;
+}
+
+BenchmarkStats Benchmark::getFrameStats() const {
+	return computeStats(frameMs);
+}
+
+BenchmarkStats Benchmark::getCpuStats() const {
+	return computeStats(cpuMs);
+}
+
+BenchmarkStats Benchmark::getGpuStats() const {
+	return computeStats(gpuMs);
+}
+
+void Benchmark::writeJson(const std::string& path) const {
+	std::FILE* file = std::fopen(path.c_str(), "w");
+	if (!file) throw Error("Cannot write benchmark results to '%s'", path.c_str());
+	std::fprintf(file, "{\n");
+	std::fprintf(file, "  \"warmupFrames\": %llu,\n", warmupFrames);
+	std::fprintf(file, "  \"frames\": %llu,\n", measuredFrames);
+	std::fprintf(file, "  \"dt\": %.6f,\n", dt);
+	writeStats(file, "frameMs", getFrameStats(), false);
+	writeStats(file, "cpuMs", getCpuStats(), false);
+	writeStats(file, "gpuMs", getGpuStats(), true);
+	std::fprintf(file, "}\n");
+	std::fclose(file);
+}
+
+std::vector<std::string> Benchmark::compare(const std::string& baselinePath, double threshold) const {
+	std::ifstream file(baselinePath);
+	if (!file) throw Error("Cannot open benchmark baseline '%s'", baselinePath.c_str());
+	std::stringstream content;
+	content << file.rdbuf();
+	const std::string json = content.str();
+
+	struct Section {
+		const char* name;
+		BenchmarkStats stats;
+	};
+	const Section sections[] = { { "frameMs", getFrameStats() }, { "cpuMs", getCpuStats() }, { "gpuMs", getGpuStats() } };
+
+	std::vector<std::string> regressions;
+	for (const Section& section : sections) {
+		for (size_t i = 1; i + 1 < 6; i++) {//mean to p99
+			double baseline = 0.0;
+			if (!findStat(json, section.name, STAT_NAMES[i], baseline))
+				throw Error("Benchmark baseline '%s' has no %s.%s", baselinePath.c_str(), section.name, STAT_NAMES[i]);
+			double current = statValue(section.stats, i);
+			if (current > baseline * (1.0 + threshold)) {
+				char message[160];
+				std::snprintf(message, sizeof(message), "%s.%s: %.3f ms, baseline %.3f ms (+%.1f%%)", section.name, STAT_NAMES[i], current,
+					baseline, baseline > 0.0 ? (current / baseline - 1.0) * 100.0 : 100.0);
+				regressions.push_back(message);
+			}
+		}
+	}
+	return regressions;
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include<string>
+#include<vector>
+#include"frame_pacer.hpp"
+
+//Distribution of a per-frame time over the measured frames, in milliseconds.
+struct BenchmarkStats {
+	double min;
+	double mean;
+	double p50;
+	double p95;
+	double p99;
+	double max;
+};
+
+/*
+* Frame time statistics of a benchmark run.
+* The run starts with warmupFrames frames that are not measured (shader variants compiled on first use, caches, clocks ramping
+* up), followed by the measured frames. The timings come from FramePacer::getFinishedFrames(), so the GPU time of a frame is
+* known a few frames after it was submitted: the run is complete once every measured frame was finished, which is up to
+* FramePacer's frames in flight after the last one.
+*
+* The results are written as JSON:
+*   { "warmupFrames": ..., "frames": ..., "dt": ...,
+*     "frameMs": { "min": ..., "mean": ..., "p50": ..., "p95": ..., "p99": ..., "max": ... }, "cpuMs": {...}, "gpuMs": {...} }
+* and can be compared against the file of an earlier run: a statistic regresses when it exceeds the baseline by more than a
+* relative threshold. The extremes are not compared, a single hitch would fail the run.
+*/
+class Benchmark {
+private:
+	unsigned long long warmupFrames;
+	unsigned long long measuredFrames;
+	double dt;
+	//Indexed by measured frame
+	std::vector<double> frameMs;
+	std::vector<double> cpuMs;
+	std::vector<double> gpuMs;
+	std::vector<bool> finished;
+	unsigned long long numFinished;
+
+public:
+	//Input:
+	// - warmup: frames run before the measured ones;
+	// - frames: measured frames;
+	// - fixedDt: time step of the animation during the run, recorded in the results.
+	Benchmark(unsigned long long warmup, unsigned long long frames, double fixedDt);
+
+	//Record the timings of finished frames. Frames outside the measured range are ignored.
+	void addFrames(const std::vector<FrameTiming>& timings);
+
+	//Frames to render: the warm-up and the measured frames.
+	unsigned long long getTotalFrames() const;
+	unsigned long long getWarmupFrames() const;
+	//True when the timings of all the measured frames were recorded.
+	bool isComplete() const;
+
+	//Nearest-rank percentiles of the samples.
+	static BenchmarkStats computeStats(std::vector<double> samples);
+	BenchmarkStats getFrameStats() const;
+	BenchmarkStats getCpuStats() const;
+	BenchmarkStats getGpuStats() const;
+
+	//Throws an Error when the file cannot be written.
+	void writeJson(const std::string& path) const;
+	//Compare against the results written by an earlier run.
+	//Returns a description of each statistic more than threshold (relative, e.g. 0.1 for 10%) slower than the baseline.
+	//Throws an Error when the baseline cannot be read.
+	std::vector<std::string> compare(const std::string& baselinePath, double threshold) const;
+};
+
+inline unsigned long long Benchmark::getTotalFrames() const {
+	return warmupFrames + measuredFrames;
+}
+
+inline unsigned long long Benchmark::getWarmupFrames() const {
+	return warmupFrames;
+}
+
+inline bool Benchmark::isComplete() const {
+	return numFinished == measuredFrames;
+}
@@ -1,6 +1,7 @@
 #pragma once
 #include<glad.h>
 #include<cstdint>
+#include<memory>
 #include"error.hpp"
 #include"vao.hpp"
 
@@ -10,6 +11,7 @@
 class Buffer {
 private:
 	GLuint bufferID;
+	uintptr_t bufferSize;//kept on the client, since the storage is immutable; querying it would round-trip to the driver
 
 public:
 	Buffer();//TODO should there be a default constructor - can we always use the other one which requires the size to be known at construction time?
@@ -37,6 +39,11 @@ public:
 	// - size: the number of bytes of the memory to be be bound.
 	void bindToUniform(uint32_t index, intptr_t offset, uintptr_t size);
 
+	//Bind the buffer to a shader storage block at a given binding point.
+	//Input: as for bindToUniform.
+	// NOTE: offset must be multiple of GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT.
+	void bindToStorage(uint32_t index, intptr_t offset, uintptr_t size) const;
+
 	//Bind the buffer to a vertex attribute at a given binding point.
 	//Input:
 	// - vao: the vertex array object holding attribute specification;
@@ -54,17 +61,44 @@ public:
 	~Buffer();
 };
 
-inline Buffer::Buffer() :bufferID(0) {}
+//Offset alignments of buffer bindings. They are constants of the context, so they are queried once (there is a single context).
+GLint uniformBufferOffsetAlignment();
+GLint storageBufferOffsetAlignment();
+
+//Copy data to a buffer whose content size changes over time. Since buffer storage is immutable, the buffer is replaced by one
+//of double the capacity (at least minCapacity bytes) when the data does not fit. Buffers are never shrunk.
+void uploadResizable(std::unique_ptr<Buffer>& buffer, const void* data, uintptr_t dataSize, uintptr_t minCapacity = 256);
+
+inline GLint uniformBufferOffsetAlignment() {
+	static const GLint alignment = [] {
+		GLint value = 0;
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &value);
+		return value;
+	}();
+	return alignment;
+}
+
+inline GLint storageBufferOffsetAlignment() {
+	static const GLint alignment = [] {
+		GLint value = 0;
+		glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &value);
+		return value;
+	}();
+	return alignment;
+}
+
+inline Buffer::Buffer() :bufferID(0), bufferSize(0) {}
 
-inline Buffer::Buffer(uintptr_t bufferSize, const void* data):bufferID(0) {
-	init(bufferSize, data);
+inline Buffer::Buffer(uintptr_t size, const void* data):bufferID(0), bufferSize(0) {
+	init(size, data);
 }
 
-inline void Buffer::init(uintptr_t bufferSize, const void* data) {
+inline void Buffer::init(uintptr_t size, const void* data) {
 	if (bufferID == 0) {
-		if (bufferSize == 0) throw Error("Attempted creating buffer with size 0.\n");
+		if (size == 0) throw Error("Attempted creating buffer with size 0.\n");
 		glCreateBuffers(1, &bufferID);
-		glNamedBufferStorage(bufferID, static_cast<GLsizeiptr>(bufferSize), data, GL_DYNAMIC_STORAGE_BIT);
+		glNamedBufferStorage(bufferID, static_cast<GLsizeiptr>(size), data, GL_DYNAMIC_STORAGE_BIT);
+		bufferSize = size;
 	}
 }
 
@@ -74,13 +108,19 @@ inline void Buffer::setData(intptr_t offset, uintptr_t dataSize, const void* dat
 }
 
 inline void Buffer::bindToUniform(uint32_t index, intptr_t offset, uintptr_t size) {
-	int uboAlignment = 0;
-	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uboAlignment);
+	const GLint uboAlignment = uniformBufferOffsetAlignment();
 	if (offset % static_cast<intptr_t>(uboAlignment) != 0) throw Error(
 		"Invalid attempt to bind buffer %u to uniform bind point %u. Offset alignment must be %i.", bufferID, index, uboAlignment);
 	glBindBufferRange(GL_UNIFORM_BUFFER, static_cast<GLuint>(index), bufferID, static_cast<GLintptr>(offset), static_cast<GLsizeiptr>(size));
 }
 
+inline void Buffer::bindToStorage(uint32_t index, intptr_t offset, uintptr_t size) const {
+	const GLint ssboAlignment = storageBufferOffsetAlignment();
+	if (offset % static_cast<intptr_t>(ssboAlignment) != 0) throw Error(
+		"Invalid attempt to bind buffer %u to storage bind point %u. Offset alignment must be %i.", bufferID, index, ssboAlignment);
+	glBindBufferRange(GL_SHADER_STORAGE_BUFFER, static_cast<GLuint>(index), bufferID, static_cast<GLintptr>(offset), static_cast<GLsizeiptr>(size));
+}
+
 inline void Buffer::bindToAttrib(const VertexArrayObject& vao, uint32_t bindingPoint, intptr_t offset, uint32_t stride) {
 	glVertexArrayVertexBuffer(vao.getID(), static_cast<GLuint>(bindingPoint), bufferID, static_cast<GLintptr>(offset), static_cast<GLsizei>(stride));
 }
@@ -94,10 +134,7 @@ inline GLuint Buffer::getBufferID() const {
 }
 
 inline uintptr_t Buffer::getSize() const {
-	if (bufferID == 0) return 0;
-	GLint64 size;
-	glGetNamedBufferParameteri64v(bufferID, GL_BUFFER_SIZE,&size);
-	return static_cast<uintptr_t>(size);
+	return bufferSize;
 }
 
 inline Buffer::~Buffer() {
@@ -106,4 +143,12 @@ inline Buffer::~Buffer() {
 	}
 }
 
-
+inline void uploadResizable(std::unique_ptr<Buffer>& buffer, const void* data, uintptr_t dataSize, uintptr_t minCapacity) {
+	if (!buffer || buffer->getSize() < dataSize) {
+		uintptr_t capacity = buffer ? buffer->getSize() : minCapacity;
+		if (capacity == 0) capacity = 1;
+		while (capacity < dataSize) capacity *= 2;
+		buffer = std::make_unique<Buffer>(capacity, nullptr);
+	}
+	if (dataSize > 0) buffer->setData(0, dataSize, data);
+}
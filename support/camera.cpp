@@ -50,7 +50,18 @@ void Camera::rotate(float xDelta, float yDelta)
 	pitch += yDelta * DEF_MOUSE_SENSITIVITY;//in radians
 
 	pitch = std::fmaxf(std::fminf(pitch, MAX_PITCH), MIN_PITCH);//Clamp pitch
+	updateBasis();
+}
 
+void Camera::setOrientation(float newYaw, float newPitch)
+{
+	yaw = newYaw;
+	pitch = std::fmaxf(std::fminf(newPitch, MAX_PITCH), MIN_PITCH);
+	updateBasis();
+}
+
+void Camera::updateBasis()
+{
 	//Convert spherical to cartesian coordinates for the forward vector.
 	//Furmulas in: https://mathworld.wolfram.com/SphericalCoordinates.html
 	//However, we have performed the following remapping to account for the fact that in OpenGL the y axis points upward:
@@ -23,6 +23,8 @@ public:
 	Vec3f getRightDir() const;
 	Vec3f getUpDir() const;
 	float getVerticalFOV() const;
+	float getYaw() const;
+	float getPitch() const;
 	bool isActive() const;
 
 	void move(const CameraMoveDir& direction, float deltaTime);
@@ -32,6 +34,8 @@ public:
 	void zoomOut();
 	void setVerticalFOV(float fovY);
 	void setPosition(const Vec3f& pos);
+	//Set the orientation directly (see yaw and pitch below), e.g. from a camera path. The pitch is clamped.
+	void setOrientation(float yaw, float pitch);
 	void speedUp();
 	void speedDown();
 	bool toggleActive();
@@ -62,6 +66,8 @@ private:
 	float moveSpeed; //Given in units per second
 	bool bActive;
 
+	//Derive the forward and right vectors from the angles.
+	void updateBasis();
 
 	//Camera class constants
 	static constexpr Vec3f WORLD_FORWARD = { 0.0f,0.0f,-1.0f };
@@ -112,6 +118,16 @@ inline float Camera::getVerticalFOV() const
 	return fovY;
 }
 
+inline float Camera::getYaw() const
+{
+	return yaw;
+}
+
+inline float Camera::getPitch() const
+{
+	return pitch;
+}
+
 inline bool Camera::isActive() const
 {
 	return bActive;
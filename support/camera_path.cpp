@@ -0,0 +1,103 @@
+#include "camera_path.hpp"
+#include"camera.hpp"
+#include"error.hpp"
+#include<algorithm>
+#include<cstdio>
+#include<fstream>
+#include<sstream>
+
+namespace {
+	//Cubic Hermite interpolation between p1 and p2, with the tangents m1, m2 scaled to the segment (u in [0, 1]).
+	template<typename T>
+	T hermite(const T& p1, const T& m1, const T& p2, const T& m2, float u) {
+		float u2 = u * u;
+		float u3 = u2 * u;
+		return p1 * (2.f * u3 - 3.f * u2 + 1.f) + m1 * (u3 - 2.f * u2 + u) + p2 * (-2.f * u3 + 3.f * u2) + m2 * (u3 - u2);
+	}
+
+	//Catmull-Rom tangent at the key between prev and next, for a segment of the given duration. The keys are not evenly
+	//spaced in time, so the difference is taken per second, then scaled to the segment.
+	template<typename T>
+	T tangent(const T& prev, float prevTime, const T& next, float nextTime, float segment) {
+		float span = nextTime - prevTime;
+		return span > 0.f ? (next - prev) * (segment / span) : T{};
+	}
+}
+
+void CameraPath::addKey(const CameraKey& key) {
+	if (!keys.empty() && key.time < keys.back().time)
+		throw Error("Camera key at %f s added after a key at %f s", key.time, keys.back().time);
+	if (!keys.empty() && key.time == keys.back().time)
+		keys.back() = key;
+	else
+		keys.push_back(key);
+}
+
+void CameraPath::record(const Camera& camera, float time) {
+	addKey(CameraKey{ time, camera.getPosition(), camera.getYaw(), camera.getPitch() });
+}
+
+CameraKey CameraPath::evaluate(float time) const {
+	if (time <= keys.front().time) return keys.front();
+	if (time >= keys.back().time) return keys.back();
+
+	//Segment [i1, i2] containing the time; the end keys are repeated for the tangents
+	size_t i2 = std::upper_bound(keys.begin(), keys.end(), time, [](float t, const CameraKey& key) { return t < key.time; }) - keys.begin();
+	size_t i1 = i2 - 1;
+	size_t i0 = i1 > 0 ? i1 - 1 : i1;
+	size_t i3 = i2 + 1 < keys.size() ? i2 + 1 : i2;
+	const CameraKey& k0 = keys[i0];
+	const CameraKey& k1 = keys[i1];
+	const CameraKey& k2 = keys[i2];
+	const CameraKey& k3 = keys[i3];
+
+	float segment = k2.time - k1.time;
+	float u = (time - k1.time) / segment;
+	CameraKey key;
+	key.time = time;
+	key.position = hermite(k1.position, tangent(k0.position, k0.time, k2.position, k2.time, segment),
+		k2.position, tangent(k1.position, k1.time, k3.position, k3.time, segment), u);
+	key.yaw = hermite(k1.yaw, tangent(k0.yaw, k0.time, k2.yaw, k2.time, segment),
+		k2.yaw, tangent(k1.yaw, k1.time, k3.yaw, k3.time, segment), u);
+	key.pitch = hermite(k1.pitch, tangent(k0.pitch, k0.time, k2.pitch, k2.time, segment),
+		k2.pitch, tangent(k1.pitch, k1.time, k3.pitch, k3.time, segment), u);
+	return key;
+}
+
+void CameraPath::apply(Camera& camera, float time) const {
+	if (keys.empty()) return;
+	CameraKey key = evaluate(time);
+	camera.setPosition(key.position);
+	camera.setOrientation(key.yaw, key.pitch);
+}
+
+void CameraPath::load(const std::string& path) {
+	std::ifstream file(path);
+	if (!file) throw Error("Cannot open camera path '%s'", path.c_str());
+
+	std::vector<CameraKey> loaded;
+	std::string line;
+	int lineNumber = 0;
+	while (std::getline(file, line)) {
+		lineNumber++;
+		size_t first = line.find_first_not_of(" \t\r");
+		if (first == std::string::npos || line[first] == '#') continue;
+		std::istringstream in(line);
+		CameraKey key{};
+		if (!(in >> key.time >> key.position.x >> key.position.y >> key.position.z >> key.yaw >> key.pitch))
+			throw Error("Invalid camera key at %s:%d, expected <time> <x> <y> <z> <yaw> <pitch>", path.c_str(), lineNumber);
+		if (!loaded.empty() && key.time <= loaded.back().time)
+			throw Error("Camera keys out of order at %s:%d", path.c_str(), lineNumber);
+		loaded.push_back(key);
+	}
+	keys = std::move(loaded);
+}
+
+void CameraPath::save(const std::string& path) const {
+	std::FILE* file = std::fopen(path.c_str(), "w");
+	if (!file) throw Error("Cannot write camera path '%s'", path.c_str());
+	std::fprintf(file, "# time x y z yaw pitch\n");
+	for (const CameraKey& key : keys)
+		std::fprintf(file, "%.4f %.4f %.4f %.4f %.5f %.5f\n", key.time, key.position.x, key.position.y, key.position.z, key.yaw, key.pitch);
+	std::fclose(file);
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include<string>
+#include<vector>
+#include"../vmlib/vec3.hpp"
+
+class Camera;
+
+//Position and orientation of the camera at a time of a path. The angles are those of Camera (radians); the yaw is not wrapped,
+//so that a key can turn further than a full turn from the previous one.
+struct CameraKey {
+	float time;//seconds from the start of the path
+	Vec3f position;
+	float yaw;
+	float pitch;
+};
+
+/*
+* Camera path through keyframes, for replaying the same views on every run.
+* The path is a Catmull-Rom spline through the positions and the angles of the keys: it passes through every key, with a
+* continuous velocity. Before the first key and after the last one, the camera stays at the end key.
+*
+* Paths are either scripted (keys added by the code) or recorded from the camera while it is moved around, and can be saved
+* to and loaded from a text file with a key per line:
+*   <time> <x> <y> <z> <yaw> <pitch>
+* Empty lines and lines starting with # are ignored.
+*/
+class CameraPath {
+private:
+	std::vector<CameraKey> keys;//sorted by time
+
+public:
+	//Add a key. Keys must be added in order of time; a key at the time of the last one replaces it.
+	void addKey(const CameraKey& key);
+	//Add a key at the given time from the current position and orientation of the camera.
+	void record(const Camera& camera, float time);
+	void clear();
+
+	bool empty() const;
+	size_t size() const;
+	//Time of the last key.
+	float getDuration() const;
+
+	//Key interpolated at the given time. The path must not be empty.
+	CameraKey evaluate(float time) const;
+	//Move the camera to the path at the given time. Does nothing on an empty path.
+	void apply(Camera& camera, float time) const;
+
+	//Throws an Error when the file cannot be opened or a line cannot be parsed.
+	void load(const std::string& path);
+	void save(const std::string& path) const;
+};
+
+inline void CameraPath::clear() {
+	keys.clear();
+}
+
+inline bool CameraPath::empty() const {
+	return keys.empty();
+}
+
+inline size_t CameraPath::size() const {
+	return keys.size();
+}
+
+inline float CameraPath::getDuration() const {
+	return keys.empty() ? 0.f : keys.back().time;
+}
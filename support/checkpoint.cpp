@@ -2,6 +2,8 @@
 
 #include <glad.h>
 
+#include <cstddef>
+
 #include "error.hpp"
 
 namespace
@@ -23,16 +25,67 @@ namespace
 
 		return "<unknown error value>";
 	}
+
+	// Checkpoints passed since the last flush, in deferred mode
+	bool gDeferred = false;
+	char const* gFirstFile = nullptr;
+	int gFirstLine = 0;
+	char const* gLastFile = nullptr;
+	int gLastLine = 0;
+	std::size_t gPending = 0;
 }
 
 namespace detail
 {
 	void check_gl_error( char const* aSourceFile, int aSourceLine )
 	{
+		if( gDeferred )
+		{
+			if( 0 == gPending++ )
+			{
+				gFirstFile = aSourceFile;
+				gFirstLine = aSourceLine;
+			}
+			gLastFile = aSourceFile;
+			gLastLine = aSourceLine;
+			return;
+		}
+
 		auto const res = glGetError();
 		if( GL_NO_ERROR != res )
 		{
 			throw Error( "(%s:%d) glGetError() returned %s (%d)", aSourceFile, aSourceLine, error_string_(res), res );
 		}
 	}
+
+	void flush_gl_errors( char const* aSourceFile, int aSourceLine )
+	{
+		if( !gDeferred || 0 == gPending )
+		{
+			gPending = 0;
+			auto const res = glGetError();
+			if( GL_NO_ERROR != res )
+				throw Error( "(%s:%d) glGetError() returned %s (%d)", aSourceFile, aSourceLine, error_string_(res), res );
+			return;
+		}
+
+		auto const pending = gPending;
+		gPending = 0;
+		auto const res = glGetError();
+		if( GL_NO_ERROR != res )
+		{
+			throw Error( "(%s:%d) glGetError() returned %s (%d), raised after the checkpoint at %s:%d (%zu deferred checkpoints, the last at %s:%d)",
+				aSourceFile, aSourceLine, error_string_(res), res, gFirstFile, gFirstLine, pending, gLastFile, gLastLine );
+		}
+	}
+
+	void set_deferred_gl_errors( bool aDeferred )
+	{
+		gDeferred = aDeferred;
+	}
+
+	bool deferred_gl_errors()
+	{
+		return gDeferred;
+	}
 }
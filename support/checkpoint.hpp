@@ -12,9 +12,23 @@
 #	define OGL_CHECKPOINT_DEBUG()   OGL_CHECKPOINT_ALWAYS()
 #endif
 
+// glGetError() synchronizes with the driver on many implementations. In
+// deferred mode (see set_deferred_gl_errors()), checkpoints only remember
+// where they are, and the errors are read once per frame by
+// OGL_CHECKPOINT_FLUSH(), which reports the checkpoints passed since the
+// last flush. Outside of deferred mode, the flush is a plain checkpoint.
+#define OGL_CHECKPOINT_FLUSH() do {                                 \
+		::detail::flush_gl_errors( __FILE__, __LINE__ );            \
+	} while(0)                                                      \
+	/*ENDM*/
+
 namespace detail
 {
 	void check_gl_error( char const*, int );
+	void flush_gl_errors( char const*, int );
+
+	void set_deferred_gl_errors( bool aDeferred );
+	bool deferred_gl_errors();
 }
 
 #endif // CHECKPOINT_HPP_3DFDA796_469C_4D37_B904_1C8D8FAE207B
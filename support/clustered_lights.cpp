@@ -0,0 +1,190 @@
+#include "clustered_lights.hpp"
+#include"program.hpp"
+#include"stream_buffer.hpp"
+#include<algorithm>
+#include<chrono>
+#include<cmath>
+
+ClusteredLights::ClusteredLights(uint32_t clustersX, uint32_t clustersY, uint32_t clustersZ) :
+	dimX(clustersX), dimY(clustersY), dimZ(clustersZ), fovY(0.f), aspect(0.f), zNear(0.f), zFar(0.f),
+	viewMat(kIdentity44f), tileWidth(1.f), tileHeight(1.f), stream(nullptr), maxLightsPerCluster(0), binningMs(0.0) {
+	if (dimX == 0 || dimY == 0 || dimZ == 0) throw Error("Invalid cluster grid %ux%ux%u\n", dimX, dimY, dimZ);
+	records.resize(static_cast<size_t>(dimX) * dimY * dimZ);
+}
+
+uint32_t ClusteredLights::sliceOf(float depth) const {
+	if (depth <= zNear) return 0;
+	float slice = std::log(depth / zNear) / std::log(zFar / zNear) * dimZ;
+	return std::min(static_cast<uint32_t>(slice), dimZ - 1);
+}
+
+void ClusteredLights::buildClusterBounds() {
+	clusterBounds.resize(records.size());
+	float tanY = std::tan(fovY * 0.5f);
+	float tanX = tanY * aspect;
+
+	for (uint32_t z = 0; z < dimZ; z++) {
+		//Exponential slices: depth of slice k is near * (far/near)^(k/dimZ)
+		float d0 = zNear * std::pow(zFar / zNear, static_cast<float>(z) / dimZ);
+		float d1 = zNear * std::pow(zFar / zNear, static_cast<float>(z + 1) / dimZ);
+		for (uint32_t y = 0; y < dimY; y++) {
+			float ny0 = -1.f + 2.f * y / dimY;
+			float ny1 = -1.f + 2.f * (y + 1) / dimY;
+			for (uint32_t x = 0; x < dimX; x++) {
+				float nx0 = -1.f + 2.f * x / dimX;
+				float nx1 = -1.f + 2.f * (x + 1) / dimX;
+
+				//The tile edges are planes through the eye, so the extremes are found at the near or far depth of the slice.
+				Aabb box{ { nx0 * tanX * d0, ny0 * tanY * d0, -d1 }, { nx0 * tanX * d0, ny0 * tanY * d0, -d0 } };
+				expand(box, { nx0 * tanX * d1, ny0 * tanY * d1, -d1 });
+				expand(box, { nx1 * tanX * d0, ny1 * tanY * d0, -d0 });
+				expand(box, { nx1 * tanX * d1, ny1 * tanY * d1, -d1 });
+				clusterBounds[(static_cast<size_t>(z) * dimY + y) * dimX + x] = box;
+			}
+		}
+	}
+}
+
+void ClusteredLights::binLight(const Vec3f& worldPos, float radius, std::vector<uint32_t>& hits, uint32_t lightIdx) {
+	Vec4f c4 = viewMat * Vec4f{ worldPos.x, worldPos.y, worldPos.z, 1.f };
+	Vec3f c{ c4.x, c4.y, c4.z };
+	float depth = -c.z;
+	if (depth + radius < zNear || depth - radius > zFar) return;
+
+	uint32_t z0 = sliceOf(depth - radius);
+	uint32_t z1 = sliceOf(depth + radius);
+
+	//Screen tile range: project the sphere's view space box at its nearest and farthest depth. Spheres reaching behind the
+	//near plane may cover any tile.
+	uint32_t x0 = 0, x1 = dimX - 1, y0 = 0, y1 = dimY - 1;
+	float dMin = depth - radius;
+	if (dMin > zNear) {
+		float dMax = depth + radius;
+		float tanY = std::tan(fovY * 0.5f);
+		float tanX = tanY * aspect;
+		float nxMin = std::min((c.x - radius) / (tanX * dMin), (c.x - radius) / (tanX * dMax));
+		float nxMax = std::max((c.x + radius) / (tanX * dMin), (c.x + radius) / (tanX * dMax));
+		float nyMin = std::min((c.y - radius) / (tanY * dMin), (c.y - radius) / (tanY * dMax));
+		float nyMax = std::max((c.y + radius) / (tanY * dMin), (c.y + radius) / (tanY * dMax));
+		if (nxMax < -1.f || nxMin > 1.f || nyMax < -1.f || nyMin > 1.f) return;
+
+		auto tile = [](float ndc, uint32_t dim) {
+			float t = (ndc * 0.5f + 0.5f) * dim;
+			return static_cast<uint32_t>(std::min(std::max(t, 0.f), static_cast<float>(dim - 1)));
+		};
+		x0 = tile(nxMin, dimX);
+		x1 = tile(nxMax, dimX);
+		y0 = tile(nyMin, dimY);
+		y1 = tile(nyMax, dimY);
+	}
+
+	float r2 = radius * radius;
+	for (uint32_t z = z0; z <= z1; z++) {
+		for (uint32_t y = y0; y <= y1; y++) {
+			for (uint32_t x = x0; x <= x1; x++) {
+				uint32_t cluster = (z * dimY + y) * dimX + x;
+				if (distance_squared(clusterBounds[cluster], c) > r2) continue;
+				hits.push_back(cluster);
+				hits.push_back(lightIdx);
+			}
+		}
+	}
+}
+
+void ClusteredLights::update(const LightManager& lights, const Mat44f& viewMatrix, float fovYRad, float aspectRatio,
+	float nearPlane, float farPlane, int fbWidth, int fbHeight) {
+	auto start = std::chrono::steady_clock::now();
+
+	if (fovYRad != fovY || aspectRatio != aspect || nearPlane != zNear || farPlane != zFar) {
+		fovY = fovYRad;
+		aspect = aspectRatio;
+		zNear = nearPlane;
+		zFar = farPlane;
+		buildClusterBounds();
+	}
+	viewMat = viewMatrix;
+	tileWidth = static_cast<float>(std::max(fbWidth, 1)) / dimX;
+	tileHeight = static_cast<float>(std::max(fbHeight, 1)) / dimY;
+
+	const auto& pointLights = lights.getPointLights();
+	const auto& spotLights = lights.getSpotLights();
+
+	pointHits.clear();
+	spotHits.clear();
+	for (size_t i = 0; i < pointLights.size(); i++)
+		binLight(pointLights[i].pos, pointLights[i].rMax, pointHits, static_cast<uint32_t>(i));
+	//Spot lights are binned by the sphere around their full range, which is conservative for narrow cones.
+	for (size_t i = 0; i < spotLights.size(); i++)
+		binLight(spotLights[i].pos, spotLights[i].rMax, spotHits, static_cast<uint32_t>(i));
+
+	//Counting sort of the hits by cluster: count, prefix sum, then scatter.
+	for (auto& record : records) record = ClusterRecord{ 0, 0, 0, 0 };
+	for (size_t i = 0; i < pointHits.size(); i += 2) records[pointHits[i]].numPointLights++;
+	for (size_t i = 0; i < spotHits.size(); i += 2) records[spotHits[i]].numSpotLights++;
+
+	uint32_t offset = 0;
+	maxLightsPerCluster = 0;
+	for (auto& record : records) {
+		record.offset = offset;
+		offset += record.numPointLights + record.numSpotLights;
+		maxLightsPerCluster = std::max(maxLightsPerCluster, static_cast<size_t>(record.numPointLights + record.numSpotLights));
+		record.padding = record.offset + record.numPointLights;//used as the spot write cursor below
+		record.numPointLights = 0;
+	}
+
+	indices.resize(offset);
+	for (size_t i = 0; i < pointHits.size(); i += 2) {
+		ClusterRecord& record = records[pointHits[i]];
+		indices[record.offset + record.numPointLights++] = pointHits[i + 1];
+	}
+	for (size_t i = 0; i < spotHits.size(); i += 2)
+		indices[records[spotHits[i]].padding++] = spotHits[i + 1];
+
+	binningMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	//Upload. Empty lists still get a small buffer, so the bindings are always valid.
+	upload(pointBuffer, pointLights.data(), pointLights.size() * sizeof(LightManager::PointLightInternal), BINDING_STORAGE_CLUSTER_POINT_LIGHTS);
+	upload(spotBuffer, spotLights.data(), spotLights.size() * sizeof(LightManager::SpotLightInternal), BINDING_STORAGE_CLUSTER_SPOT_LIGHTS);
+	upload(recordBuffer, records.data(), records.size() * sizeof(ClusterRecord), BINDING_STORAGE_CLUSTER_RECORDS);
+	upload(indexBuffer, indices.data(), indices.size() * sizeof(uint32_t), BINDING_STORAGE_CLUSTER_INDICES);
+}
+
+void ClusteredLights::upload(std::unique_ptr<Buffer>& buffer, const void* data, size_t size, int binding) {
+	if (stream) {
+		stream->uploadStorage(data, size).bindToStorage(binding);
+		return;
+	}
+	uploadResizable(buffer, data, size);
+	buffer->bindToStorage(binding, 0, buffer->getSize());
+}
+
+void ClusteredLights::setStreamBuffer(StreamBuffer* streamBuffer) {
+	stream = streamBuffer;
+}
+
+void ClusteredLights::setUniforms(const ShaderProgram& program) const {
+	GLuint progId = program.programId();
+	float logRatio = std::log(zFar / zNear);
+	glProgramUniformMatrix4fv(progId, LOCATION_UNIFORM_CLUSTER_VIEW, 1, GL_TRUE, viewMat.v);
+	glProgramUniform3ui(progId, LOCATION_UNIFORM_CLUSTER_DIMS, dimX, dimY, dimZ);
+	glProgramUniform2f(progId, LOCATION_UNIFORM_CLUSTER_TILE_SIZE, tileWidth, tileHeight);
+	//slice = log(depth) * scale + bias, see sliceOf()
+	float slices = static_cast<float>(dimZ);
+	glProgramUniform2f(progId, LOCATION_UNIFORM_CLUSTER_SLICE_PARAMS, slices / logRatio, -slices * std::log(zNear) / logRatio);
+}
+
+size_t ClusteredLights::getNumClusters() const {
+	return records.size();
+}
+
+size_t ClusteredLights::getNumIndices() const {
+	return indices.size();
+}
+
+size_t ClusteredLights::getMaxLightsPerCluster() const {
+	return maxLightsPerCluster;
+}
+
+double ClusteredLights::getBinningMs() const {
+	return binningMs;
+}
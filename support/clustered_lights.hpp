@@ -0,0 +1,95 @@
+#pragma once
+#include<glad.h>
+#include<cstdint>
+#include<memory>
+#include<vector>
+#include"buffer.hpp"
+#include"lights.hpp"
+#include"../vmlib/mat44.hpp"
+#include"../vmlib/bounds.hpp"
+
+class ShaderProgram;
+class StreamBuffer;
+
+//Shader storage binding points of the clustered light data (must match assets/cookTorranceClustered.frag).
+constexpr const int BINDING_STORAGE_CLUSTER_POINT_LIGHTS = 3;
+constexpr const int BINDING_STORAGE_CLUSTER_SPOT_LIGHTS = 4;
+constexpr const int BINDING_STORAGE_CLUSTER_RECORDS = 5;
+constexpr const int BINDING_STORAGE_CLUSTER_INDICES = 6;
+
+//Uniform locations of the cluster grid parameters in assets/cookTorranceClustered.frag.
+constexpr const int LOCATION_UNIFORM_CLUSTER_VIEW = 10;
+constexpr const int LOCATION_UNIFORM_CLUSTER_DIMS = 11;
+constexpr const int LOCATION_UNIFORM_CLUSTER_TILE_SIZE = 12;
+constexpr const int LOCATION_UNIFORM_CLUSTER_SLICE_PARAMS = 13;
+
+/*
+* Clustered forward lighting.
+* The view frustum is split into a grid of clusters ("froxels"): dimX x dimY screen tiles and dimZ depth slices, spaced
+* exponentially between the near and far planes so that clusters stay roughly cubic. Every frame, each point and spot light of
+* the LightManager is binned on the CPU into the clusters its bounding sphere overlaps. The fragment shader then finds its
+* cluster from gl_FragCoord and its view depth, and only loops over that cluster's lights.
+*
+* GPU data (shader storage buffers, grown by doubling as required):
+*  - all point and spot lights, in the LightManager layout;
+*  - one record per cluster: offset into the index list, number of point lights, number of spot lights;
+*  - the index list: for each cluster, its point light indices followed by its spot light indices.
+*/
+class ClusteredLights {
+private:
+	struct ClusterRecord {
+		uint32_t offset;
+		uint32_t numPointLights;
+		uint32_t numSpotLights;
+		uint32_t padding;
+	};
+
+	uint32_t dimX, dimY, dimZ;
+	float fovY, aspect, zNear, zFar;
+	std::vector<Aabb> clusterBounds;//view space bounds of each cluster, rebuilt when the projection changes
+
+	std::vector<ClusterRecord> records;
+	std::vector<uint32_t> indices;
+	std::vector<uint32_t> pointHits, spotHits;//(cluster, light) pairs, flattened
+	Mat44f viewMat;
+	float tileWidth, tileHeight;
+
+	std::unique_ptr<Buffer> pointBuffer, spotBuffer, recordBuffer, indexBuffer;
+	StreamBuffer* stream;//if set, the data is uploaded to it instead of the buffers above
+
+	size_t maxLightsPerCluster;
+	double binningMs;
+
+	void buildClusterBounds();
+	uint32_t sliceOf(float depth) const;
+	void binLight(const Vec3f& worldPos, float radius, std::vector<uint32_t>& hits, uint32_t lightIdx);
+
+	//Upload data to the stream buffer, or to a storage buffer (see uploadResizable), and bind it.
+	void upload(std::unique_ptr<Buffer>& buffer, const void* data, size_t size, int binding);
+
+public:
+	//Input:
+	// - clustersX, clustersY: number of screen tiles;
+	// - clustersZ: number of depth slices.
+	ClusteredLights(uint32_t clustersX = 16, uint32_t clustersY = 9, uint32_t clustersZ = 24);
+
+	//Bin the lights for the given camera and upload the results.
+	//Input:
+	// - lights: the light manager holding all lights;
+	// - viewMatrix: world to camera matrix;
+	// - fovYRad, aspectRatio, nearPlane, farPlane: parameters of the perspective projection;
+	// - fbWidth, fbHeight: framebuffer size in pixels.
+	void update(const LightManager& lights, const Mat44f& viewMatrix, float fovYRad, float aspectRatio, float nearPlane, float farPlane,
+		int fbWidth, int fbHeight);
+
+	//Upload the light data of update() to the region of the current frame of a stream buffer (nullptr: own buffers).
+	void setStreamBuffer(StreamBuffer* streamBuffer);
+
+	//Set the grid uniforms of a clustered program. Call after update().
+	void setUniforms(const ShaderProgram& program) const;
+
+	size_t getNumClusters() const;
+	size_t getNumIndices() const;
+	size_t getMaxLightsPerCluster() const;
+	double getBinningMs() const;//CPU time of the last update()
+};
@@ -0,0 +1,166 @@
+#include "cpu_profiler.hpp"
+
+#if CPU_PROFILER
+#include<algorithm>
+#include<atomic>
+#include<chrono>
+#include<cstdint>
+#include<fstream>
+#include<memory>
+#include<mutex>
+#include<vector>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#if defined(_MSC_VER)
+#include<intrin.h>
+#else
+#include<x86intrin.h>
+#endif
+#define CPU_PROFILER_RDTSC 1
+#endif
+
+namespace {
+	using Ticks = std::uint64_t;
+
+	Ticks readTicks() {
+#if defined(CPU_PROFILER_RDTSC)
+		return __rdtsc();
+#else
+		return static_cast<Ticks>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+	}
+
+	struct Event {
+		const char* name;
+		Ticks begin, end;
+	};
+
+	//Written by its thread only, read by writeChromeTrace().
+	struct ThreadRing {
+		Event events[CpuProfiler::RING_SIZE];
+		std::atomic<std::uint64_t> written{ 0 };//number of events recorded so far; event i is at i % RING_SIZE
+		const char* openNames[CpuProfiler::MAX_DEPTH];
+		Ticks openBegins[CpuProfiler::MAX_DEPTH];
+		int depth = 0;
+		int tid = 0;
+		std::string name;
+	};
+
+	//All rings ever created. Rings outlive their threads, so that their zones can still be written.
+	struct Registry {
+		std::mutex mutex;
+		std::vector<std::unique_ptr<ThreadRing>> rings;
+		//Reference point of the tick to time conversion
+		Ticks startTicks = readTicks();
+		std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+		std::atomic<Ticks> captureStart{ 0 };
+	};
+
+	Registry& registry() {
+		static Registry instance;
+		return instance;
+	}
+
+	thread_local ThreadRing* threadRing = nullptr;
+
+	ThreadRing& currentRing() {
+		if (!threadRing) {
+			Registry& reg = registry();
+			std::lock_guard<std::mutex> lock(reg.mutex);
+			reg.rings.push_back(std::make_unique<ThreadRing>());
+			threadRing = reg.rings.back().get();
+			threadRing->tid = static_cast<int>(reg.rings.size());
+			threadRing->name = "Thread " + std::to_string(threadRing->tid);
+		}
+		return *threadRing;
+	}
+
+	void writeJsonString(std::ofstream& out, const char* text) {
+		out << '"';
+		for (const char* c = text; *c; c++) {
+			if (*c == '"' || *c == '\\') out << '\\';
+			out << *c;
+		}
+		out << '"';
+	}
+}
+
+void CpuProfiler::begin(const char* name) {
+	ThreadRing& ring = currentRing();
+	if (ring.depth < MAX_DEPTH) {
+		ring.openNames[ring.depth] = name;
+		ring.openBegins[ring.depth] = readTicks();
+	}
+	ring.depth++;
+}
+
+void CpuProfiler::end() {
+	Ticks now = readTicks();
+	ThreadRing& ring = currentRing();
+	if (ring.depth == 0) return;
+	ring.depth--;
+	if (ring.depth >= MAX_DEPTH) return;
+
+	std::uint64_t index = ring.written.load(std::memory_order_relaxed);
+	ring.events[index % RING_SIZE] = Event{ ring.openNames[ring.depth], ring.openBegins[ring.depth], now };
+	ring.written.store(index + 1, std::memory_order_release);
+}
+
+void CpuProfiler::setThreadName(const char* name) {
+	ThreadRing& ring = currentRing();
+	std::lock_guard<std::mutex> lock(registry().mutex);
+	ring.name = name;
+}
+
+void CpuProfiler::startCapture() {
+	registry().captureStart.store(readTicks(), std::memory_order_relaxed);
+}
+
+bool CpuProfiler::writeChromeTrace(const std::string& path) {
+	std::ofstream out(path, std::ios::out | std::ios::trunc);
+	if (!out.is_open()) return false;
+
+	Registry& reg = registry();
+	std::lock_guard<std::mutex> lock(reg.mutex);
+
+	//Ticks per microsecond, measured over the lifetime of the profiler
+	double elapsedUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - reg.startTime).count();
+	Ticks elapsedTicks = readTicks() - reg.startTicks;
+	double ticksPerUs = elapsedUs > 0.0 && elapsedTicks > 0 ? static_cast<double>(elapsedTicks) / elapsedUs : 1000.0;
+	Ticks captureStart = reg.captureStart.load(std::memory_order_relaxed);
+
+	out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+	bool first = true;
+	std::vector<Event> events;
+	for (const auto& ring : reg.rings) {
+		out << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << ring->tid << ",\"args\":{\"name\":";
+		writeJsonString(out, ring->name.c_str());
+		out << "}}";
+		first = false;
+
+		//The owning thread keeps writing: copy the newest RING_SIZE events, then drop the ones it overwrote meanwhile
+		std::uint64_t end = ring->written.load(std::memory_order_acquire);
+		std::uint64_t begin = end > RING_SIZE ? end - RING_SIZE : 0;
+		events.clear();
+		for (std::uint64_t i = begin; i < end; i++)
+			events.push_back(ring->events[i % RING_SIZE]);
+		std::uint64_t after = ring->written.load(std::memory_order_acquire);
+		//With a full ring, the zone being written when the copy ended may be torn as well
+		std::uint64_t overwritten = after - end + (end >= RING_SIZE ? 1 : 0);
+		size_t skip = static_cast<size_t>(std::min<std::uint64_t>(overwritten, events.size()));
+
+		for (size_t i = skip; i < events.size(); i++) {
+			const Event& e = events[i];
+			if (e.begin < captureStart) continue;
+			out << ",\n{\"name\":";
+			writeJsonString(out, e.name);
+			out << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << ring->tid
+				<< ",\"ts\":" << static_cast<double>(e.begin - reg.startTicks) / ticksPerUs
+				<< ",\"dur\":" << static_cast<double>(e.end - e.begin) / ticksPerUs << "}";
+		}
+	}
+	out << "\n]}\n";
+	return out.good();
+}
+#endif
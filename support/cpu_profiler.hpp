@@ -0,0 +1,66 @@
+#pragma once
+
+//CPU_PROFILER is defined to 1 by premake in debug builds, and in release builds with --cpu-profiler. Otherwise the zone macros
+//expand to nothing and the profiler is not compiled at all.
+#ifndef CPU_PROFILER
+#define CPU_PROFILER 0
+#endif
+
+#define CPU_PROFILER_CONCAT_(a, b) a##b
+#define CPU_PROFILER_CONCAT(a, b) CPU_PROFILER_CONCAT_(a, b)
+
+#if CPU_PROFILER
+//Zone from here to the end of the enclosing scope. The name must be a string literal ("" name does not compile otherwise).
+#define CPU_ZONE(name) CpuProfiler::Zone CPU_PROFILER_CONCAT(cpuZone_, __LINE__)("" name)
+//Zone between two points of the same scope, for code whose variables are used after it.
+#define CPU_ZONE_BEGIN(name) CpuProfiler::begin("" name)
+#define CPU_ZONE_END() CpuProfiler::end()
+//Name of the calling thread in the trace.
+#define CPU_THREAD_NAME(name) CpuProfiler::setThreadName("" name)
+#else
+#define CPU_ZONE(name) ((void)0)
+#define CPU_ZONE_BEGIN(name) ((void)0)
+#define CPU_ZONE_END() ((void)0)
+#define CPU_THREAD_NAME(name) ((void)0)
+#endif
+
+#if CPU_PROFILER
+#include<string>
+
+/*
+* Instrumenting CPU profiler.
+* Each thread records its zones into its own ring buffer of the last RING_SIZE zones, so recording takes no lock: only the
+* owning thread writes a ring, and it publishes each zone by advancing an atomic counter. writeChromeTrace() copies the rings
+* while they are being written, and leaves out the zones that were overwritten during the copy.
+* Timestamps are read with rdtsc on x86-64 (converted to time with the rate measured against the steady clock), and from the
+* steady clock elsewhere.
+*
+* The trace is written in the Chrome trace event format, to be opened in chrome://tracing or https://ui.perfetto.dev.
+* Zones are given with the CPU_ZONE macros, so that they disappear with the profiler.
+*/
+class CpuProfiler {
+public:
+	static const size_t RING_SIZE = 1 << 16;//zones kept per thread, a power of two
+	static const int MAX_DEPTH = 64;//deeper zones are not recorded
+
+	class Zone {
+	public:
+		explicit Zone(const char* name) { begin(name); }
+		~Zone() { end(); }
+
+		Zone(const Zone&) = delete;
+		Zone& operator=(const Zone&) = delete;
+	};
+
+	static void begin(const char* name);
+	static void end();
+	static void setThreadName(const char* name);
+
+	//Only zones starting after the last call are written to the next trace.
+	static void startCapture();
+
+	//Write the zones held by the rings of all threads (started since startCapture()) as Chrome trace JSON.
+	//Returns false if the file cannot be written.
+	static bool writeChromeTrace(const std::string& path);
+};
+#endif
@@ -0,0 +1,41 @@
+#include "culling.hpp"
+
+FrustumCuller::FrustumCuller(size_t capacityHint) : frustum{} {
+	centers.reserve(capacityHint);
+	radius.reserve(capacityHint);
+	visible.reserve(capacityHint);
+}
+
+void FrustumCuller::begin(const Mat44f& viewProjMat) {
+	frustum = make_frustum(viewProjMat);
+	centers.clear();
+	radius.clear();
+	visible.clear();
+}
+
+size_t FrustumCuller::add(const Sphere& worldSphere) {
+	centers.push_back(worldSphere.center);
+	radius.push_back(worldSphere.radius);
+	return radius.size() - 1;
+}
+
+size_t FrustumCuller::cull() {
+	visible.resize(radius.size());
+	intersects_batch(frustum, centers, radius.data(), visible.data());
+
+	size_t numCulled = 0;
+	for (std::uint8_t v : visible) numCulled += v ? 0 : 1;
+	return numCulled;
+}
+
+bool FrustumCuller::isVisible(size_t idx) const {
+	return idx < visible.size() && visible[idx] != 0;
+}
+
+size_t FrustumCuller::size() const {
+	return radius.size();
+}
+
+const Frustum& FrustumCuller::getFrustum() const {
+	return frustum;
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include<cstdint>
+#include<vector>
+#include"../vmlib/mat44.hpp"
+#include"../vmlib/bounds.hpp"
+#include"../vmlib/frustum.hpp"
+#include"../vmlib/soa.hpp"
+
+//Per-frame culling counters.
+struct CullStats {
+	size_t objectsTested;
+	size_t objectsCulled;//outside of the frustum
+	size_t objectsOccluded;//hidden behind other geometry
+	size_t trianglesSubmitted;
+	size_t trianglesCulled;
+};
+
+/*
+* CPU frustum culling of whole objects.
+* Each frame, the world-space bounding spheres of the objects are collected with add(), then tested all at once with cull().
+* Spheres are kept as a structure of arrays (centres and radii), so that the test runs on 8 (AVX) or 4 (SSE) spheres per iteration
+* (see intersects_batch in vmlib/frustum.hpp).
+*/
+class FrustumCuller {
+private:
+	Frustum frustum;
+	Vec3fSoa centers;
+	std::vector<float> radius;
+	std::vector<std::uint8_t> visible;
+
+public:
+	//Input:
+	// - capacityHint: expected number of objects per frame, so an early allocation can be made.
+	FrustumCuller(size_t capacityHint = 32);
+
+	//Start a new frame: extract the frustum of the view-projection matrix and forget the previous objects.
+	void begin(const Mat44f& viewProjMat);
+
+	//Add an object given by its world-space bounding sphere. Returns the index used to query the result.
+	size_t add(const Sphere& worldSphere);
+
+	//Test all objects added since begin(). Returns the number of culled objects.
+	size_t cull();
+
+	//Result of the last cull() for the object.
+	bool isVisible(size_t idx) const;
+
+	size_t size() const;
+	const Frustum& getFrustum() const;
+};
@@ -0,0 +1,235 @@
+#include "deferred.hpp"
+#include"program.hpp"
+#include"stream_buffer.hpp"
+#include<cmath>
+
+namespace {
+	//Uniform locations shared by the lighting passes (assets/deferredAmbient.frag, assets/deferredLightVolume.*)
+	constexpr GLint LOCATION_DEFERRED_INV_VIEW_PROJ = 0;
+	constexpr GLint LOCATION_DEFERRED_VIEW_PROJ = 2;
+	constexpr GLint LOCATION_DEFERRED_CAM_POS = 3;
+	constexpr GLint LOCATION_DEFERRED_SCREEN_SIZE = 5;
+	constexpr GLint LOCATION_DEFERRED_LIGHT_TYPE = 6;
+
+	constexpr GLint TEXTURE_UNIT_DEFERRED_RADIANCE = 0;//assets/deferredResolve.frag
+
+	//A unit icosahedron is not a bounding volume of the unit sphere: its faces are only 0.7947 away from the centre.
+	//Scaling it by the inverse makes the faces touch the sphere, so the volume covers the whole light range.
+	constexpr float ICOSAHEDRON_SPHERE_SCALE = 1.2584f;
+
+	GLuint createTarget(GLenum format, int width, int height) {
+		GLuint tex = 0;
+		glCreateTextures(GL_TEXTURE_2D, 1, &tex);
+		glTextureStorage2D(tex, 1, format, width, height);
+		glTextureParameteri(tex, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTextureParameteri(tex, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTextureParameteri(tex, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTextureParameteri(tex, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		return tex;
+	}
+
+	void checkFramebuffer(GLuint fbo, const char* name) {
+		GLenum status = glCheckNamedFramebufferStatus(fbo, GL_FRAMEBUFFER);
+		if (status != GL_FRAMEBUFFER_COMPLETE) throw Error("Deferred %s framebuffer is incomplete (status 0x%x)\n", name, status);
+	}
+}
+
+DeferredRenderer::DeferredRenderer(ShaderProgram* ambientProg, ShaderProgram* lightVolumeProg, ShaderProgram* resolveProg) :
+	ambientProgram(ambientProg), lightVolumeProgram(lightVolumeProg), resolveProgram(resolveProg), width(0), height(0),
+	albedoTex(0), normalTex(0), materialTex(0), emissiveTex(0), depthTex(0), depthCopyTex(0), radianceTex(0), outputTex(0),
+	gBufferFbo(0), radianceFbo(0), outputFbo(0), volumeIndexCount(0), pointBuffer(nullptr), spotBuffer(nullptr),
+	stream(nullptr), numLightVolumes(0), background{ 0.f, 0.f, 0.f } {
+	const float t = (1.f + std::sqrt(5.f)) * 0.5f;
+	const float s = ICOSAHEDRON_SPHERE_SCALE / std::sqrt(1.f + t * t);
+	const Vec3f vertices[12] = {
+		{ -s, t * s, 0.f }, { s, t * s, 0.f }, { -s, -t * s, 0.f }, { s, -t * s, 0.f },
+		{ 0.f, -s, t * s }, { 0.f, s, t * s }, { 0.f, -s, -t * s }, { 0.f, s, -t * s },
+		{ t * s, 0.f, -s }, { t * s, 0.f, s }, { -t * s, 0.f, -s }, { -t * s, 0.f, s },
+	};
+	const GLuint indices[60] = {
+		0, 11, 5, 0, 5, 1, 0, 1, 7, 0, 7, 10, 0, 10, 11,
+		1, 5, 9, 5, 11, 4, 11, 10, 2, 10, 7, 6, 7, 1, 8,
+		3, 9, 4, 3, 4, 2, 3, 2, 6, 3, 6, 8, 3, 8, 9,
+		4, 9, 5, 2, 4, 11, 6, 2, 10, 8, 6, 7, 9, 8, 1,
+	};
+	volumeIndexCount = 60;
+	volumeVertices.init(sizeof(vertices), vertices);
+	volumeIndices.init(sizeof(indices), indices);
+	volumeVao.addAttribF(0, 3, 0);
+	volumeVertices.bindToAttrib(volumeVao, 0, 0, sizeof(Vec3f));
+	volumeIndices.bindAsElementBuf(volumeVao);
+}
+
+DeferredRenderer::~DeferredRenderer() {
+	release();
+}
+
+void DeferredRenderer::release() {
+	GLuint fbos[] = { gBufferFbo, radianceFbo, outputFbo };
+	GLuint textures[] = { albedoTex, normalTex, materialTex, emissiveTex, depthTex, depthCopyTex, radianceTex, outputTex };
+	if (gBufferFbo) glDeleteFramebuffers(3, fbos);
+	if (albedoTex) glDeleteTextures(8, textures);
+	gBufferFbo = radianceFbo = outputFbo = 0;
+	albedoTex = normalTex = materialTex = emissiveTex = depthTex = depthCopyTex = radianceTex = outputTex = 0;
+	width = height = 0;
+}
+
+void DeferredRenderer::resize(int newWidth, int newHeight) {
+	release();
+	width = newWidth;
+	height = newHeight;
+
+	albedoTex = createTarget(GL_RGBA8, width, height);
+	normalTex = createTarget(GL_RGBA16F, width, height);
+	materialTex = createTarget(GL_RGBA8, width, height);
+	emissiveTex = createTarget(GL_RGBA16F, width, height);
+	depthTex = createTarget(GL_DEPTH_COMPONENT32F, width, height);
+	depthCopyTex = createTarget(GL_DEPTH_COMPONENT32F, width, height);
+	radianceTex = createTarget(GL_RGBA16F, width, height);
+	outputTex = createTarget(GL_RGBA8, width, height);
+
+	glCreateFramebuffers(1, &gBufferFbo);
+	glNamedFramebufferTexture(gBufferFbo, GL_COLOR_ATTACHMENT0, albedoTex, 0);
+	glNamedFramebufferTexture(gBufferFbo, GL_COLOR_ATTACHMENT1, normalTex, 0);
+	glNamedFramebufferTexture(gBufferFbo, GL_COLOR_ATTACHMENT2, materialTex, 0);
+	glNamedFramebufferTexture(gBufferFbo, GL_COLOR_ATTACHMENT3, emissiveTex, 0);
+	glNamedFramebufferTexture(gBufferFbo, GL_DEPTH_ATTACHMENT, depthTex, 0);
+	const GLenum drawBuffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2, GL_COLOR_ATTACHMENT3 };
+	glNamedFramebufferDrawBuffers(gBufferFbo, 4, drawBuffers);
+	checkFramebuffer(gBufferFbo, "G-buffer");
+
+	glCreateFramebuffers(1, &radianceFbo);
+	glNamedFramebufferTexture(radianceFbo, GL_COLOR_ATTACHMENT0, radianceTex, 0);
+	glNamedFramebufferTexture(radianceFbo, GL_DEPTH_ATTACHMENT, depthTex, 0);
+	checkFramebuffer(radianceFbo, "radiance");
+
+	glCreateFramebuffers(1, &outputFbo);
+	glNamedFramebufferTexture(outputFbo, GL_COLOR_ATTACHMENT0, outputTex, 0);
+	glNamedFramebufferTexture(outputFbo, GL_DEPTH_ATTACHMENT, depthTex, 0);
+	checkFramebuffer(outputFbo, "output");
+}
+
+void DeferredRenderer::setStreamBuffer(StreamBuffer* streamBuffer) {
+	stream = streamBuffer;
+}
+
+void DeferredRenderer::setBackground(const Vec3f& color) {
+	//The accumulated radiance is gamma corrected by the resolve pass, so store the colour the resolve turns back into this one
+	background = Vec3f{ std::pow(color.x, 2.2f), std::pow(color.y, 2.2f), std::pow(color.z, 2.2f) };
+}
+
+void DeferredRenderer::beginGeometryPass(int fbWidth, int fbHeight) {
+	if (fbWidth != width || fbHeight != height) resize(fbWidth, fbHeight);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, gBufferFbo);
+	//The G-buffer alpha channels hold data, so nothing may be blended into them
+	glDisable(GL_BLEND);
+
+	const float zero[4] = { 0.f, 0.f, 0.f, 0.f };
+	const float one = 1.f;
+	for (GLint i = 0; i < 4; i++) glClearNamedFramebufferfv(gBufferFbo, GL_COLOR, i, zero);
+	glClearNamedFramebufferfv(gBufferFbo, GL_DEPTH, 0, &one);
+}
+
+void DeferredRenderer::lightingPass(const LightManager& lights, const Mat44f& viewProjMat, const Vec3f& camPos) {
+	//The light volumes depth test against depthTex while the shaders read the depth, so they read a copy instead
+	glCopyImageSubData(depthTex, GL_TEXTURE_2D, 0, 0, 0, 0, depthCopyTex, GL_TEXTURE_2D, 0, 0, 0, 0, width, height, 1);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, radianceFbo);
+	const float clear[4] = { background.x, background.y, background.z, 1.f };
+	glClearNamedFramebufferfv(radianceFbo, GL_COLOR, 0, clear);
+
+	glBindTextureUnit(TEXTURE_UNIT_GBUFFER_ALBEDO, albedoTex);
+	glBindTextureUnit(TEXTURE_UNIT_GBUFFER_NORMAL, normalTex);
+	glBindTextureUnit(TEXTURE_UNIT_GBUFFER_MATERIAL, materialTex);
+	glBindTextureUnit(TEXTURE_UNIT_GBUFFER_EMISSIVE, emissiveTex);
+	glBindTextureUnit(TEXTURE_UNIT_GBUFFER_DEPTH, depthCopyTex);
+
+	Mat44f invViewProj = invert(viewProjMat);
+
+	//Ambient, emitted and directional light, for every pixel
+	GLuint ambientId = ambientProgram->programId();
+	glUseProgram(ambientId);
+	glProgramUniformMatrix4fv(ambientId, LOCATION_DEFERRED_INV_VIEW_PROJ, 1, GL_TRUE, invViewProj.v);
+	glProgramUniform3f(ambientId, LOCATION_DEFERRED_CAM_POS, camPos.x, camPos.y, camPos.z);
+	glDisable(GL_DEPTH_TEST);
+	glDepthMask(GL_FALSE);
+	emptyVao.bind();
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+
+	//Point and spot lights, added on top
+	const auto& pointLights = lights.getPointLights();
+	const auto& spotLights = lights.getSpotLights();
+	numLightVolumes = pointLights.size() + spotLights.size();
+	if (numLightVolumes > 0) {
+		size_t pointSize = pointLights.size() * sizeof(LightManager::PointLightInternal);
+		size_t spotSize = spotLights.size() * sizeof(LightManager::SpotLightInternal);
+		if (stream) {
+			stream->uploadStorage(pointLights.data(), pointSize).bindToStorage(BINDING_STORAGE_DEFERRED_POINT_LIGHTS);
+			stream->uploadStorage(spotLights.data(), spotSize).bindToStorage(BINDING_STORAGE_DEFERRED_SPOT_LIGHTS);
+		}
+		else {
+			uploadResizable(pointBuffer, pointLights.data(), pointSize);
+			uploadResizable(spotBuffer, spotLights.data(), spotSize);
+			pointBuffer->bindToStorage(BINDING_STORAGE_DEFERRED_POINT_LIGHTS, 0, pointBuffer->getSize());
+			spotBuffer->bindToStorage(BINDING_STORAGE_DEFERRED_SPOT_LIGHTS, 0, spotBuffer->getSize());
+		}
+
+		GLuint volumeId = lightVolumeProgram->programId();
+		glUseProgram(volumeId);
+		glProgramUniformMatrix4fv(volumeId, LOCATION_DEFERRED_INV_VIEW_PROJ, 1, GL_TRUE, invViewProj.v);
+		glProgramUniformMatrix4fv(volumeId, LOCATION_DEFERRED_VIEW_PROJ, 1, GL_TRUE, viewProjMat.v);
+		glProgramUniform3f(volumeId, LOCATION_DEFERRED_CAM_POS, camPos.x, camPos.y, camPos.z);
+		glProgramUniform2f(volumeId, LOCATION_DEFERRED_SCREEN_SIZE, static_cast<float>(width), static_cast<float>(height));
+
+		//Back faces still cover the pixels when the camera is inside a volume. A pixel is lit if its surface lies in front of
+		//the back of the volume; the distance test in the shader rejects the surfaces in front of the volume.
+		glEnable(GL_DEPTH_TEST);
+		glDepthFunc(GL_GEQUAL);
+		glCullFace(GL_FRONT);
+		glEnable(GL_DEPTH_CLAMP);
+		glEnable(GL_BLEND);
+		glBlendFunc(GL_ONE, GL_ONE);
+
+		volumeVao.bind();
+		if (!pointLights.empty()) {
+			glProgramUniform1i(volumeId, LOCATION_DEFERRED_LIGHT_TYPE, 0);
+			glDrawElementsInstanced(GL_TRIANGLES, volumeIndexCount, GL_UNSIGNED_INT, nullptr, static_cast<GLsizei>(pointLights.size()));
+		}
+		if (!spotLights.empty()) {
+			glProgramUniform1i(volumeId, LOCATION_DEFERRED_LIGHT_TYPE, 1);
+			glDrawElementsInstanced(GL_TRIANGLES, volumeIndexCount, GL_UNSIGNED_INT, nullptr, static_cast<GLsizei>(spotLights.size()));
+		}
+
+		glDisable(GL_DEPTH_CLAMP);
+		glCullFace(GL_BACK);
+		glDepthFunc(GL_LESS);
+		glDisable(GL_BLEND);
+		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	}
+	glEnable(GL_DEPTH_TEST);
+	glDepthMask(GL_TRUE);
+}
+
+void DeferredRenderer::resolve() {
+	glBindFramebuffer(GL_FRAMEBUFFER, outputFbo);
+	glDisable(GL_DEPTH_TEST);
+	glDisable(GL_BLEND);
+
+	glUseProgram(resolveProgram->programId());
+	glBindTextureUnit(TEXTURE_UNIT_DEFERRED_RADIANCE, radianceTex);
+	emptyVao.bind();
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+
+	glEnable(GL_DEPTH_TEST);
+	glEnable(GL_BLEND);
+}
+
+void DeferredRenderer::present(GLuint target) {
+	glBlitNamedFramebuffer(outputFbo, target, 0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_FRAMEBUFFER, target);
+}
+
+size_t DeferredRenderer::getNumLightVolumes() const {
+	return numLightVolumes;
+}
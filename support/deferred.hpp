@@ -0,0 +1,109 @@
+#pragma once
+#include<glad.h>
+#include<memory>
+#include"buffer.hpp"
+#include"vao.hpp"
+#include"lights.hpp"
+#include"../vmlib/vec3.hpp"
+#include"../vmlib/mat44.hpp"
+
+class ShaderProgram;
+class StreamBuffer;
+
+//Texture units the G-buffer is read from in the lighting passes (must match assets/deferredAmbient.frag and
+//assets/deferredLightVolume.frag).
+constexpr const int TEXTURE_UNIT_GBUFFER_ALBEDO = 0;
+constexpr const int TEXTURE_UNIT_GBUFFER_NORMAL = 1;
+constexpr const int TEXTURE_UNIT_GBUFFER_MATERIAL = 2;
+constexpr const int TEXTURE_UNIT_GBUFFER_EMISSIVE = 3;
+constexpr const int TEXTURE_UNIT_GBUFFER_DEPTH = 4;
+
+//Shader storage binding points of the lights drawn as light volumes (same layout as the clustered path).
+constexpr const int BINDING_STORAGE_DEFERRED_POINT_LIGHTS = 3;
+constexpr const int BINDING_STORAGE_DEFERRED_SPOT_LIGHTS = 4;
+
+/*
+* Deferred shading.
+* Opaque geometry is drawn once into a G-buffer holding the surface parameters of the nearest fragment of each pixel:
+*  - RT0 (RGBA8): albedo, ambient occlusion;
+*  - RT1 (RGBA16F): world space normal;
+*  - RT2 (RGBA8): metallic, roughness;
+*  - RT3 (RGBA16F): emitted radiance;
+*  - depth.
+* The lighting then runs per pixel, independently of the geometry that produced it, and is accumulated in linear radiance:
+*  - a full-screen pass adds ambient, emitted and directional light (assets/deferredAmbient.frag);
+*  - each point and spot light is drawn as a proxy sphere bounding its range, so that only pixels close to the light are shaded
+*    (assets/deferredLightVolume.*). The back faces of the volumes are drawn with GL_GEQUAL against the scene depth: pixels whose
+*    surface lies behind the volume are rejected by the depth test, and depth clamping keeps volumes cut by the far plane.
+* Finally, the radiance is gamma corrected into an output buffer sharing the G-buffer depth, so that transparent and other
+* forward-shaded geometry can be drawn on top before the image is copied to the window (present()).
+*
+* A frame therefore looks like:
+*   beginGeometryPass(); draw opaque geometry with the G-buffer programs; lightingPass(); resolve(); draw forward geometry; present();
+* beginGeometryPass() and resolve() disable blending and lightingPass() changes the depth and cull state; everything is restored
+* to the defaults of main() (GL_LESS, depth writes, back face culling, alpha blending) by the end of resolve(). The lighting and
+* resolve passes bind their own vertex arrays, so the caller must bind its vertex array again before drawing meshes.
+*/
+class DeferredRenderer {
+private:
+	ShaderProgram* ambientProgram;//full-screen ambient, emissive and directional lights
+	ShaderProgram* lightVolumeProgram;//point and spot light volumes
+	ShaderProgram* resolveProgram;//gamma correction into the output buffer
+
+	int width, height;
+	GLuint albedoTex, normalTex, materialTex, emissiveTex;
+	GLuint depthTex;//depth attachment shared by all framebuffers
+	GLuint depthCopyTex;//copy of the depth read by the lighting passes, which also depth test against depthTex
+	GLuint radianceTex;//accumulated linear radiance
+	GLuint outputTex;
+	GLuint gBufferFbo, radianceFbo, outputFbo;
+
+	VertexArrayObject emptyVao;//full-screen passes generate their vertices
+	VertexArrayObject volumeVao;
+	Buffer volumeVertices, volumeIndices;
+	GLsizei volumeIndexCount;
+	std::unique_ptr<Buffer> pointBuffer, spotBuffer;
+	StreamBuffer* stream;//if set, the lights are uploaded to it instead of the buffers above
+	size_t numLightVolumes;
+
+	Vec3f background;//linear radiance of pixels not covered by geometry
+
+	void release();
+	void resize(int newWidth, int newHeight);
+
+public:
+	//Input:
+	// - ambientProg: program built from assets/fullscreen.vert and assets/deferredAmbient.frag;
+	// - lightVolumeProg: program built from assets/deferredLightVolume.vert and assets/deferredLightVolume.frag;
+	// - resolveProg: program built from assets/fullscreen.vert and assets/deferredResolve.frag.
+	DeferredRenderer(ShaderProgram* ambientProg, ShaderProgram* lightVolumeProg, ShaderProgram* resolveProg);
+	~DeferredRenderer();
+
+	DeferredRenderer(const DeferredRenderer&) = delete;
+	DeferredRenderer& operator=(const DeferredRenderer&) = delete;
+
+	//Set the colour of the background, as it should appear on screen (i.e. the clear colour of the forward path).
+	void setBackground(const Vec3f& color);
+
+	//Upload the lights of lightingPass() to the region of the current frame of a stream buffer (nullptr: own buffers).
+	void setStreamBuffer(StreamBuffer* streamBuffer);
+
+	//Bind and clear the G-buffer, (re)allocating it if the framebuffer size changed.
+	void beginGeometryPass(int fbWidth, int fbHeight);
+
+	//Light the G-buffer.
+	//Input:
+	// - lights: all directional, point and spot lights (the directional lights are read from its uniform buffer);
+	// - viewProjMat: the view-projection matrix the G-buffer was drawn with;
+	// - camPos: world space position of the camera.
+	void lightingPass(const LightManager& lights, const Mat44f& viewProjMat, const Vec3f& camPos);
+
+	//Convert the lit image to display values. Leaves the output buffer bound for drawing and reading, with the scene depth.
+	void resolve();
+
+	//Copy the output to the target framebuffer (the default one, or the offscreen one of a headless window) and bind it.
+	void present(GLuint target = 0);
+
+	//Number of point and spot lights drawn by the last lighting pass.
+	size_t getNumLightVolumes() const;
+};
@@ -0,0 +1,309 @@
+#include "frame_capture.hpp"
+#include<stb_image_write.h>
+#include<algorithm>
+#include<chrono>
+
+namespace {
+	//Convert bottom-up RGBA rows to top-down RGB rows.
+	void toRgb(const unsigned char* rgba, int width, int height, std::vector<unsigned char>& rgb) {
+		rgb.resize(static_cast<size_t>(width) * height * 3);
+		for (int y = 0; y < height; y++) {
+			const unsigned char* src = rgba + static_cast<size_t>(height - 1 - y) * width * 4;
+			unsigned char* dst = rgb.data() + static_cast<size_t>(y) * width * 3;
+			for (int x = 0; x < width; x++, src += 4, dst += 3) {
+				dst[0] = src[0];
+				dst[1] = src[1];
+				dst[2] = src[2];
+			}
+		}
+	}
+
+	//Write RGB pixels as a PPM or PNG file. Returns false if the file cannot be written.
+	bool writeImage(const std::string& path, ImageFormat format, int width, int height, const std::vector<unsigned char>& rgb) {
+		if (format == ImageFormat::PNG)
+			return stbi_write_png(path.c_str(), width, height, 3, rgb.data(), width * 3) != 0;
+
+		std::FILE* file = std::fopen(path.c_str(), "wb");
+		if (!file) return false;
+		std::fprintf(file, "P6\n%d %d\n255\n", width, height);
+		bool ok = std::fwrite(rgb.data(), 1, rgb.size(), file) == rgb.size();
+		return std::fclose(file) == 0 && ok;
+	}
+
+	bool seekTo(std::FILE* file, long long offset) {
+#if defined(_WIN32)
+		return _fseeki64(file, offset, SEEK_SET) == 0;
+#else
+		return fseeko(file, static_cast<off_t>(offset), SEEK_SET) == 0;
+#endif
+	}
+
+	void waitForFence(GLsync fence) {
+		//Flush on the first wait only; afterwards the commands are on their way.
+		GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+		while (glClientWaitSync(fence, flags, 1000000000) == GL_TIMEOUT_EXPIRED)
+			flags = 0;
+	}
+
+	bool isSignaled(GLsync fence) {
+		GLenum status = glClientWaitSync(fence, 0, 0);
+		return status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED;
+	}
+}
+
+FrameCapture::FrameCapture(int numWriters) : recording(false), recordFormat(ImageFormat::PPM), recordWidth(0), recordHeight(0),
+	recordedFrames(0), droppedFrames(0), rawFile(nullptr), stopping(false) {
+	if (numWriters <= 0) numWriters = std::clamp(static_cast<int>(std::thread::hardware_concurrency()) / 2, 1, 4);
+	for (int i = 0; i < numWriters; i++)
+		writers.emplace_back(&FrameCapture::writerLoop, this);
+}
+
+FrameCapture::~FrameCapture() {
+	//Captures already read back are still written: wait for their readbacks, then for the writers.
+	for (auto& readback : readbacks) {
+		if (!readback->fence) continue;
+		waitForFence(readback->fence);
+		submit(*readback);
+	}
+	finishRecording();
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (std::thread& writer : writers) writer.join();
+
+	for (auto& readback : readbacks) release(*readback);
+}
+
+void FrameCapture::allocate(Readback& readback, int width, int height) {
+	const GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	readback.size = static_cast<GLsizeiptr>(width) * height * 4;
+	glCreateBuffers(1, &readback.buffer);
+	glNamedBufferStorage(readback.buffer, readback.size, nullptr, flags);
+	readback.pixels = static_cast<const unsigned char*>(glMapNamedBufferRange(readback.buffer, 0, readback.size, flags));
+	readback.width = width;
+	readback.height = height;
+}
+
+void FrameCapture::release(Readback& readback) {
+	if (!readback.buffer) return;
+	glUnmapNamedBuffer(readback.buffer);
+	glDeleteBuffers(1, &readback.buffer);
+	readback.buffer = 0;
+	readback.pixels = nullptr;
+}
+
+void FrameCapture::read(Readback& readback, int width, int height) {
+	if (readback.buffer && (readback.width != width || readback.height != height)) release(readback);
+	if (!readback.buffer) allocate(readback, width, height);
+	readback.written.store(false, std::memory_order_relaxed);
+
+	//RGBA rows are always 4-byte aligned, so the default pack alignment fits, and it is the native layout of most drivers.
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+	glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void FrameCapture::request(const std::string& path, ImageFormat format) {
+	requests.push_back(Request{ path, format == ImageFormat::RAW ? ImageFormat::PPM : format });
+}
+
+void FrameCapture::startRecording(const std::string& prefix, ImageFormat format, int numSlots) {
+	stopRecording();
+	finishRecording();
+
+	recording = true;
+	recordPrefix = prefix;
+	recordFormat = format;
+	recordWidth = recordHeight = 0;
+	recordedFrames = 0;
+	droppedFrames = 0;
+	framesWritten.store(0);
+	bytesWritten.store(0);
+	writeNanoseconds.store(0);
+	recordStart = recordStop = Clock::now();
+	for (int i = 0; i < std::max(numSlots, 1); i++) {
+		slots.push_back(std::make_unique<Readback>());
+		Readback& slot = *slots.back();
+		slot.buffer = 0;
+		slot.fence = nullptr;
+		slot.pixels = nullptr;
+		slot.busy = false;
+	}
+}
+
+void FrameCapture::stopRecording() {
+	if (!recording) return;
+	recording = false;
+	recordStop = Clock::now();
+}
+
+void FrameCapture::finishRecording() {
+	for (auto& slot : slots) {
+		if (!slot->busy) continue;
+		if (slot->fence) {
+			waitForFence(slot->fence);
+			submit(*slot);
+		}
+		while (!slot->written.load(std::memory_order_acquire))
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		slot->busy = false;
+	}
+	for (auto& slot : slots) release(*slot);
+	slots.clear();
+	closeRawFile();
+}
+
+void FrameCapture::closeRawFile() {
+	if (!rawFile) return;
+	if (std::fclose(rawFile) != 0)
+		std::fprintf(stderr, "Cannot write recording '%s'\n", recordPrefix.c_str());
+	rawFile = nullptr;
+}
+
+RecordingStats FrameCapture::getRecordingStats() const {
+	RecordingStats stats{};
+	stats.framesCaptured = static_cast<size_t>(recordedFrames);
+	stats.framesWritten = static_cast<size_t>(framesWritten.load(std::memory_order_relaxed));
+	stats.framesDropped = droppedFrames;
+	stats.slots = slots.size();
+	for (const auto& slot : slots)
+		if (slot->busy) stats.framesInFlight++;
+	if (stats.framesWritten > 0)
+		stats.writeMs = static_cast<double>(writeNanoseconds.load(std::memory_order_relaxed)) * 1e-6 / stats.framesWritten;
+	double seconds = std::chrono::duration<double>((recording ? Clock::now() : recordStop) - recordStart).count();
+	if (seconds > 0.0)
+		stats.megabytesPerSecond = static_cast<double>(bytesWritten.load(std::memory_order_relaxed)) / (1024.0 * 1024.0) / seconds;
+	return stats;
+}
+
+void FrameCapture::beforeSwap(int width, int height, GLuint framebuffer) {
+	if ((requests.empty() && !recording) || width <= 0 || height <= 0) return;
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+
+	//Each request gets its own readback; several requests in one frame are rare.
+	for (Request& request : requests) {
+		auto readback = std::make_unique<Readback>();
+		readback->buffer = 0;
+		readback->request = std::move(request);
+		readback->frame = -1;
+		readback->busy = true;
+		read(*readback, width, height);
+		readbacks.push_back(std::move(readback));
+	}
+	requests.clear();
+
+	if (recording) capture(width, height);
+}
+
+void FrameCapture::capture(int width, int height) {
+	if (recordWidth == 0) {
+		recordWidth = width;
+		recordHeight = height;
+		if (recordFormat == ImageFormat::RAW) {
+			std::string path = recordPrefix + "_" + std::to_string(width) + "x" + std::to_string(height) + ".rgb";
+			rawFile = std::fopen(path.c_str(), "wb");
+			if (!rawFile) {
+				std::fprintf(stderr, "Cannot open recording '%s'\n", path.c_str());
+				stopRecording();
+				return;
+			}
+		}
+	}
+	if (width != recordWidth || height != recordHeight) {
+		droppedFrames++;
+		return;
+	}
+
+	auto freeSlot = std::find_if(slots.begin(), slots.end(), [](const std::unique_ptr<Readback>& slot) { return !slot->busy; });
+	if (freeSlot == slots.end()) {
+		droppedFrames++;
+		return;
+	}
+	Readback& slot = **freeSlot;
+	slot.busy = true;
+	slot.frame = recordedFrames++;
+	slot.request.format = recordFormat;
+	if (recordFormat != ImageFormat::RAW) {
+		char number[32];
+		std::snprintf(number, sizeof(number), "_%06lld", slot.frame);
+		slot.request.path = recordPrefix + number + (recordFormat == ImageFormat::PNG ? ".png" : ".ppm");
+	}
+	read(slot, width, height);
+}
+
+void FrameCapture::update() {
+	for (auto& readback : readbacks)
+		if (readback->fence && isSignaled(readback->fence)) submit(*readback);
+
+	auto written = std::partition(readbacks.begin(), readbacks.end(),
+		[](const std::unique_ptr<Readback>& readback) { return !readback->written.load(std::memory_order_acquire); });
+	for (auto it = written; it != readbacks.end(); ++it) release(**it);
+	readbacks.erase(written, readbacks.end());
+
+	bool slotsBusy = false;
+	for (auto& slot : slots) {
+		if (!slot->busy) continue;
+		if (slot->fence && isSignaled(slot->fence)) submit(*slot);
+		if (!slot->fence && slot->written.load(std::memory_order_acquire)) slot->busy = false;
+		slotsBusy |= slot->busy;
+	}
+	//A stopped recording is closed once its last frame is written
+	if (!recording && !slotsBusy && !slots.empty()) finishRecording();
+}
+
+void FrameCapture::submit(Readback& readback) {
+	glDeleteSync(readback.fence);
+	readback.fence = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		jobs.push_back(&readback);
+	}
+	wake.notify_one();
+}
+
+void FrameCapture::write(Readback& readback) {
+	auto start = Clock::now();
+	thread_local std::vector<unsigned char> rgb;
+	toRgb(readback.pixels, readback.width, readback.height, rgb);
+
+	const Request& request = readback.request;
+	bool ok;
+	if (request.format == ImageFormat::RAW) {
+		//Frames are written by several threads in any order, each at the offset of its index
+		std::lock_guard<std::mutex> lock(rawMutex);
+		ok = rawFile && seekTo(rawFile, readback.frame * static_cast<long long>(rgb.size()))
+			&& std::fwrite(rgb.data(), 1, rgb.size(), rawFile) == rgb.size();
+	}
+	else
+		ok = writeImage(request.path, request.format, readback.width, readback.height, rgb);
+
+	if (readback.frame < 0) {
+		if (ok) std::printf("Screenshot saved to '%s'\n", request.path.c_str());
+		else std::fprintf(stderr, "Cannot write screenshot '%s'\n", request.path.c_str());
+	}
+	else {
+		if (!ok) std::fprintf(stderr, "Cannot write frame %lld of recording '%s'\n", readback.frame, recordPrefix.c_str());
+		framesWritten.fetch_add(1, std::memory_order_relaxed);
+		bytesWritten.fetch_add(rgb.size(), std::memory_order_relaxed);
+		writeNanoseconds.fetch_add(static_cast<std::uint64_t>(
+			std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count()), std::memory_order_relaxed);
+	}
+}
+
+void FrameCapture::writerLoop() {
+	for (;;) {
+		Readback* readback = nullptr;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [this] { return stopping || !jobs.empty(); });
+			if (jobs.empty()) return;
+			readback = jobs.front();
+			jobs.pop_front();
+		}
+		write(*readback);
+		readback->written.store(true, std::memory_order_release);
+	}
+}
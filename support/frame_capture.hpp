@@ -0,0 +1,147 @@
+#pragma once
+#include<glad.h>
+#include<atomic>
+#include<condition_variable>
+#include<cstdint>
+#include<cstdio>
+#include<deque>
+#include<memory>
+#include<mutex>
+#include<string>
+#include<thread>
+#include<vector>
+#include"../main/defaults.hpp"
+
+//File format of captured frames.
+enum class ImageFormat {
+	PPM,//binary PPM (P6): no encoding, the fastest to write
+	PNG,
+	RAW//recordings only: headerless RGB frames, top row first, all appended to one file
+};
+
+//Progress of a recording.
+struct RecordingStats {
+	size_t framesCaptured;//frames read back
+	size_t framesWritten;
+	size_t framesDropped;//frames not captured because all readback slots were busy, or because the framebuffer was resized
+	size_t framesInFlight;//slots being read back or written: at the number of slots, the writers do not keep up
+	size_t slots;
+	double writeMs;//average time a writer takes for a frame
+	double megabytesPerSecond;//written since the start of the recording
+};
+
+/*
+* Asynchronous capture of the default framebuffer to image files.
+* A capture can be requested at any time (e.g. from a key callback); it is taken by beforeSwap(), once the frame is complete. The
+* back buffer is read into a pixel pack buffer, which returns without waiting for the GPU, and a fence is inserted after the read.
+* update() polls the fences without blocking: once a readback is done, its mapped pixels are handed to a pool of writer threads,
+* which convert them and write the files, and the pack buffer is released (or reused) when its frame is written. Neither the render
+* thread nor the GL pipeline waits for the readback or for the encoding.
+*
+* A recording captures every frame into a ring of pack buffers. The ring is the bounded queue to the writers: a frame is only
+* captured if a slot is free, otherwise it is dropped, so a slow disk or encoder costs frames of the recording but never frames of
+* the application. Frames are written as an image sequence (<prefix>_<frame>.ppm/.png) or appended to a raw file
+* (<prefix>_<width>x<height>.rgb, e.g. for ffmpeg -f rawvideo -pixel_format rgb24 -video_size <width>x<height>). A recording keeps
+* the size of its first frame; frames of another size are dropped.
+*
+* All functions must be called from the thread of the GL context. The destructor finishes the captures in flight.
+*/
+class FrameCapture {
+private:
+	struct Request {
+		std::string path;
+		ImageFormat format;
+	};
+
+	//A frame read into a pack buffer, then written by a writer.
+	struct Readback {
+		GLuint buffer;
+		GLsizeiptr size;
+		GLsync fence;//null once the readback is done and the frame was handed to the writers
+		const unsigned char* pixels;//persistent mapping of the buffer: RGBA rows, bottom row first
+		int width, height;
+		Request request;
+		long long frame;//index of the frame in its recording, -1 for screenshots
+		bool busy;//recording slots: being read back or written
+		std::atomic<bool> written{ false };
+	};
+
+	std::vector<Request> requests;//to be taken by the next beforeSwap()
+	std::vector<std::unique_ptr<Readback>> readbacks;//screenshots in flight
+
+	//Recording
+	bool recording;
+	std::string recordPrefix;
+	ImageFormat recordFormat;
+	std::vector<std::unique_ptr<Readback>> slots;
+	int recordWidth, recordHeight;//size of the first frame, 0 before it
+	long long recordedFrames;
+	size_t droppedFrames;
+	std::FILE* rawFile;//RAW recordings, guarded by rawMutex while recording
+	std::mutex rawMutex;
+	Clock::time_point recordStart, recordStop;
+	std::atomic<std::uint64_t> framesWritten{ 0 };
+	std::atomic<std::uint64_t> bytesWritten{ 0 };
+	std::atomic<std::uint64_t> writeNanoseconds{ 0 };
+
+	//Writer pool
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::deque<Readback*> jobs;//handed to the writers, guarded by mutex
+	bool stopping;//guarded by mutex
+	std::vector<std::thread> writers;
+
+	static void allocate(Readback& readback, int width, int height);
+	static void release(Readback& readback);
+	void read(Readback& readback, int width, int height);
+	void capture(int width, int height);
+	void submit(Readback& readback);
+	void write(Readback& readback);
+	void writerLoop();
+	void finishRecording();//wait until the frames of the recording are written, then release the slots
+	void closeRawFile();
+
+public:
+	//Input:
+	// - numWriters: number of writer threads, 0 to pick from the number of hardware threads.
+	FrameCapture(int numWriters = 0);
+	~FrameCapture();
+
+	FrameCapture(const FrameCapture&) = delete;
+	FrameCapture& operator=(const FrameCapture&) = delete;
+
+	//Capture the next complete frame to the given file (PPM or PNG).
+	void request(const std::string& path, ImageFormat format);
+
+	//Start recording every frame. Stops the current recording first, and waits until its frames are written.
+	//Input:
+	// - prefix: start of the file names;
+	// - format: image sequence (PPM, PNG) or one RAW file;
+	// - numSlots: pack buffers in the ring, i.e. how many frames may wait for the writers.
+	void startRecording(const std::string& prefix, ImageFormat format, int numSlots = 8);
+	//Stop capturing. The frames in flight are still written; the raw file is closed by update() once they are.
+	void stopRecording();
+	bool isRecording() const;
+	RecordingStats getRecordingStats() const;
+
+	//Read the back buffer of the default framebuffer for the requests made so far, and for the recording. Call when the frame is
+	//complete, before the swap.
+	//Input:
+	// - width, height: size of the framebuffer;
+	// - framebuffer: the framebuffer presented, if not the default one (headless rendering).
+	void beforeSwap(int width, int height, GLuint framebuffer = 0);
+
+	//Hand the finished readbacks to the writers and release the pack buffers they have written. Does not block.
+	void update();
+
+	//Number of screenshots requested and not written yet.
+	size_t getPendingCount() const;
+};
+
+inline bool FrameCapture::isRecording() const {
+	return recording;
+}
+
+inline size_t FrameCapture::getPendingCount() const {
+	return requests.size() + readbacks.size();
+}
@@ -0,0 +1,204 @@
+#include "frame_pacer.hpp"
+#include"window.hpp"
+#include<algorithm>
+#include<thread>
+
+namespace {
+	double millisecondsBetween(Clock::time_point a, Clock::time_point b) {
+		return std::chrono::duration<double, std::milli>(b - a).count();
+	}
+
+	long long nanosecondsOf(Clock::time_point t) {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch()).count();
+	}
+
+	//The GPU clock drifts against the CPU clock, so their offset is measured again from time to time.
+	constexpr unsigned long long CALIBRATION_INTERVAL = 300;
+
+	//Bounds of the part of the frame limiter's wait that is spent spinning rather than sleeping.
+	constexpr double MIN_SPIN_MARGIN_MS = 0.2;
+	constexpr double MAX_SPIN_MARGIN_MS = 4.0;
+}
+
+FramePacer::FramePacer(int framesInFlight) : mode(PresentMode::VSYNC), targetFps(60.0), maxFramesInFlight(2),
+	adaptiveSupported(false), hasSwapInterval(false), slots{}, frameIndex(0), spinMarginMs(1.0), gpuClockOffsetNs(0), framesSinceCalibration(0),
+	historyNext(0), latest{} {
+	setMaxFramesInFlight(framesInFlight);
+	//A headless window may render through a context GLFW does not own (see Window), which has no swap interval
+	hasSwapInterval = glfwGetCurrentContext() != nullptr;
+	adaptiveSupported = hasSwapInterval &&
+		(glfwExtensionSupported("WGL_EXT_swap_control_tear") || glfwExtensionSupported("GLX_EXT_swap_control_tear"));
+	for (Slot& slot : slots)
+		glCreateQueries(GL_TIMESTAMP, 2, slot.queries);
+	history.reserve(HISTORY_SIZE);
+	frameStart = lastFrameStart = nextDeadline = Clock::now();
+	applySwapInterval();
+	calibrate();
+}
+
+FramePacer::~FramePacer() {
+	for (Slot& slot : slots) {
+		if (slot.fence) glDeleteSync(slot.fence);
+		glDeleteQueries(2, slot.queries);
+	}
+}
+
+void FramePacer::applySwapInterval() {
+	if (!hasSwapInterval) return;
+	switch (mode) {
+	case PresentMode::VSYNC:
+		glfwSwapInterval(1);
+		break;
+	case PresentMode::UNLOCKED:
+	case PresentMode::FIXED:
+		glfwSwapInterval(0);
+		break;
+	case PresentMode::ADAPTIVE:
+		glfwSwapInterval(adaptiveSupported ? -1 : 1);
+		break;
+	}
+}
+
+void FramePacer::calibrate() {
+	GLint64 gpuNs = 0;
+	glGetInteger64v(GL_TIMESTAMP, &gpuNs);
+	gpuClockOffsetNs = static_cast<long long>(gpuNs) - nanosecondsOf(Clock::now());
+	framesSinceCalibration = 0;
+}
+
+long long FramePacer::toCpuNs(GLuint64 gpuNs) const {
+	return static_cast<long long>(gpuNs) - gpuClockOffsetNs;
+}
+
+void FramePacer::setMode(PresentMode newMode, double fps) {
+	targetFps = std::max(fps, 1.0);
+	if (newMode == mode) return;
+	mode = newMode;
+	nextDeadline = Clock::now();
+	applySwapInterval();
+}
+
+void FramePacer::setMaxFramesInFlight(int frames) {
+	maxFramesInFlight = std::clamp(frames, 1, MAX_FRAMES_IN_FLIGHT);
+}
+
+void FramePacer::beginFrame() {
+	lastFrameStart = frameStart;
+	frameStart = Clock::now();
+
+	Slot& slot = slots[frameIndex % MAX_FRAMES_IN_FLIGHT];
+	slot.timing = FrameTiming{};
+	slot.timing.frame = frameIndex;
+	slot.timing.frameMs = millisecondsBetween(lastFrameStart, frameStart);
+	slot.inputTime = frameStart;
+	slot.used = true;
+	glQueryCounter(slot.queries[0], GL_TIMESTAMP);
+}
+
+void FramePacer::waitForFence(Slot& slot) {
+	if (!slot.fence) return;
+	//Flush on the first wait only; afterwards the commands are on their way.
+	GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+	while (glClientWaitSync(slot.fence, flags, 1000000000) == GL_TIMEOUT_EXPIRED)
+		flags = 0;
+	glDeleteSync(slot.fence);
+	slot.fence = nullptr;
+}
+
+void FramePacer::collect(Slot& slot) {
+	if (!slot.used || slot.fence) return;
+	slot.used = false;
+
+	GLuint64 begin = 0, end = 0;
+	glGetQueryObjectui64v(slot.queries[0], GL_QUERY_RESULT, &begin);
+	glGetQueryObjectui64v(slot.queries[1], GL_QUERY_RESULT, &end);
+	slot.timing.gpuMs = static_cast<double>(end - begin) * 1e-6;
+	slot.timing.latencyMs = static_cast<double>(toCpuNs(end) - nanosecondsOf(slot.inputTime)) * 1e-6;
+
+	latest = slot.timing;
+	finished.push_back(latest);
+	if (history.size() < HISTORY_SIZE) history.push_back(latest);
+	else history[historyNext] = latest;
+	historyNext = (historyNext + 1) % HISTORY_SIZE;
+}
+
+void FramePacer::limit() {
+	if (mode != PresentMode::FIXED) return;
+	const auto period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / targetFps));
+	auto now = Clock::now();
+	nextDeadline += period;
+	//A late frame is not held, and the following frames start over from now instead of rushing to catch up.
+	if (nextDeadline <= now) {
+		nextDeadline = now;
+		return;
+	}
+
+	double remainingMs = millisecondsBetween(now, nextDeadline);
+	if (remainingMs > spinMarginMs) {
+		const auto requested = std::chrono::duration<double, std::milli>(remainingMs - spinMarginMs);
+		std::this_thread::sleep_for(requested);
+		//Keep the margin just above the oversleep of the scheduler, and let it shrink slowly when sleeping gets more precise.
+		double oversleepMs = millisecondsBetween(now, Clock::now()) - requested.count();
+		spinMarginMs = std::clamp(std::max(oversleepMs * 1.25, spinMarginMs * 0.99), MIN_SPIN_MARGIN_MS, MAX_SPIN_MARGIN_MS);
+	}
+	while (Clock::now() < nextDeadline)
+		std::this_thread::yield();
+}
+
+void FramePacer::endFrame(Window& window) {
+	Slot& slot = slots[frameIndex % MAX_FRAMES_IN_FLIGHT];
+	auto cpuEnd = Clock::now();
+	slot.timing.cpuMs = millisecondsBetween(frameStart, cpuEnd);
+
+	window.swapBuffers();
+	auto swapEnd = Clock::now();
+	slot.timing.swapMs = millisecondsBetween(cpuEnd, swapEnd);
+	glQueryCounter(slot.queries[1], GL_TIMESTAMP);
+	slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	//Before the next frame starts, at most maxFramesInFlight - 1 frames may still be running on the GPU. Fences signal in
+	//order, so all slots up to the newest one that has to be finished are waited for, oldest first.
+	int retire = static_cast<int>(std::min<unsigned long long>(frameIndex, MAX_FRAMES_IN_FLIGHT - 1));
+	for (int back = retire; back >= maxFramesInFlight - 1; back--)
+		waitForFence(slots[(frameIndex - back) % MAX_FRAMES_IN_FLIGHT]);
+	limit();
+	slot.timing.waitMs = millisecondsBetween(swapEnd, Clock::now());
+
+	//Timings are complete once the fence of their frame signalled; this may include the current frame.
+	finished.clear();
+	for (int back = retire; back >= 0; back--)
+		collect(slots[(frameIndex - back) % MAX_FRAMES_IN_FLIGHT]);
+
+	if (++framesSinceCalibration >= CALIBRATION_INTERVAL) calibrate();
+	frameIndex++;
+}
+
+FrameTiming FramePacer::getAverage() const {
+	FrameTiming avg{};
+	if (history.empty()) return avg;
+	for (const FrameTiming& t : history) {
+		avg.frameMs += t.frameMs;
+		avg.cpuMs += t.cpuMs;
+		avg.swapMs += t.swapMs;
+		avg.waitMs += t.waitMs;
+		avg.gpuMs += t.gpuMs;
+		avg.latencyMs += t.latencyMs;
+	}
+	double n = static_cast<double>(history.size());
+	avg.frame = latest.frame;
+	avg.frameMs /= n;
+	avg.cpuMs /= n;
+	avg.swapMs /= n;
+	avg.waitMs /= n;
+	avg.gpuMs /= n;
+	avg.latencyMs /= n;
+	return avg;
+}
+
+void FramePacer::getFrameTimes(std::vector<float>& out) const {
+	out.clear();
+	for (size_t i = 0; i < history.size(); i++) {
+		size_t index = history.size() < HISTORY_SIZE ? i : (historyNext + i) % HISTORY_SIZE;
+		out.push_back(static_cast<float>(history[index].frameMs));
+	}
+}
@@ -0,0 +1,143 @@
+#pragma once
+#include<glad.h>
+#include<vector>
+#include"../main/defaults.hpp"
+
+class Window;
+
+//How frames are presented.
+enum class PresentMode {
+	VSYNC,//swap interval 1: wait for the vertical blank
+	UNLOCKED,//swap interval 0: present as fast as possible, with tearing
+	FIXED,//swap interval 0, and the CPU holds each frame to a target frame rate
+	ADAPTIVE//swap interval -1: wait for the vertical blank, but present late frames immediately (falls back to VSYNC)
+};
+
+//Timings of one frame, in milliseconds.
+struct FrameTiming {
+	unsigned long long frame;
+	double frameMs;//start of the previous frame to the start of this one
+	double cpuMs;//beginFrame() to endFrame(): the CPU work of the frame
+	double swapMs;//time blocked in the buffer swap
+	double waitMs;//time blocked by the frame cap and the frame limiter after the swap
+	double gpuMs;//GPU time from the first command of the frame to the swap
+	double latencyMs;//input sampled (beginFrame()) to the GPU finishing the frame
+};
+
+/*
+* Frame pacing.
+* Owns the swap interval and everything the main loop waits on between two frames:
+*  - the present mode, see PresentMode. In FIXED mode, the time left until the next frame is slept away, except for the last
+*    part, where the scheduler may oversleep, which is spent spinning. The margin kept for the spin follows the oversleep
+*    actually observed, so it stays small on systems with a fine timer;
+*  - the number of frames in flight: a fence is inserted after each swap, and the CPU does not start a frame while more than
+*    maxFramesInFlight earlier frames are unfinished on the GPU. Fewer frames in flight means less latency, more means more
+*    overlap between the CPU and the GPU.
+*
+* The GPU times come from GL_TIMESTAMP queries at the start of the frame and after the swap. They are read once the fence of
+* the frame has signalled, so the timing of a frame becomes available up to maxFramesInFlight - 1 frames later. The latency is measured
+* from the input sample at the start of the frame to the GPU timestamp after the swap, which is mapped to the CPU clock; it
+* approximates input-to-present, not counting the scan-out.
+*
+* A frame looks like:
+*   poll the input; beginFrame(); render; endFrame(window);
+*/
+class FramePacer {
+private:
+	//Fence and queries of a frame in flight.
+	struct Slot {
+		GLsync fence;
+		GLuint queries[2];//GL_TIMESTAMP at the start and after the swap
+		FrameTiming timing;
+		Clock::time_point inputTime;
+		bool used;
+	};
+
+	static const int MAX_FRAMES_IN_FLIGHT = 4;
+	static const size_t HISTORY_SIZE = 240;
+
+	PresentMode mode;
+	double targetFps;
+	int maxFramesInFlight;
+	bool adaptiveSupported;
+	bool hasSwapInterval;//false when the current context is not a GLFW one
+
+	Slot slots[MAX_FRAMES_IN_FLIGHT];
+	unsigned long long frameIndex;
+	Clock::time_point frameStart, lastFrameStart, nextDeadline;
+	double spinMarginMs;
+
+	//GPU time - CPU time, in nanoseconds, measured by calibrate()
+	long long gpuClockOffsetNs;
+	unsigned long long framesSinceCalibration;
+
+	std::vector<FrameTiming> history;//ring of the last HISTORY_SIZE finished frames
+	size_t historyNext;
+	FrameTiming latest;
+	std::vector<FrameTiming> finished;//frames collected by the last endFrame()
+
+	void applySwapInterval();
+	void calibrate();
+	void limit();
+	void waitForFence(Slot& slot);
+	void collect(Slot& slot);//read the timing of a finished frame into the history
+	long long toCpuNs(GLuint64 gpuNs) const;
+
+public:
+	//Input:
+	// - framesInFlight: initial cap, clamped to [1, 4].
+	//Requires a current context; the swap interval is set to vsync.
+	explicit FramePacer(int framesInFlight = 2);
+	~FramePacer();
+
+	FramePacer(const FramePacer&) = delete;
+	FramePacer& operator=(const FramePacer&) = delete;
+
+	//Change the present mode. targetFps is used in FIXED mode.
+	void setMode(PresentMode newMode, double fps);
+	void setMaxFramesInFlight(int frames);
+
+	//Start a frame, right after the input was polled.
+	void beginFrame();
+
+	//End the frame: swap the buffers of the window, then wait as the mode and the frame cap require.
+	void endFrame(Window& window);
+
+	PresentMode getMode() const;
+	double getTargetFps() const;
+	int getMaxFramesInFlight() const;
+	bool isAdaptiveSupported() const;
+
+	//Most recent finished frame; all zero before the first one.
+	const FrameTiming& getLatest() const;
+	//Frames whose timing became available during the last endFrame(), oldest first. Unlike getLatest(), none is skipped.
+	const std::vector<FrameTiming>& getFinishedFrames() const;
+	//Average of the finished frames in the history.
+	FrameTiming getAverage() const;
+	//Frame times of the history, oldest first (for plotting).
+	void getFrameTimes(std::vector<float>& out) const;
+};
+
+inline PresentMode FramePacer::getMode() const {
+	return mode;
+}
+
+inline double FramePacer::getTargetFps() const {
+	return targetFps;
+}
+
+inline int FramePacer::getMaxFramesInFlight() const {
+	return maxFramesInFlight;
+}
+
+inline bool FramePacer::isAdaptiveSupported() const {
+	return adaptiveSupported;
+}
+
+inline const FrameTiming& FramePacer::getLatest() const {
+	return latest;
+}
+
+inline const std::vector<FrameTiming>& FramePacer::getFinishedFrames() const {
+	return finished;
+}
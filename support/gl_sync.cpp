@@ -0,0 +1,153 @@
+#include "gl_sync.hpp"
+#include<glad.h>
+#include<algorithm>
+#include<cstdio>
+#include<type_traits>
+#include<unordered_map>
+
+#if defined(_MSC_VER)
+#include<intrin.h>
+#pragma intrinsic(_ReturnAddress)
+#define GL_SYNC_RETURN_ADDRESS() _ReturnAddress()
+#else
+#define GL_SYNC_RETURN_ADDRESS() __builtin_return_address(0)
+#endif
+
+#if defined(__linux__)
+#include<dlfcn.h>
+#include<cxxabi.h>
+#include<cstdlib>
+#endif
+
+namespace {
+	struct SiteCounts {
+		const char* function;
+		size_t frameCount;
+		size_t lastFrameCount;
+		size_t totalCount;
+	};
+
+	bool enabled = false;
+	size_t frameTotal = 0;
+	size_t lastFrameTotal = 0;
+	std::unordered_map<const void*, SiteCounts> sites;
+
+	//Replaces the GLAD entry point Slot by a hook counting the calls, then forwarding them to the driver.
+	template<auto* Slot, typename Function>
+	struct SyncHook;
+
+	template<auto* Slot, typename R, typename... Args>
+	struct SyncHook<Slot, R(APIENTRYP)(Args...)> {
+		static inline R(APIENTRYP original)(Args...) = nullptr;
+		static inline const char* name = nullptr;
+
+		static R APIENTRY call(Args... args) {
+			GlSyncTracker::record(name, GL_SYNC_RETURN_ADDRESS());
+			return original(args...);
+		}
+
+		static void install(const char* functionName) {
+			if (original || !*Slot) return;
+			name = functionName;
+			original = *Slot;
+			*Slot = &call;
+		}
+
+		static void uninstall() {
+			if (!original) return;
+			*Slot = original;
+			original = nullptr;
+		}
+	};
+
+#define GL_SYNC_HOOK(fn) SyncHook<&glad_gl##fn, std::remove_reference_t<decltype(glad_gl##fn)>>
+#define GL_SYNC_HOOK_INSTALL(fn) GL_SYNC_HOOK(fn)::install("gl" #fn)
+#define GL_SYNC_HOOK_UNINSTALL(fn) GL_SYNC_HOOK(fn)::uninstall()
+
+//Calls that may wait for the GPU or round-trip to the driver, without the gl prefix (glGetError etc. are GLAD macros).
+#define GL_SYNC_FUNCTIONS(X) \
+	X(GetError) X(GetBooleanv) X(GetFloatv) X(GetIntegerv) X(GetInteger64v) X(GetIntegeri_v) \
+	X(GetNamedBufferParameteriv) X(GetNamedBufferParameteri64v) X(GetNamedBufferSubData) X(GetBufferSubData) \
+	X(GetTextureImage) X(GetTexImage) X(GetTextureLevelParameteriv) X(GetTextureParameteriv) \
+	X(GetQueryObjectiv) X(GetQueryObjectuiv) X(GetQueryObjecti64v) X(GetQueryObjectui64v) \
+	X(ReadPixels) X(ReadnPixels) X(Finish) X(ClientWaitSync) X(GetSynciv) X(MapNamedBuffer) X(MapNamedBufferRange) \
+	X(GetProgramiv) X(GetShaderiv) X(GetUniformLocation) X(GetProgramBinary) X(CheckNamedFramebufferStatus)
+
+#define GL_SYNC_INSTALL_ENTRY(fn) GL_SYNC_HOOK_INSTALL(fn);
+#define GL_SYNC_UNINSTALL_ENTRY(fn) GL_SYNC_HOOK_UNINSTALL(fn);
+}
+
+void GlSyncTracker::setEnabled(bool on) {
+	if (on == enabled) return;
+	enabled = on;
+	if (on) {
+		GL_SYNC_FUNCTIONS(GL_SYNC_INSTALL_ENTRY)
+	}
+	else {
+		GL_SYNC_FUNCTIONS(GL_SYNC_UNINSTALL_ENTRY)
+		sites.clear();
+		frameTotal = lastFrameTotal = 0;
+	}
+}
+
+bool GlSyncTracker::isEnabled() {
+	return enabled;
+}
+
+void GlSyncTracker::record(const char* function, const void* address) {
+	SiteCounts& site = sites.try_emplace(address, SiteCounts{ function, 0, 0, 0 }).first->second;
+	site.frameCount++;
+	site.totalCount++;
+	frameTotal++;
+}
+
+void GlSyncTracker::beginFrame() {
+	for (auto& entry : sites) {
+		entry.second.lastFrameCount = entry.second.frameCount;
+		entry.second.frameCount = 0;
+	}
+	lastFrameTotal = frameTotal;
+	frameTotal = 0;
+}
+
+size_t GlSyncTracker::getLastFrameCount() {
+	return lastFrameTotal;
+}
+
+std::vector<GlSyncTracker::CallSite> GlSyncTracker::getCallSites() {
+	std::vector<CallSite> result;
+	result.reserve(sites.size());
+	for (const auto& entry : sites)
+		result.push_back(CallSite{ entry.second.function, entry.first, entry.second.lastFrameCount, entry.second.totalCount });
+	std::sort(result.begin(), result.end(), [](const CallSite& a, const CallSite& b) {
+		if (a.lastFrameCount != b.lastFrameCount) return a.lastFrameCount > b.lastFrameCount;
+		return a.totalCount > b.totalCount;
+	});
+	return result;
+}
+
+std::string GlSyncTracker::describe(const void* address) {
+	char buffer[512];
+#if defined(__linux__)
+	Dl_info info{};
+	if (dladdr(address, &info) && info.dli_fname) {
+		if (info.dli_sname) {
+			int status = 0;
+			char* demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+			std::snprintf(buffer, sizeof(buffer), "%s+0x%zx", status == 0 && demangled ? demangled : info.dli_sname,
+				static_cast<size_t>(static_cast<const char*>(address) - static_cast<const char*>(info.dli_saddr)));
+			std::free(demangled);
+		}
+		else {
+			const char* module = info.dli_fname;
+			for (const char* c = info.dli_fname; *c; c++)
+				if (*c == '/') module = c + 1;
+			std::snprintf(buffer, sizeof(buffer), "%s+0x%zx", module,
+				static_cast<size_t>(static_cast<const char*>(address) - static_cast<const char*>(info.dli_fbase)));
+		}
+		return buffer;
+	}
+#endif
+	std::snprintf(buffer, sizeof(buffer), "%p", address);
+	return buffer;
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include<cstddef>
+#include<string>
+#include<vector>
+
+/*
+* Detector of synchronous GL calls.
+* Queries such as glGetError, glGetIntegerv or glGetNamedBufferParameteri64v return state of the driver, and on many
+* implementations they wait for the commands issued before them, stalling the pipeline. While the tracker is enabled, the GLAD
+* entry points of the calls that may synchronize (queries, readbacks, glFinish, fence waits, mapping) are replaced by hooks
+* counting every call per call site, i.e. per return address. Disabling the tracker restores the original entry points.
+*
+* Call sites are named by describe(): the enclosing symbol where the platform can tell, otherwise the module and the offset of
+* the address in it (resolve it with addr2line -f -C -e <module> <offset>, or the map file on Windows). On Linux the symbols of
+* the executable are only known when it is linked with -rdynamic.
+* The hooks only see calls made through GLAD; the ImGui backend loads its own GL entry points.
+*/
+class GlSyncTracker {
+public:
+	struct CallSite {
+		const char* function;//the GL function called
+		const void* address;//return address of the call
+		size_t lastFrameCount;//calls during the last finished frame
+		size_t totalCount;//calls since the tracker was enabled
+	};
+
+	//Install or remove the hooks. Requires GLAD to be loaded.
+	static void setEnabled(bool on);
+	static bool isEnabled();
+
+	//Close the current frame: its counts become the last frame's counts.
+	static void beginFrame();
+
+	//Synchronous calls during the last finished frame.
+	static size_t getLastFrameCount();
+
+	//Call sites seen since the tracker was enabled, sorted by their last frame count, then by their total count.
+	static std::vector<CallSite> getCallSites();
+
+	//Human-readable name of a call site.
+	static std::string describe(const void* address);
+
+	//Count a call (used by the hooks).
+	static void record(const char* function, const void* address);
+};
@@ -0,0 +1,110 @@
+#include "gpu_culling.hpp"
+#include"mesh.hpp"
+#include"instance_buffer.hpp"
+#include"program.hpp"
+#include<vector>
+
+namespace {
+	constexpr GLuint CULL_WORKGROUP_SIZE = 64;//must match local_size_x in frustumCull.comp
+
+	//Uniform locations in frustumCull.comp
+	constexpr GLint LOCATION_CULL_VIEW_PROJ = 0;
+	constexpr GLint LOCATION_CULL_BOUNDING_SPHERE = 1;
+	constexpr GLint LOCATION_CULL_NUM_INSTANCES = 2;
+	constexpr GLint LOCATION_CULL_NUM_FACE_GROUPS = 3;
+	constexpr GLint LOCATION_CULL_COMMANDS_PER_FACE_GROUP = 4;
+	constexpr GLint LOCATION_CULL_COMPACT = 5;
+}
+
+GpuFrustumCuller::GpuFrustumCuller(ShaderProgram* cullProgram) : program(cullProgram),
+	commandBuffer(nullptr), faceGroupBuffer(nullptr),
+	counterBuffer(sizeof(GLuint), nullptr), readbackBuffer(sizeof(GLuint), nullptr), readbackFence(nullptr),
+	instanceCapacity(0), faceGroupCapacity(0), numCommands(0), visibleCount(0) {
+	//The count variant of the multi draw is core in GL 4.6 only. Without it, fall back to the non-compacting path.
+	compact = GLAD_GL_VERSION_4_6 && glMultiDrawElementsIndirectCount != nullptr;
+}
+
+GpuFrustumCuller::~GpuFrustumCuller() {
+	if (readbackFence) glDeleteSync(readbackFence);
+}
+
+void GpuFrustumCuller::reserve(size_t numInstances, size_t numFaceGroups) {
+	if (numInstances > instanceCapacity || numFaceGroups > faceGroupCapacity || !commandBuffer) {
+		instanceCapacity = instanceCapacity > 0 ? instanceCapacity : 1;
+		while (instanceCapacity < numInstances) instanceCapacity *= 2;
+		faceGroupCapacity = numFaceGroups > faceGroupCapacity ? numFaceGroups : faceGroupCapacity;
+		commandBuffer = std::make_unique<Buffer>(instanceCapacity * faceGroupCapacity * sizeof(DrawElementsIndirectCommand), nullptr);
+		faceGroupBuffer = std::make_unique<Buffer>(faceGroupCapacity * sizeof(GLuint), nullptr);
+	}
+}
+
+void GpuFrustumCuller::readBackVisibleCount() {
+	if (!readbackFence) return;
+	//Only read once the copy has completed, so the read never waits for the GPU. Otherwise keep the old value.
+	GLenum status = glClientWaitSync(readbackFence, 0, 0);
+	if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED) {
+		glGetNamedBufferSubData(readbackBuffer.getBufferID(), 0, sizeof(GLuint), &visibleCount);
+		glDeleteSync(readbackFence);
+		readbackFence = nullptr;
+	}
+}
+
+void GpuFrustumCuller::cull(const Mesh& mesh, const InstanceBuffer& instances, const Mat44f& viewProjMat) {
+	numCommands = 0;
+	if (!program || instances.size() == 0 || mesh.faceGroups.empty()) return;
+
+	readBackVisibleCount();
+	reserve(instances.size(), mesh.faceGroups.size());
+	numCommands = compact ? instanceCapacity : instances.size();
+
+	std::vector<GLuint> indexCounts(mesh.faceGroups.size());
+	for (size_t i = 0; i < mesh.faceGroups.size(); i++) indexCounts[i] = static_cast<GLuint>(mesh.faceGroups[i].numIndices);
+	faceGroupBuffer->setData(0, indexCounts.size() * sizeof(GLuint), indexCounts.data());
+
+	GLuint zero = 0;
+	counterBuffer.setData(0, sizeof(GLuint), &zero);
+
+	GLuint progId = program->programId();
+	glUseProgram(progId);
+	glProgramUniformMatrix4fv(progId, LOCATION_CULL_VIEW_PROJ, 1, GL_TRUE, viewProjMat.v);
+	glProgramUniform4f(progId, LOCATION_CULL_BOUNDING_SPHERE, mesh.boundingSphere.center.x, mesh.boundingSphere.center.y,
+		mesh.boundingSphere.center.z, mesh.boundingSphere.radius);
+	glProgramUniform1ui(progId, LOCATION_CULL_NUM_INSTANCES, static_cast<GLuint>(instances.size()));
+	glProgramUniform1ui(progId, LOCATION_CULL_NUM_FACE_GROUPS, static_cast<GLuint>(mesh.faceGroups.size()));
+	glProgramUniform1ui(progId, LOCATION_CULL_COMMANDS_PER_FACE_GROUP, static_cast<GLuint>(numCommands));
+	glProgramUniform1i(progId, LOCATION_CULL_COMPACT, compact ? 1 : 0);
+
+	instances.bindToStorage(BINDING_STORAGE_CULL_INSTANCES);
+	commandBuffer->bindToStorage(BINDING_STORAGE_CULL_COMMANDS, 0, instanceCapacity * faceGroupCapacity * sizeof(DrawElementsIndirectCommand));
+	faceGroupBuffer->bindToStorage(BINDING_STORAGE_CULL_FACE_GROUPS, 0, faceGroupCapacity * sizeof(GLuint));
+	glBindBufferBase(GL_ATOMIC_COUNTER_BUFFER, BINDING_ATOMIC_CULL_VISIBLE_COUNT, counterBuffer.getBufferID());
+
+	GLuint numGroups = static_cast<GLuint>((instances.size() + CULL_WORKGROUP_SIZE - 1) / CULL_WORKGROUP_SIZE);
+	glDispatchCompute(numGroups, 1, 1);
+
+	//Commands and the draw count are consumed as indirect/parameter buffers; the counter is also copied for the readback.
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+
+	if (!readbackFence) {
+		glCopyNamedBufferSubData(counterBuffer.getBufferID(), readbackBuffer.getBufferID(), 0, 0, sizeof(GLuint));
+		readbackFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+}
+
+void GpuFrustumCuller::draw(State& state, VertexArrayObject& vao, Mesh& mesh, const InstanceBuffer& instances, const Mat44f& viewProjMat) {
+	if (numCommands == 0) return;
+	mesh.drawIndirect(state, vao, instances, viewProjMat, *commandBuffer, numCommands, compact ? &counterBuffer : nullptr);
+}
+
+void GpuFrustumCuller::drawDepth(State& state, VertexArrayObject& vao, Mesh& mesh, const InstanceBuffer& instances, const Mat44f& viewProjMat) {
+	if (numCommands == 0) return;
+	mesh.drawIndirect(state, vao, instances, viewProjMat, *commandBuffer, numCommands, compact ? &counterBuffer : nullptr, true);
+}
+
+unsigned int GpuFrustumCuller::getVisibleCount() const {
+	return visibleCount;
+}
+
+bool GpuFrustumCuller::isCompacting() const {
+	return compact;
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include<glad.h>
+#include<memory>
+#include"buffer.hpp"
+#include"../vmlib/mat44.hpp"
+
+class Mesh;
+class InstanceBuffer;
+class ShaderProgram;
+class VertexArrayObject;
+struct State;
+
+constexpr const int BINDING_STORAGE_CULL_INSTANCES = 0;
+constexpr const int BINDING_STORAGE_CULL_COMMANDS = 1;
+constexpr const int BINDING_STORAGE_CULL_FACE_GROUPS = 2;
+constexpr const int BINDING_ATOMIC_CULL_VISIBLE_COUNT = 0;
+
+/*
+* Frustum culling of mesh instances on the GPU.
+* A compute shader (assets/frustumCull.comp) tests the bounding sphere of every instance against the view frustum and writes
+* indirect draw commands for the visible ones, so the CPU never sees the per-instance results.
+*  - If glMultiDrawElementsIndirectCount is available (GL 4.6), the survivors are compacted using an atomic counter, and the
+*    counter doubles as the draw count of the indirect draw.
+*  - Otherwise, every instance keeps its own command slot and culled instances get instanceCount = 0, which is then drawn with
+*    plain glMultiDrawElementsIndirect.
+* Both paths only use GL 4.5 core features apart from the draw call itself, so they run on software GL such as llvmpipe.
+*
+* One culler is used per instanced mesh, since the command and counter buffers are consumed by the draw that follows the cull.
+*/
+class GpuFrustumCuller {
+private:
+	ShaderProgram* program;//the compute program, shared between cullers
+
+	std::unique_ptr<Buffer> commandBuffer;//one list of DrawElementsIndirectCommand per face group
+	std::unique_ptr<Buffer> faceGroupBuffer;//index count of each face group
+	Buffer counterBuffer;//atomic counter of visible instances; also used as the parameter buffer holding the draw count
+	Buffer readbackBuffer;//copy of the counter, read on the CPU once the GPU is done with it
+	GLsync readbackFence;
+
+	size_t instanceCapacity;//command slots per face group
+	size_t faceGroupCapacity;
+	size_t numCommands;//number of command slots per face group written by the last cull
+	unsigned int visibleCount;
+	bool compact;
+
+	void reserve(size_t numInstances, size_t numFaceGroups);
+	void readBackVisibleCount();
+
+public:
+	//Input:
+	// - cullProgram: program built from assets/frustumCull.comp.
+	GpuFrustumCuller(ShaderProgram* cullProgram);
+	~GpuFrustumCuller();
+
+	GpuFrustumCuller(const GpuFrustumCuller&) = delete;
+	GpuFrustumCuller& operator=(const GpuFrustumCuller&) = delete;
+
+	//Test the instances against the frustum of the view-projection matrix and write the indirect commands.
+	//The instance buffer must have been uploaded.
+	void cull(const Mesh& mesh, const InstanceBuffer& instances, const Mat44f& viewProjMat);
+
+	//Draw the instances that survived the last cull.
+	void draw(State& state, VertexArrayObject& vao, Mesh& mesh, const InstanceBuffer& instances, const Mat44f& viewProjMat);
+
+	//Draw the instances that survived the last cull into the depth buffer only (depth pre-pass).
+	void drawDepth(State& state, VertexArrayObject& vao, Mesh& mesh, const InstanceBuffer& instances, const Mat44f& viewProjMat);
+
+	//Number of visible instances. The counter is read back without stalling, so the value lags a frame or two behind.
+	unsigned int getVisibleCount() const;
+
+	//Is the compacting path (glMultiDrawElementsIndirectCount) in use?
+	bool isCompacting() const;
+};
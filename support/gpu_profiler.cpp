@@ -0,0 +1,119 @@
+#include "gpu_profiler.hpp"
+
+GpuProfiler::GpuProfiler() : enabled(true), inFrame(false), slots{}, frameIndex(0), droppedFrames(0) {
+}
+
+GpuProfiler::~GpuProfiler() {
+	for (FrameSlot& slot : slots)
+		if (!slot.queries.empty()) glDeleteQueries(static_cast<GLsizei>(slot.queries.size()), slot.queries.data());
+}
+
+void GpuProfiler::setEnabled(bool on) {
+	enabled = on;
+}
+
+GLuint GpuProfiler::nextQuery(FrameSlot& slot) {
+	if (slot.usedQueries == static_cast<int>(slot.queries.size())) {
+		//Grow in steps, most frames issue the same number of queries
+		size_t oldSize = slot.queries.size();
+		slot.queries.resize(oldSize + 32);
+		glCreateQueries(GL_TIMESTAMP, 32, slot.queries.data() + oldSize);
+	}
+	return slot.queries[slot.usedQueries++];
+}
+
+bool GpuProfiler::resolve(FrameSlot& slot) {
+	//Queries complete in order, so the last one decides
+	GLint available = 0;
+	glGetQueryObjectiv(slot.queries[slot.usedQueries - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+	if (!available) return false;
+
+	std::vector<GLuint64> timestamps(slot.usedQueries);
+	for (int i = 0; i < slot.usedQueries; i++)
+		glGetQueryObjectui64v(slot.queries[i], GL_QUERY_RESULT, &timestamps[i]);
+
+	const GLuint64 frameStart = timestamps[slot.records[0].beginQuery];
+	zones.clear();
+	paths.resize(slot.records.size());
+	for (size_t i = 0; i < slot.records.size(); i++) {
+		const Record& record = slot.records[i];
+		paths[i] = record.parent < 0 ? std::string(record.name) : paths[record.parent] + "/" + record.name;
+		double ms = static_cast<double>(timestamps[record.endQuery] - timestamps[record.beginQuery]) * 1e-6;
+
+		auto found = averages.find(paths[i]);
+		double avg = found == averages.end() ? ms : found->second * 0.95 + ms * 0.05;
+		averages[paths[i]] = avg;
+		zones.push_back(ZoneStats{ record.name, record.depth, ms, avg });
+
+		if (csv.is_open()) {
+			double startMs = static_cast<double>(timestamps[record.beginQuery] - frameStart) * 1e-6;
+			csv << slot.frame << ',' << paths[i] << ',' << record.depth << ',' << startMs << ',' << ms << '\n';
+		}
+	}
+	slot.pending = false;
+	return true;
+}
+
+void GpuProfiler::beginFrame() {
+	//Read back the finished frames, oldest first. The oldest one is in the slot of the new frame.
+	for (unsigned long long back = FRAMES_IN_FLIGHT; back > 0; back--) {
+		if (back > frameIndex) continue;
+		FrameSlot& older = slots[(frameIndex - back) % FRAMES_IN_FLIGHT];
+		if (older.pending && !resolve(older)) break;
+	}
+
+	FrameSlot& slot = slots[frameIndex % FRAMES_IN_FLIGHT];
+	if (slot.pending) {
+		droppedFrames++;
+		slot.pending = false;
+	}
+	if (!enabled) return;
+
+	slot.usedQueries = 0;
+	slot.records.clear();
+	slot.frame = frameIndex;
+	openRecords.clear();
+	inFrame = true;
+	push("Frame");
+}
+
+void GpuProfiler::endFrame() {
+	if (!inFrame) return;
+	while (!openRecords.empty()) pop();
+	inFrame = false;
+	slots[frameIndex % FRAMES_IN_FLIGHT].pending = true;
+	frameIndex++;
+}
+
+void GpuProfiler::push(const char* name) {
+	if (!inFrame) return;
+	FrameSlot& slot = slots[frameIndex % FRAMES_IN_FLIGHT];
+	Record record{};
+	record.name = name;
+	record.parent = openRecords.empty() ? -1 : openRecords.back();
+	record.depth = static_cast<int>(openRecords.size());
+	record.beginQuery = slot.usedQueries;
+	glQueryCounter(nextQuery(slot), GL_TIMESTAMP);
+	openRecords.push_back(static_cast<int>(slot.records.size()));
+	slot.records.push_back(record);
+}
+
+void GpuProfiler::pop() {
+	if (!inFrame || openRecords.empty()) return;
+	FrameSlot& slot = slots[frameIndex % FRAMES_IN_FLIGHT];
+	slot.records[openRecords.back()].endQuery = slot.usedQueries;
+	glQueryCounter(nextQuery(slot), GL_TIMESTAMP);
+	openRecords.pop_back();
+}
+
+bool GpuProfiler::startCsv(const std::string& path) {
+	stopCsv();
+	csv.open(path, std::ios::out | std::ios::trunc);
+	if (!csv.is_open()) return false;
+	csv << "frame,zone,depth,start_ms,duration_ms\n";
+	return true;
+}
+
+void GpuProfiler::stopCsv() {
+	if (csv.is_open()) csv.close();
+}
@@ -0,0 +1,133 @@
+#pragma once
+#include<glad.h>
+#include<fstream>
+#include<string>
+#include<unordered_map>
+#include<vector>
+
+/*
+* Hierarchical GPU profiler.
+* Zones are opened and closed around passes or single draws (see GpuProfiler::Zone) and may be nested. Each zone boundary is a
+* GL_TIMESTAMP query, so unlike GpuTimer, zones can nest and can be used inside GpuTimer sections. Frames are only read back
+* once their queries are available: the queries of a frame live in one of FRAMES_IN_FLIGHT slots, which are checked at the
+* start of each later frame. When a slot comes around again before its results arrived, that frame is dropped instead of
+* waiting for the GPU.
+*
+* A zone is identified by its path, i.e. the names of the zones enclosing it; its time is smoothed over frames like GpuTimer.
+* getZones() lists the zones of the last frame read back, in the order they were opened. The zones of every frame read back can
+* also be written to a CSV file (frame, zone path, depth, start and duration in milliseconds, relative to the frame).
+*
+* A frame looks like:
+*   beginFrame(); { GpuProfiler::Zone zone(profiler, "Pass"); ... } ...; endFrame();
+* Zone names must outlive the profiler (string literals).
+*/
+class GpuProfiler {
+public:
+	//Opens a zone for its lifetime.
+	class Zone {
+	private:
+		GpuProfiler* profiler;
+	public:
+		//The zone is not recorded if enabled is false, e.g. for optional per-draw zones.
+		Zone(GpuProfiler& gpuProfiler, const char* name, bool enabled = true);
+		~Zone();
+
+		Zone(const Zone&) = delete;
+		Zone& operator=(const Zone&) = delete;
+	};
+
+	struct ZoneStats {
+		const char* name;
+		int depth;//0 for the frame, 1 for zones opened directly in it, ...
+		double lastMs;
+		double avgMs;
+	};
+
+private:
+	static const int FRAMES_IN_FLIGHT = 4;
+
+	struct Record {
+		const char* name;
+		int parent;//index of the enclosing record, -1 for the frame
+		int depth;
+		int beginQuery, endQuery;
+	};
+
+	struct FrameSlot {
+		std::vector<GLuint> queries;
+		int usedQueries;
+		std::vector<Record> records;
+		unsigned long long frame;
+		bool pending;//the queries were issued and not read back yet
+	};
+
+	bool enabled;
+	bool inFrame;
+	FrameSlot slots[FRAMES_IN_FLIGHT];
+	unsigned long long frameIndex;
+	std::vector<int> openRecords;//stack of the zones currently open in the frame being recorded
+	size_t droppedFrames;
+
+	std::unordered_map<std::string, double> averages;//smoothed time by zone path
+	std::vector<ZoneStats> zones;
+	std::vector<std::string> paths;//scratch for resolve()
+
+	std::ofstream csv;
+
+	GLuint nextQuery(FrameSlot& slot);
+	bool resolve(FrameSlot& slot);//false if the results are not available yet
+
+public:
+	GpuProfiler();
+	~GpuProfiler();
+
+	GpuProfiler(const GpuProfiler&) = delete;
+	GpuProfiler& operator=(const GpuProfiler&) = delete;
+
+	//Turn recording on or off. Takes effect at the next beginFrame().
+	void setEnabled(bool on);
+	bool isEnabled() const;
+
+	//Start a frame (opens the frame zone), after reading back the earlier frames that are done.
+	void beginFrame();
+	void endFrame();
+
+	void push(const char* name);
+	void pop();
+
+	//Zones of the last frame read back.
+	const std::vector<ZoneStats>& getZones() const;
+	//Number of frames whose results were not available in time.
+	size_t getDroppedFrames() const;
+
+	//Write the zones of every frame read back to a CSV file, until stopCsv(). Returns false if the file cannot be opened.
+	bool startCsv(const std::string& path);
+	void stopCsv();
+	bool isWritingCsv() const;
+};
+
+inline GpuProfiler::Zone::Zone(GpuProfiler& gpuProfiler, const char* name, bool enabled) : profiler(nullptr) {
+	if (!enabled || !gpuProfiler.inFrame) return;
+	profiler = &gpuProfiler;
+	profiler->push(name);
+}
+
+inline GpuProfiler::Zone::~Zone() {
+	if (profiler) profiler->pop();
+}
+
+inline bool GpuProfiler::isEnabled() const {
+	return enabled;
+}
+
+inline const std::vector<GpuProfiler::ZoneStats>& GpuProfiler::getZones() const {
+	return zones;
+}
+
+inline size_t GpuProfiler::getDroppedFrames() const {
+	return droppedFrames;
+}
+
+inline bool GpuProfiler::isWritingCsv() const {
+	return csv.is_open();
+}
@@ -0,0 +1,84 @@
+#pragma once
+#include<glad.h>
+
+/*
+* Measures the GPU time of a section of a frame with GL_TIME_ELAPSED queries.
+* Results are only read once available, so a small ring of queries is cycled through and the reported time lags a few frames
+* behind. The time is smoothed with an exponential moving average, since single frames are noisy.
+* Only one GL_TIME_ELAPSED query can be active at a time, so timers cannot be nested.
+*/
+class GpuTimer {
+private:
+	static const int NUM_QUERIES = 4;
+	GLuint queries[NUM_QUERIES];
+	bool pending[NUM_QUERIES];
+	int current;
+	double avgMs;
+	bool hasResult;
+
+public:
+	GpuTimer();
+	~GpuTimer();
+
+	GpuTimer(const GpuTimer&) = delete;
+	GpuTimer& operator=(const GpuTimer&) = delete;
+
+	//Start timing. Collects the results of earlier queries that are done.
+	void begin();
+	void end();
+
+	//Smoothed time between begin() and end() in milliseconds, or 0 if no result is available yet.
+	double getMilliseconds() const;
+	bool hasData() const;
+
+	//Forget the measured time, e.g. after switching render modes.
+	void reset();
+};
+
+inline GpuTimer::GpuTimer() : current(0), avgMs(0.0), hasResult(false) {
+	glCreateQueries(GL_TIME_ELAPSED, NUM_QUERIES, queries);
+	for (int i = 0; i < NUM_QUERIES; i++) pending[i] = false;
+}
+
+inline GpuTimer::~GpuTimer() {
+	glDeleteQueries(NUM_QUERIES, queries);
+}
+
+inline void GpuTimer::begin() {
+	for (int i = 0; i < NUM_QUERIES; i++) {
+		if (!pending[i]) continue;
+		GLint available = 0;
+		glGetQueryObjectiv(queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available) continue;
+
+		GLuint64 ns = 0;
+		glGetQueryObjectui64v(queries[i], GL_QUERY_RESULT, &ns);
+		pending[i] = false;
+		double ms = static_cast<double>(ns) * 1e-6;
+		avgMs = hasResult ? avgMs * 0.95 + ms * 0.05 : ms;
+		hasResult = true;
+	}
+
+	//If every query is still in flight, reuse the oldest one; its result is lost.
+	current = (current + 1) % NUM_QUERIES;
+	pending[current] = false;
+	glBeginQuery(GL_TIME_ELAPSED, queries[current]);
+}
+
+inline void GpuTimer::end() {
+	glEndQuery(GL_TIME_ELAPSED);
+	pending[current] = true;
+}
+
+inline double GpuTimer::getMilliseconds() const {
+	return hasResult ? avgMs : 0.0;
+}
+
+inline bool GpuTimer::hasData() const {
+	return hasResult;
+}
+
+inline void GpuTimer::reset() {
+	avgMs = 0.0;
+	hasResult = false;
+}
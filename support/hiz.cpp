@@ -0,0 +1,191 @@
+#include "hiz.hpp"
+#include"program.hpp"
+#include<algorithm>
+#include<cmath>
+
+namespace {
+	constexpr GLuint HIZ_WORKGROUP_SIZE = 8;//must match local_size_x/y in hizReduce.comp
+	constexpr int HIZ_READBACK_MAX_SIZE = 256;//the first level no larger than this in either dimension is read back
+	constexpr float HIZ_VIEW_TOLERANCE = 1e-5f;//largest change of a view-projection element, relative to the largest element
+
+	//Uniform locations in hizReduce.comp
+	constexpr GLint LOCATION_HIZ_SRC_SIZE = 0;
+	constexpr GLint LOCATION_HIZ_DST_SIZE = 1;
+	constexpr GLint LOCATION_HIZ_COPY_DEPTH = 2;
+
+	//Screen rectangle (in [0,1] texture coordinates) and nearest depth of a projected box.
+	struct ScreenRect {
+		float minX, minY, maxX, maxY;
+		float minDepth;
+	};
+
+	//Project the corners of the box. Returns false if the box crosses the near plane, in which case no rectangle can be given.
+	bool projectBox(const Aabb& box, const Mat44f& viewProjMat, ScreenRect& rect) {
+		rect = ScreenRect{ 1.f, 1.f, 0.f, 0.f, 1.f };
+		for (int i = 0; i < 8; i++) {
+			Vec4f corner{
+				(i & 1) ? box.max.x : box.min.x,
+				(i & 2) ? box.max.y : box.min.y,
+				(i & 4) ? box.max.z : box.min.z,
+				1.f };
+			Vec4f clip = viewProjMat * corner;
+			if (clip.w <= 1e-5f || clip.z < -clip.w) return false;
+
+			float x = clip.x / clip.w * 0.5f + 0.5f;
+			float y = clip.y / clip.w * 0.5f + 0.5f;
+			float z = clip.z / clip.w * 0.5f + 0.5f;
+			rect.minX = std::min(rect.minX, x);
+			rect.maxX = std::max(rect.maxX, x);
+			rect.minY = std::min(rect.minY, y);
+			rect.maxY = std::max(rect.maxY, y);
+			rect.minDepth = std::min(rect.minDepth, z);
+		}
+		return true;
+	}
+
+	//Are the matrices the same, up to float noise? Any real camera or projection change is larger than the tolerance.
+	bool sameViewProj(const Mat44f& a, const Mat44f& b) {
+		float scale = 0.f, diff = 0.f;
+		for (int i = 0; i < 16; i++) {
+			scale = std::max(scale, std::fabs(a.v[i]));
+			diff = std::max(diff, std::fabs(a.v[i] - b.v[i]));
+		}
+		return diff <= HIZ_VIEW_TOLERANCE * scale;
+	}
+}
+
+HiZBuffer::HiZBuffer(ShaderProgram* reduceProgram) : program(reduceProgram), depthTex(0), pyramidTex(0), width(0), height(0),
+	numLevels(0), readbackLevel(0), readbackBuffer(nullptr), readbackFence(nullptr), pendingViewProj(kIdentity44f),
+	depthWidth(0), depthHeight(0), depthViewProj(kIdentity44f), valid(false) {
+}
+
+HiZBuffer::~HiZBuffer() {
+	release();
+}
+
+void HiZBuffer::release() {
+	if (readbackFence) glDeleteSync(readbackFence);
+	if (depthTex) glDeleteTextures(1, &depthTex);
+	if (pyramidTex) glDeleteTextures(1, &pyramidTex);
+	readbackFence = nullptr;
+	depthTex = pyramidTex = 0;
+	readbackBuffer.reset();
+	valid = false;
+}
+
+void HiZBuffer::resize(int newWidth, int newHeight) {
+	release();
+	width = newWidth;
+	height = newHeight;
+
+	numLevels = 1;
+	while ((std::max(width, height) >> numLevels) > 0) numLevels++;
+
+	//Depth is copied to a depth texture first, since depth formats cannot be bound as images.
+	glCreateTextures(GL_TEXTURE_2D, 1, &depthTex);
+	glTextureStorage2D(depthTex, 1, GL_DEPTH_COMPONENT32F, width, height);
+	glTextureParameteri(depthTex, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTextureParameteri(depthTex, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	readbackLevel = 0;
+	while (readbackLevel + 1 < numLevels &&
+		(std::max(width >> readbackLevel, 1) > HIZ_READBACK_MAX_SIZE || std::max(height >> readbackLevel, 1) > HIZ_READBACK_MAX_SIZE))
+		readbackLevel++;
+
+	//Only the levels up to the one read back are ever built
+	glCreateTextures(GL_TEXTURE_2D, 1, &pyramidTex);
+	glTextureStorage2D(pyramidTex, readbackLevel + 1, GL_R32F, width, height);
+	depthWidth = std::max(width >> readbackLevel, 1);
+	depthHeight = std::max(height >> readbackLevel, 1);
+	depth.assign(static_cast<size_t>(depthWidth) * depthHeight, 1.f);
+	readbackBuffer = std::make_unique<Buffer>(depth.size() * sizeof(float), nullptr);
+}
+
+void HiZBuffer::capture(int fbWidth, int fbHeight, const Mat44f& viewProjMat) {
+	if (!program || fbWidth <= 0 || fbHeight <= 0) return;
+	if (fbWidth != width || fbHeight != height) resize(fbWidth, fbHeight);
+	//The pyramid only feeds the readback: nothing to build until the previous one is done
+	if (readbackFence) return;
+
+	glCopyTextureSubImage2D(depthTex, 0, 0, 0, 0, 0, width, height);
+
+	GLuint progId = program->programId();
+	glUseProgram(progId);
+	glBindTextureUnit(TEXTURE_UNIT_HIZ_DEPTH, depthTex);
+
+	for (int level = 0; level <= readbackLevel; level++) {
+		int srcWidth = std::max(width >> std::max(level - 1, 0), 1);
+		int srcHeight = std::max(height >> std::max(level - 1, 0), 1);
+		int dstWidth = std::max(width >> level, 1);
+		int dstHeight = std::max(height >> level, 1);
+
+		glProgramUniform2i(progId, LOCATION_HIZ_SRC_SIZE, srcWidth, srcHeight);
+		glProgramUniform2i(progId, LOCATION_HIZ_DST_SIZE, dstWidth, dstHeight);
+		glProgramUniform1i(progId, LOCATION_HIZ_COPY_DEPTH, level == 0 ? 1 : 0);
+		glBindImageTexture(IMAGE_UNIT_HIZ_SRC, pyramidTex, std::max(level - 1, 0), GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+		glBindImageTexture(IMAGE_UNIT_HIZ_DST, pyramidTex, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+
+		glDispatchCompute((dstWidth + HIZ_WORKGROUP_SIZE - 1) / HIZ_WORKGROUP_SIZE, (dstHeight + HIZ_WORKGROUP_SIZE - 1) / HIZ_WORKGROUP_SIZE, 1);
+		glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+	}
+
+	glBindImageTexture(IMAGE_UNIT_HIZ_SRC, 0, 0, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+	glBindImageTexture(IMAGE_UNIT_HIZ_DST, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+
+	glMemoryBarrier(GL_PIXEL_BUFFER_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, readbackBuffer->getBufferID());
+	glGetTextureImage(pyramidTex, readbackLevel, GL_RED, GL_FLOAT, static_cast<GLsizei>(depth.size() * sizeof(float)), nullptr);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	readbackFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	pendingViewProj = viewProjMat;
+}
+
+void HiZBuffer::update() {
+	pollReadback();
+}
+
+void HiZBuffer::pollReadback() {
+	if (!readbackFence) return;
+	//Never wait for the GPU - keep testing against the older depth until the copy is done.
+	GLenum status = glClientWaitSync(readbackFence, 0, 0);
+	if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED) {
+		glGetNamedBufferSubData(readbackBuffer->getBufferID(), 0, static_cast<GLsizeiptr>(depth.size() * sizeof(float)), depth.data());
+		glDeleteSync(readbackFence);
+		readbackFence = nullptr;
+		depthViewProj = pendingViewProj;
+		valid = true;
+	}
+}
+
+bool HiZBuffer::isOccluded(const Aabb& worldBox, const Mat44f& viewProjMat) const {
+	//Once the camera moved, parallax can reveal what was hidden behind an occluder in the read back depth
+	if (!valid || !sameViewProj(viewProjMat, depthViewProj)) return false;
+
+	ScreenRect rect;
+	if (!projectBox(worldBox, depthViewProj, rect)) return false;
+	if (rect.maxX < 0.f || rect.maxY < 0.f || rect.minX > 1.f || rect.minY > 1.f) return false;//off screen, left to frustum culling
+
+	int x0 = std::max(static_cast<int>(std::floor(rect.minX * depthWidth)) - 1, 0);
+	int y0 = std::max(static_cast<int>(std::floor(rect.minY * depthHeight)) - 1, 0);
+	int x1 = std::min(static_cast<int>(std::floor(rect.maxX * depthWidth)) + 1, depthWidth - 1);
+	int y1 = std::min(static_cast<int>(std::floor(rect.maxY * depthHeight)) + 1, depthHeight - 1);
+
+	for (int y = y0; y <= y1; y++) {
+		for (int x = x0; x <= x1; x++) {
+			if (depth[static_cast<size_t>(y) * depthWidth + x] >= rect.minDepth) return false;
+		}
+	}
+	return true;
+}
+
+bool HiZBuffer::isValid() const {
+	return valid;
+}
+
+int HiZBuffer::getReadbackWidth() const {
+	return depthWidth;
+}
+
+int HiZBuffer::getReadbackHeight() const {
+	return depthHeight;
+}
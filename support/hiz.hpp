@@ -0,0 +1,83 @@
+#pragma once
+#include<glad.h>
+#include<memory>
+#include<vector>
+#include"buffer.hpp"
+#include"../vmlib/mat44.hpp"
+#include"../vmlib/bounds.hpp"
+
+class ShaderProgram;
+
+//Texture and image units used while building the pyramid (must match assets/hizReduce.comp).
+constexpr const int TEXTURE_UNIT_HIZ_DEPTH = 0;
+constexpr const int IMAGE_UNIT_HIZ_SRC = 0;
+constexpr const int IMAGE_UNIT_HIZ_DST = 1;
+
+/*
+* Hierarchical-Z occlusion culling.
+* At the end of the opaque pass, the depth buffer is copied and reduced into a mip pyramid in which each texel holds the
+* farthest depth of the area it covers (assets/hizReduce.comp). A coarse level of the pyramid is read back to the CPU
+* asynchronously (pixel pack buffer + fence), and the following frames test the screen rectangles of object bounds against it.
+*
+* Since the pyramid lags one or more frames behind, the tests are made conservative:
+*  - nothing is culled unless the view-projection matrix is the one the depth was rendered with. Once the camera moved, an
+*    object hidden behind an occluder in the read back depth can be visible now (parallax), which no test in either frame
+*    can rule out. Culling picks up again once the depth of the new view is read back;
+*  - the current box is projected with that view-projection matrix, so the motion of the object itself is accounted for.
+*    Occluders that moved since the depth was captured are not: for the frames the depth lags behind, an object they
+*    uncovered can still be culled;
+*  - the rectangle is grown by one texel, to cover rounding in the coarse level;
+*  - a box crossing the near plane is always visible.
+* An object is reported occluded only if its nearest depth is behind the farthest depth over the whole rectangle.
+*/
+class HiZBuffer {
+private:
+	ShaderProgram* program;//the reduction compute program
+
+	GLuint depthTex;//copy of the depth buffer
+	GLuint pyramidTex;//R32F, mip levels 0 to readbackLevel
+	int width, height;
+	int numLevels;
+	int readbackLevel;//level that is read back to the CPU
+
+	std::unique_ptr<Buffer> readbackBuffer;
+	GLsync readbackFence;
+	Mat44f pendingViewProj;//view-projection of the frame currently being read back
+
+	std::vector<float> depth;//the read back level, row by row starting at the bottom of the screen
+	int depthWidth, depthHeight;
+	Mat44f depthViewProj;//view-projection matrix the read back depth was rendered with
+	bool valid;
+
+	void release();
+	void resize(int newWidth, int newHeight);
+	void pollReadback();
+
+public:
+	//Input:
+	// - reduceProgram: program built from assets/hizReduce.comp.
+	HiZBuffer(ShaderProgram* reduceProgram);
+	~HiZBuffer();
+
+	HiZBuffer(const HiZBuffer&) = delete;
+	HiZBuffer& operator=(const HiZBuffer&) = delete;
+
+	//Copy the depth buffer of the current read framebuffer, build the pyramid, and start reading it back. Does nothing while
+	//the previous readback is in flight.
+	//Input:
+	// - fbWidth, fbHeight: size of the framebuffer;
+	// - viewProjMat: view-projection matrix the depth was rendered with.
+	void capture(int fbWidth, int fbHeight, const Mat44f& viewProjMat);
+
+	//Pick up a finished readback, if any. Call once per frame before testing.
+	void update();
+
+	//Is the world-space box hidden behind the depth of a previous frame? Returns false if no depth is available yet, or if
+	//viewProjMat differs from the view-projection matrix of that depth.
+	bool isOccluded(const Aabb& worldBox, const Mat44f& viewProjMat) const;
+
+	//Has depth been read back, i.e. can isOccluded() return true?
+	bool isValid() const;
+	int getReadbackWidth() const;
+	int getReadbackHeight() const;
+};
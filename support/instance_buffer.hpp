@@ -0,0 +1,110 @@
+#pragma once
+#include<glad.h>
+#include<cstring>
+#include<memory>
+#include<vector>
+#include"buffer.hpp"
+#include"stream_buffer.hpp"
+#include"vao.hpp"
+#include"../vmlib/mat44.hpp"
+
+constexpr const int ATTRIB_LOCATION_INSTANCE_MODEL = 4;//occupies locations 4-7
+constexpr const int ATTRIB_LOCATION_INSTANCE_MODEL_N = 8;//occupies locations 8-11
+constexpr const int BINDING_POINT_INSTANCE = 4;//vertex buffer binding point used for per-instance data
+
+//Per-instance data. Matrices are stored column-major (i.e. transposed Mat44f), so the vertex shader can read them
+//directly as mat4 attributes.
+struct InstanceData {
+	Mat44f modelMat;
+	Mat44f modelMatN;
+};
+
+/*
+* A list of per-instance transforms and the GPU buffer they are streamed to.
+* The CPU-side list is rebuilt by the user (clear() + add()) and then sent to the GPU with upload().
+* Buffers use immutable storage, so when the list outgrows the buffer, a new buffer with double the capacity is allocated.
+* Lists rebuilt every frame are better uploaded to a StreamBuffer instead: the instances are then copied into its mapped memory
+* and the bindings use that range until the next upload, which must happen every frame the instances are drawn.
+*/
+class InstanceBuffer {
+private:
+	std::vector<InstanceData> instances;
+	std::unique_ptr<Buffer> buffer;
+	size_t capacity;//number of instances the GPU buffer can hold
+	StreamAllocation streamed;//range of the last upload to a stream buffer
+	bool isStreamed;//the last upload went to a stream buffer
+
+public:
+	//Input:
+	// - capacityHint: expected number of instances, so an early allocation can be made.
+	InstanceBuffer(size_t capacityHint = 16);
+
+	//Remove all instances (the GPU buffer is kept).
+	void clear();
+
+	//Append an instance. Matrices are given in the usual row-major Mat44f form.
+	void add(const Mat44f& modelMat, const Mat44f& modelMatN);
+
+	//Copy the instance list to the GPU, growing the buffer if required.
+	void upload();
+	//Copy the instance list to the region of the current frame of a stream buffer.
+	void upload(StreamBuffer& stream);
+
+	//Bind the uploaded instances to the per-instance binding point of the given vao.
+	void bindToAttrib(const VertexArrayObject& vao) const;
+	//Bind the uploaded instances to a shader storage block.
+	void bindToStorage(uint32_t index) const;
+
+	size_t size() const;
+	const InstanceData& operator[](size_t idx) const;
+};
+
+inline InstanceBuffer::InstanceBuffer(size_t capacityHint) : buffer(nullptr), capacity(capacityHint > 0 ? capacityHint : 1),
+	streamed{ nullptr, 0, 0, 0 }, isStreamed(false) {
+	instances.reserve(capacity);
+	buffer = std::make_unique<Buffer>(capacity * sizeof(InstanceData), nullptr);
+}
+
+inline void InstanceBuffer::clear() {
+	instances.clear();
+}
+
+inline void InstanceBuffer::add(const Mat44f& modelMat, const Mat44f& modelMatN) {
+	instances.push_back({ transpose(modelMat), transpose(modelMatN) });
+}
+
+inline void InstanceBuffer::upload() {
+	if (instances.empty()) return;
+	if (instances.size() > capacity) {
+		while (capacity < instances.size()) capacity *= 2;
+		buffer = std::make_unique<Buffer>(capacity * sizeof(InstanceData), nullptr);
+	}
+	buffer->setData(0, instances.size() * sizeof(InstanceData), instances.data());
+	isStreamed = false;
+}
+
+inline void InstanceBuffer::upload(StreamBuffer& stream) {
+	if (instances.empty()) return;
+	//Storage alignment, since the GPU culler reads the instances as a shader storage block
+	streamed = stream.allocateStorage(instances.size() * sizeof(InstanceData));
+	std::memcpy(streamed.data, instances.data(), streamed.size);
+	isStreamed = true;
+}
+
+inline void InstanceBuffer::bindToAttrib(const VertexArrayObject& vao) const {
+	if (isStreamed) streamed.bindToAttrib(vao, BINDING_POINT_INSTANCE, sizeof(InstanceData));
+	else buffer->bindToAttrib(vao, BINDING_POINT_INSTANCE, 0, sizeof(InstanceData));
+}
+
+inline void InstanceBuffer::bindToStorage(uint32_t index) const {
+	if (isStreamed) streamed.bindToStorage(index);
+	else buffer->bindToStorage(index, 0, instances.size() * sizeof(InstanceData));
+}
+
+inline size_t InstanceBuffer::size() const {
+	return instances.size();
+}
+
+inline const InstanceData& InstanceBuffer::operator[](size_t idx) const {
+	return instances[idx];
+}
@@ -46,31 +46,32 @@ int LightManager::addDirLight(const DirLight& dirLight) {
 }
 
 int LightManager::addPointLight(const PointLight& pointLight, float attenFuncPow) {
-	if (numPointLights >= MAX_POINT_LIGHTS) {
-		throw Error("Cannot create a new point light, because max number of point lights (%i) has been reached.", MAX_POINT_LIGHTS);
+	PointLightInternal pointLightNew{ pointLight.pos,pointLight.rMax,pointLight.col,0.0f,calcAttenConsts(pointLight.rMax,attenFuncPow),0.0f };
+	pointLights.push_back(pointLightNew);
+
+	//Update buffer. Lights past the buffer capacity are only kept on the CPU.
+	if (numPointLights < static_cast<int>(MAX_POINT_LIGHTS)) {
+		pointLightBuffer.setData(numPointLights * sizeof(PointLightInternal), sizeof(PointLightInternal), &pointLightNew);
+		numPointLights++;
+		pointLightBuffer.setData(MAX_POINT_LIGHTS * sizeof(PointLightInternal), sizeof(int), &numPointLights);
 	}
-	PointLightInternal pointLightNew{ pointLight.pos,0.0f,pointLight.col,0.0f,calcAttenConsts(pointLight.rMax,attenFuncPow),0.0f };
-	//Update buffer
-	pointLightBuffer.setData(numPointLights * sizeof(PointLightInternal), sizeof(PointLightInternal), &pointLightNew);
-	numPointLights++;
-	pointLightBuffer.setData(MAX_POINT_LIGHTS * sizeof(PointLightInternal), sizeof(int), &numPointLights);
-	
-	return numPointLights - 1;//return light index
+
+	return static_cast<int>(pointLights.size()) - 1;//return light index
 }
 
 int LightManager::addSpotLight(const SpotLight& spotLight, float attenFuncPow) {
-	if (numSpotLights >= MAX_SPOT_LIGHTS) {
-		throw Error("Cannot create a new spot light, because max number of spot lights (%i) has been reached.", MAX_SPOT_LIGHTS);
-	}
 	SpotLightInternal spotLightNew{ spotLight.pos,std::cosf(spotLight.innerCone),spotLight.dir,std::cosf(spotLight.outerCone),
-	spotLight.col,0.0f,calcAttenConsts(spotLight.rMax,attenFuncPow),0.0f };
-
-	//Update buffer
-	spotLightBuffer.setData(numSpotLights * sizeof(SpotLightInternal), sizeof(SpotLightInternal), &spotLightNew);
-	numSpotLights++;
-	spotLightBuffer.setData(MAX_SPOT_LIGHTS * sizeof(SpotLightInternal), sizeof(int), &numSpotLights);
+	spotLight.col,spotLight.rMax,calcAttenConsts(spotLight.rMax,attenFuncPow),0.0f };
+	spotLights.push_back(spotLightNew);
+
+	//Update buffer. Lights past the buffer capacity are only kept on the CPU.
+	if (numSpotLights < static_cast<int>(MAX_SPOT_LIGHTS)) {
+		spotLightBuffer.setData(numSpotLights * sizeof(SpotLightInternal), sizeof(SpotLightInternal), &spotLightNew);
+		numSpotLights++;
+		spotLightBuffer.setData(MAX_SPOT_LIGHTS * sizeof(SpotLightInternal), sizeof(int), &numSpotLights);
+	}
 
-	return numSpotLights-1;//return light index
+	return static_cast<int>(spotLights.size()) - 1;//return light index
 }
 
 void LightManager::editDirLight(int idx, const DirLight& dirLight) {
@@ -82,21 +83,26 @@ void LightManager::editDirLight(int idx, const DirLight& dirLight) {
 }
 
 void LightManager::editPointLight(int idx, const PointLight& pointLight, float attenFuncPow) {
-	if (idx >= MAX_POINT_LIGHTS || idx < 0) {
-		throw Error("Invalid index. Must be in the range 0-%i", MAX_POINT_LIGHTS - 1);
+	if (idx >= static_cast<int>(pointLights.size()) || idx < 0) {
+		throw Error("Invalid index. Must be in the range 0-%i", static_cast<int>(pointLights.size()) - 1);
 	}
-	PointLightInternal pointLightNew{ pointLight.pos,0.0f,pointLight.col,0.0f,calcAttenConsts(pointLight.rMax,attenFuncPow),0.0f };
+	PointLightInternal pointLightNew{ pointLight.pos,pointLight.rMax,pointLight.col,0.0f,calcAttenConsts(pointLight.rMax,attenFuncPow),0.0f };
+	pointLights[idx] = pointLightNew;
 
-	pointLightBuffer.setData(idx * sizeof(PointLightInternal), sizeof(PointLightInternal), &pointLightNew);
+	if (idx < numPointLights)
+		pointLightBuffer.setData(idx * sizeof(PointLightInternal), sizeof(PointLightInternal), &pointLightNew);
 }
 
 void LightManager::editSpotLight(int idx, const SpotLight& spotLight, float attenFuncPow) {
-	if (idx >= MAX_SPOT_LIGHTS || idx < 0) {
-		throw Error("Invalid index. Must be in the range 0-%i", MAX_SPOT_LIGHTS - 1);
+	if (idx >= static_cast<int>(spotLights.size()) || idx < 0) {
+		throw Error("Invalid index. Must be in the range 0-%i", static_cast<int>(spotLights.size()) - 1);
 	}
 	SpotLightInternal spotLightNew{ spotLight.pos,std::cosf(spotLight.innerCone),spotLight.dir,std::cosf(spotLight.outerCone),
-		spotLight.col,0.0f,calcAttenConsts(spotLight.rMax,attenFuncPow),0.0f };
-	spotLightBuffer.setData(idx * sizeof(SpotLightInternal), sizeof(SpotLightInternal), &spotLightNew);
+		spotLight.col,spotLight.rMax,calcAttenConsts(spotLight.rMax,attenFuncPow),0.0f };
+	spotLights[idx] = spotLightNew;
+
+	if (idx < numSpotLights)
+		spotLightBuffer.setData(idx * sizeof(SpotLightInternal), sizeof(SpotLightInternal), &spotLightNew);
 }
 
 void LightManager::clearDirLights() {
@@ -106,14 +112,24 @@ void LightManager::clearDirLights() {
 
 void LightManager::clearPointLights() {
 	numPointLights = 0;
+	pointLights.clear();
 	pointLightBuffer.setData(MAX_POINT_LIGHTS * sizeof(PointLightInternal), sizeof(int), &numPointLights);
 }
 
 void LightManager::clearSpotLights() {
 	numSpotLights = 0;
+	spotLights.clear();
 	spotLightBuffer.setData(MAX_SPOT_LIGHTS * sizeof(SpotLightInternal), sizeof(int), &numSpotLights);
 }
 
 void LightManager::setAmbientLight(const Vec3f ambLight, const ShaderProgram& program) {
 	glProgramUniform3f(program.programId(), LOCATION_UNIFORM_AMBIENT_LIGHT, ambLight.x, ambLight.y, ambLight.z);
 }
+
+const std::vector<LightManager::PointLightInternal>& LightManager::getPointLights() const {
+	return pointLights;
+}
+
+const std::vector<LightManager::SpotLightInternal>& LightManager::getSpotLights() const {
+	return spotLights;
+}
\ No newline at end of file
@@ -37,10 +37,17 @@ struct SpotLight {
 	float rMax;//maximum radius of illumination
 };
 
+/*
+* Manages the lights of the scene and their GPU buffers.
+* The uniform buffers read by the forward shaders hold at most MAX_POINT_LIGHTS/MAX_SPOT_LIGHTS lights. Further lights are accepted
+* and kept on the CPU (see getPointLights()/getSpotLights()), so they can be used by the clustered path (clustered_lights.hpp),
+* but they are invisible to the shaders that read the uniform buffers.
+*/
 class LightManager {
-private:
+public:
 	//For consistency, we prefer to add explicit padding and keep the 'pos' and 'dir' members Vec3f for all structs
 	//instead of setting them Vec4f for some structs (to avoid explicit padding variables) and Vec3f in others.
+	//The layouts match both std140 and std430, so the same structs are used in uniform and shader storage buffers.
 	struct DirLightInternal {
 		Vec3f dir;
 		float padding; //unused variable
@@ -50,7 +57,7 @@ private:
 
 	struct PointLightInternal {
 		Vec3f pos;
-		float padding;//unused variable
+		float rMax;//unused by the shaders reading the uniform buffer
 		Vec3f col;
 		float padding2;
 		Vec3f attenConst;
@@ -63,17 +70,20 @@ private:
 		Vec3f dir;
 		float outerCone;
 		Vec3f col;
-		float padding;
+		float rMax;//unused by the shaders reading the uniform buffer
 		Vec3f attenConst;
 		float padding2;
 	};
 
+private:
 	Buffer dirLightBuffer;
 	Buffer pointLightBuffer;
 	Buffer spotLightBuffer;
 	int numDirLights;
 	int numPointLights;
 	int numSpotLights;
+	std::vector<PointLightInternal> pointLights;//all point lights, including those past the uniform buffer capacity
+	std::vector<SpotLightInternal> spotLights;//all spot lights, including those past the uniform buffer capacity
 
 	Vec3f calcAttenConsts(float rMax, float k = 2);
 
@@ -99,4 +109,7 @@ public:
 	void clearSpotLights();
 
 	void setAmbientLight(const Vec3f ambLight, const ShaderProgram& program);
+
+	const std::vector<PointLightInternal>& getPointLights() const;
+	const std::vector<SpotLightInternal>& getSpotLights() const;
 };
\ No newline at end of file
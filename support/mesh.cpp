@@ -1,62 +1,98 @@
 #include "mesh.hpp"
 #include"program.hpp"
+#include"instance_buffer.hpp"
+#include"culling.hpp"
 #include"texture.hpp"
 #include"rapidobj/rapidobj.hpp"
 #include<unordered_map>
 #include"window.hpp"
 #include"camera.hpp"
+#include"object_lights.hpp"
+#include"shader_permutations.hpp"
+#include"cpu_profiler.hpp"
 
 const char* ASSETS_TEX_DIR = "./assets/";
 
 
-Mesh::Mesh(Vertex* vertices, size_t numVerts, size_t numFaceGroupsHint, bool uvFlag) : vbo(numVerts*sizeof(Vertex),vertices), hasUVs(uvFlag) {
+Mesh::Mesh(Vertex* vertices, size_t numVerts, size_t numFaceGroupsHint, bool uvFlag) : vbo(numVerts*sizeof(Vertex),vertices), hasUVs(uvFlag),
+	bounds(numVerts == 0 ? Aabb{ { 0.f, 0.f, 0.f }, { 0.f, 0.f, 0.f } } : make_aabb(&vertices->pos, numVerts, sizeof(Vertex))),
+	boundingSphere(numVerts == 0 ? Sphere{ { 0.f, 0.f, 0.f }, 0.f } : make_bounding_sphere(&vertices->pos, numVerts, sizeof(Vertex))) {
 
 	//Reserve space for face groups
 	faceGroups.reserve(numFaceGroupsHint);
 }
 
 void Mesh::addFaceGroup(unsigned int* indices, size_t numIndices, const Material& mat) {
-	faceGroups.emplace_back(indices, numIndices, mat);
+	faceGroups.emplace_back(indices, numIndices, mat, bounds, boundingSphere);
 }
 
-void Mesh::draw(State& state, VertexArrayObject& vao, const MeshUniforms& uniforms) {
+void Mesh::addFaceGroup(unsigned int* indices, size_t numIndices, const Material& mat, const Aabb& fgBounds, const Sphere& fgSphere) {
+	faceGroups.emplace_back(indices, numIndices, mat, fgBounds, fgSphere);
+}
+
+size_t Mesh::getNumTriangles() const {
+	size_t numTris = 0;
+	for (const auto& fg : faceGroups) numTris += fg.numIndices / 3;
+	return numTris;
+}
 
+void Mesh::bindVertexBuffer(VertexArrayObject& vao) {
 	vbo.bindToAttrib(vao, ATTRIB_LOCATION_VERT_POS, 0, sizeof(Vertex));//bind buffer to pos binding point, stride is the vertex size
 	vbo.bindToAttrib(vao, ATTRIB_LOCATION_VERT_NORMAL, 0, sizeof(Vertex));//bind buffer to normal binding point
 	vbo.bindToAttrib(vao, ATTRIB_LOCATION_VERT_UV, 0, sizeof(Vertex));//bind buffer to uv binding point
 	vbo.bindToAttrib(vao, ATTRIB_LOCATION_VERT_TANGENT, 0, sizeof(Vertex));//bind buffer to tangent binding point
+}
+
+ShaderProgram* Mesh::useProgram(State& state, MaterialFaceGroupInternal& faceGroup, int standardCode, int bumpMapCode) {
+	ShaderProgram* program = nullptr;
+	uint32_t features = materialShaderFeatures(faceGroup.mat, hasUVs);
+
+	if (faceGroup.mat.normalMap)
+		program = state.programs->getProgram(bumpMapCode, features);
+	if (!program) program = state.programs->getProgram(standardCode, features);
+	if (!program) return nullptr;
+
+	glUseProgram(program->programId());
+	glProgramUniform3f(program->programId(), 3, state.cam->getPosition().x, state.cam->getPosition().y, state.cam->getPosition().z);
+	if (state.objectLights) state.objectLights->setUniforms(*program);
+
+	//Bind appropriate material parameters
+	if (hasUVs) {
+		if (state.programs->lightModel == LightModel::PBR) {
+			faceGroup.mat.bindPbrParams(*program);
+		}
+		else
+			faceGroup.mat.bindNonPbrParams(*program);
+	}
+	else {
+		faceGroup.mat.bindMaterialNoTex(*program, state.programs->lightModel);
+	}
+	return program;
+}
+
+void Mesh::draw(State& state, VertexArrayObject& vao, const MeshUniforms& uniforms) {
+	CPU_ZONE("Mesh::draw");
+
+	bindVertexBuffer(vao);
+
+	//Face groups are only tested when there is more than one - otherwise the caller has already tested the whole mesh.
+	bool cullFaceGroups = uniforms.frustum && uniforms.modelMat && faceGroups.size() > 1;
 
-	ShaderProgram* last = nullptr;
-	
 	for (auto it = faceGroups.begin(); it != faceGroups.end(); it++) {
-		it->veb.bindAsElementBuf(vao);
-		ShaderProgram* program = nullptr;
+		if (cullFaceGroups && !intersects(*uniforms.frustum, transform_aabb(*uniforms.modelMat, it->bounds))) {
+			if (uniforms.stats) uniforms.stats->trianglesCulled += it->numIndices / 3;
+			continue;
+		}
+		if (uniforms.stats) uniforms.stats->trianglesSubmitted += it->numIndices / 3;
 
-		
-		if (it->mat.normalMap)
-			program = state.programs->getProgram(RenderSettings::BUMP_MAP);
-		if(!program) program = state.programs->getProgram(RenderSettings::STANDARD);
+		it->veb.bindAsElementBuf(vao);
+		ShaderProgram* program = useProgram(state, *it, RenderSettings::STANDARD, RenderSettings::BUMP_MAP);
 
 		if (program) {
-			glUseProgram(program->programId());
 			//Set up uniforms
 			if (uniforms.modelMat) glProgramUniformMatrix4fv(program->programId(), 0, 1, GL_TRUE, uniforms.modelMat->v);
 			if (uniforms.modelMatN) glProgramUniformMatrix4fv(program->programId(), 1, 1, GL_TRUE, uniforms.modelMatN->v);
 			if (uniforms.viewProjMat) glProgramUniformMatrix4fv(program->programId(), 2, 1, GL_TRUE, uniforms.viewProjMat->v);
-			glProgramUniform3f(program->programId(), 3, state.cam->getPosition().x, state.cam->getPosition().y, state.cam->getPosition().z);
-
-			//Bind appropriate material parameters
-			if (hasUVs) {
-				if (state.programs->lightModel == LightModel::PBR) {
-					it->mat.bindPbrParams(*program);
-				}
-				else
-					it->mat.bindNonPbrParams(*program);
-			}
-			else {
-				it->mat.bindMaterialNoTex(*program, state.programs->lightModel);
-			}
-			
 		}
 
 		//Draw
@@ -64,9 +100,109 @@ void Mesh::draw(State& state, VertexArrayObject& vao, const MeshUniforms& unifor
 	}
 }
 
+void Mesh::drawDepth(State& state, VertexArrayObject& vao, const MeshUniforms& uniforms) {
+	CPU_ZONE("Mesh::drawDepth");
+	ShaderProgram* program = state.programs->getProgram(RenderSettings::DEPTH_ONLY);
+	if (!program) return;
+
+	bindVertexBuffer(vao);
+	glUseProgram(program->programId());
+	if (uniforms.modelMat) glProgramUniformMatrix4fv(program->programId(), 0, 1, GL_TRUE, uniforms.modelMat->v);
+	if (uniforms.viewProjMat) glProgramUniformMatrix4fv(program->programId(), 2, 1, GL_TRUE, uniforms.viewProjMat->v);
+
+	bool cullFaceGroups = uniforms.frustum && uniforms.modelMat && faceGroups.size() > 1;
+
+	for (auto it = faceGroups.begin(); it != faceGroups.end(); it++) {
+		if (cullFaceGroups && !intersects(*uniforms.frustum, transform_aabb(*uniforms.modelMat, it->bounds))) continue;
+		it->veb.bindAsElementBuf(vao);
+		glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(it->numIndices), GL_UNSIGNED_INT, nullptr);
+	}
+}
+
+void Mesh::drawDepthInstanced(State& state, VertexArrayObject& vao, const InstanceBuffer& instances, const Mat44f& viewProjMat) {
+	ShaderProgram* program = state.programs->getProgram(RenderSettings::DEPTH_ONLY_INSTANCED);
+	if (!program || instances.size() == 0) return;
+
+	bindVertexBuffer(vao);
+	instances.bindToAttrib(vao);
+	glUseProgram(program->programId());
+	glProgramUniformMatrix4fv(program->programId(), 2, 1, GL_TRUE, viewProjMat.v);
+
+	for (auto it = faceGroups.begin(); it != faceGroups.end(); it++) {
+		it->veb.bindAsElementBuf(vao);
+		glDrawElementsInstanced(GL_TRIANGLES, static_cast<GLsizei>(it->numIndices), GL_UNSIGNED_INT, nullptr,
+			static_cast<GLsizei>(instances.size()));
+	}
+}
+
+void Mesh::drawInstanced(State& state, VertexArrayObject& vao, const InstanceBuffer& instances, const Mat44f& viewProjMat) {
+	CPU_ZONE("Mesh::drawInstanced");
+	if (instances.size() == 0) return;
+
+	bindVertexBuffer(vao);
+	instances.bindToAttrib(vao);
+
+	for (auto it = faceGroups.begin(); it != faceGroups.end(); it++) {
+		it->veb.bindAsElementBuf(vao);
+		ShaderProgram* program = useProgram(state, *it, RenderSettings::INSTANCED, RenderSettings::INSTANCED_BUMP_MAP);
+
+		if (program) {
+			glProgramUniformMatrix4fv(program->programId(), 2, 1, GL_TRUE, viewProjMat.v);
+			glDrawElementsInstanced(GL_TRIANGLES, static_cast<GLsizei>(it->numIndices), GL_UNSIGNED_INT, nullptr,
+				static_cast<GLsizei>(instances.size()));
+			continue;
+		}
+
+		//No instanced program available - draw the instances one by one with the regular programs.
+		//Instance matrices are stored column-major, hence no transposition on upload.
+		program = useProgram(state, *it, RenderSettings::STANDARD, RenderSettings::BUMP_MAP);
+		if (!program) continue;
+		glProgramUniformMatrix4fv(program->programId(), 2, 1, GL_TRUE, viewProjMat.v);
+		for (size_t i = 0; i < instances.size(); i++) {
+			glProgramUniformMatrix4fv(program->programId(), 0, 1, GL_FALSE, instances[i].modelMat.v);
+			glProgramUniformMatrix4fv(program->programId(), 1, 1, GL_FALSE, instances[i].modelMatN.v);
+			glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(it->numIndices), GL_UNSIGNED_INT, nullptr);
+		}
+	}
+}
+
+void Mesh::drawIndirect(State& state, VertexArrayObject& vao, const InstanceBuffer& instances, const Mat44f& viewProjMat,
+	const Buffer& commands, size_t commandsPerFaceGroup, const Buffer* drawCount, bool depthOnly) {
+	if (instances.size() == 0 || commandsPerFaceGroup == 0) return;
+	ShaderProgram* depthProgram = depthOnly ? state.programs->getProgram(RenderSettings::DEPTH_ONLY_INSTANCED) : nullptr;
+	if (depthOnly && !depthProgram) return;
+
+	bindVertexBuffer(vao);
+	instances.bindToAttrib(vao);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commands.getBufferID());
+	if (drawCount) glBindBuffer(GL_PARAMETER_BUFFER, drawCount->getBufferID());
 
-Mesh::MaterialFaceGroupInternal::MaterialFaceGroupInternal(unsigned int* indices, size_t numIndices, const Material& material) :
-	mat(material), veb(numIndices  * sizeof(int), indices), numIndices(numIndices) {
+	for (size_t i = 0; i < faceGroups.size(); i++) {
+		ShaderProgram* program = depthProgram;
+		if (depthOnly)
+			glUseProgram(program->programId());
+		else
+			program = useProgram(state, faceGroups[i], RenderSettings::INSTANCED, RenderSettings::INSTANCED_BUMP_MAP);
+		if (!program) continue;//indirect draws rely on per-instance attributes, so there is no non-instanced fallback
+		glProgramUniformMatrix4fv(program->programId(), 2, 1, GL_TRUE, viewProjMat.v);
+		faceGroups[i].veb.bindAsElementBuf(vao);
+
+		const void* offset = reinterpret_cast<const void*>(i * commandsPerFaceGroup * sizeof(DrawElementsIndirectCommand));
+		if (drawCount)
+			glMultiDrawElementsIndirectCount(GL_TRIANGLES, GL_UNSIGNED_INT, offset, 0,
+				static_cast<GLsizei>(commandsPerFaceGroup), sizeof(DrawElementsIndirectCommand));
+		else
+			glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, offset,
+				static_cast<GLsizei>(commandsPerFaceGroup), sizeof(DrawElementsIndirectCommand));
+	}
+
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	if (drawCount) glBindBuffer(GL_PARAMETER_BUFFER, 0);
+}
+
+Mesh::MaterialFaceGroupInternal::MaterialFaceGroupInternal(unsigned int* indices, size_t numIndices, const Material& material,
+	const Aabb& bounds, const Sphere& boundingSphere) :
+	mat(material), veb(numIndices  * sizeof(int), indices), numIndices(numIndices), bounds(bounds), boundingSphere(boundingSphere) {
 }
 
 
@@ -142,6 +278,34 @@ namespace std {
 }
 
 
+//#############################################//
+// HELPER FUNCTIONS RELATED TO BOUNDING VOLUMES //
+//#############################################//
+namespace {
+
+	//Compute the bounding box and sphere of the vertices referenced by an index array.
+	//The sphere is centred at the centre of the box, as in make_bounding_sphere.
+	void calculateBounds(const Vertex* vertices, const std::vector<unsigned int>& indices, Aabb& bounds, Sphere& sphere) {
+		if (indices.empty()) {
+			bounds = Aabb{ { 0.f, 0.f, 0.f }, { 0.f, 0.f, 0.f } };
+			sphere = Sphere{ { 0.f, 0.f, 0.f }, 0.f };
+			return;
+		}
+
+		bounds = Aabb{ vertices[indices[0]].pos, vertices[indices[0]].pos };
+		for (unsigned int idx : indices) expand(bounds, vertices[idx].pos);
+
+		Vec3f center = 0.5f * (bounds.min + bounds.max);
+		float radius2 = 0.f;
+		for (unsigned int idx : indices) {
+			Vec3f d = vertices[idx].pos - center;
+			radius2 = std::fmax(radius2, dot(d, d));
+		}
+		sphere = Sphere{ center, std::sqrt(radius2) };
+	}
+}
+
+
 //#################################################//
 // HELPER FUNCTIONS RELATED TO TANGENT CALCULATION //
 //#################################################//
@@ -391,7 +555,10 @@ Mesh* MeshLoader::loadMesh(const char* filename) {
 		mat.setPbrParams(diffTex, metallicTex, roughnessTex, ambientTex);
 		mat.setAdditionalParams(emissiveTex, bumpTex, nullptr);
 
-		newMesh->addFaceGroup(indexArrays[i].data(), indexArrays[i].size(), mat);
+		Aabb fgBounds;
+		Sphere fgSphere;
+		calculateBounds(vertices.data(), indexArrays[i], fgBounds, fgSphere);
+		newMesh->addFaceGroup(indexArrays[i].data(), indexArrays[i].size(), mat, fgBounds, fgSphere);
 	}
 
 	if (meshes.size() == meshes.capacity()) meshes.reserve(meshes.size() * 2);
@@ -402,5 +569,7 @@ Mesh* MeshLoader::loadMesh(const char* filename) {
 	printf("Number of normals: %i\n", (int)numNormals);
 	printf("Number of UVs: %i\n", (int)numUVs);
 	printf("Number of materials: %i\n", static_cast<int>(result.materials.size()));
+	printf("Bounding sphere: centre (%f, %f, %f), radius %f\n", newMesh->boundingSphere.center.x, newMesh->boundingSphere.center.y,
+		newMesh->boundingSphere.center.z, newMesh->boundingSphere.radius);
 	return newMesh;
 }
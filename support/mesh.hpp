@@ -5,10 +5,15 @@
 #include"../vmlib/vec2.hpp"
 #include"../vmlib/vec3.hpp"
 #include"../vmlib/mat44.hpp"
+#include"../vmlib/bounds.hpp"
+#include"../vmlib/frustum.hpp"
 #include<vector>
 #include"texture.hpp"
 
 class State;
+class ShaderProgram;
+class InstanceBuffer;
+struct CullStats;
 
 constexpr const int ATTRIB_LOCATION_VERT_POS = 0;
 constexpr const int ATTRIB_LOCATION_VERT_NORMAL = 1;
@@ -29,10 +34,21 @@ struct Vertex {
 	float handedness;
 };
 
+//Layout of a single indirect draw, as read by glDrawElementsIndirect and friends from GL_DRAW_INDIRECT_BUFFER.
+struct DrawElementsIndirectCommand {
+	GLuint count;//number of indices
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	GLuint baseInstance;//offsets the fetch of per-instance attributes
+};
+
 struct MeshUniforms {
 	const Mat44f* modelMat;
 	const Mat44f* modelMatN;
 	const Mat44f* viewProjMat;
+	const Frustum* frustum;//(optional) world-space frustum; face groups of multi-material meshes outside of it are skipped
+	CullStats* stats;//(optional) receives the number of submitted and culled triangles
 };
 
 /*
@@ -48,13 +64,26 @@ public://TODO make private again
 		Material mat;//material shared by the faces in the group
 		Buffer veb;//vertex element buffer - an index buffer, indexing the vertex array
 		size_t numIndices;
+		Aabb bounds;//in model space
+		Sphere boundingSphere;//in model space
 		//MaterialFaceGroupInternal(const std::vector<unsigned int>& indices, const Material& material);
-		MaterialFaceGroupInternal(unsigned int* indices, size_t numIndices, const Material& material);
+		MaterialFaceGroupInternal(unsigned int* indices, size_t numIndices, const Material& material, const Aabb& bounds,
+			const Sphere& boundingSphere);
 	};
 
 	Buffer vbo;//list of vertices - contains positions, normals, and tex coords
 	std::vector<MaterialFaceGroupInternal> faceGroups;
 	bool hasUVs;
+	Aabb bounds;//in model space, computed from the vertex positions on construction (empty box at the origin without vertices)
+	Sphere boundingSphere;//in model space, computed from the vertex positions on construction (zero radius without vertices)
+
+	//Bind the vertex buffer to the pos, normal, uv, and tangent binding points of the vao.
+	void bindVertexBuffer(VertexArrayObject& vao);
+
+	//Pick the program for the face group (the bump map variant if the material has a normal map and the program exists,
+	//the standard variant otherwise), make it current, and bind the camera position and the material.
+	//Returns the program used, or nullptr if none is set.
+	ShaderProgram* useProgram(State& state, MaterialFaceGroupInternal& faceGroup, int standardCode, int bumpMapCode);
 
 public:
 	//Input:
@@ -65,10 +94,41 @@ public:
 	Mesh(Vertex* vertices, size_t numVerts, size_t numFaceGroupsHint = 1, bool uvFlag = true);
 
 	//Load a new face group, i.e. a list of triangles and an associated material.
+	//The face group takes the bounds of the whole mesh.
 	void addFaceGroup(unsigned int* indices, size_t numIndices, const Material& mat);
 
+	//Load a new face group with its own (model space) bounding volumes, used to cull parts of large meshes.
+	void addFaceGroup(unsigned int* indices, size_t numIndices, const Material& mat, const Aabb& fgBounds, const Sphere& fgSphere);
+
+	//Total number of triangles over all face groups.
+	size_t getNumTriangles() const;
+
 	//Draw the mesh.
 	void draw(State& state, VertexArrayObject& vao, const MeshUniforms& uniforms);
+
+	//Draw the mesh into the depth buffer only, with the DEPTH_ONLY program of the current render settings (no materials are bound).
+	//Face groups are culled as in draw(); stats are not updated.
+	void drawDepth(State& state, VertexArrayObject& vao, const MeshUniforms& uniforms);
+
+	//Depth-only variant of drawInstanced(), using the DEPTH_ONLY_INSTANCED program.
+	void drawDepthInstanced(State& state, VertexArrayObject& vao, const InstanceBuffer& instances, const Mat44f& viewProjMat);
+
+	//Draw all instances in the instance buffer with a single draw call per face group.
+	//The vao must have the per-instance attributes set up (see VertexArrayObject::addInstanceAttribMat4F) and the
+	//instance buffer must have been uploaded. Uses the INSTANCED programs of the current render settings; if these are
+	//not set, falls back to one regular draw per instance.
+	void drawInstanced(State& state, VertexArrayObject& vao, const InstanceBuffer& instances, const Mat44f& viewProjMat);
+
+	//Draw instances using indirect commands produced on the GPU (see GpuFrustumCuller).
+	//The command buffer holds one list of commandsPerFaceGroup commands for each face group, in face group order.
+	//Input:
+	// - commands: the buffer holding the DrawElementsIndirectCommand lists;
+	// - commandsPerFaceGroup: length of each list (the maximum number of draws per face group);
+	// - drawCount: (optional) buffer holding the number of valid commands per list as a GLuint at offset 0. If nullptr, all
+	//   commandsPerFaceGroup commands are submitted (commands for skipped instances are expected to have instanceCount = 0);
+	// - depthOnly: draw with the DEPTH_ONLY_INSTANCED program instead of the INSTANCED ones.
+	void drawIndirect(State& state, VertexArrayObject& vao, const InstanceBuffer& instances, const Mat44f& viewProjMat,
+		const Buffer& commands, size_t commandsPerFaceGroup, const Buffer* drawCount, bool depthOnly = false);
 };
 
 /*
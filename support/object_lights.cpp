@@ -0,0 +1,63 @@
+#include "object_lights.hpp"
+#include"program.hpp"
+#include<algorithm>
+#include<cmath>
+
+namespace {
+	//Can a sphere overlap the cone of a spot light? The cone is given by its apex, unit axis and the cosine of its half angle.
+	//The signed distance from the centre to the cone surface is found in the plane through the axis and the centre; for
+	//centres behind the apex it underestimates the distance, which keeps the test conservative.
+	bool sphereInCone(const Vec3f& center, float radius, const Vec3f& apex, const Vec3f& axis, float cosAngle) {
+		Vec3f v = center - apex;
+		float along = dot(v, axis);
+		float across = std::sqrt(std::max(dot(v, v) - along * along, 0.f));
+		float sinAngle = std::sqrt(std::max(1.f - cosAngle * cosAngle, 0.f));
+		return cosAngle * across - sinAngle * along <= radius;
+	}
+}
+
+ObjectLightLists::ObjectLightLists() : counts{ 0, 0 }, indices{}, stats{} {
+}
+
+void ObjectLightLists::begin(const LightManager& lights) {
+	const auto& allPoints = lights.getPointLights();
+	const auto& allSpots = lights.getSpotLights();
+	pointLights.assign(allPoints.begin(), allPoints.begin() + std::min<size_t>(allPoints.size(), MAX_POINT_LIGHTS));
+	spotLights.assign(allSpots.begin(), allSpots.begin() + std::min<size_t>(allSpots.size(), MAX_SPOT_LIGHTS));
+	stats = LightListStats{ 0, 0, pointLights.size() + spotLights.size() };
+}
+
+void ObjectLightLists::assign(const Aabb& worldBox) {
+	int n = 0;
+	for (size_t i = 0; i < pointLights.size(); i++) {
+		const auto& light = pointLights[i];
+		if (distance_squared(worldBox, light.pos) <= light.rMax * light.rMax)
+			indices[n++] = static_cast<GLint>(i);
+	}
+	counts[0] = n;
+
+	Vec3f boxCenter = 0.5f * (worldBox.min + worldBox.max);
+	Vec3f halfSize = 0.5f * (worldBox.max - worldBox.min);
+	float boxRadius = length(halfSize);
+	for (size_t i = 0; i < spotLights.size(); i++) {
+		const auto& light = spotLights[i];
+		if (distance_squared(worldBox, light.pos) > light.rMax * light.rMax) continue;
+		if (!sphereInCone(boxCenter, boxRadius, light.pos, light.dir, light.outerCone)) continue;
+		indices[n++] = static_cast<GLint>(i);
+	}
+	counts[1] = n - counts[0];
+
+	stats.objects++;
+	stats.lightsEvaluated += static_cast<size_t>(n);
+}
+
+void ObjectLightLists::setUniforms(const ShaderProgram& program) const {
+	GLuint progId = program.programId();
+	glProgramUniform2i(progId, LOCATION_UNIFORM_LIGHT_COUNTS, counts[0], counts[1]);
+	if (counts[0] + counts[1] > 0)
+		glProgramUniform1iv(progId, LOCATION_UNIFORM_LIGHT_INDICES, counts[0] + counts[1], indices);
+}
+
+const LightListStats& ObjectLightLists::getStats() const {
+	return stats;
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include<glad.h>
+#include<vector>
+#include"lights.hpp"
+#include"../vmlib/bounds.hpp"
+
+class ShaderProgram;
+
+//Uniform locations of the light list in assets/cookTorranceLightList.frag.
+constexpr const int LOCATION_UNIFORM_LIGHT_COUNTS = 14;
+constexpr const int LOCATION_UNIFORM_LIGHT_INDICES = 15;
+
+//Per-frame counters of the light assignment.
+struct LightListStats {
+	size_t objects;//number of light lists built
+	size_t lightsEvaluated;//sum of the list lengths
+	size_t lightsAvailable;//point and spot lights in the uniform buffers, i.e. the list length without assignment
+
+	double averageLightsPerObject() const { return objects ? static_cast<double>(lightsEvaluated) / objects : 0.0; }
+};
+
+/*
+* Per-object light lists.
+* The forward shaders loop over all point and spot lights of the uniform buffers, although most objects are only reached by
+* a few of them. Before an object is drawn, assign() intersects its world-space bounds with the range of each light, and for
+* spot lights also with the cone, and keeps the indices of the lights that may reach it. The list is passed with the draw as
+* a uniform array (assets/cookTorranceLightList.frag), so the shader only evaluates those lights.
+*
+* Mesh::useProgram() sets the uniforms of the current list on every program it selects while State::objectLights points to
+* this object, so the list must be assigned before each draw. Only the lights held by the uniform buffers (the first
+* MAX_POINT_LIGHTS/MAX_SPOT_LIGHTS) are considered.
+*/
+class ObjectLightLists {
+private:
+	std::vector<LightManager::PointLightInternal> pointLights;
+	std::vector<LightManager::SpotLightInternal> spotLights;
+
+	GLint counts[2];//point, spot
+	GLint indices[MAX_POINT_LIGHTS + MAX_SPOT_LIGHTS];//point light indices, then spot light indices
+	LightListStats stats;
+
+public:
+	ObjectLightLists();
+
+	//Start a new frame: take a copy of the lights in the uniform buffers and reset the counters.
+	void begin(const LightManager& lights);
+
+	//Build the list of the lights reaching a world-space box.
+	void assign(const Aabb& worldBox);
+
+	//Set the current list on a program using it.
+	void setUniforms(const ShaderProgram& program) const;
+
+	const LightListStats& getStats() const;
+};
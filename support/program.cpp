@@ -1,23 +1,43 @@
 #include "program.hpp"
 
+#include <string>
 #include <vector>
 #include <utility>
 
 #include <cstdio>
+#include <cstring>
 
 #include <glad.h>
 #include <GLFW/glfw3.h>
 
 #include "error.hpp"
 #include "checkpoint.hpp"
+#include "shader_permutations.hpp"
+#include "program_cache.hpp"
 
 namespace
 {
-	GLuint load_shader_( 
-		GLenum aShaderType, 
+	std::vector<GLchar> read_shader_source_(
 		char const* aSourcePath
 	);
 
+	GLuint issue_shader_(
+		GLenum aShaderType,
+		std::vector<GLchar> const& aSource,
+		std::vector<std::string> const& aDefines
+	);
+
+	void check_shader_(
+		GLuint aShader,
+		GLenum aShaderType,
+		char const* aSourcePath
+	);
+
+	bool parallel_compile_();
+
+	// GL_KHR_parallel_shader_compile is not part of the generated loader
+	constexpr GLenum kCompletionStatusKHR_ = 0x91B1;
+
 	// lightweight std::experimental::scope_exit alternative
 	// Not the most complete or convenient implementation...
 	template< typename tFunc >
@@ -37,6 +57,8 @@ namespace
 	}
 }
 
+ProgramBinaryCache* ShaderProgram::sBinaryCache = nullptr;
+
 //ShaderProgram::ShaderProgram(std::vector<ShaderSource> aShaderSources)
 //	: mProgram(0)
 //	, mSources(std::move(aShaderSources))
@@ -44,27 +66,44 @@ namespace
 //	reload();
 //}
 
-ShaderProgram::ShaderProgram(std::vector<ShaderSource> aShaderSources)
+ShaderProgram::ShaderProgram(std::vector<ShaderSource> aShaderSources, std::vector<std::string> aDefines, bool aAsync)
 	: mProgram(0)
+	, mPendingProgram(0)
+	, mLoaded(false)
 	, mSources(std::move(aShaderSources))
+	, mDefines(std::move(aDefines))
 {
-	reload();
+	if( aAsync )
+		reloadAsync();
+	else
+		reload();
 }
 
 ShaderProgram::~ShaderProgram()
 {
+	discard_pending_();
 	if( 0 != mProgram )
 		glDeleteProgram( mProgram );
 }
 
 ShaderProgram::ShaderProgram(ShaderProgram&& aOther) noexcept
 	: mProgram(std::exchange(aOther.mProgram, 0))
+	, mPendingProgram(std::exchange(aOther.mPendingProgram, 0))
+	, mLoaded(std::exchange(aOther.mLoaded, false))
+	, mPendingShaders(std::move(aOther.mPendingShaders))
+	, mPendingKey(std::move(aOther.mPendingKey))
 	, mSources(std::move(aOther.mSources))
+	, mDefines(std::move(aOther.mDefines))
 {}
 ShaderProgram& ShaderProgram::operator= (ShaderProgram&& aOther) noexcept
 {
 	std::swap( mProgram, aOther.mProgram );
+	std::swap( mPendingProgram, aOther.mPendingProgram );
+	std::swap( mLoaded, aOther.mLoaded );
+	std::swap( mPendingShaders, aOther.mPendingShaders );
+	std::swap( mPendingKey, aOther.mPendingKey );
 	std::swap( mSources, aOther.mSources );
+	std::swap( mDefines, aOther.mDefines );
 	return *this;
 }
 
@@ -73,11 +112,130 @@ GLuint ShaderProgram::programId() const noexcept
 	return mProgram;
 }
 
+void ShaderProgram::setBinaryCache( ProgramBinaryCache* aCache ) noexcept
+{
+	sBinaryCache = aCache;
+}
+
 void ShaderProgram::reload()
 {
-	// Space to hold the shaders when we load them
-	std::vector<GLuint> shaders;
-	shaders.reserve( mSources.size() );
+	reloadAsync();
+	finish();
+}
+
+void ShaderProgram::reloadAsync()
+{
+	// A reload still in flight is superseded
+	discard_pending_();
+
+	// Read the shader sources. With a binary cache, they are part of the key of
+	// the program: any change to a file or to the defines misses the cache.
+	std::vector<std::vector<GLchar>> texts;
+	texts.reserve( mSources.size() );
+	for( auto const& source : mSources )
+		texts.emplace_back( read_shader_source_( source.sourcePath.c_str() ) );
+
+	std::string cacheKey;
+	if( sBinaryCache )
+	{
+		for( std::size_t i = 0; i < mSources.size(); ++i )
+		{
+			cacheKey += std::to_string( mSources[i].type ) + ' ' + mSources[i].sourcePath + '\n';
+			cacheKey.append( texts[i].data(), texts[i].size() );
+			cacheKey += '\n';
+		}
+		for( auto const& define : mDefines )
+			cacheKey += "#define " + define + '\n';
+
+		// A cached binary is ready right away. One the driver rejects leaves the
+		// program unusable, so the program is compiled in a fresh object instead.
+		GLuint prog = glCreateProgram();
+		if( sBinaryCache->load( cacheKey, prog ) )
+		{
+			OGL_CHECKPOINT_ALWAYS();
+			std::swap( mProgram, prog );
+			if( 0 != prog )
+				glDeleteProgram( prog );
+			mLoaded = true;
+			return;
+		}
+		glDeleteProgram( prog );
+	}
+
+	// Issue the compilation and the link without querying their results, which
+	// would wait for them. The driver may run them on its own threads (see
+	// poll()); errors are reported when the reload completes.
+	OGL_CHECKPOINT_ALWAYS();
+
+	mPendingProgram = glCreateProgram();
+	if( sBinaryCache )
+		glProgramParameteri( mPendingProgram, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE );
+
+	for( std::size_t i = 0; i < mSources.size(); ++i )
+	{
+		mPendingShaders.emplace_back( issue_shader_( mSources[i].type, texts[i], mDefines ) );
+		glAttachShader( mPendingProgram, mPendingShaders.back() );
+	}
+
+	glLinkProgram( mPendingProgram );
+	mPendingKey = std::move( cacheKey );
+
+	OGL_CHECKPOINT_ALWAYS();
+}
+
+bool ShaderProgram::poll()
+{
+	if( 0 == mPendingProgram )
+		return true;
+
+	// Without GL_KHR_parallel_shader_compile, there is no way to tell whether
+	// the driver is done without waiting for it.
+	if( parallel_compile_() )
+	{
+		GLint done = GL_FALSE;
+		glGetProgramiv( mPendingProgram, kCompletionStatusKHR_, &done );
+		if( GL_TRUE != done )
+			return false;
+	}
+
+	complete_();
+	return true;
+}
+
+void ShaderProgram::finish()
+{
+	if( 0 != mPendingProgram )
+		complete_();
+}
+
+bool ShaderProgram::isPending() const noexcept
+{
+	return 0 != mPendingProgram;
+}
+
+bool ShaderProgram::consumeLoaded() noexcept
+{
+	return std::exchange( mLoaded, false );
+}
+
+void ShaderProgram::discard_pending_() noexcept
+{
+	for( auto const shader : mPendingShaders )
+		glDeleteShader( shader );
+	mPendingShaders.clear();
+	if( 0 != mPendingProgram )
+		glDeleteProgram( mPendingProgram );
+	mPendingProgram = 0;
+	mPendingKey.clear();
+}
+
+void ShaderProgram::complete_()
+{
+	GLuint prog = std::exchange( mPendingProgram, 0 );
+	std::vector<GLuint> shaders = std::move( mPendingShaders );
+	std::string cacheKey = std::move( mPendingKey );
+	mPendingShaders.clear();
+	mPendingKey.clear();
 
 	// Ensure that shaders are cleaned up properly, regardless of how we leave
 	// the function (e.g., either by returning or by exception)
@@ -86,15 +244,6 @@ void ShaderProgram::reload()
 			glDeleteShader( shader );
 	} );
 
-	// Load shaders
-	for( auto const& source : mSources )
-		shaders.emplace_back( load_shader_( source.type, source.sourcePath.c_str() ) );
-
-	// Create program object
-	OGL_CHECKPOINT_ALWAYS();
-
-	GLuint prog = glCreateProgram();
-
 	// Ensure that the program is cleaned up. 
 
 	/* There is a small trick here. If we successfully compile and link the new
@@ -110,11 +259,9 @@ void ShaderProgram::reload()
 			glDeleteProgram( prog );
 	} );
 
-	// Link individual shaders to create the final shader program
-	for( auto const shader : shaders )
-		glAttachShader( prog, shader );
-
-	glLinkProgram( prog );
+	// Compile errors are reported first, as they make the link fail as well
+	for( std::size_t i = 0; i < shaders.size(); ++i )
+		check_shader_( shaders[i], mSources[i].type, mSources[i].sourcePath.c_str() );
 
 	{
 		// Get info log
@@ -138,16 +285,20 @@ void ShaderProgram::reload()
 		if( !log.empty() )
 			std::fprintf( stderr, "Note: shader program linking log:\n%s\n", log.data() );
 	}
-	
+
+	if( sBinaryCache )
+		sBinaryCache->store( cacheKey, prog );
+
 	OGL_CHECKPOINT_ALWAYS();
 
 	// Replace the old shader program (if any) with the new one
 	std::swap( mProgram, prog );
+	mLoaded = true;
 }
 
 namespace
 {
-	GLuint load_shader_( GLenum aShaderType, char const* aSourcePath )
+	std::vector<GLchar> read_shader_source_( char const* aSourcePath )
 	{
 		// Load the shader source code from file
 		std::vector<GLchar> source;
@@ -170,9 +321,9 @@ namespace
 				if( 0 == ret )
 				{
 					if( auto const err = std::ferror( fin ) )
-						throw Error( "load_shader_(): error while reading from '%s': %d (%zu bytes read, %zu total)", aSourcePath, err, read, length );
+						throw Error( "read_shader_source_(): error while reading from '%s': %d (%zu bytes read, %zu total)", aSourcePath, err, read, length );
 					if( std::feof( fin ) )
-						throw Error( "load_shader_(): unexpected EOF in '%s' (%zu bytes read, %zu total)", aSourcePath, read, length );
+						throw Error( "read_shader_source_(): unexpected EOF in '%s' (%zu bytes read, %zu total)", aSourcePath, read, length );
 				}
 			
 				read += ret;
@@ -180,20 +331,53 @@ namespace
 		}
 		else
 		{
-			throw Error( "load_shader_(): unable to open input file '%s'", aSourcePath );
+			throw Error( "read_shader_source_(): unable to open input file '%s'", aSourcePath );
 		}
 
+		return source;
+	}
+
+	GLuint issue_shader_( GLenum aShaderType, std::vector<GLchar> const& aSource, std::vector<std::string> const& aDefines )
+	{
 		// Create shader object
 		OGL_CHECKPOINT_ALWAYS();
 
 		GLuint shader = glCreateShader( aShaderType );
 
+		// Defines go right after the #version directive, which must come first.
+		// A #line directive afterwards keeps the line numbers of the compile log
+		// those of the file.
+		std::size_t split = 0;
+		std::string defines;
+		if( !aDefines.empty() )
+		{
+			std::string const text( aSource.data(), aSource.size() );
+			auto const version = text.find( "#version" );
+			if( std::string::npos != version )
+			{
+				auto const eol = text.find( '\n', version );
+				split = std::string::npos == eol ? text.size() : eol+1;
+			}
+
+			for( auto const& define : aDefines )
+				defines += "#define " + define + "\n";
+
+			std::size_t line = 1;
+			for( std::size_t i = 0; i < split; ++i )
+				line += ('\n' == text[i]);
+			defines += "#line " + std::to_string( line ) + "\n";
+		}
+
 		// Compile shader
 		GLchar const* sources[] = {
-			source.data()
+			aSource.data(),
+			defines.data(),
+			aSource.data() + split
 		};
 		GLsizei lengths[] = {
-			GLsizei(source.size())
+			GLsizei(split),
+			GLsizei(defines.size()),
+			GLsizei(aSource.size() - split)
 		};
 
 		glShaderSource( shader, sizeof(sources)/sizeof(sources[0]), sources, lengths );
@@ -202,19 +386,24 @@ namespace
 
 		OGL_CHECKPOINT_ALWAYS();
 
+		return shader;
+	}
+
+	void check_shader_( GLuint aShader, GLenum aShaderType, char const* aSourcePath )
+	{
 		// Get compile info log
 		/* The compile log is mainly relevant if there is an error. However, on some
 		 * systems, it can include additional information even if compilation was
 		 * successful. This might include warnings and/or usage hints.
 		 */
 		GLint logLength = 0;
-		glGetShaderiv( shader, GL_INFO_LOG_LENGTH, &logLength );
+		glGetShaderiv( aShader, GL_INFO_LOG_LENGTH, &logLength );
 
 		std::vector<GLchar> log;
 		if( logLength )
 		{
 			log.resize( logLength );
-			glGetShaderInfoLog( shader, GLsizei(log.size()), nullptr, log.data() );
+			glGetShaderInfoLog( aShader, GLsizei(log.size()), nullptr, log.data() );
 		}
 
 		char const* shaderTypeName = "unknown shader";
@@ -230,11 +419,10 @@ namespace
 
 		// Check compile status
 		GLint status = 0;
-		glGetShaderiv( shader, GL_COMPILE_STATUS, &status );
+		glGetShaderiv( aShader, GL_COMPILE_STATUS, &status );
 
 		if( GL_TRUE != status )
 		{
-			glDeleteShader( shader );
 			throw Error( "%s \"%s\" compilation failed:\n%s\n", shaderTypeName, aSourcePath, log.data() );
 		}
 
@@ -242,26 +430,90 @@ namespace
 			std::fprintf( stderr, "Note: %s \"%s\" log:\n%s\n", shaderTypeName, aSourcePath, log.data() );
 
 		OGL_CHECKPOINT_ALWAYS();
+	}
 
-		return shader;
+	bool parallel_compile_()
+	{
+		// Checked once: there is a single context
+		static bool const supported = [] {
+			GLint count = 0;
+			glGetIntegerv( GL_NUM_EXTENSIONS, &count );
+
+			char const* threadsEntry = nullptr;
+			for( GLint i = 0; i < count && !threadsEntry; ++i )
+			{
+				auto const name = reinterpret_cast<char const*>( glGetStringi( GL_EXTENSIONS, GLuint(i) ) );
+				if( 0 == std::strcmp( name, "GL_KHR_parallel_shader_compile" ) )
+					threadsEntry = "glMaxShaderCompilerThreadsKHR";
+				else if( 0 == std::strcmp( name, "GL_ARB_parallel_shader_compile" ) )
+					threadsEntry = "glMaxShaderCompilerThreadsARB";
+			}
+			if( !threadsEntry )
+				return false;
+
+			// Let the driver pick the number of compiler threads (the default is kept for contexts GLFW does not own, see Window)
+			using MaxShaderCompilerThreads = void (APIENTRYP)( GLuint );
+			if( !glfwGetCurrentContext() )
+				return true;
+			if( auto const maxThreads = reinterpret_cast<MaxShaderCompilerThreads>( glfwGetProcAddress( threadsEntry ) ) )
+				maxThreads( 0xFFFFFFFFu );
+			return true;
+		}();
+		return supported;
 	}
 }
 
-RenderSettings::RenderSettings(LightModel model): programs(MAX_CODES,nullptr), lightModel(model) {
+RenderSettings::RenderSettings(LightModel model): programs(MAX_CODES,nullptr), permuted(MAX_CODES, PermutedCode{ nullptr, 0 }),
+	lightModel(model) {
 }
 
 void RenderSettings::setProgram(int code, ShaderProgram* program) {
 	if (code >= MAX_CODES || code < 0) return;
 	programs[code] = program;
+	permuted[code].cache = nullptr;
+}
+
+void RenderSettings::setPermutations(int code, ShaderPermutations* cache, const std::vector<ShaderProgram::ShaderSource>& sources) {
+	if (code >= MAX_CODES || code < 0) return;
+	programs[code] = nullptr;
+	permuted[code] = PermutedCode{ cache, cache->addSources(sources) };
 }
 
 void RenderSettings::reloadPrograms() {
-	for (int i = 0; i < programs.size();i++) {
-		if (programs[i]) programs[i]->reload();
+	for (size_t i = 0; i < programs.size();i++) {
+		if (programs[i]) programs[i]->reloadAsync();
+	}
+	//Caches may serve several codes, but are reloaded once
+	for (size_t i = 0; i < permuted.size(); i++) {
+		bool reloaded = false;
+		for (size_t j = 0; j < i; j++) reloaded = reloaded || permuted[j].cache == permuted[i].cache;
+		if (permuted[i].cache && !reloaded) permuted[i].cache->reloadAsync();
+	}
+}
+
+size_t RenderSettings::pollPrograms() {
+	size_t pending = 0;
+	for (size_t i = 0; i < programs.size(); i++) {
+		if (!programs[i]) continue;
+		try {
+			if (!programs[i]->poll()) pending++;
+		}
+		catch (std::exception const& eErr) {
+			std::fprintf(stderr, "Error when reloading shader:\n");
+			std::fprintf(stderr, "%s\n", eErr.what());
+			std::fprintf(stderr, "Keeping old shader.\n");
+		}
+	}
+	for (size_t i = 0; i < permuted.size(); i++) {
+		bool polled = false;
+		for (size_t j = 0; j < i; j++) polled = polled || permuted[j].cache == permuted[i].cache;
+		if (permuted[i].cache && !polled) pending += permuted[i].cache->poll();
 	}
+	return pending;
 }
 
-ShaderProgram* RenderSettings::getProgram(int code) const {
+ShaderProgram* RenderSettings::getProgram(int code, uint32_t features) const {
 	if (code >= MAX_CODES || code < 0) return nullptr;
+	if (permuted[code].cache) return permuted[code].cache->get(permuted[code].sourceSet, features);
 	return programs[code];
 }
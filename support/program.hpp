@@ -11,6 +11,8 @@
 
 enum class LightModel {BlinnPhong, PBR};
 
+class ProgramBinaryCache;
+
 class ShaderProgram final
 {
 	public:
@@ -21,7 +23,11 @@ class ShaderProgram final
 		};
 
 	public:
-		explicit ShaderProgram(std::vector<ShaderSource> = {});
+		// aDefines: macros defined in every shader of the program, right after
+		// its #version line ("NAME" or "NAME VALUE").
+		// aAsync: only issue the compilation (see reloadAsync()); the program
+		// can be used once finish() returned or poll() returned true.
+		explicit ShaderProgram(std::vector<ShaderSource> = {}, std::vector<std::string> aDefines = {}, bool aAsync = false);
 
 		~ShaderProgram();
 
@@ -34,26 +40,87 @@ class ShaderProgram final
 	public:
 		GLuint programId() const noexcept;
 
+		// Compile and link the program again, and wait for the result. Throws
+		// on errors, keeping the current program.
 		void reload();
+
+		// Issue the compilation and link without waiting for them. The current
+		// program stays in use until the new one replaces it in poll() or
+		// finish(), so many programs can compile at the same time (on driver
+		// threads with GL_KHR_parallel_shader_compile).
+		void reloadAsync();
+
+		// Complete a pending reload if the driver is done with it. Returns true
+		// when no reload is pending any more. Throws on errors, keeping the
+		// current program. Without GL_KHR_parallel_shader_compile, the first
+		// poll waits for the driver.
+		bool poll();
+
+		// Wait for the pending reload, if any. Throws as poll().
+		void finish();
+
+		bool isPending() const noexcept;
+
+		// Returns true once after the program in use was replaced by a newly
+		// loaded one, whether it was compiled or came from the binary cache
+		// (which replaces it right in reloadAsync()). Lets the owner set the
+		// uniforms of the new program.
+		bool consumeLoaded() noexcept;
+
+		// Programs loaded after this call are looked up in, and added to, the
+		// given cache of program binaries (nullptr: always compile).
+		static void setBinaryCache( ProgramBinaryCache* aCache ) noexcept;
 	private:
+		void complete_();
+		void discard_pending_() noexcept;
+
+		static ProgramBinaryCache* sBinaryCache;
+
 		GLuint mProgram;
+		GLuint mPendingProgram;//linking, replaces mProgram once done
+		bool mLoaded;//mProgram was replaced since the last consumeLoaded()
+		std::vector<GLuint> mPendingShaders;
+		std::string mPendingKey;//binary cache key of the pending program
 		std::vector<ShaderSource> mSources;
+		std::vector<std::string> mDefines;
 };
 
+class ShaderPermutations;
+
 class RenderSettings {
 private:
-	static const int MAX_CODES = 2;
+	static const int MAX_CODES = 6;
 	std::vector<ShaderProgram*> programs;
 
+	//Codes whose programs are variants from a permutation cache (see shader_permutations.hpp)
+	struct PermutedCode {
+		ShaderPermutations* cache;
+		size_t sourceSet;
+	};
+	std::vector<PermutedCode> permuted;
+
 public:
 	RenderSettings(LightModel model);
 	void setProgram(int code, ShaderProgram* program);
+	//Take the programs of a code from a permutation cache instead, built from the given shader sources with the defines of
+	//the features requested by getProgram().
+	void setPermutations(int code, ShaderPermutations* cache, const std::vector<ShaderProgram::ShaderSource>& sources);
+	//Issue the reload of all programs. Each program is replaced once its new version is compiled (see pollPrograms()).
 	void reloadPrograms();
-	ShaderProgram* getProgram(int code) const;
+	//Swap in the reloaded programs that are ready; errors are reported and the old programs kept. Call once per frame.
+	//Returns the number of programs still compiling.
+	size_t pollPrograms();
+	//Input:
+	// - features: shader feature bits (SHADER_FEATURE_*) of the material to draw. Only used by permuted codes.
+	ShaderProgram* getProgram(int code, uint32_t features = 0) const;
 	LightModel lightModel;
 
 	static const int STANDARD = 0;
 	static const int BUMP_MAP = 1;
+	static const int INSTANCED = 2;//per-instance model matrices read from vertex attributes (see instance_buffer.hpp)
+	static const int INSTANCED_BUMP_MAP = 3;
+	static const int DEPTH_ONLY = 4;//position-only programs of the depth pre-pass
+	static const int DEPTH_ONLY_INSTANCED = 5;
 };
 
 #endif // PROGRAM_HPP_39793FD2_7845_47A7_9E21_6DDAD42C9A09
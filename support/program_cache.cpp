@@ -0,0 +1,131 @@
+#include "program_cache.hpp"
+#include<cstdio>
+#include<filesystem>
+#include<vector>
+
+namespace {
+	//Bumped whenever the file layout changes
+	constexpr uint32_t CACHE_FILE_MAGIC = 0x31424750;//"PGB1"
+
+	struct CacheFileHeader {
+		uint32_t magic;
+		uint32_t format;//binary format of glGetProgramBinary
+		uint64_t keyCheck;//second hash of the key
+		uint64_t binarySize;
+	};
+
+	//FNV-1a, 64 bit
+	uint64_t hashString(const std::string& text, uint64_t seed = 14695981039346656037ull) {
+		uint64_t hash = seed;
+		for (unsigned char c : text) {
+			hash ^= c;
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+	constexpr uint64_t KEY_CHECK_SEED = 0x9e3779b97f4a7c15ull;
+
+	bool readCacheFile(const std::string& path, uint64_t keyCheck, CacheFileHeader& header, std::vector<char>& binary) {
+		std::FILE* file = std::fopen(path.c_str(), "rb");
+		if (!file) return false;
+		bool valid = std::fread(&header, sizeof(header), 1, file) == 1 && header.magic == CACHE_FILE_MAGIC
+			&& header.keyCheck == keyCheck && header.binarySize > 0;
+		if (valid) {
+			binary.resize(static_cast<size_t>(header.binarySize));
+			valid = std::fread(binary.data(), 1, binary.size(), file) == binary.size();
+		}
+		std::fclose(file);
+		return valid;
+	}
+
+	const char* glString(GLenum name) {
+		const GLubyte* str = glGetString(name);
+		return str ? reinterpret_cast<const char*>(str) : "";
+	}
+}
+
+ProgramBinaryCache::ProgramBinaryCache(const std::string& cacheDirectory) : directory(cacheDirectory), supported(false),
+	hits(0), misses(0), rejected(0) {
+	driver = std::string(glString(GL_VENDOR)) + '\n' + glString(GL_RENDERER) + '\n' + glString(GL_VERSION) + '\n';
+
+	GLint numFormats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats);
+	supported = numFormats > 0;
+
+	std::error_code error;
+	std::filesystem::create_directories(directory, error);
+	if (error) {
+		std::fprintf(stderr, "Note: cannot create program binary cache directory '%s': %s\n", directory.c_str(), error.message().c_str());
+		supported = false;
+	}
+}
+
+std::string ProgramBinaryCache::filePath(uint64_t keyHash) const {
+	char name[32];
+	std::snprintf(name, sizeof(name), "%016llx.bin", static_cast<unsigned long long>(keyHash));
+	return directory + "/" + name;
+}
+
+bool ProgramBinaryCache::load(const std::string& key, GLuint program) {
+	std::string fullKey = driver + key;
+	CacheFileHeader header{};
+	std::vector<char> binary;
+	if (!supported || !readCacheFile(filePath(hashString(fullKey)), hashString(fullKey, KEY_CHECK_SEED), header, binary)) {
+		misses++;
+		return false;
+	}
+
+	glProgramBinary(program, header.format, binary.data(), static_cast<GLsizei>(binary.size()));
+	GLint status = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &status);
+	if (status != GL_TRUE) {
+		rejected++;
+		misses++;
+		return false;
+	}
+	hits++;
+	return true;
+}
+
+void ProgramBinaryCache::store(const std::string& key, GLuint program) {
+	if (!supported) return;
+
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0) return;
+
+	std::vector<char> binary(static_cast<size_t>(length));
+	GLenum format = 0;
+	GLsizei written = 0;
+	glGetProgramBinary(program, length, &written, &format, binary.data());
+	if (written <= 0) return;
+
+	std::string fullKey = driver + key;
+	CacheFileHeader header{ CACHE_FILE_MAGIC, format, hashString(fullKey, KEY_CHECK_SEED), static_cast<uint64_t>(written) };
+	std::string path = filePath(hashString(fullKey));
+	std::FILE* file = std::fopen(path.c_str(), "wb");
+	if (!file) {
+		std::fprintf(stderr, "Note: cannot write program binary '%s'\n", path.c_str());
+		return;
+	}
+	bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1
+		&& std::fwrite(binary.data(), 1, static_cast<size_t>(written), file) == static_cast<size_t>(written);
+	std::fclose(file);
+	if (!ok) {
+		std::fprintf(stderr, "Note: cannot write program binary '%s'\n", path.c_str());
+		std::remove(path.c_str());
+	}
+}
+
+size_t ProgramBinaryCache::getHits() const {
+	return hits;
+}
+
+size_t ProgramBinaryCache::getMisses() const {
+	return misses;
+}
+
+size_t ProgramBinaryCache::getRejected() const {
+	return rejected;
+}
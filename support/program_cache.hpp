@@ -0,0 +1,38 @@
+#pragma once
+#include<glad.h>
+#include<cstdint>
+#include<string>
+
+/*
+* On-disk cache of linked program binaries (glGetProgramBinary).
+* ShaderProgram::reload() looks a program up by a key made of its shader paths, sources and defines. The cache adds the
+* vendor, renderer and version strings of the driver, since a binary is only valid for the driver that produced it. The file
+* name is a hash of the full key; the file also holds a second hash of the key, so that a name collision is a miss rather
+* than a wrong program.
+* Drivers may still reject a binary (e.g. after an update that kept the version string); the caller then compiles the
+* program from source, and stores the new binary over the old one.
+*/
+class ProgramBinaryCache {
+private:
+	std::string directory;
+	std::string driver;//vendor, renderer, version
+	bool supported;//the driver offers at least one binary format
+	size_t hits, misses, rejected;
+
+	std::string filePath(uint64_t keyHash) const;
+
+public:
+	//Input:
+	// - cacheDirectory: where the binaries are kept; created if needed.
+	explicit ProgramBinaryCache(const std::string& cacheDirectory);
+
+	//Load the binary of a program into a newly created program object. Returns false if there is no (valid) binary.
+	bool load(const std::string& key, GLuint program);
+
+	//Store the binary of a linked program.
+	void store(const std::string& key, GLuint program);
+
+	size_t getHits() const;
+	size_t getMisses() const;//includes the rejected binaries
+	size_t getRejected() const;
+};
@@ -0,0 +1,95 @@
+#include "scene_graph.hpp"
+#include"error.hpp"
+#include"../vmlib/mat44_simd.hpp"
+#include<cstring>
+
+namespace {
+	//T * R * S, written directly: the columns of R scaled, and the translation in the last column.
+	Mat44f composeTrs(const Vec3f& t, const Mat44f& r, const Vec3f& s) {
+		Mat44f m = r;
+		for (int i = 0; i < 3; i++) {
+			m(i, 0) *= s.x;
+			m(i, 1) *= s.y;
+			m(i, 2) *= s.z;
+		}
+		m(0, 3) = t.x;
+		m(1, 3) = t.y;
+		m(2, 3) = t.z;
+		m(3, 0) = m(3, 1) = m(3, 2) = 0.f;
+		m(3, 3) = 1.f;
+		return m;
+	}
+
+	//Inverse transpose of the upper 3x3 block: its cofactor matrix divided by its determinant. Normals only need that block;
+	//the translation of the result is zero.
+	Mat44f normalMatrix(const Mat44f& m) {
+		Mat44f n = kIdentity44f;
+		n(0, 0) = m(1, 1) * m(2, 2) - m(1, 2) * m(2, 1);
+		n(0, 1) = m(1, 2) * m(2, 0) - m(1, 0) * m(2, 2);
+		n(0, 2) = m(1, 0) * m(2, 1) - m(1, 1) * m(2, 0);
+		n(1, 0) = m(0, 2) * m(2, 1) - m(0, 1) * m(2, 2);
+		n(1, 1) = m(0, 0) * m(2, 2) - m(0, 2) * m(2, 0);
+		n(1, 2) = m(0, 1) * m(2, 0) - m(0, 0) * m(2, 1);
+		n(2, 0) = m(0, 1) * m(1, 2) - m(0, 2) * m(1, 1);
+		n(2, 1) = m(0, 2) * m(1, 0) - m(0, 0) * m(1, 2);
+		n(2, 2) = m(0, 0) * m(1, 1) - m(0, 1) * m(1, 0);
+		float det = m(0, 0) * n(0, 0) + m(0, 1) * n(0, 1) + m(0, 2) * n(0, 2);
+		float invDet = det != 0.f ? 1.f / det : 0.f;
+		for (int i = 0; i < 3; i++)
+			for (int j = 0; j < 3; j++)
+				n(i, j) *= invDet;
+		return n;
+	}
+}
+
+SceneGraph::SceneGraph() : lastUpdateCount(0) {
+}
+
+SceneGraph::NodeId SceneGraph::addNode(NodeId parent, const Vec3f& translation, const Mat44f& rotation, const Vec3f& scale) {
+	NodeId node = static_cast<NodeId>(parents.size());
+	if (parent != NO_PARENT && parent >= node) throw Error("Scene graph node %u added before its parent %u", node, parent);
+	parents.push_back(parent);
+	translations.push_back(translation);
+	rotations.push_back(rotation);
+	scales.push_back(scale);
+	worlds.push_back(kIdentity44f);
+	normals.push_back(kIdentity44f);
+	dirty.push_back(1);
+	changed.push_back(0);
+	return node;
+}
+
+void SceneGraph::setTranslation(NodeId node, const Vec3f& translation) {
+	Vec3f& current = translations[node];
+	if (current.x == translation.x && current.y == translation.y && current.z == translation.z) return;
+	current = translation;
+	dirty[node] = 1;
+}
+
+void SceneGraph::setRotation(NodeId node, const Mat44f& rotation) {
+	if (std::memcmp(rotations[node].v, rotation.v, sizeof(rotation.v)) == 0) return;
+	rotations[node] = rotation;
+	dirty[node] = 1;
+}
+
+void SceneGraph::setScale(NodeId node, const Vec3f& scale) {
+	Vec3f& current = scales[node];
+	if (current.x == scale.x && current.y == scale.y && current.z == scale.z) return;
+	current = scale;
+	dirty[node] = 1;
+}
+
+void SceneGraph::update() {
+	lastUpdateCount = 0;
+	for (size_t i = 0; i < parents.size(); i++) {
+		NodeId parent = parents[i];
+		bool recompute = dirty[i] || (parent != NO_PARENT && changed[parent]);
+		changed[i] = recompute;
+		if (!recompute) continue;
+		Mat44f local = composeTrs(translations[i], rotations[i], scales[i]);
+		worlds[i] = parent == NO_PARENT ? local : mul_simd(worlds[parent], local);
+		normals[i] = normalMatrix(worlds[i]);
+		dirty[i] = 0;
+		lastUpdateCount++;
+	}
+}
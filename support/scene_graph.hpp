@@ -0,0 +1,77 @@
+#pragma once
+#include<cstddef>
+#include<cstdint>
+#include<vector>
+#include"../vmlib/mat44.hpp"
+
+/*
+* Transform hierarchy: each node has a local translation, rotation and scale relative to its parent, and the graph derives
+* its world matrix (parent world * T * R * S) and its normal matrix (inverse transpose of the world matrix, for the normals).
+*
+* The nodes are stored in flat arrays, in the order they were added. A node's parent must be added before it, so that order
+* is a topological one and update() computes every parent before its children in a single pass. Setting a local transform
+* only marks the node dirty (and nothing at all when the value did not change); update() then recomputes the dirty nodes
+* and the descendants of recomputed nodes, and leaves the matrices of everything else, e.g. the static scenery, untouched.
+*
+* The references returned by getWorld() and getNormal() stay valid until the next addNode().
+*/
+class SceneGraph {
+public:
+	using NodeId = uint32_t;
+	static constexpr NodeId NO_PARENT = ~0u;
+
+private:
+	std::vector<NodeId> parents;
+	std::vector<Vec3f> translations;
+	std::vector<Mat44f> rotations;
+	std::vector<Vec3f> scales;
+	std::vector<Mat44f> worlds;
+	std::vector<Mat44f> normals;
+	std::vector<uint8_t> dirty;//the local transform changed since the last update()
+	std::vector<uint8_t> changed;//the world matrix was recomputed by the last update()
+	size_t lastUpdateCount;
+
+public:
+	SceneGraph();
+
+	//Add a node. The rotation must be a pure rotation matrix. The new node is dirty.
+	NodeId addNode(NodeId parent = NO_PARENT, const Vec3f& translation = { 0.f, 0.f, 0.f }, const Mat44f& rotation = kIdentity44f,
+		const Vec3f& scale = { 1.f, 1.f, 1.f });
+
+	void setTranslation(NodeId node, const Vec3f& translation);
+	void setRotation(NodeId node, const Mat44f& rotation);
+	void setScale(NodeId node, const Vec3f& scale);
+
+	//Recompute the world and normal matrices of the dirty nodes and of their descendants.
+	void update();
+
+	//Results of the last update().
+	const Mat44f& getWorld(NodeId node) const;
+	const Mat44f& getNormal(NodeId node) const;
+	//True when the matrices of the node were recomputed by the last update().
+	bool hasChanged(NodeId node) const;
+
+	size_t size() const;
+	//Number of nodes recomputed by the last update().
+	size_t getLastUpdateCount() const;
+};
+
+inline const Mat44f& SceneGraph::getWorld(NodeId node) const {
+	return worlds[node];
+}
+
+inline const Mat44f& SceneGraph::getNormal(NodeId node) const {
+	return normals[node];
+}
+
+inline bool SceneGraph::hasChanged(NodeId node) const {
+	return changed[node] != 0;
+}
+
+inline size_t SceneGraph::size() const {
+	return parents.size();
+}
+
+inline size_t SceneGraph::getLastUpdateCount() const {
+	return lastUpdateCount;
+}
@@ -0,0 +1,100 @@
+#include "shader_permutations.hpp"
+#include"material.hpp"
+#include"error.hpp"
+#include<cstdio>
+#include<exception>
+
+const char* const SHADER_FEATURE_DEFINES[NUM_SHADER_FEATURES] = {
+	"NO_UVS",
+	"NO_EMISSIVE_MAP",
+	"NO_MASK",
+	"NO_AMBIENT_OCCLUSION_MAP",
+};
+
+uint32_t materialShaderFeatures(const Material& material, bool hasUVs) {
+	if (!hasUVs) return SHADER_FEATURE_NO_UVS;
+	uint32_t features = 0;
+	if (!material.emissiveTex) features |= SHADER_FEATURE_NO_EMISSIVE_MAP;
+	if (!material.maskTex) features |= SHADER_FEATURE_NO_MASK;
+	if (!material.ambientTex) features |= SHADER_FEATURE_NO_AMBIENT_OCCLUSION_MAP;
+	return features;
+}
+
+ShaderPermutations::ShaderPermutations(InitProgram init) : initProgram(std::move(init)) {
+}
+
+size_t ShaderPermutations::addSources(const SourceSet& sources) {
+	for (size_t i = 0; i < sourceSets.size(); i++) {
+		const SourceSet& set = sourceSets[i];
+		bool same = set.size() == sources.size();
+		for (size_t j = 0; same && j < set.size(); j++)
+			same = set[j].type == sources[j].type && set[j].sourcePath == sources[j].sourcePath;
+		if (same) return i;
+	}
+	sourceSets.push_back(sources);
+	return sourceSets.size() - 1;
+}
+
+ShaderProgram* ShaderPermutations::get(size_t sourceSet, uint32_t features) {
+	if (sourceSet >= sourceSets.size()) throw Error("Unknown shader source set %zu\n", sourceSet);
+	uint64_t key = (static_cast<uint64_t>(sourceSet) << 32) | features;
+	auto it = variants.find(key);
+	if (it == variants.end()) {
+		std::vector<std::string> defines;
+		for (int i = 0; i < NUM_SHADER_FEATURES; i++)
+			if (features & (1u << i)) defines.push_back(SHADER_FEATURE_DEFINES[i]);
+		it = variants.emplace(key, std::make_unique<ShaderProgram>(sourceSets[sourceSet], std::move(defines), true)).first;
+	}
+
+	//A variant that is being reloaded keeps its previous program meanwhile. One loaded from the binary cache is ready
+	//right away, without going through poll(), so it is initialized here.
+	ShaderProgram* program = it->second.get();
+	if (program->programId() != 0) {
+		if (program->consumeLoaded() && initProgram) initProgram(*program);
+		return program;
+	}
+	if (features != 0) return get(sourceSet, 0);
+
+	//The generic variant has no fallback
+	program->finish();
+	if (program->consumeLoaded() && initProgram) initProgram(*program);
+	return program;
+}
+
+void ShaderPermutations::reloadAsync() {
+	for (auto& variant : variants)
+		variant.second->reloadAsync();
+}
+
+size_t ShaderPermutations::poll() {
+	size_t pending = 0;
+	for (auto& variant : variants) {
+		ShaderProgram& program = *variant.second;
+		try {
+			if (program.isPending() && !program.poll()) {
+				pending++;
+				continue;
+			}
+			//Also covers the variants reloaded from the binary cache, which never were pending
+			if (program.consumeLoaded() && initProgram) initProgram(program);
+		}
+		catch (std::exception const& eErr) {
+			std::fprintf(stderr, "Error when compiling shader variant:\n%s\n", eErr.what());
+		}
+	}
+	return pending;
+}
+
+size_t ShaderPermutations::getNumVariants() const {
+	size_t live = 0;
+	for (const auto& variant : variants)
+		if (variant.second->programId() != 0) live++;
+	return live;
+}
+
+size_t ShaderPermutations::getNumPending() const {
+	size_t pending = 0;
+	for (const auto& variant : variants)
+		if (variant.second->isPending()) pending++;
+	return pending;
+}
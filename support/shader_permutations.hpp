@@ -0,0 +1,68 @@
+#pragma once
+#include<glad.h>
+#include<cstdint>
+#include<functional>
+#include<memory>
+#include<string>
+#include<unordered_map>
+#include<vector>
+#include"program.hpp"
+
+struct Material;
+
+//Material features a shader can be specialized for. Each bit selects a define (see ShaderPermutations), which removes the
+//corresponding texture reads from the shaders written for them (e.g. assets/cookTorranceLightList.frag).
+constexpr const uint32_t SHADER_FEATURE_NO_UVS = 1u << 0;//NO_UVS: no texture coordinates, the material is drawn untextured
+constexpr const uint32_t SHADER_FEATURE_NO_EMISSIVE_MAP = 1u << 1;//NO_EMISSIVE_MAP: emission is the material constant
+constexpr const uint32_t SHADER_FEATURE_NO_MASK = 1u << 2;//NO_MASK: fully opaque
+constexpr const uint32_t SHADER_FEATURE_NO_AMBIENT_OCCLUSION_MAP = 1u << 3;//NO_AMBIENT_OCCLUSION_MAP: no occlusion
+constexpr const int NUM_SHADER_FEATURES = 4;
+
+//Defines of the feature bits, in bit order.
+extern const char* const SHADER_FEATURE_DEFINES[NUM_SHADER_FEATURES];
+
+//The feature bits a material is drawn with.
+uint32_t materialShaderFeatures(const Material& material, bool hasUVs);
+
+/*
+* Lazily compiled shader variants.
+* A variant is a program built from a set of shader sources with the defines of a feature bitmask injected after #version.
+* Variants are compiled on first use and kept, so the number of live variants is bounded by the combinations actually drawn
+* rather than by all possible ones. RenderSettings::setPermutations() makes the programs of a code come from a cache.
+* Compilation does not block drawing: a new variant is issued asynchronously, and until poll() finds it ready the generic
+* variant (no feature bits) is returned instead, which renders the same image, only slower. Only the generic variant itself is
+* waited for on first use.
+*/
+class ShaderPermutations {
+public:
+	using SourceSet = std::vector<ShaderProgram::ShaderSource>;
+	//Called on each new or reloaded variant once compiled or loaded from the binary cache, to set uniforms that do not change
+	//per draw
+	using InitProgram = std::function<void(ShaderProgram& program)>;
+
+private:
+	std::vector<SourceSet> sourceSets;
+	std::unordered_map<uint64_t, std::unique_ptr<ShaderProgram>> variants;//key: source set index << 32 | features
+	InitProgram initProgram;
+
+public:
+	explicit ShaderPermutations(InitProgram init = {});
+
+	ShaderPermutations(const ShaderPermutations&) = delete;
+	ShaderPermutations& operator=(const ShaderPermutations&) = delete;
+
+	//Register a set of shader sources and return its index. Registering the same set again returns the same index.
+	size_t addSources(const SourceSet& sources);
+
+	//Get the variant of a source set for a feature bitmask, or the generic one while it is compiling.
+	ShaderProgram* get(size_t sourceSet, uint32_t features);
+
+	//Issue the recompilation of all variants. They are replaced when ready, see poll().
+	void reloadAsync();
+
+	//Complete the variants the driver is done with. Returns the number still compiling. Call once per frame.
+	size_t poll();
+
+	size_t getNumVariants() const;//usable variants
+	size_t getNumPending() const;//variants compiling (for the first time or reloading)
+};
@@ -0,0 +1,154 @@
+#include "shadow_atlas.hpp"
+#include<algorithm>
+#include<cmath>
+
+namespace {
+	GLuint createShadowTexture(int width, int height) {
+		GLuint tex = 0;
+		glCreateTextures(GL_TEXTURE_2D, 1, &tex);
+		glTextureStorage2D(tex, 1, GL_DEPTH_COMPONENT32F, width, height);
+		glTextureParameteri(tex, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTextureParameteri(tex, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTextureParameteri(tex, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTextureParameteri(tex, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		return tex;
+	}
+
+	GLuint createDepthFramebuffer(GLuint depthTex) {
+		GLuint fbo = 0;
+		glCreateFramebuffers(1, &fbo);
+		glNamedFramebufferTexture(fbo, GL_DEPTH_ATTACHMENT, depthTex, 0);
+		glNamedFramebufferDrawBuffer(fbo, GL_NONE);
+		glNamedFramebufferReadBuffer(fbo, GL_NONE);
+		GLenum status = glCheckNamedFramebufferStatus(fbo, GL_FRAMEBUFFER);
+		if (status != GL_FRAMEBUFFER_COMPLETE) throw Error("Shadow atlas framebuffer is incomplete (status 0x%x)\n", status);
+		return fbo;
+	}
+
+	//Do two lights need different shadow maps? The colour and the attenuation do not matter.
+	bool sameShadowFrustum(const LightManager::SpotLightInternal& a, const LightManager::SpotLightInternal& b) {
+		return a.pos.x == b.pos.x && a.pos.y == b.pos.y && a.pos.z == b.pos.z
+			&& a.dir.x == b.dir.x && a.dir.y == b.dir.y && a.dir.z == b.dir.z
+			&& a.outerCone == b.outerCone && a.rMax == b.rMax;
+	}
+
+	//Near plane of the shadow frustums. Kept well away from the light, so that the depth precision is spent on the scene.
+	constexpr float SPOT_SHADOW_NEAR = 0.3f;
+}
+
+SpotShadowAtlas::SpotShadowAtlas(int tileResolution) : tileSize(tileResolution), tilesX(0), tilesY(0), atlasTex(0), staticTex(0),
+	atlasFbo(0), staticFbo(0), block{}, staticValid(false), staticRenders(0) {
+	tilesX = static_cast<int>(std::ceil(std::sqrt(static_cast<float>(MAX_SPOT_LIGHTS))));
+	tilesY = (static_cast<int>(MAX_SPOT_LIGHTS) + tilesX - 1) / tilesX;
+
+	atlasTex = createShadowTexture(tilesX * tileSize, tilesY * tileSize);
+	glTextureParameteri(atlasTex, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+	glTextureParameteri(atlasTex, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+	staticTex = createShadowTexture(tilesX * tileSize, tilesY * tileSize);
+	atlasFbo = createDepthFramebuffer(atlasTex);
+	staticFbo = createDepthFramebuffer(staticTex);
+
+	uniformBuffer.init(sizeof(ShadowBlock), &block);
+}
+
+SpotShadowAtlas::~SpotShadowAtlas() {
+	GLuint fbos[] = { atlasFbo, staticFbo };
+	GLuint textures[] = { atlasTex, staticTex };
+	glDeleteFramebuffers(2, fbos);
+	glDeleteTextures(2, textures);
+}
+
+void SpotShadowAtlas::computeMatrices(const std::vector<LightManager::SpotLightInternal>& lights) {
+	lightViewProjs.resize(lights.size());
+	const float tileW = 1.f / tilesX;
+	const float tileH = 1.f / tilesY;
+	for (size_t i = 0; i < lights.size(); i++) {
+		const auto& light = lights[i];
+		Vec3f up = std::abs(light.dir.y) > 0.99f ? Vec3f{ 0.f, 0.f, 1.f } : Vec3f{ 0.f, 1.f, 0.f };
+		float halfAngle = std::min(std::acos(std::clamp(light.outerCone, -1.f, 1.f)), MAX_SPOT_SHADOW_HALF_ANGLE);
+		Mat44f proj = make_perspective_projection(2.f * halfAngle, 1.f, SPOT_SHADOW_NEAR, std::max(light.rMax, 2.f * SPOT_SHADOW_NEAR));
+		lightViewProjs[i] = proj * make_lookat(light.pos, light.pos + light.dir, up);
+
+		//Clip space of the light to the tile of the atlas: [-1,1] maps to the tile, depth to [0,1]
+		float minX = (i % tilesX) * tileW;
+		float minY = (i / tilesX) * tileH;
+		Mat44f toTile{
+			0.5f * tileW, 0.f, 0.f, minX + 0.5f * tileW,
+			0.f, 0.5f * tileH, 0.f, minY + 0.5f * tileH,
+			0.f, 0.f, 0.5f, 0.5f,
+			0.f, 0.f, 0.f, 1.f
+		};
+		block.shadowMats[i] = transpose(toTile * lightViewProjs[i]);
+		block.tileRects[i] = { minX, minY, minX + tileW, minY + tileH };
+	}
+	block.numShadows = static_cast<int>(lights.size());
+}
+
+void SpotShadowAtlas::renderTiles(GLuint fbo, const DrawCasters& drawCasters, bool staticCasters) {
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	for (size_t i = 0; i < lightViewProjs.size(); i++) {
+		glViewport(static_cast<GLint>(i % tilesX) * tileSize, static_cast<GLint>(i / tilesX) * tileSize, tileSize, tileSize);
+		drawCasters(lightViewProjs[i], staticCasters);
+	}
+}
+
+void SpotShadowAtlas::update(const LightManager& lights, bool useCache, const DrawCasters& drawCasters, int width, int height,
+	GLuint framebuffer) {
+	const auto& allSpots = lights.getSpotLights();
+	size_t numLights = std::min<size_t>(allSpots.size(), MAX_SPOT_LIGHTS);
+	bool lightsChanged = numLights != cachedLights.size();
+	for (size_t i = 0; i < numLights && !lightsChanged; i++)
+		lightsChanged = !sameShadowFrustum(allSpots[i], cachedLights[i]);
+	if (lightsChanged) {
+		cachedLights.assign(allSpots.begin(), allSpots.begin() + numLights);
+		computeMatrices(cachedLights);
+		staticValid = false;
+	}
+	uniformBuffer.setData(0, sizeof(ShadowBlock), &block);
+	if (numLights == 0) return;
+
+	glEnable(GL_POLYGON_OFFSET_FILL);
+	glPolygonOffset(2.f, 4.f);
+
+	if (useCache) {
+		if (!staticValid) {
+			glBindFramebuffer(GL_FRAMEBUFFER, staticFbo);
+			glClear(GL_DEPTH_BUFFER_BIT);
+			renderTiles(staticFbo, drawCasters, true);
+			staticValid = true;
+			staticRenders++;
+		}
+		glCopyImageSubData(staticTex, GL_TEXTURE_2D, 0, 0, 0, 0, atlasTex, GL_TEXTURE_2D, 0, 0, 0, 0,
+			tilesX * tileSize, tilesY * tileSize, 1);
+		renderTiles(atlasFbo, drawCasters, false);
+	}
+	else {
+		glBindFramebuffer(GL_FRAMEBUFFER, atlasFbo);
+		glClear(GL_DEPTH_BUFFER_BIT);
+		renderTiles(atlasFbo, drawCasters, true);
+		renderTiles(atlasFbo, drawCasters, false);
+	}
+
+	glDisable(GL_POLYGON_OFFSET_FILL);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glViewport(0, 0, width, height);
+}
+
+void SpotShadowAtlas::disable() {
+	ShadowBlock off = block;
+	off.numShadows = 0;
+	uniformBuffer.setData(0, sizeof(ShadowBlock), &off);
+}
+
+void SpotShadowAtlas::invalidate() {
+	staticValid = false;
+}
+
+void SpotShadowAtlas::bind() {
+	uniformBuffer.bindToUniform(BINDING_UNIFORM_SPOT_SHADOWS, 0, sizeof(ShadowBlock));
+	glBindTextureUnit(TEXTURE_UNIT_SPOT_SHADOW_ATLAS, atlasTex);
+}
+
+size_t SpotShadowAtlas::getStaticRenderCount() const {
+	return staticRenders;
+}
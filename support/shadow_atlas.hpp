@@ -0,0 +1,93 @@
+#pragma once
+#include<glad.h>
+#include<functional>
+#include<vector>
+#include"buffer.hpp"
+#include"lights.hpp"
+#include"../vmlib/mat44.hpp"
+#include"../vmlib/vec4.hpp"
+
+//Uniform block and texture unit the spot light shadows are read from (assets/cookTorranceLightList.frag,
+//assets/cookTorranceClustered.frag, assets/deferredLightVolume.frag).
+constexpr const int BINDING_UNIFORM_SPOT_SHADOWS = 3;
+constexpr const int TEXTURE_UNIT_SPOT_SHADOW_ATLAS = 9;
+
+//The shadow frustum of a spot light is a perspective projection, so it cannot cover cones of 90 degrees or more around the
+//axis. Wider cones are clipped to this half angle; fragments outside of the shadow frustum are lit without shadow.
+constexpr const float MAX_SPOT_SHADOW_HALF_ANGLE = 1.3f;//about 75 degrees
+
+/*
+* Shadow maps of the spot lights, packed as square tiles into one depth texture (the atlas).
+* The lights of the scene rarely move and most shadow casters never do, so the casters are split in two sets:
+*  - static casters are rendered into a separate texture of the same layout, which is kept until invalidated;
+*  - every frame, the static texture is copied into the atlas and only the dynamic casters are rendered on top of it.
+* The static texture is re-rendered when the position, direction, cone or range of a light changed (detected by update()), or
+* after invalidate(), which the caller must use when a static caster moved. With caching off, all casters are rendered into
+* the atlas every frame.
+*
+* The shaders find the atlas tile of spot light i from the matrix spotShadowMats[i] of the uniform block, which maps world
+* space to the atlas (with depth in [0,1]). Only the spot lights held by the uniform buffers (the first MAX_SPOT_LIGHTS) have
+* shadows; numSpotShadows is 0 when shadows are off, so the same shaders work without them.
+*/
+class SpotShadowAtlas {
+public:
+	//Draw the static or the dynamic shadow casters depth-only with a light's view-projection matrix. The framebuffer, viewport
+	//and depth state are set up by the atlas; the callback must bind its vertex arrays.
+	using DrawCasters = std::function<void(const Mat44f& lightViewProj, bool staticCasters)>;
+
+private:
+	//Must match the std140 layout of the SpotShadows block in the shaders.
+	struct ShadowBlock {
+		Mat44f shadowMats[MAX_SPOT_LIGHTS];//world to atlas texture coordinates, transposed for upload
+		Vec4f tileRects[MAX_SPOT_LIGHTS];//atlas coordinates of the tiles: min x, min y, max x, max y
+		int numShadows;
+		int padding[3];
+	};
+
+	int tileSize;
+	int tilesX, tilesY;
+	GLuint atlasTex;//static and dynamic casters, read by the shaders
+	GLuint staticTex;//static casters only
+	GLuint atlasFbo, staticFbo;
+	Buffer uniformBuffer;
+	ShadowBlock block;
+
+	std::vector<LightManager::SpotLightInternal> cachedLights;//lights the static texture was rendered for
+	std::vector<Mat44f> lightViewProjs;
+	bool staticValid;
+	size_t staticRenders;
+
+	void computeMatrices(const std::vector<LightManager::SpotLightInternal>& lights);
+	void renderTiles(GLuint fbo, const DrawCasters& drawCasters, bool staticCasters);
+
+public:
+	//Input:
+	// - tileResolution: width and height of the shadow map of a single light.
+	explicit SpotShadowAtlas(int tileResolution = 512);
+	~SpotShadowAtlas();
+
+	SpotShadowAtlas(const SpotShadowAtlas&) = delete;
+	SpotShadowAtlas& operator=(const SpotShadowAtlas&) = delete;
+
+	//Render the shadow maps of the spot lights and upload their matrices.
+	//Input:
+	// - lights: the spot lights are read from it;
+	// - useCache: render the static casters only when needed, see above;
+	// - drawCasters: draws the shadow casters;
+	// - width, height, framebuffer: size of the framebuffer the frame is rendered to, and its name (0 for the screen).
+	//Binds the framebuffer back when done, with a viewport covering it.
+	void update(const LightManager& lights, bool useCache, const DrawCasters& drawCasters, int width, int height,
+		GLuint framebuffer = 0);
+
+	//Turn the shadows off in the shaders (numSpotShadows = 0).
+	void disable();
+
+	//Render the static casters again at the next cached update, e.g. after a static caster moved.
+	void invalidate();
+
+	//Bind the uniform block and the atlas for the shaders.
+	void bind();
+
+	//Number of times the static texture was rendered.
+	size_t getStaticRenderCount() const;
+};
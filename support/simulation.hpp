@@ -0,0 +1,204 @@
+#pragma once
+#include<algorithm>
+#include<atomic>
+#include<cstdint>
+#include<functional>
+#include<thread>
+#include"cpu_profiler.hpp"
+#include"triple_buffer.hpp"
+#include"../main/defaults.hpp"
+
+//The two latest states of a simulation, for rendering in between.
+template<typename T>
+struct SimulationSnapshot {
+	T previous;
+	T current;
+	unsigned long long tick;//steps taken up to current
+	Clock::time_point time;//time current was scheduled for (thread mode)
+};
+
+/*
+* Simulation advanced in fixed time steps, independently of the frame rate.
+* Every step runs the step function on the state with the same dt, so the simulation goes through the same states whatever
+* the frame rate. After each step, or each batch of steps, the previous and current states are published through a triple
+* buffer; the renderer blends them with getAlpha(), so the motion stays smooth when frames and steps are not aligned (the
+* rendered state lags the simulation by up to a step).
+*
+* The steps run either:
+*  - on a thread of their own (start()), paced by the clock, so the simulation overlaps the rendering and the GPU submission.
+*    When the thread falls behind by more than MAX_CATCH_UP_STEPS, the missed time is dropped rather than simulated in a burst;
+*  - on the caller's thread (advance()), e.g. by a fixed amount per frame for reproducible benchmark runs.
+*
+* The step function runs on the simulation thread while it is started: it must only read what the other threads write
+* through atomics. snapshot() must be called from a single (the rendering) thread.
+*/
+template<typename T>
+class FixedStepSimulation {
+public:
+	using StepFunction = std::function<void(T& state, float dt)>;
+
+private:
+	static constexpr int MAX_CATCH_UP_STEPS = 8;
+
+	StepFunction step;
+	float stepSeconds;
+	SimulationSnapshot<T> work;//latest states, owned by the thread that steps
+	TripleBuffer<SimulationSnapshot<T>> snapshots;
+	double remainder;//advance(): time not simulated yet, in seconds
+
+	std::thread thread;
+	std::atomic<bool> running;
+	std::atomic<std::uint64_t> steps;
+	std::atomic<std::uint64_t> stepNanoseconds;
+	std::atomic<std::uint64_t> droppedSteps;
+
+	void runStep();
+	void threadLoop();
+
+public:
+	//Input:
+	// - initial: state at tick 0;
+	// - stepSeconds: duration of a step;
+	// - step: advances the state by dt.
+	FixedStepSimulation(const T& initial, float stepSeconds, StepFunction step);
+	~FixedStepSimulation();
+
+	FixedStepSimulation(const FixedStepSimulation&) = delete;
+	FixedStepSimulation& operator=(const FixedStepSimulation&) = delete;
+
+	//Run the steps on a thread, from now on. The simulation continues from its current state.
+	void start();
+	//Stop and join the thread. advance() can be used afterwards.
+	void stop();
+	bool isRunning() const;
+
+	//Run the steps that fit in the given time on the calling thread; the rest is carried over to the next call.
+	//Not allowed while the thread runs.
+	void advance(double seconds);
+
+	//Latest published states.
+	const SimulationSnapshot<T>& snapshot();
+	//Position between the previous (0) and the current (1) state of the snapshot to render now.
+	float getAlpha(const SimulationSnapshot<T>& snapshot) const;
+
+	float getStepSeconds() const;
+	unsigned long long getSteps() const;
+	//Average cost of a step, in milliseconds.
+	double getStepMs() const;
+	//Steps dropped because the thread could not keep up.
+	unsigned long long getDroppedSteps() const;
+};
+
+template<typename T>
+FixedStepSimulation<T>::FixedStepSimulation(const T& initial, float seconds, StepFunction stepFunction) : step(std::move(stepFunction)),
+	stepSeconds(seconds), work{ initial, initial, 0, Clock::now() }, snapshots(work), remainder(0.0), running(false), steps(0),
+	stepNanoseconds(0), droppedSteps(0) {
+}
+
+template<typename T>
+FixedStepSimulation<T>::~FixedStepSimulation() {
+	stop();
+}
+
+template<typename T>
+void FixedStepSimulation<T>::runStep() {
+	CPU_ZONE("Simulation step");
+	Clock::time_point begin = Clock::now();
+	work.previous = work.current;
+	step(work.current, stepSeconds);
+	work.tick++;
+	steps.fetch_add(1, std::memory_order_relaxed);
+	stepNanoseconds.fetch_add(static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - begin).count()),
+		std::memory_order_relaxed);
+}
+
+template<typename T>
+void FixedStepSimulation<T>::threadLoop() {
+	CPU_THREAD_NAME("Simulation");
+	const auto period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(stepSeconds));
+	Clock::time_point next = Clock::now() + period;
+	while (running.load(std::memory_order_acquire)) {
+		std::this_thread::sleep_until(next);
+		int done = 0;
+		for (Clock::time_point now = Clock::now(); next <= now && done < MAX_CATCH_UP_STEPS; next += period, done++)
+			runStep();
+		//Too far behind (e.g. stopped in a debugger): drop the missed steps and go on from now
+		Clock::time_point now = Clock::now();
+		if (next + period * MAX_CATCH_UP_STEPS < now) {
+			droppedSteps.fetch_add(static_cast<std::uint64_t>((now - next) / period), std::memory_order_relaxed);
+			next = now + period;
+		}
+		if (done == 0) continue;
+		work.time = next - period;
+		snapshots.getBack() = work;
+		snapshots.publish();
+	}
+}
+
+template<typename T>
+void FixedStepSimulation<T>::start() {
+	if (running.load()) return;
+	running.store(true, std::memory_order_release);
+	thread = std::thread(&FixedStepSimulation::threadLoop, this);
+}
+
+template<typename T>
+void FixedStepSimulation<T>::stop() {
+	if (!running.load()) return;
+	running.store(false, std::memory_order_release);
+	thread.join();
+	remainder = 0.0;
+}
+
+template<typename T>
+inline bool FixedStepSimulation<T>::isRunning() const {
+	return running.load(std::memory_order_relaxed);
+}
+
+template<typename T>
+void FixedStepSimulation<T>::advance(double seconds) {
+	if (isRunning()) return;
+	remainder += seconds;
+	int done = 0;
+	//A small tolerance, so that e.g. a frame of 1/60 s runs exactly two steps of 1/120 s despite rounding
+	for (; remainder + 1e-6 >= stepSeconds; remainder -= stepSeconds, done++)
+		runStep();
+	remainder = std::max(remainder, 0.0);
+	if (done == 0) return;
+	work.time = Clock::now();
+	snapshots.getBack() = work;
+	snapshots.publish();
+}
+
+template<typename T>
+const SimulationSnapshot<T>& FixedStepSimulation<T>::snapshot() {
+	snapshots.update();
+	return snapshots.getFront();
+}
+
+template<typename T>
+float FixedStepSimulation<T>::getAlpha(const SimulationSnapshot<T>& current) const {
+	double alpha = isRunning() ? std::chrono::duration<double>(Clock::now() - current.time).count() / stepSeconds : remainder / stepSeconds;
+	return static_cast<float>(std::clamp(alpha, 0.0, 1.0));
+}
+
+template<typename T>
+inline float FixedStepSimulation<T>::getStepSeconds() const {
+	return stepSeconds;
+}
+
+template<typename T>
+inline unsigned long long FixedStepSimulation<T>::getSteps() const {
+	return steps.load(std::memory_order_relaxed);
+}
+
+template<typename T>
+inline double FixedStepSimulation<T>::getStepMs() const {
+	std::uint64_t count = steps.load(std::memory_order_relaxed);
+	return count ? static_cast<double>(stepNanoseconds.load(std::memory_order_relaxed)) * 1e-6 / count : 0.0;
+}
+
+template<typename T>
+inline unsigned long long FixedStepSimulation<T>::getDroppedSteps() const {
+	return droppedSteps.load(std::memory_order_relaxed);
+}
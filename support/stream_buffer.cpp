@@ -0,0 +1,117 @@
+#include "stream_buffer.hpp"
+#include"buffer.hpp"
+#include"error.hpp"
+#include<algorithm>
+#include<cstring>
+
+namespace {
+	const GLbitfield STREAM_STORAGE_FLAGS = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+	uintptr_t alignUp(uintptr_t value, uintptr_t alignment) {
+		return (value + alignment - 1) / alignment * alignment;
+	}
+
+	//Regions start at multiples of this, so offsets aligned within a region are aligned in the buffer.
+	uintptr_t regionAlignment() {
+		return std::max<uintptr_t>({ 256, static_cast<uintptr_t>(uniformBufferOffsetAlignment()),
+			static_cast<uintptr_t>(storageBufferOffsetAlignment()) });
+	}
+}
+
+StreamBuffer::StreamBuffer(uintptr_t bytesPerFrame, int regions) :
+	bufferID(0), mapping(nullptr), regionSize(0), numRegions(regions), region(0), head(0), fences(regions > 0 ? regions : 0, nullptr),
+	frameBytes(0), lastFrameBytes(0), peakFrameBytes(0), stalls(0) {
+	if (bytesPerFrame == 0 || regions < 1) throw Error("Invalid stream buffer of %d regions of %zu bytes\n", regions, static_cast<size_t>(bytesPerFrame));
+	create(alignUp(bytesPerFrame, regionAlignment()));
+}
+
+StreamBuffer::~StreamBuffer() {
+	for (GLsync fence : fences)
+		if (fence) glDeleteSync(fence);
+	for (GLuint retired : retiredBuffers) glDeleteBuffers(1, &retired);
+	if (bufferID) {
+		glUnmapNamedBuffer(bufferID);
+		glDeleteBuffers(1, &bufferID);
+	}
+}
+
+void StreamBuffer::create(uintptr_t bytesPerRegion) {
+	regionSize = bytesPerRegion;
+	GLsizeiptr totalSize = static_cast<GLsizeiptr>(regionSize * numRegions);
+	glCreateBuffers(1, &bufferID);
+	glNamedBufferStorage(bufferID, totalSize, nullptr, STREAM_STORAGE_FLAGS);
+	mapping = static_cast<char*>(glMapNamedBufferRange(bufferID, 0, totalSize, STREAM_STORAGE_FLAGS));
+	if (!mapping) throw Error("Failed to map stream buffer %u of %zu bytes\n", bufferID, static_cast<size_t>(totalSize));
+}
+
+void StreamBuffer::grow(uintptr_t minBytes) {
+	//Ranges already handed out this frame point into the old buffer, which is kept until endFrame(). None of the regions of the
+	//new buffer were used, so the fences of the old one no longer matter.
+	retiredBuffers.push_back(bufferID);
+	for (GLsync& fence : fences) {
+		if (fence) glDeleteSync(fence);
+		fence = nullptr;
+	}
+	create(alignUp(std::max(regionSize * 2, minBytes), regionAlignment()));
+	region = 0;
+	head = 0;
+}
+
+void StreamBuffer::beginFrame() {
+	region = (region + 1) % numRegions;
+	head = 0;
+	frameBytes = 0;
+
+	GLsync& fence = fences[region];
+	if (!fence) return;
+	GLenum status = glClientWaitSync(fence, 0, 0);
+	if (status == GL_TIMEOUT_EXPIRED) {
+		stalls++;
+		//Flush on the first wait only; afterwards the commands are on their way.
+		GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+		while (glClientWaitSync(fence, flags, 1000000000) == GL_TIMEOUT_EXPIRED)
+			flags = 0;
+	}
+	glDeleteSync(fence);
+	fence = nullptr;
+}
+
+void StreamBuffer::endFrame() {
+	if (fences[region]) glDeleteSync(fences[region]);
+	fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	//The commands of the frame were issued; deleting the replaced buffers now only releases them once the GPU is done.
+	for (GLuint retired : retiredBuffers) glDeleteBuffers(1, &retired);
+	retiredBuffers.clear();
+
+	lastFrameBytes = frameBytes;
+	peakFrameBytes = std::max(peakFrameBytes, frameBytes);
+}
+
+StreamAllocation StreamBuffer::allocate(uintptr_t size, uintptr_t alignment) {
+	if (alignment == 0) alignment = 1;
+	uintptr_t offset = alignUp(head, alignment);
+	if (offset + size > regionSize) {
+		grow(size + alignment);
+		offset = 0;
+	}
+	head = offset + size;
+	frameBytes += size;
+
+	uintptr_t bufferOffset = static_cast<uintptr_t>(region) * regionSize + offset;
+	return StreamAllocation{ mapping + bufferOffset, bufferID, bufferOffset, size };
+}
+
+StreamAllocation StreamBuffer::allocateUniform(uintptr_t size) {
+	return allocate(size, static_cast<uintptr_t>(uniformBufferOffsetAlignment()));
+}
+
+StreamAllocation StreamBuffer::allocateStorage(uintptr_t size) {
+	return allocate(size, static_cast<uintptr_t>(storageBufferOffsetAlignment()));
+}
+
+StreamAllocation StreamBuffer::uploadStorage(const void* data, uintptr_t size) {
+	StreamAllocation allocation = allocateStorage(std::max<uintptr_t>(size, 16));
+	if (size > 0) std::memcpy(allocation.data, data, size);
+	return allocation;
+}
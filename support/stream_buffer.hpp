@@ -0,0 +1,121 @@
+#pragma once
+#include<glad.h>
+#include<cstddef>
+#include<cstdint>
+#include<vector>
+#include"vao.hpp"
+
+//A range of a StreamBuffer. It is only valid during the frame it was allocated in.
+struct StreamAllocation {
+	void* data;//mapped memory of the range, written directly by the CPU
+	GLuint buffer;
+	uintptr_t offset;//offset of the range in the buffer
+	uintptr_t size;
+
+	//Bind the range (see Buffer for the alignment rules of the offsets; StreamBuffer::allocateUniform/allocateStorage follow them).
+	void bindToUniform(uint32_t index) const;
+	void bindToStorage(uint32_t index) const;
+	void bindToAttrib(const VertexArrayObject& vao, uint32_t bindingPoint, uint32_t stride) const;
+	//Bind the buffer as GL_DRAW_INDIRECT_BUFFER; the commands then start at offset.
+	void bindAsIndirect() const;
+};
+
+/*
+* Buffer for data rewritten every frame: transforms, light lists, constants, indirect commands.
+* Its storage is mapped once, persistently and coherently, and split into numRegions regions used in turn, one per frame.
+* Data is written straight into the mapping through a bump allocator, so an upload is a memcpy without a copy by the driver,
+* and the written ranges are bound with their offsets.
+* A fence is inserted at the end of each frame. Before a region is reused, beginFrame() waits for the fence of the frame that
+* used it last, which only blocks when the GPU is more than numRegions - 1 frames behind.
+*
+* When a frame needs more than a region, the buffer is replaced by one with regions of twice the size. The old buffer stays alive
+* until the end of the frame, so the ranges allocated from it remain valid, and is then deleted (the driver keeps its storage
+* for the commands still in flight).
+*
+* A frame looks like:
+*   beginFrame(); allocate(), write and bind ...; draw ...; endFrame();
+*/
+class StreamBuffer {
+private:
+	GLuint bufferID;
+	char* mapping;
+	uintptr_t regionSize;
+	int numRegions;
+	int region;//region of the current frame
+	uintptr_t head;//offset of the first free byte in the region
+	std::vector<GLsync> fences;//fence of the last frame that used each region
+	std::vector<GLuint> retiredBuffers;//buffers replaced during the current frame
+
+	uintptr_t frameBytes;//bytes allocated by the current frame
+	uintptr_t lastFrameBytes;
+	uintptr_t peakFrameBytes;
+	size_t stalls;
+
+	void create(uintptr_t bytesPerRegion);
+	void grow(uintptr_t minBytes);
+
+public:
+	//Input:
+	// - bytesPerFrame: initial size of a region, grown when a frame needs more;
+	// - regions: number of frames whose data can be in flight at once.
+	StreamBuffer(uintptr_t bytesPerFrame, int regions = 3);
+	~StreamBuffer();
+
+	StreamBuffer(const StreamBuffer&) = delete;
+	StreamBuffer& operator=(const StreamBuffer&) = delete;
+
+	//Move to the next region, waiting until the GPU is done with it.
+	void beginFrame();
+	//Fence the region of the frame. Call once all the commands using it were issued.
+	void endFrame();
+
+	//Reserve size bytes in the region of the frame, at an offset multiple of alignment.
+	StreamAllocation allocate(uintptr_t size, uintptr_t alignment = 16);
+	//allocate() with the alignment required to bind the range as a uniform buffer / a shader storage buffer.
+	StreamAllocation allocateUniform(uintptr_t size);
+	StreamAllocation allocateStorage(uintptr_t size);
+	//allocateStorage() and copy data into it. Empty data still gets a small range, so that it can always be bound.
+	StreamAllocation uploadStorage(const void* data, uintptr_t size);
+
+	uintptr_t getRegionSize() const;
+	int getNumRegions() const;
+	uintptr_t getLastFrameBytes() const;//bytes allocated by the last finished frame
+	uintptr_t getPeakFrameBytes() const;
+	size_t getStalls() const;//frames for which beginFrame() had to wait for the GPU
+};
+
+inline void StreamAllocation::bindToUniform(uint32_t index) const {
+	glBindBufferRange(GL_UNIFORM_BUFFER, static_cast<GLuint>(index), buffer, static_cast<GLintptr>(offset), static_cast<GLsizeiptr>(size));
+}
+
+inline void StreamAllocation::bindToStorage(uint32_t index) const {
+	glBindBufferRange(GL_SHADER_STORAGE_BUFFER, static_cast<GLuint>(index), buffer, static_cast<GLintptr>(offset), static_cast<GLsizeiptr>(size));
+}
+
+inline void StreamAllocation::bindToAttrib(const VertexArrayObject& vao, uint32_t bindingPoint, uint32_t stride) const {
+	glVertexArrayVertexBuffer(vao.getID(), static_cast<GLuint>(bindingPoint), buffer, static_cast<GLintptr>(offset), static_cast<GLsizei>(stride));
+}
+
+inline void StreamAllocation::bindAsIndirect() const {
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, buffer);
+}
+
+inline uintptr_t StreamBuffer::getRegionSize() const {
+	return regionSize;
+}
+
+inline int StreamBuffer::getNumRegions() const {
+	return numRegions;
+}
+
+inline uintptr_t StreamBuffer::getLastFrameBytes() const {
+	return lastFrameBytes;
+}
+
+inline uintptr_t StreamBuffer::getPeakFrameBytes() const {
+	return peakFrameBytes;
+}
+
+inline size_t StreamBuffer::getStalls() const {
+	return stalls;
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include<atomic>
+
+/*
+* Lock-free triple buffer for handing the latest value from one producer thread to one consumer thread.
+* The producer writes into the back buffer and publishes it; the consumer takes the newest published buffer as its front
+* buffer. The third buffer sits between them, so neither side ever waits for the other or sees a buffer being written: a value
+* published while the consumer still reads the previous one simply replaces the unread one in the middle.
+*
+* The producer calls getBack() and publish(); the consumer calls update() and getFront().
+*/
+template<typename T>
+class TripleBuffer {
+private:
+	static constexpr unsigned INDEX_MASK = 3u;
+	static constexpr unsigned NEW_BIT = 4u;//the middle buffer was published since the consumer last took it
+
+	T buffers[3];
+	std::atomic<unsigned> middle;
+	unsigned back;//producer only
+	unsigned front;//consumer only
+
+public:
+	//All three buffers start with the given value.
+	explicit TripleBuffer(const T& initial = T{});
+
+	TripleBuffer(const TripleBuffer&) = delete;
+	TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+	//Producer: buffer to write the next value into.
+	T& getBack();
+	//Producer: make the back buffer the newest value, and get a free buffer as the new back buffer.
+	void publish();
+
+	//Consumer: take the newest value, if one was published since the last call. Returns whether the front buffer changed.
+	bool update();
+	//Consumer: newest value taken by update().
+	const T& getFront() const;
+};
+
+template<typename T>
+TripleBuffer<T>::TripleBuffer(const T& initial) : buffers{ initial, initial, initial }, middle(2u), back(0u), front(1u) {
+}
+
+template<typename T>
+inline T& TripleBuffer<T>::getBack() {
+	return buffers[back];
+}
+
+template<typename T>
+inline void TripleBuffer<T>::publish() {
+	back = middle.exchange(back | NEW_BIT, std::memory_order_acq_rel) & INDEX_MASK;
+}
+
+template<typename T>
+inline bool TripleBuffer<T>::update() {
+	if (!(middle.load(std::memory_order_relaxed) & NEW_BIT)) return false;
+	front = middle.exchange(front, std::memory_order_acq_rel) & INDEX_MASK;
+	return true;
+}
+
+template<typename T>
+inline const T& TripleBuffer<T>::getFront() const {
+	return buffers[front];
+}
@@ -29,6 +29,17 @@ public:
 	//For convenience, we aim to always set the bindng point to be the same as the attribute index.
 	void bindAttrib(uint32_t attribIdx, uint32_t bindingPointIdx);
 
+	//Define a per-instance 4x4 float matrix attribute. A mat4 occupies four consecutive attribute locations (one per column),
+	//all of which are sourced from the same binding point. The binding point is set to advance once per instance.
+	//Input:
+	// - firstAttribIdx: location of the matrix in the vertex shader (the matrix also uses the next three locations);
+	// - relativeOffset: offset of the matrix from the start of the per-instance block (the matrix must be stored column-major);
+	// - bindingPointIdx: the binding point the instance buffer will be bound to.
+	void addInstanceAttribMat4F(uint32_t firstAttribIdx, uint32_t relativeOffset, uint32_t bindingPointIdx);
+
+	//Set how often the buffer bound to a binding point advances: 0 = once per vertex (default), N = once every N instances.
+	void setBindingDivisor(uint32_t bindingPointIdx, uint32_t divisor);
+
 	void enableAttrib(uint32_t attribIdx);
 	void disableAttrib(uint32_t attribIdx);
 	GLuint getID() const;
@@ -69,6 +80,21 @@ inline void VertexArrayObject::bindAttrib(uint32_t attribIdx, uint32_t bindingPo
 	glVertexArrayAttribBinding(vao, attribIdx, bindingPointIdx);
 }
 
+inline void VertexArrayObject::addInstanceAttribMat4F(uint32_t firstAttribIdx, uint32_t relativeOffset, uint32_t bindingPointIdx) {
+	for (uint32_t col = 0; col < 4; col++) {
+		uint32_t attribIdx = firstAttribIdx + col;
+		glVertexArrayAttribFormat(vao, static_cast<GLuint>(attribIdx), 4, GL_FLOAT, GL_FALSE, static_cast<GLuint>(relativeOffset + col * 4 * sizeof(float)));
+		enableAttrib(attribIdx);
+		bindAttrib(attribIdx, bindingPointIdx);
+	}
+	setBindingDivisor(bindingPointIdx, 1);
+}
+
+inline void VertexArrayObject::setBindingDivisor(uint32_t bindingPointIdx, uint32_t divisor) {
+	//Unlike glVertexAttribDivisor, the divisor is a property of the binding point, so all attributes sourced from it advance together.
+	glVertexArrayBindingDivisor(vao, static_cast<GLuint>(bindingPointIdx), static_cast<GLuint>(divisor));
+}
+
 inline void VertexArrayObject::enableAttrib(uint32_t attribIdx) {
 	glEnableVertexArrayAttrib(vao, attribIdx);
 }
@@ -2,9 +2,14 @@
 #include"error.hpp"
 #include"camera.hpp"
 #include"program.hpp"
-#include <fstream>
+#include <cstdlib>
 #include <string>
 
+#if defined(__linux__)
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
 //Global variables to track the movement of mouse cursor
 double cursorLastX = 0.0;
 double cursorLastY = 0.0;
@@ -16,9 +21,22 @@ void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods
 void cursorPosCallback(GLFWwindow* window, double xPos, double yPos);
 void scrollCallback(GLFWwindow* window, double xOffset, double yOffset);
 
-Window::Window(int width, int height, const char* title, bool fullscreen) : mWidth(width), mHeight(height), title(title), bFullscreen(fullscreen),
-xPos(0), yPos(0), mState(nullptr), scrCounter(0)
+Window::Window(int width, int height, const char* title, bool fullscreen, bool headless) : mWidth(width), mHeight(height), title(title),
+bFullscreen(fullscreen && !headless), xPos(0), yPos(0), mState(nullptr), scrCounter(0), frameCapture(std::make_unique<FrameCapture>()),
+screenshotFormat(ImageFormat::PPM), bHeadless(headless), offscreenFbo(0), offscreenColor(0), offscreenDepth(0),
+eglDisplay(nullptr), eglContext(nullptr)
 {
+	if (headless && (width <= 0 || height <= 0)) throw Error("Invalid headless framebuffer size %dx%d", width, height);
+	fullscreen = bFullscreen;
+
+	// Without a display server, the window comes from GLFW's null platform (input and ImGui only) and the context is created
+	// directly with EGL, without a surface
+	bool surfaceless = false;
+#if defined(__linux__)
+	surfaceless = headless && !std::getenv("DISPLAY") && !std::getenv("WAYLAND_DISPLAY");
+	if (surfaceless) glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+#endif
+
 	// Initialize GLFW
 	if (GLFW_TRUE != glfwInit())
 	{
@@ -47,6 +65,11 @@ xPos(0), yPos(0), mState(nullptr), scrCounter(0)
 	glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GLFW_TRUE);
 	#endif // ~ !NDEBUG
 
+	if (headless)
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	if (surfaceless)
+		glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+
 	//Create window (either windowed or fullscreen mode)
 	GLFWmonitor* monitor = glfwGetPrimaryMonitor();
 	const GLFWvidmode* mode = glfwGetVideoMode(monitor);
@@ -63,13 +86,20 @@ xPos(0), yPos(0), mState(nullptr), scrCounter(0)
 		throw Error("glfwCreateWindow() failed with '%s' (%d)", msg, ecode);
 	}
 
-	// Set up drawing stuff
-	glfwMakeContextCurrent(window);
-	glfwSwapInterval(1); // V-Sync is on.
+	if (surfaceless)
+	{
+		createSurfacelessContext();
+	}
+	else
+	{
+		// Set up drawing stuff
+		glfwMakeContextCurrent(window);
+		glfwSwapInterval(1); // V-Sync is on (FramePacer changes the present mode).
 
-	// Initialize GLAD
-	if (!gladLoadGLLoader((GLADloadproc)&glfwGetProcAddress))
-		throw Error("gladLoaDGLLoader() failed - cannot load GL API!");
+		// Initialize GLAD
+		if (!gladLoadGLLoader((GLADloadproc)&glfwGetProcAddress))
+			throw Error("gladLoaDGLLoader() failed - cannot load GL API!");
+	}
 
 	std::printf("RENDERER %s\n", glGetString(GL_RENDERER));
 	std::printf("VENDOR %s\n", glGetString(GL_VENDOR));
@@ -84,12 +114,16 @@ xPos(0), yPos(0), mState(nullptr), scrCounter(0)
 	if (glfwRawMouseMotionSupported())
 		glfwSetInputMode(window, GLFW_RAW_MOUSE_MOTION, GLFW_TRUE);
 
-	//Set callbacks
-	glfwSetFramebufferSizeCallback(window, framebufferSizeCallback);
+	//Set callbacks. The offscreen framebuffer of headless mode keeps its size.
+	if (!headless)
+		glfwSetFramebufferSizeCallback(window, framebufferSizeCallback);
 	glfwSetKeyCallback(window, keyCallback);
 	glfwSetCursorPosCallback(window, cursorPosCallback);
 	glfwSetScrollCallback(window, scrollCallback);
 
+	if (headless)
+		createOffscreenFramebuffer(width, height);
+
 	//Set viewport
 	if (fullscreen)
 		glViewport(0, 0, mode->width, mode->height);
@@ -97,8 +131,74 @@ xPos(0), yPos(0), mState(nullptr), scrCounter(0)
 		glViewport(0, 0, width, height);
 }
 
+void Window::createSurfacelessContext()
+{
+#if defined(__linux__)
+	auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if (!getPlatformDisplay) throw Error("eglGetPlatformDisplayEXT is not available - cannot render without a display");
+	EGLDisplay display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+	if (display == EGL_NO_DISPLAY || !eglInitialize(display, nullptr, nullptr))
+		throw Error("eglInitialize() failed for the surfaceless platform (0x%x)", eglGetError());
+	eglDisplay = display;
+	if (!eglBindAPI(EGL_OPENGL_API)) throw Error("eglBindAPI() failed (0x%x)", eglGetError());
+
+	//Same version and profile as the hints of the windowed context
+	const EGLint attribs[] = {
+		EGL_CONTEXT_MAJOR_VERSION, 4,
+		EGL_CONTEXT_MINOR_VERSION, 5,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+	#if !defined(NDEBUG)
+		EGL_CONTEXT_OPENGL_DEBUG, EGL_TRUE,
+	#endif
+		EGL_NONE
+	};
+	EGLContext context = eglCreateContext(display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, attribs);
+	if (context == EGL_NO_CONTEXT) throw Error("eglCreateContext() failed (0x%x)", eglGetError());
+	eglContext = context;
+	if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+		throw Error("eglMakeCurrent() failed (0x%x)", eglGetError());
+
+	if (!gladLoadGLLoader((GLADloadproc)&eglGetProcAddress))
+		throw Error("gladLoaDGLLoader() failed - cannot load GL API!");
+#else
+	throw Error("Rendering without a display is only supported on Linux");
+#endif
+}
+
+void Window::destroySurfacelessContext()
+{
+#if defined(__linux__)
+	if (!eglDisplay) return;
+	if (eglContext)
+	{
+		eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		eglDestroyContext(eglDisplay, eglContext);
+	}
+	eglTerminate(eglDisplay);
+	eglDisplay = nullptr;
+	eglContext = nullptr;
+#endif
+}
+
+void Window::createOffscreenFramebuffer(int width, int height)
+{
+	//Same formats as the default framebuffer: 8-bit RGBA colour and 24-bit depth
+	glCreateTextures(GL_TEXTURE_2D, 1, &offscreenColor);
+	glTextureStorage2D(offscreenColor, 1, GL_RGBA8, width, height);
+	glCreateRenderbuffers(1, &offscreenDepth);
+	glNamedRenderbufferStorage(offscreenDepth, GL_DEPTH_COMPONENT24, width, height);
+
+	glCreateFramebuffers(1, &offscreenFbo);
+	glNamedFramebufferTexture(offscreenFbo, GL_COLOR_ATTACHMENT0, offscreenColor, 0);
+	glNamedFramebufferRenderbuffer(offscreenFbo, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, offscreenDepth);
+	GLenum status = glCheckNamedFramebufferStatus(offscreenFbo, GL_FRAMEBUFFER);
+	if (status != GL_FRAMEBUFFER_COMPLETE) throw Error("Offscreen framebuffer incomplete (0x%x)", status);
+	glBindFramebuffer(GL_FRAMEBUFFER, offscreenFbo);
+}
+
 void Window::toggleFullscreen()
 {
+	if (bHeadless) return;
 	bFullscreen = !bFullscreen;
 
 	if(bFullscreen) //Make fullscreen
@@ -121,6 +221,14 @@ void Window::toggleFullscreen()
 Window::~Window()
 {
 	printf("window destr\n");
+	frameCapture.reset();//finishes the screenshots in flight, which needs the context
+	if (offscreenFbo)
+	{
+		glDeleteFramebuffers(1, &offscreenFbo);
+		glDeleteRenderbuffers(1, &offscreenDepth);
+		glDeleteTextures(1, &offscreenColor);
+	}
+	destroySurfacelessContext();
 	glfwDestroyWindow(window);
 	glfwTerminate();
 }
@@ -203,7 +311,7 @@ void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods
 				try
 				{
 					state->programs->reloadPrograms();
-					std::fprintf(stderr, "Shaders reloaded and recompiled.\n");
+					std::fprintf(stderr, "Shaders reloading; each program is replaced once recompiled.\n");
 				}
 				catch (std::exception const& eErr)
 				{
@@ -318,36 +426,20 @@ void scrollCallback(GLFWwindow* window, double xOffset, double yOffset)
 	(void)xOffset;//unused
 }
 
-void drawPPM(const char* filename, int width, int height, unsigned char* data) {
-	//Set up output stream
-	std::ofstream ppmFileStream(filename, std::ios::out | std::ios::binary);
-	ppmFileStream << "P3\n";
-	ppmFileStream << width << " " << height << "\n";
-	ppmFileStream << 255 << "\n";
-
-	//Draw
-	for (int rowIdx = height-1; rowIdx >= 0; --rowIdx) {
-		unsigned char* rowStart = data + rowIdx * width * 3;
-		for (int colIdx = 0; colIdx < width; ++colIdx) {
-
-			ppmFileStream << (int)rowStart[0] << " " << (int)rowStart[1] << " " << (int)rowStart[2] << "\t";
-			rowStart += 3;
-		}
-		ppmFileStream << "\n";
-	}
-
-	ppmFileStream.close();
+void Window::takeScreenshot() {
+	const char* extension = screenshotFormat == ImageFormat::PNG ? ".png" : ".ppm";
+	frameCapture->request(std::string("scr_") + std::to_string(scrCounter++) + extension, screenshotFormat);
 }
 
-inline void Window::takeScreenshot() {
-	int width{};
-	int height{};
-	getFramebufferSize(width, height);
-	unsigned char* pixels = new unsigned char[3 * width * height];
-
-	glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixels);
-	drawPPM((std::string("scr_") + std::to_string(scrCounter++) + ".ppm").c_str(), width, height, pixels);
-
-	delete[] pixels;
+void Window::swapBuffers() {
+	if (!isMinimized()) {
+		int width = 0, height = 0;
+		getFramebufferSize(width, height);
+		frameCapture->beforeSwap(width, height, offscreenFbo);
+		//Nothing is shown in headless mode: the offscreen framebuffer is only read by the captures
+		if (!bHeadless)
+			glfwSwapBuffers(window);
+	}
+	frameCapture->update();
 }
 
@@ -1,7 +1,9 @@
 #pragma once
 #include<glad.h>
 #include <GLFW/glfw3.h>
+#include<memory>
 #include"../main/defaults.hpp"
+#include"frame_capture.hpp"
 
 //Forward declarations
 class ShaderProgram;
@@ -9,6 +11,7 @@ class RenderSettings;
 class Camera;
 class Window;
 class VertexArrayObject;
+class ObjectLightLists;
 
 struct State
 {
@@ -16,8 +19,10 @@ private:
 	//Last recorded point in time. Used to calculate animation delta.
 	Clock::time_point last;
 	float deltaT;
+	float fixedDeltaT;//when positive, used as dt instead of the wall-clock time
 public:
-	State(RenderSettings* settings, Camera* cam) :programs(settings), cam(cam), deltaT(0.0f), animationActive(true) {
+	State(RenderSettings* settings, Camera* cam) :programs(settings), cam(cam), objectLights(nullptr), deltaT(0.0f), fixedDeltaT(0.0f),
+		animationActive(true) {
 		last = Clock::now();
 	}
 
@@ -26,7 +31,12 @@ public:
 		const auto now = Clock::now();
 		float delta = std::chrono::duration_cast<Secondsf>(now - last).count();
 		last = now;
-		deltaT = delta;
+		deltaT = fixedDeltaT > 0.0f ? fixedDeltaT : delta;
+	}
+
+	//Advance every frame by the same time step, whatever the frame rate (benchmarks), or by the time elapsed with 0.
+	void setFixedDt(float dt) {
+		fixedDeltaT = dt;
 	}
 
 	//Get the time delta (in seconds) recorded at the last clock update. 
@@ -36,6 +46,7 @@ public:
 
 	RenderSettings* programs;
 	Camera* cam;
+	const ObjectLightLists* objectLights;//light list of the object being drawn, if the programs use one
 	bool animationActive;
 };
 
@@ -52,13 +63,32 @@ private:
 	int xPos;
 	int yPos;
 	int scrCounter;
+	std::unique_ptr<FrameCapture> frameCapture;//screenshots, read back and written without stalling the frame loop
+	ImageFormat screenshotFormat;
 
 	bool bFullscreen;
 
+	//Headless mode: the window is hidden and the frames are rendered into an offscreen framebuffer of a fixed size.
+	bool bHeadless;
+	GLuint offscreenFbo;
+	GLuint offscreenColor;
+	GLuint offscreenDepth;
+	//EGL display and context of a headless window without a display server (GLFW then has no context); null otherwise
+	void* eglDisplay;
+	void* eglContext;
+
 	void processKeyInput();
+	void createOffscreenFramebuffer(int width, int height);
+	void createSurfacelessContext();
+	void destroySurfacelessContext();
 
 public:
-	Window(int width, int height, const char* title, bool fullscreen = false);
+	//Input:
+	// - width, height: size of the window, or of the offscreen framebuffer when headless;
+	// - headless: hide the window and render offscreen. Without a display (no DISPLAY or WAYLAND_DISPLAY on Linux), the window
+	//   comes from GLFW's null platform and the context from EGL's surfaceless platform, e.g. Mesa llvmpipe on a CI machine;
+	//   with one (e.g. Xvfb), the context of a hidden window is used.
+	Window(int width, int height, const char* title, bool fullscreen = false, bool headless = false);
 
 	void toggleFullscreen();
 	void setState(State* state);
@@ -69,13 +99,23 @@ public:
 	State* getState() const;
 
 	bool isFullscreen() const;
+	bool isHeadless() const;
+	//Framebuffer the frames are drawn into and presented from: 0, or the offscreen framebuffer when headless.
+	//Passes that draw to the screen bind this one.
+	GLuint getFramebuffer() const;
 	bool IsClosed() const;
 	bool isMinimized() const;
 
+	//Capture the next frame to scr_<counter>.ppm/.png. The file is written in the background.
 	void takeScreenshot();
+	void setScreenshotFormat(ImageFormat format);
+	FrameCapture& getFrameCapture();
 
 	//Performs a buffer swap and polls for input events.
 	void updateWindow();
+	//The two halves of updateWindow(), for callers timing the swap (FramePacer).
+	void swapBuffers();
+	void pollEvents();
 	GLFWwindow* getGLFWindow() const;
 
 	~Window();
@@ -86,6 +126,11 @@ inline void Window::setState(State* state) {
 }
 
 inline void Window::getFramebufferSize(int& width, int& height) const {
+	if (bHeadless) {
+		width = mWidth;
+		height = mHeight;
+		return;
+	}
 	glfwGetFramebufferSize(window, &width, &height);
 }
 
@@ -108,6 +153,14 @@ inline bool Window::isFullscreen() const {
 	return bFullscreen;
 }
 
+inline bool Window::isHeadless() const {
+	return bHeadless;
+}
+
+inline GLuint Window::getFramebuffer() const {
+	return offscreenFbo;
+}
+
 inline bool Window::IsClosed() const {
 	return glfwWindowShouldClose(window);
 }
@@ -117,14 +170,25 @@ inline bool Window::isMinimized() const {
 }
 
 inline void Window::updateWindow() {
+	swapBuffers();
+	pollEvents();
+}
+
+
+inline void Window::pollEvents() {
 	if (!isMinimized())
-	{
-		glfwSwapBuffers(window);
 		processKeyInput(); //process movement keys
-	}
 	glfwPollEvents(); //process callbacks
 }
 
+inline void Window::setScreenshotFormat(ImageFormat format) {
+	screenshotFormat = format;
+}
+
+inline FrameCapture& Window::getFrameCapture() {
+	return *frameCapture;
+}
+
 inline GLFWwindow* Window::getGLFWindow() const {
 	return window;
 }
@@ -0,0 +1,76 @@
+#ifndef BENCH_HPP_17F47B81_D9B0_4351_85C3_D9A63D9F647B
+#define BENCH_HPP_17F47B81_D9B0_4351_85C3_D9A63D9F647B
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <vector>
+
+// Timing and checking helpers shared by the benchmarks.
+// Each kernel runs over arrays of count elements; the time reported is the best of a few runs, per element. The results of
+// the SIMD kernels are also checked against the scalar ones: the largest difference, relative to the largest magnitude of
+// the values, must stay below kTolerance.
+
+using BenchClock = std::chrono::steady_clock;
+
+constexpr int kPasses = 100;//passes over the arrays per run
+constexpr int kRuns = 7;
+constexpr float kTolerance = 1e-4f;
+
+inline volatile float gSink;
+
+//Best time of the runs, in nanoseconds per element. aPass makes a pass over the arrays and returns one of its results.
+template< typename TPass >
+double time_per_element( std::size_t aCount, TPass&& aPass )
+{
+	double best = 1e30;
+	for( int run = 0; run < kRuns; ++run )
+	{
+		auto begin = BenchClock::now();
+		for( int pass = 0; pass < kPasses; ++pass )
+			gSink = aPass();
+		double ns = std::chrono::duration<double, std::nano>( BenchClock::now() - begin ).count();
+		best = std::min( best, ns / (double(kPasses) * aCount) );
+	}
+	return best;
+}
+
+//Largest difference between the floats of two arrays (of floats, or of structs of floats), relative to the largest value.
+template< typename T >
+float max_difference( const std::vector<T>& aExpected, const std::vector<T>& aActual )
+{
+	const float* a = reinterpret_cast<const float*>( aExpected.data() );
+	const float* b = reinterpret_cast<const float*>( aActual.data() );
+	std::size_t n = std::min( aExpected.size(), aActual.size() ) * sizeof(T) / sizeof(float);
+	float diff = aExpected.size() == aActual.size() ? 0.f : INFINITY;
+	float magnitude = 1.f;
+	for( std::size_t i = 0; i < n; ++i )
+	{
+		diff = std::max( diff, std::fabs( a[i] - b[i] ) );
+		magnitude = std::max( magnitude, std::fabs( a[i] ) );
+	}
+	return diff / magnitude;
+}
+
+inline void print_header( const char* aTitle, std::size_t aCount, const char* aInstructionSet )
+{
+	std::printf( "\n%s: %zu elements, %s\n", aTitle, aCount, aInstructionSet );
+	std::printf( "%-28s %10s %10s %9s %12s\n", "kernel", "scalar ns", "simd ns", "speedup", "difference" );
+}
+
+//Print a line of results. Returns false if the results differ too much.
+inline bool report( const char* aName, double aScalarNs, double aSimdNs, float aDifference )
+{
+	bool ok = aDifference <= kTolerance;
+	std::printf( "%-28s %10.2f %10.2f %8.2fx %12.3g%s\n", aName, aScalarNs, aSimdNs, aScalarNs / aSimdNs, aDifference,
+		ok ? "" : "  MISMATCH" );
+	return ok;
+}
+
+// Benchmarks. Return false if a kernel gave results that differ from the scalar code.
+bool run_mat44_benchmarks( std::size_t aCount );
+bool run_soa_benchmarks( std::size_t aCount );
+
+#endif // BENCH_HPP_17F47B81_D9B0_4351_85C3_D9A63D9F647B
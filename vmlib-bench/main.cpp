@@ -0,0 +1,27 @@
+#include <cstdio>
+#include <cstdlib>
+
+#include "bench.hpp"
+
+// Microbenchmark of the SIMD kernels of vmlib against the scalar code.
+// Usage: vmlib-bench [count]
+// Exits with 1 when a kernel gives results that differ from the scalar code, so that the run also checks the kernels.
+
+namespace
+{
+	constexpr std::size_t kDefaultCount = 4096;
+}
+
+int main( int aArgc, char* aArgv[] )
+{
+	std::size_t count = aArgc > 1 ? std::strtoul( aArgv[1], nullptr, 10 ) : kDefaultCount;
+	if( 0 == count )
+	{
+		std::fprintf( stderr, "Usage: %s [count]\n", aArgv[0] );
+		return 1;
+	}
+
+	bool ok = run_mat44_benchmarks( count );
+	ok &= run_soa_benchmarks( count );
+	return ok ? 0 : 1;
+}
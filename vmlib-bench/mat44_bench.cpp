@@ -0,0 +1,94 @@
+#include <random>
+#include <vector>
+
+#include "bench.hpp"
+#include "../vmlib/simd.hpp"
+#include "../vmlib/mat44_simd.hpp"
+
+// Mat44f kernels of vmlib/mat44_simd.hpp against the scalar operators of vmlib/mat44.hpp.
+
+namespace
+{
+	//Random affine transform: rotation, non-uniform scale and translation.
+	Mat44f random_affine( std::mt19937& aRng )
+	{
+		std::uniform_real_distribution<float> angle( -3.14159f, 3.14159f );
+		std::uniform_real_distribution<float> scale( 0.5f, 2.f );
+		std::uniform_real_distribution<float> offset( -10.f, 10.f );
+		return make_translation( { offset( aRng ), offset( aRng ), offset( aRng ) } )
+			* make_rotation_y( angle( aRng ) ) * make_rotation_x( angle( aRng ) )
+			* make_scaling( scale( aRng ), scale( aRng ), scale( aRng ) );
+	}
+}
+
+bool run_mat44_benchmarks( std::size_t aCount )
+{
+	std::mt19937 rng( 1234 );
+	std::uniform_real_distribution<float> coord( -50.f, 50.f );
+
+	std::vector<Mat44f> lefts( aCount ), rights( aCount );
+	std::vector<Vec4f> vectors( aCount );
+	for( std::size_t i = 0; i < aCount; ++i )
+	{
+		lefts[i] = random_affine( rng );
+		rights[i] = random_affine( rng );
+		vectors[i] = Vec4f{ coord( rng ), coord( rng ), coord( rng ), 1.f };
+	}
+	Mat44f viewProj = make_perspective_projection( 1.2f, 16.f / 9.f, 0.1f, 100.f )
+		* make_lookat( { 5.f, 3.f, 5.f }, { 0.f, 0.f, 0.f }, { 0.f, 1.f, 0.f } );
+
+	std::vector<Mat44f> expectedM( aCount ), actualM( aCount );
+	std::vector<Vec4f> expectedV( aCount ), actualV( aCount );
+
+	print_header( "Mat44f", aCount, kSimdInstructionSet );
+	bool ok = true;
+
+	double scalar = time_per_element( aCount, [&] {
+		for( std::size_t i = 0; i < aCount; ++i ) expectedM[i] = lefts[i] * rights[i];
+		return expectedM[aCount - 1].v[0];
+	} );
+	double simd = time_per_element( aCount, [&] {
+		mul_batch( lefts.data(), rights.data(), aCount, actualM.data() );
+		return actualM[aCount - 1].v[0];
+	} );
+	ok &= report( "mat * mat (pairwise)", scalar, simd, max_difference( expectedM, actualM ) );
+
+	scalar = time_per_element( aCount, [&] {
+		for( std::size_t i = 0; i < aCount; ++i ) expectedM[i] = viewProj * rights[i];
+		return expectedM[aCount - 1].v[0];
+	} );
+	simd = time_per_element( aCount, [&] {
+		mul_batch( viewProj, rights.data(), aCount, actualM.data() );
+		return actualM[aCount - 1].v[0];
+	} );
+	ok &= report( "mat * mat (one to many)", scalar, simd, max_difference( expectedM, actualM ) );
+
+	scalar = time_per_element( aCount, [&] {
+		for( std::size_t i = 0; i < aCount; ++i ) expectedV[i] = lefts[i] * vectors[i];
+		return expectedV[aCount - 1].x;
+	} );
+	simd = time_per_element( aCount, [&] {
+		for( std::size_t i = 0; i < aCount; ++i ) actualV[i] = mul_simd( lefts[i], vectors[i] );
+		return actualV[aCount - 1].x;
+	} );
+	ok &= report( "mat * vec4", scalar, simd, max_difference( expectedV, actualV ) );
+
+	scalar = time_per_element( aCount, [&] {
+		for( std::size_t i = 0; i < aCount; ++i ) expectedM[i] = invert( lefts[i] );
+		return expectedM[aCount - 1].v[0];
+	} );
+	simd = time_per_element( aCount, [&] {
+		for( std::size_t i = 0; i < aCount; ++i ) actualM[i] = invert_simd( lefts[i] );
+		return actualM[aCount - 1].v[0];
+	} );
+	ok &= report( "invert", scalar, simd, max_difference( expectedM, actualM ) );
+
+	// The scalar reference for the affine inverse is the general one: there was no dedicated affine inverse before
+	simd = time_per_element( aCount, [&] {
+		for( std::size_t i = 0; i < aCount; ++i ) actualM[i] = invert_affine( lefts[i] );
+		return actualM[aCount - 1].v[0];
+	} );
+	ok &= report( "invert affine (vs invert)", scalar, simd, max_difference( expectedM, actualM ) );
+
+	return ok;
+}
@@ -0,0 +1,135 @@
+#include <random>
+#include <vector>
+
+#include "bench.hpp"
+#include "../vmlib/simd.hpp"
+#include "../vmlib/soa.hpp"
+
+// Structure-of-arrays kernels of vmlib/soa.hpp against the scalar functions on arrays of Vec3f/Vec4f.
+
+namespace
+{
+	std::vector<Vec3f> to_aos( const Vec3fSoa& aSoa )
+	{
+		std::vector<Vec3f> aos( aSoa.size() );
+		for( std::size_t i = 0; i < aSoa.size(); ++i )
+			aos[i] = aSoa.get( i );
+		return aos;
+	}
+}
+
+bool run_soa_benchmarks( std::size_t aCount )
+{
+	std::mt19937 rng( 5678 );
+	std::uniform_real_distribution<float> coord( -50.f, 50.f );
+
+	std::vector<Vec3f> lefts( aCount ), rights( aCount );
+	std::vector<Vec4f> lefts4( aCount ), rights4( aCount );
+	for( std::size_t i = 0; i < aCount; ++i )
+	{
+		lefts[i] = Vec3f{ coord( rng ), coord( rng ), coord( rng ) };
+		rights[i] = Vec3f{ coord( rng ), coord( rng ), coord( rng ) };
+		lefts4[i] = Vec4f{ coord( rng ), coord( rng ), coord( rng ), coord( rng ) };
+		rights4[i] = Vec4f{ coord( rng ), coord( rng ), coord( rng ), coord( rng ) };
+	}
+	Vec3fSoa leftSoa = make_soa( lefts.data(), aCount );
+	Vec3fSoa rightSoa = make_soa( rights.data(), aCount );
+	Vec4fSoa left4Soa = make_soa( lefts4.data(), aCount );
+	Vec4fSoa right4Soa = make_soa( rights4.data(), aCount );
+
+	Frustum frustum = make_frustum( make_perspective_projection( 1.2f, 16.f / 9.f, 0.1f, 100.f )
+		* make_lookat( { 5.f, 3.f, 5.f }, { 0.f, 0.f, 0.f }, { 0.f, 1.f, 0.f } ) );
+	std::vector<float> radii( aCount );
+	for( std::size_t i = 0; i < aCount; ++i )
+		radii[i] = 0.1f + 0.05f * static_cast<float>( i % 40 );
+
+	std::vector<float> expected( aCount ), actual( aCount );
+	std::vector<Vec3f> expected3( aCount );
+	Vec3fSoa actualSoa;
+
+	print_header( "Vec3f/Vec4f arrays vs structure of arrays", aCount, kSimdInstructionSet );
+	bool ok = true;
+
+	double scalar = time_per_element( aCount, [&] {
+		for( std::size_t i = 0; i < aCount; ++i ) expected[i] = dot( lefts[i], rights[i] );
+		return expected[aCount - 1];
+	} );
+	double simd = time_per_element( aCount, [&] {
+		dot_batch( leftSoa, rightSoa, actual.data() );
+		return actual[aCount - 1];
+	} );
+	ok &= report( "dot (vec3)", scalar, simd, max_difference( expected, actual ) );
+
+	scalar = time_per_element( aCount, [&] {
+		for( std::size_t i = 0; i < aCount; ++i ) expected[i] = dot( lefts4[i], rights4[i] );
+		return expected[aCount - 1];
+	} );
+	simd = time_per_element( aCount, [&] {
+		dot_batch( left4Soa, right4Soa, actual.data() );
+		return actual[aCount - 1];
+	} );
+	ok &= report( "dot (vec4)", scalar, simd, max_difference( expected, actual ) );
+
+	scalar = time_per_element( aCount, [&] {
+		for( std::size_t i = 0; i < aCount; ++i ) expected3[i] = cross( lefts[i], rights[i] );
+		return expected3[aCount - 1].x;
+	} );
+	simd = time_per_element( aCount, [&] {
+		cross_batch( leftSoa, rightSoa, actualSoa );
+		return actualSoa.x[aCount - 1];
+	} );
+	ok &= report( "cross", scalar, simd, max_difference( expected3, to_aos( actualSoa ) ) );
+
+	// In place, so later passes normalize unit vectors: the cost is the same
+	expected3 = lefts;
+	actualSoa = leftSoa;
+	scalar = time_per_element( aCount, [&] {
+		for( std::size_t i = 0; i < aCount; ++i ) expected3[i] = normalize( expected3[i] );
+		return expected3[aCount - 1].x;
+	} );
+	simd = time_per_element( aCount, [&] {
+		normalize_batch( actualSoa );
+		return actualSoa.x[aCount - 1];
+	} );
+	ok &= report( "normalize", scalar, simd, max_difference( expected3, to_aos( actualSoa ) ) );
+
+	std::vector<Aabb> expectedBox( 1 ), actualBox( 1 );
+	scalar = time_per_element( aCount, [&] {
+		expectedBox[0] = make_aabb( lefts.data(), aCount );
+		return expectedBox[0].min.x;
+	} );
+	simd = time_per_element( aCount, [&] {
+		actualBox[0] = make_aabb( leftSoa );
+		return actualBox[0].min.x;
+	} );
+	ok &= report( "aabb (min/max)", scalar, simd, max_difference( expectedBox, actualBox ) );
+
+	const Vec4f& plane = frustum.planes[Frustum::kLeft];
+	scalar = time_per_element( aCount, [&] {
+		for( std::size_t i = 0; i < aCount; ++i )
+			expected[i] = plane.x * lefts[i].x + plane.y * lefts[i].y + plane.z * lefts[i].z + plane.w;
+		return expected[aCount - 1];
+	} );
+	simd = time_per_element( aCount, [&] {
+		plane_distance_batch( plane, leftSoa, actual.data() );
+		return actual[aCount - 1];
+	} );
+	ok &= report( "plane distance", scalar, simd, max_difference( expected, actual ) );
+
+	std::vector<std::uint8_t> expectedVisible( aCount ), actualVisible( aCount );
+	scalar = time_per_element( aCount, [&] {
+		for( std::size_t i = 0; i < aCount; ++i )
+			expectedVisible[i] = intersects( frustum, Sphere{ lefts[i], radii[i] } ) ? 1 : 0;
+		return float( expectedVisible[aCount - 1] );
+	} );
+	simd = time_per_element( aCount, [&] {
+		intersects_batch( frustum, leftSoa, radii.data(), actualVisible.data() );
+		return float( actualVisible[aCount - 1] );
+	} );
+	std::size_t mismatches = 0;
+	for( std::size_t i = 0; i < aCount; ++i )
+		mismatches += expectedVisible[i] != actualVisible[i] ? 1 : 0;
+	ok &= report( "sphere vs frustum", scalar, simd, float( mismatches ) );
+
+	return ok;
+}
@@ -0,0 +1,398 @@
+// The checks are asserts, so keep them in release builds too
+#undef NDEBUG
+#include <cassert>
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <limits>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "../vmlib/simd.hpp"
+#include "../vmlib/mat44_simd.hpp"
+#include "../vmlib/soa.hpp"
+
+// Correctness checks of the SIMD code of vmlib against the scalar functions:
+//  - the Mat44f operations of vmlib/mat44_simd.hpp, on random, affine and near-singular matrices;
+//  - the structure-of-arrays kernels of vmlib/soa.hpp. They process kWidth vectors per iteration and the rest one by one,
+//    so each kernel runs on arrays of 0, 1, kWidth - 1, kWidth, kWidth + 1 and a few more vectors, to go through the SIMD
+//    loop, the scalar tail, and both.
+// Usage: vmlib-check. Aborts on the first failed check.
+
+namespace
+{
+#if defined(VMLIB_SSE)
+	constexpr std::size_t kWidth = soa_detail::kWidth;
+#else
+	constexpr std::size_t kWidth = 4;//scalar code only: any width will do
+#endif
+
+	constexpr std::size_t kCounts[] = { 0, 1, kWidth - 1, kWidth, kWidth + 1, 3 * kWidth + 2 };
+
+	// With fused multiply-adds, the SIMD results may differ from the scalar ones in the last bits
+	constexpr float kTolerance = 1e-5f;
+
+	bool near( float aExpected, float aActual )
+	{
+		return std::fabs( aExpected - aActual ) <= kTolerance * std::fmax( 1.f, std::fabs( aExpected ) );
+	}
+	bool near( const Vec3f& aExpected, const Vec3f& aActual )
+	{
+		return near( aExpected.x, aActual.x ) && near( aExpected.y, aActual.y ) && near( aExpected.z, aActual.z );
+	}
+	bool equal( const Vec3f& aExpected, const Vec3f& aActual )
+	{
+		return aExpected.x == aActual.x && aExpected.y == aActual.y && aExpected.z == aActual.z;
+	}
+	bool equal( const Vec4f& aExpected, const Vec4f& aActual )
+	{
+		return aExpected.x == aActual.x && aExpected.y == aActual.y && aExpected.z == aActual.z && aExpected.w == aActual.w;
+	}
+
+	// Largest difference between the floats of two vectors or matrices, relative to the largest float of aExpected. The
+	// elements of a matrix product or inverse are all rounded relative to the largest of them, not to their own size.
+	template< typename T >
+	float difference( const T& aExpected, const T& aActual )
+	{
+		const float* e = reinterpret_cast<const float*>( &aExpected );
+		const float* a = reinterpret_cast<const float*>( &aActual );
+		float diff = 0.f, magnitude = 1.f;
+		for( std::size_t i = 0; i < sizeof(T) / sizeof(float); ++i )
+		{
+			diff = std::fmax( diff, std::fabs( e[i] - a[i] ) );
+			magnitude = std::fmax( magnitude, std::fabs( e[i] ) );
+		}
+		return diff / magnitude;
+	}
+
+	std::mt19937 gRng( 1234 );
+
+	std::vector<Vec3f> random_vec3( std::size_t aCount, float aRange )
+	{
+		std::uniform_real_distribution<float> coord( -aRange, aRange );
+		std::vector<Vec3f> v( aCount );
+		for( auto& p : v )
+			p = Vec3f{ coord( gRng ), coord( gRng ), coord( gRng ) };
+		return v;
+	}
+	std::vector<Vec4f> random_vec4( std::size_t aCount, float aRange )
+	{
+		std::uniform_real_distribution<float> coord( -aRange, aRange );
+		std::vector<Vec4f> v( aCount );
+		for( auto& p : v )
+			p = Vec4f{ coord( gRng ), coord( gRng ), coord( gRng ), coord( gRng ) };
+		return v;
+	}
+
+	Mat44f random_mat44( float aRange )
+	{
+		std::uniform_real_distribution<float> element( -aRange, aRange );
+		Mat44f m;
+		for( auto& e : m.v )
+			e = element( gRng );
+		return m;
+	}
+
+	// Rotation, non-uniform scale and translation
+	Mat44f random_affine( float aMinScale = 0.5f )
+	{
+		std::uniform_real_distribution<float> angle( -3.14159f, 3.14159f );
+		std::uniform_real_distribution<float> scale( aMinScale, 2.f );
+		std::uniform_real_distribution<float> offset( -10.f, 10.f );
+		return make_translation( { offset( gRng ), offset( gRng ), offset( gRng ) } )
+			* make_rotation_y( angle( gRng ) ) * make_rotation_x( angle( gRng ) )
+			* make_scaling( scale( gRng ), scale( gRng ), scale( gRng ) );
+	}
+
+	void check_mat44_mul()
+	{
+		Mat44f viewProj = make_perspective_projection( 1.2f, 16.f / 9.f, 0.1f, 100.f )
+			* make_lookat( { 5.f, 3.f, 5.f }, { 0.f, 0.f, 0.f }, { 0.f, 1.f, 0.f } );
+		for( int k = 0; k < 100; ++k )
+		{
+			Mat44f a = random_mat44( 10.f ), b = random_affine();
+			assert( difference( a * b, mul_simd( a, b ) ) <= kTolerance );
+			assert( difference( viewProj * b, mul_simd( viewProj, b ) ) <= kTolerance );
+
+			std::uniform_real_distribution<float> coord( -50.f, 50.f );
+			Vec4f v{ coord( gRng ), coord( gRng ), coord( gRng ), 1.f };
+			assert( difference( a * v, mul_simd( a, v ) ) <= kTolerance );
+		}
+
+		// Batches, on the counts around the SIMD width like the SoA kernels; nothing written past the end
+		for( std::size_t count : kCounts )
+		{
+			std::vector<Mat44f> lefts( count ), rights( count ), out( count + 1, kIdentity44f );
+			for( std::size_t i = 0; i < count; ++i )
+			{
+				lefts[i] = random_affine();
+				rights[i] = random_affine();
+			}
+			mul_batch( viewProj, rights.data(), count, out.data() );
+			for( std::size_t i = 0; i < count; ++i )
+				assert( difference( viewProj * rights[i], out[i] ) <= kTolerance );
+			assert( 0.f == difference( kIdentity44f, out[count] ) );
+
+			mul_batch( lefts.data(), rights.data(), count, out.data() );
+			for( std::size_t i = 0; i < count; ++i )
+				assert( difference( lefts[i] * rights[i], out[i] ) <= kTolerance );
+			assert( 0.f == difference( kIdentity44f, out[count] ) );
+
+			// In place
+			std::vector<Mat44f> inPlace = rights;
+			mul_batch( viewProj, inPlace.data(), count, inPlace.data() );
+			for( std::size_t i = 0; i < count; ++i )
+				assert( difference( viewProj * rights[i], inPlace[i] ) <= kTolerance );
+		}
+	}
+
+	void check_mat44_transpose()
+	{
+		for( int k = 0; k < 100; ++k )
+		{
+			Mat44f m = random_mat44( 10.f );
+			assert( 0.f == difference( transpose( m ), transpose_simd( m ) ) );
+		}
+	}
+
+	// Error of an inverse computed in float, relative to its largest element, in units of epsilon times the condition number
+	// of the matrix (infinity norm). The reference is computed in double, by Gauss-Jordan elimination with partial pivoting.
+	// Any float inverse is only accurate to about epsilon times the condition number, whatever the order of its operations.
+	double inverse_error( const Mat44f& aM, const Mat44f& aInverse )
+	{
+		double a[4][8];
+		for( std::size_t i = 0; i < 4; ++i )
+		{
+			for( std::size_t j = 0; j < 4; ++j )
+			{
+				a[i][j] = aM(i,j);
+				a[i][j + 4] = i == j ? 1. : 0.;
+			}
+		}
+		for( std::size_t c = 0; c < 4; ++c )
+		{
+			std::size_t pivot = c;
+			for( std::size_t r = c + 1; r < 4; ++r )
+				pivot = std::fabs( a[r][c] ) > std::fabs( a[pivot][c] ) ? r : pivot;
+			for( std::size_t j = 0; j < 8; ++j )
+				std::swap( a[c][j], a[pivot][j] );
+			assert( a[c][c] != 0. );
+			double rcp = 1. / a[c][c];
+			for( std::size_t j = 0; j < 8; ++j )
+				a[c][j] *= rcp;
+			for( std::size_t r = 0; r < 4; ++r )
+			{
+				double f = r == c ? 0. : a[r][c];
+				for( std::size_t j = 0; j < 8; ++j )
+					a[r][j] -= f * a[c][j];
+			}
+		}
+
+		double normM = 0., normInverse = 0., diff = 0., magnitude = 0.;
+		for( std::size_t i = 0; i < 4; ++i )
+		{
+			double rowM = 0., rowInverse = 0.;
+			for( std::size_t j = 0; j < 4; ++j )
+			{
+				rowM += std::fabs( aM(i,j) );
+				rowInverse += std::fabs( a[i][j + 4] );
+				diff = std::fmax( diff, std::fabs( a[i][j + 4] - aInverse(i,j) ) );
+				magnitude = std::fmax( magnitude, std::fabs( a[i][j + 4] ) );
+			}
+			normM = std::fmax( normM, rowM );
+			normInverse = std::fmax( normInverse, rowInverse );
+		}
+		return diff / magnitude / (normM * normInverse * std::numeric_limits<float>::epsilon());
+	}
+
+	// The worst error measured over 100000 random matrices of each kind below is about 15
+	constexpr double kInverseErrorBound = 64.;
+
+	void check_mat44_invert()
+	{
+		for( int k = 0; k < 100; ++k )
+		{
+			Mat44f m = random_mat44( 10.f );
+			assert( inverse_error( m, invert_simd( m ) ) <= kInverseErrorBound );
+			assert( inverse_error( m, invert( m ) ) <= kInverseErrorBound );
+
+			// Well conditioned: the same results as the scalar code
+			Mat44f affine = random_affine();
+			assert( difference( invert( affine ), invert_simd( affine ) ) <= kTolerance );
+			assert( difference( invert( affine ), invert_affine( affine ) ) <= kTolerance );
+			assert( difference( kIdentity44f, mul_simd( affine, invert_affine( affine ) ) ) <= kTolerance );
+		}
+
+		// Near-singular matrices: one axis almost flattened, and two almost equal rows
+		for( int k = 0; k < 100; ++k )
+		{
+			Mat44f flat = random_affine( 1.f ) * make_scaling( 1.f, 1e-4f, 1.f );
+			assert( inverse_error( flat, invert_simd( flat ) ) <= kInverseErrorBound );
+			assert( inverse_error( flat, invert_affine( flat ) ) <= kInverseErrorBound );
+
+			Mat44f m = random_mat44( 1.f );
+			for( std::size_t j = 0; j < 4; ++j )
+				m(3,j) = m(2,j) + 1e-4f * m(3,j);
+			assert( inverse_error( m, invert_simd( m ) ) <= kInverseErrorBound );
+			assert( inverse_error( m, invert( m ) ) <= kInverseErrorBound );
+		}
+	}
+
+	void check_dot( std::size_t aCount )
+	{
+		auto lefts = random_vec3( aCount, 1.f ), rights = random_vec3( aCount, 1.f );
+		std::vector<float> out( aCount + 1, -1.f );
+		dot_batch( make_soa( lefts.data(), aCount ), make_soa( rights.data(), aCount ), out.data() );
+		for( std::size_t i = 0; i < aCount; ++i )
+			assert( near( dot( lefts[i], rights[i] ), out[i] ) );
+		assert( -1.f == out[aCount] );//nothing written past the end
+
+		auto lefts4 = random_vec4( aCount, 1.f ), rights4 = random_vec4( aCount, 1.f );
+		out.assign( aCount + 1, -1.f );
+		dot_batch( make_soa( lefts4.data(), aCount ), make_soa( rights4.data(), aCount ), out.data() );
+		for( std::size_t i = 0; i < aCount; ++i )
+			assert( near( dot( lefts4[i], rights4[i] ), out[i] ) );
+		assert( -1.f == out[aCount] );
+	}
+
+	void check_cross( std::size_t aCount )
+	{
+		auto lefts = random_vec3( aCount, 1.f ), rights = random_vec3( aCount, 1.f );
+		Vec3fSoa leftSoa = make_soa( lefts.data(), aCount );
+		Vec3fSoa out;
+		cross_batch( leftSoa, make_soa( rights.data(), aCount ), out );
+		assert( aCount == out.size() );
+		for( std::size_t i = 0; i < aCount; ++i )
+			assert( near( cross( lefts[i], rights[i] ), out.get( i ) ) );
+
+		// The output may be one of the inputs
+		cross_batch( leftSoa, make_soa( rights.data(), aCount ), leftSoa );
+		for( std::size_t i = 0; i < aCount; ++i )
+			assert( near( cross( lefts[i], rights[i] ), leftSoa.get( i ) ) );
+	}
+
+	void check_normalize( std::size_t aCount )
+	{
+		auto vs = random_vec3( aCount, 10.f );
+		for( auto& v : vs )
+			v.x += v.x < 0.f ? -0.5f : 0.5f;//keep away from zero length
+		Vec3fSoa soa = make_soa( vs.data(), aCount );
+		normalize_batch( soa );
+		assert( aCount == soa.size() );
+		for( std::size_t i = 0; i < aCount; ++i )
+			assert( near( normalize( vs[i] ), soa.get( i ) ) );
+	}
+
+	void check_reduce( std::size_t aCount )
+	{
+		// Minimum, maximum and boxes are exact
+		auto points = random_vec3( aCount, 50.f );
+		Vec3fSoa soa = make_soa( points.data(), aCount );
+		Aabb expected = make_aabb( points.data(), aCount );
+		Aabb actual = make_aabb( soa );
+		assert( equal( expected.min, actual.min ) && equal( expected.max, actual.max ) );
+		assert( equal( expected.min, min_batch( soa ) ) && equal( expected.max, max_batch( soa ) ) );
+
+		auto points4 = random_vec4( aCount, 50.f );
+		Vec4fSoa soa4 = make_soa( points4.data(), aCount );
+		Vec4f expectedMin4{ 0.f, 0.f, 0.f, 0.f }, expectedMax4{ 0.f, 0.f, 0.f, 0.f };
+		for( std::size_t i = 0; i < aCount; ++i )
+		{
+			const Vec4f& p = points4[i];
+			expectedMin4 = 0 == i ? p : Vec4f{ std::fmin( expectedMin4.x, p.x ), std::fmin( expectedMin4.y, p.y ),
+				std::fmin( expectedMin4.z, p.z ), std::fmin( expectedMin4.w, p.w ) };
+			expectedMax4 = 0 == i ? p : Vec4f{ std::fmax( expectedMax4.x, p.x ), std::fmax( expectedMax4.y, p.y ),
+				std::fmax( expectedMax4.z, p.z ), std::fmax( expectedMax4.w, p.w ) };
+		}
+		assert( equal( expectedMin4, min_batch( soa4 ) ) && equal( expectedMax4, max_batch( soa4 ) ) );
+
+		// Expanding a box that already holds some of the points, and one that holds all of them
+		Aabb box{ { -1.f, -1.f, -1.f }, { 1.f, 1.f, 1.f } };
+		Aabb expectedBox = box;
+		for( const auto& p : points )
+			expand( expectedBox, p );
+		expand( box, soa );
+		assert( equal( expectedBox.min, box.min ) && equal( expectedBox.max, box.max ) );
+		expand( box, soa );
+		assert( equal( expectedBox.min, box.min ) && equal( expectedBox.max, box.max ) );
+	}
+
+	void check_plane_distance( std::size_t aCount )
+	{
+		auto points = random_vec3( aCount, 1.f );
+		Vec4f plane{ 0.48f, -0.6f, 0.64f, 0.25f };//unit normal
+		std::vector<float> out( aCount + 1, -1.f );
+		plane_distance_batch( plane, make_soa( points.data(), aCount ), out.data() );
+		for( std::size_t i = 0; i < aCount; ++i )
+			assert( near( plane.x * points[i].x + plane.y * points[i].y + plane.z * points[i].z + plane.w, out[i] ) );
+		assert( -1.f == out[aCount] );
+	}
+
+	void check_intersects( std::size_t aCount )
+	{
+		Frustum frustum = make_frustum( make_perspective_projection( 1.2f, 16.f / 9.f, 0.1f, 100.f )
+			* make_lookat( { 5.f, 3.f, 5.f }, { 0.f, 0.f, 0.f }, { 0.f, 1.f, 0.f } ) );
+
+		// Spread around the frustum so that some spheres are in and some out
+		auto centers = random_vec3( aCount, 20.f );
+		std::vector<float> radii( aCount );
+		for( std::size_t i = 0; i < aCount; ++i )
+			radii[i] = 0.1f + 0.5f * static_cast<float>( i % 7 );
+
+		std::vector<std::uint8_t> visible( aCount + 1, 2 );
+		intersects_batch( frustum, make_soa( centers.data(), aCount ), radii.data(), visible.data() );
+		for( std::size_t i = 0; i < aCount; ++i )
+			assert( (intersects( frustum, Sphere{ centers[i], radii[i] } ) ? 1 : 0) == visible[i] );
+		assert( 2 == visible[aCount] );
+	}
+
+	// make_soa() reading the positions out of interleaved vertex data
+	void check_strided( std::size_t aCount )
+	{
+		struct Vertex
+		{
+			Vec3f position;
+			float u, v;
+			Vec4f color;
+		};
+		auto positions = random_vec3( aCount, 50.f );
+		auto colors = random_vec4( aCount, 1.f );
+		// One more vertex, far outside the others: reading it would grow the box
+		std::vector<Vertex> vertices( aCount + 1, Vertex{ { 1e6f, 1e6f, 1e6f }, 0.f, 1.f, { 1e6f, 1e6f, 1e6f, 1e6f } } );
+		for( std::size_t i = 0; i < aCount; ++i )
+			vertices[i] = Vertex{ positions[i], 0.f, 1.f, colors[i] };
+
+		Vec3fSoa soa = make_soa( &vertices[0].position, aCount, sizeof(Vertex) );
+		Vec4fSoa soa4 = make_soa( &vertices[0].color, aCount, sizeof(Vertex) );
+		assert( aCount == soa.size() && aCount == soa4.size() );
+		for( std::size_t i = 0; i < aCount; ++i )
+			assert( equal( positions[i], soa.get( i ) ) && equal( colors[i], soa4.get( i ) ) );
+
+		Aabb expected = make_aabb( &vertices[0].position, aCount, sizeof(Vertex) );
+		Aabb actual = make_aabb( soa );
+		assert( equal( expected.min, actual.min ) && equal( expected.max, actual.max ) );
+	}
+}
+
+int main()
+{
+	check_mat44_mul();
+	check_mat44_transpose();
+	check_mat44_invert();
+
+	for( std::size_t count : kCounts )
+	{
+		check_dot( count );
+		check_cross( count );
+		check_normalize( count );
+		check_reduce( count );
+		check_plane_distance( count );
+		check_intersects( count );
+		check_strided( count );
+	}
+
+	std::printf( "vmlib-check: all checks passed (%s)\n", kSimdInstructionSet );
+	return 0;
+}
@@ -0,0 +1,128 @@
+#ifndef BOUNDS_HPP_0C8E5B7A_3F2D_4E61_9A47_D2B1C6E4F930
+#define BOUNDS_HPP_0C8E5B7A_3F2D_4E61_9A47_D2B1C6E4F930
+
+#include <cmath>
+#include <cstddef>
+
+#include "vec3.hpp"
+#include "vec4.hpp"
+#include "mat44.hpp"
+
+/** Aabb: an axis-aligned bounding box given by its minimum and maximum corners.
+ */
+struct Aabb
+{
+	Vec3f min;
+	Vec3f max;
+};
+
+/** Sphere: a bounding sphere given by its centre and radius.
+ *
+ * Like the vector types, Sphere is a POD and can be copied straight into GPU
+ * buffers (as a vec4 with the radius in w).
+ */
+struct Sphere
+{
+	Vec3f center;
+	float radius;
+};
+
+//Compute the bounding box of a list of points.
+//Input:
+// - aFirst: pointer to the position of the first point;
+// - aCount: number of points;
+// - aStride: number of bytes between consecutive positions (allows reading positions out of interleaved vertex data).
+inline Aabb make_aabb( const Vec3f* aFirst, std::size_t aCount, std::size_t aStride = sizeof(Vec3f) ) noexcept
+{
+	if( 0 == aCount )
+		return Aabb{ { 0.f, 0.f, 0.f }, { 0.f, 0.f, 0.f } };
+
+	const char* bytes = reinterpret_cast<const char*>(aFirst);
+	Aabb box{ *aFirst, *aFirst };
+	for( std::size_t i = 1; i < aCount; ++i )
+	{
+		const Vec3f& p = *reinterpret_cast<const Vec3f*>( bytes + i * aStride );
+		box.min = Vec3f{ std::fmin( box.min.x, p.x ), std::fmin( box.min.y, p.y ), std::fmin( box.min.z, p.z ) };
+		box.max = Vec3f{ std::fmax( box.max.x, p.x ), std::fmax( box.max.y, p.y ), std::fmax( box.max.z, p.z ) };
+	}
+	return box;
+}
+
+//Grow the box so that it contains the point.
+inline void expand( Aabb& aBox, const Vec3f& aPoint ) noexcept
+{
+	aBox.min = Vec3f{ std::fmin( aBox.min.x, aPoint.x ), std::fmin( aBox.min.y, aPoint.y ), std::fmin( aBox.min.z, aPoint.z ) };
+	aBox.max = Vec3f{ std::fmax( aBox.max.x, aPoint.x ), std::fmax( aBox.max.y, aPoint.y ), std::fmax( aBox.max.z, aPoint.z ) };
+}
+
+//Squared distance from a point to the box (0 if the point is inside). A sphere overlaps the box if this is at most its
+//squared radius.
+inline float distance_squared( const Aabb& aBox, const Vec3f& aPoint ) noexcept
+{
+	float d2 = 0.f;
+	for( std::size_t i = 0; i < 3; ++i )
+	{
+		float v = aPoint[i];
+		if( v < aBox.min[i] ) d2 += (aBox.min[i] - v) * (aBox.min[i] - v);
+		else if( v > aBox.max[i] ) d2 += (v - aBox.max[i]) * (v - aBox.max[i]);
+	}
+	return d2;
+}
+
+//Transform a box and return the axis-aligned box enclosing the result.
+//Rather than transforming all 8 corners, each output extent is accumulated from the matrix entries, as described in:
+//J. Arvo. 1990. "Transforming Axis-Aligned Bounding Boxes". Graphics Gems. p548
+inline Aabb transform_aabb( const Mat44f& aM, const Aabb& aBox ) noexcept
+{
+	Aabb result{ { aM(0,3), aM(1,3), aM(2,3) }, { aM(0,3), aM(1,3), aM(2,3) } };
+	for( std::size_t i = 0; i < 3; ++i )
+	{
+		for( std::size_t j = 0; j < 3; ++j )
+		{
+			float a = aM(i,j) * aBox.min[j];
+			float b = aM(i,j) * aBox.max[j];
+			result.min[i] += std::fmin( a, b );
+			result.max[i] += std::fmax( a, b );
+		}
+	}
+	return result;
+}
+
+//Transform a sphere. The radius is scaled by the largest axis scale of the matrix, so the result stays conservative
+//under non-uniform scaling.
+inline Sphere transform_sphere( const Mat44f& aM, const Sphere& aSphere ) noexcept
+{
+	Vec4f c = aM * Vec4f{ aSphere.center.x, aSphere.center.y, aSphere.center.z, 1.f };
+	float sx = aM(0,0) * aM(0,0) + aM(1,0) * aM(1,0) + aM(2,0) * aM(2,0);
+	float sy = aM(0,1) * aM(0,1) + aM(1,1) * aM(1,1) + aM(2,1) * aM(2,1);
+	float sz = aM(0,2) * aM(0,2) + aM(1,2) * aM(1,2) + aM(2,2) * aM(2,2);
+	float scale = std::sqrt( std::fmax( sx, std::fmax( sy, sz ) ) );
+	return Sphere{ { c.x, c.y, c.z }, aSphere.radius * scale };
+}
+
+//Compute a bounding sphere for a list of points. The sphere is centred at the centre of the points' bounding box,
+//which is not the tightest sphere possible, but is cheap and good enough for culling.
+//Input:
+// - aFirst: pointer to the position of the first point;
+// - aCount: number of points;
+// - aStride: number of bytes between consecutive positions (allows reading positions out of interleaved vertex data).
+inline Sphere make_bounding_sphere( const Vec3f* aFirst, std::size_t aCount, std::size_t aStride = sizeof(Vec3f) ) noexcept
+{
+	if( 0 == aCount )
+		return Sphere{ { 0.f, 0.f, 0.f }, 0.f };
+
+	Aabb box = make_aabb( aFirst, aCount, aStride );
+	const char* bytes = reinterpret_cast<const char*>(aFirst);
+
+	Vec3f center = 0.5f * (box.min + box.max);
+	float radius2 = 0.f;
+	for( std::size_t i = 0; i < aCount; ++i )
+	{
+		Vec3f d = *reinterpret_cast<const Vec3f*>( bytes + i * aStride ) - center;
+		radius2 = std::fmax( radius2, dot( d, d ) );
+	}
+
+	return Sphere{ center, std::sqrt( radius2 ) };
+}
+
+#endif // BOUNDS_HPP_0C8E5B7A_3F2D_4E61_9A47_D2B1C6E4F930
@@ -9,3 +9,4 @@
 
 #include "mat22.hpp"
 #include "mat44.hpp"
+#include "bounds.hpp"
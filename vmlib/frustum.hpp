@@ -0,0 +1,141 @@
+#ifndef FRUSTUM_HPP_A4D93E21_6B0C_4F7E_8D25_3C9F1B7E6A02
+#define FRUSTUM_HPP_A4D93E21_6B0C_4F7E_8D25_3C9F1B7E6A02
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#include "vec4.hpp"
+#include "mat44.hpp"
+#include "bounds.hpp"
+
+#if defined(__AVX__)
+#	include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#	include <emmintrin.h>
+#endif
+
+/** Frustum: the six planes bounding the view volume.
+ *
+ * Each plane is stored as (a,b,c,d), with the normal (a,b,c) pointing into
+ * the frustum and normalized, so that dot(n,p) + d is the signed distance of
+ * the point p from the plane.
+ */
+struct Frustum
+{
+	enum { kLeft, kRight, kBottom, kTop, kNear, kFar, kPlaneCount };
+	Vec4f planes[kPlaneCount];
+};
+
+//Extract the frustum planes from a view-projection matrix (planes are in world space) or a projection matrix (planes
+//are in camera space). Follows:
+//G. Gribb, K. Hartmann. 2001. "Fast Extraction of Viewing Frustum Planes from the World-View-Projection Matrix".
+inline Frustum make_frustum( const Mat44f& aViewProj ) noexcept
+{
+	auto row = [&]( std::size_t aI ) {
+		return Vec4f{ aViewProj(aI,0), aViewProj(aI,1), aViewProj(aI,2), aViewProj(aI,3) };
+	};
+
+	Frustum f{};
+	f.planes[Frustum::kLeft] = row(3) + row(0);
+	f.planes[Frustum::kRight] = row(3) - row(0);
+	f.planes[Frustum::kBottom] = row(3) + row(1);
+	f.planes[Frustum::kTop] = row(3) - row(1);
+	f.planes[Frustum::kNear] = row(3) + row(2);
+	f.planes[Frustum::kFar] = row(3) - row(2);
+
+	for( auto& plane : f.planes )
+	{
+		float len = std::sqrt( plane.x * plane.x + plane.y * plane.y + plane.z * plane.z );
+		plane /= len;
+	}
+	return f;
+}
+
+//Does the sphere intersect or lie inside the frustum?
+inline bool intersects( const Frustum& aFrustum, const Sphere& aSphere ) noexcept
+{
+	for( auto const& plane : aFrustum.planes )
+	{
+		float dist = plane.x * aSphere.center.x + plane.y * aSphere.center.y + plane.z * aSphere.center.z + plane.w;
+		if( dist < -aSphere.radius )
+			return false;
+	}
+	return true;
+}
+
+//Does the box intersect or lie inside the frustum? Tests the box corner furthest along each plane normal, so boxes
+//near frustum corners may be reported as visible even though they are outside (conservative).
+inline bool intersects( const Frustum& aFrustum, const Aabb& aBox ) noexcept
+{
+	for( auto const& plane : aFrustum.planes )
+	{
+		float px = plane.x >= 0.f ? aBox.max.x : aBox.min.x;
+		float py = plane.y >= 0.f ? aBox.max.y : aBox.min.y;
+		float pz = plane.z >= 0.f ? aBox.max.z : aBox.min.z;
+		if( plane.x * px + plane.y * py + plane.z * pz + plane.w < 0.f )
+			return false;
+	}
+	return true;
+}
+
+//Test many spheres against the frustum at once. The spheres are given as separate arrays of centre coordinates and
+//radii (structure of arrays), so that 8 (AVX) or 4 (SSE) spheres are tested per iteration. The instruction set is picked
+//at compile time; leftover spheres are tested one by one.
+//Output: aVisible[i] is set to 1 if sphere i intersects the frustum and 0 otherwise.
+inline void intersects_batch( const Frustum& aFrustum, const float* aX, const float* aY, const float* aZ, const float* aR,
+	std::size_t aCount, std::uint8_t* aVisible ) noexcept
+{
+	std::size_t i = 0;
+
+#if defined(__AVX__)
+	for( ; i + 8 <= aCount; i += 8 )
+	{
+		__m256 x = _mm256_loadu_ps( aX + i );
+		__m256 y = _mm256_loadu_ps( aY + i );
+		__m256 z = _mm256_loadu_ps( aZ + i );
+		__m256 negR = _mm256_sub_ps( _mm256_setzero_ps(), _mm256_loadu_ps( aR + i ) );
+
+		__m256 inside = _mm256_castsi256_ps( _mm256_set1_epi32( -1 ) );
+		for( auto const& plane : aFrustum.planes )
+		{
+			__m256 d = _mm256_add_ps(
+				_mm256_add_ps( _mm256_mul_ps( _mm256_set1_ps( plane.x ), x ), _mm256_mul_ps( _mm256_set1_ps( plane.y ), y ) ),
+				_mm256_add_ps( _mm256_mul_ps( _mm256_set1_ps( plane.z ), z ), _mm256_set1_ps( plane.w ) ) );
+			inside = _mm256_and_ps( inside, _mm256_cmp_ps( d, negR, _CMP_GE_OQ ) );
+		}
+
+		int mask = _mm256_movemask_ps( inside );
+		for( int k = 0; k < 8; ++k )
+			aVisible[i + k] = static_cast<std::uint8_t>( (mask >> k) & 1 );
+	}
+#endif
+
+#if defined(__AVX__) || defined(__SSE2__) || defined(_M_X64)
+	for( ; i + 4 <= aCount; i += 4 )
+	{
+		__m128 x = _mm_loadu_ps( aX + i );
+		__m128 y = _mm_loadu_ps( aY + i );
+		__m128 z = _mm_loadu_ps( aZ + i );
+		__m128 negR = _mm_sub_ps( _mm_setzero_ps(), _mm_loadu_ps( aR + i ) );
+
+		__m128 inside = _mm_castsi128_ps( _mm_set1_epi32( -1 ) );
+		for( auto const& plane : aFrustum.planes )
+		{
+			__m128 d = _mm_add_ps(
+				_mm_add_ps( _mm_mul_ps( _mm_set1_ps( plane.x ), x ), _mm_mul_ps( _mm_set1_ps( plane.y ), y ) ),
+				_mm_add_ps( _mm_mul_ps( _mm_set1_ps( plane.z ), z ), _mm_set1_ps( plane.w ) ) );
+			inside = _mm_and_ps( inside, _mm_cmpge_ps( d, negR ) );
+		}
+
+		int mask = _mm_movemask_ps( inside );
+		for( int k = 0; k < 4; ++k )
+			aVisible[i + k] = static_cast<std::uint8_t>( (mask >> k) & 1 );
+	}
+#endif
+
+	for( ; i < aCount; ++i )
+		aVisible[i] = intersects( aFrustum, Sphere{ { aX[i], aY[i], aZ[i] }, aR[i] } ) ? 1 : 0;
+}
+
+#endif // FRUSTUM_HPP_A4D93E21_6B0C_4F7E_8D25_3C9F1B7E6A02
@@ -96,6 +96,66 @@ Vec4f operator*(const Mat44f& aLeft, const Vec4f& aRight ) noexcept
 
 // Functions:
 
+//Swap rows and columns. Since Mat44f is row-major, this is also how a matrix is brought into the column-major layout
+//GLSL expects when it reads a mat4 from a buffer (rather than through glProgramUniformMatrix4fv with transpose = GL_TRUE).
+constexpr
+Mat44f transpose( const Mat44f& aM ) noexcept
+{
+	return Mat44f{
+		aM(0,0), aM(1,0), aM(2,0), aM(3,0),
+		aM(0,1), aM(1,1), aM(2,1), aM(3,1),
+		aM(0,2), aM(1,2), aM(2,2), aM(3,2),
+		aM(0,3), aM(1,3), aM(2,3), aM(3,3)
+	};
+}
+
+//Inverse of a matrix, by cofactor expansion over 2x2 minors. The matrix must be invertible (asserted in debug builds).
+//Used for instance to recover world positions from depth with the inverse of a view-projection matrix.
+inline
+Mat44f invert( const Mat44f& aM ) noexcept
+{
+	// 2x2 minors of the upper two rows (s) and lower two rows (c)
+	float s0 = aM(0,0) * aM(1,1) - aM(1,0) * aM(0,1);
+	float s1 = aM(0,0) * aM(1,2) - aM(1,0) * aM(0,2);
+	float s2 = aM(0,0) * aM(1,3) - aM(1,0) * aM(0,3);
+	float s3 = aM(0,1) * aM(1,2) - aM(1,1) * aM(0,2);
+	float s4 = aM(0,1) * aM(1,3) - aM(1,1) * aM(0,3);
+	float s5 = aM(0,2) * aM(1,3) - aM(1,2) * aM(0,3);
+
+	float c5 = aM(2,2) * aM(3,3) - aM(3,2) * aM(2,3);
+	float c4 = aM(2,1) * aM(3,3) - aM(3,1) * aM(2,3);
+	float c3 = aM(2,1) * aM(3,2) - aM(3,1) * aM(2,2);
+	float c2 = aM(2,0) * aM(3,3) - aM(3,0) * aM(2,3);
+	float c1 = aM(2,0) * aM(3,2) - aM(3,0) * aM(2,2);
+	float c0 = aM(2,0) * aM(3,1) - aM(3,0) * aM(2,1);
+
+	float det = s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0;
+	assert( det != 0.f );
+	float inv = 1.f / det;
+
+	return Mat44f{
+		( aM(1,1) * c5 - aM(1,2) * c4 + aM(1,3) * c3) * inv,
+		(-aM(0,1) * c5 + aM(0,2) * c4 - aM(0,3) * c3) * inv,
+		( aM(3,1) * s5 - aM(3,2) * s4 + aM(3,3) * s3) * inv,
+		(-aM(2,1) * s5 + aM(2,2) * s4 - aM(2,3) * s3) * inv,
+
+		(-aM(1,0) * c5 + aM(1,2) * c2 - aM(1,3) * c1) * inv,
+		( aM(0,0) * c5 - aM(0,2) * c2 + aM(0,3) * c1) * inv,
+		(-aM(3,0) * s5 + aM(3,2) * s2 - aM(3,3) * s1) * inv,
+		( aM(2,0) * s5 - aM(2,2) * s2 + aM(2,3) * s1) * inv,
+
+		( aM(1,0) * c4 - aM(1,1) * c2 + aM(1,3) * c0) * inv,
+		(-aM(0,0) * c4 + aM(0,1) * c2 - aM(0,3) * c0) * inv,
+		( aM(3,0) * s4 - aM(3,1) * s2 + aM(3,3) * s0) * inv,
+		(-aM(2,0) * s4 + aM(2,1) * s2 - aM(2,3) * s0) * inv,
+
+		(-aM(1,0) * c3 + aM(1,1) * c1 - aM(1,2) * c0) * inv,
+		( aM(0,0) * c3 - aM(0,1) * c1 + aM(0,2) * c0) * inv,
+		(-aM(3,0) * s3 + aM(3,1) * s1 - aM(3,2) * s0) * inv,
+		( aM(2,0) * s3 - aM(2,1) * s1 + aM(2,2) * s0) * inv
+	};
+}
+
 inline
 Mat44f make_rotation_x( float aAngle ) noexcept
 {
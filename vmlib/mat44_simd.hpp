@@ -0,0 +1,370 @@
+#ifndef MAT44_SIMD_HPP_3C0BB7BA_51F5_4341_8D6A_40ABCAD13A87
+#define MAT44_SIMD_HPP_3C0BB7BA_51F5_4341_8D6A_40ABCAD13A87
+
+#include <cassert>
+#include <cstddef>
+
+#include "simd.hpp"
+#include "vec3.hpp"
+#include "vec4.hpp"
+#include "mat44.hpp"
+
+/** SIMD versions of the Mat44f operations, and batch transforms.
+ *
+ * The functions compute the same results as the scalar operators of
+ * mat44.hpp, up to rounding, with SSE (or AVX, where two rows fit in a
+ * register) when the target has it, and with the scalar code otherwise (see
+ * simd.hpp). The scalar operators stay as they are, so that matrices can
+ * still be built in constant expressions; code on hot paths, like transform
+ * propagation and culling, calls these instead.
+ *
+ * transpose_simd() and transform_points_batch() keep the scalar code on all
+ * targets: their SSE and AVX versions measured no faster in vmlib-bench.
+ * vmlib-check checks the others against the scalar operators.
+ *
+ * Mat44f has no alignment beyond that of float, so all loads and stores are
+ * unaligned ones. Each row of a Mat44f fills one SSE register.
+ */
+
+namespace mat44_simd_detail
+{
+#if defined(VMLIB_SSE)
+	template< int aX, int aY, int aZ, int aW >
+	inline __m128 shuffle( __m128 aA, __m128 aB ) noexcept
+	{
+		return _mm_shuffle_ps( aA, aB, _MM_SHUFFLE( aW, aZ, aY, aX ) );
+	}
+	template< int aX, int aY, int aZ, int aW >
+	inline __m128 swizzle( __m128 aV ) noexcept
+	{
+		return _mm_shuffle_ps( aV, aV, _MM_SHUFFLE( aW, aZ, aY, aX ) );
+	}
+
+	// aA * aB + aC
+	inline __m128 madd( __m128 aA, __m128 aB, __m128 aC ) noexcept
+	{
+#	if defined(VMLIB_FMA)
+		return _mm_fmadd_ps( aA, aB, aC );
+#	else
+		return _mm_add_ps( _mm_mul_ps( aA, aB ), aC );
+#	endif
+	}
+
+	// Sum of the four elements, in every element
+	inline __m128 sum( __m128 aV ) noexcept
+	{
+		__m128 s = _mm_add_ps( aV, swizzle<2,3,0,1>( aV ) );
+		return _mm_add_ps( s, swizzle<1,0,3,2>( s ) );
+	}
+
+	// A row of aLeft * aRight: the rows of aRight weighted by the elements of the row of aLeft
+	inline __m128 mul_row( __m128 aRow, __m128 aR0, __m128 aR1, __m128 aR2, __m128 aR3 ) noexcept
+	{
+		__m128 r = _mm_mul_ps( swizzle<0,0,0,0>( aRow ), aR0 );
+		r = madd( swizzle<1,1,1,1>( aRow ), aR1, r );
+		r = madd( swizzle<2,2,2,2>( aRow ), aR2, r );
+		return madd( swizzle<3,3,3,3>( aRow ), aR3, r );
+	}
+
+	// 2x2 matrices, stored row-major in a register: aA * aB, adj(aA) * aB and aA * adj(aB)
+	inline __m128 mat2_mul( __m128 aA, __m128 aB ) noexcept
+	{
+		return _mm_add_ps( _mm_mul_ps( aA, swizzle<0,3,0,3>( aB ) ), _mm_mul_ps( swizzle<1,0,3,2>( aA ), swizzle<2,1,2,1>( aB ) ) );
+	}
+	inline __m128 mat2_adj_mul( __m128 aA, __m128 aB ) noexcept
+	{
+		return _mm_sub_ps( _mm_mul_ps( swizzle<3,3,0,0>( aA ), aB ), _mm_mul_ps( swizzle<1,1,2,2>( aA ), swizzle<2,3,0,1>( aB ) ) );
+	}
+	inline __m128 mat2_mul_adj( __m128 aA, __m128 aB ) noexcept
+	{
+		return _mm_sub_ps( _mm_mul_ps( aA, swizzle<3,0,3,0>( aB ) ), _mm_mul_ps( swizzle<1,0,3,2>( aA ), swizzle<2,1,2,1>( aB ) ) );
+	}
+
+	// Cross product of the xyz parts; w is 0 when the w of the inputs is
+	inline __m128 cross( __m128 aA, __m128 aB ) noexcept
+	{
+		return _mm_sub_ps( _mm_mul_ps( swizzle<1,2,0,3>( aA ), swizzle<2,0,1,3>( aB ) ),
+			_mm_mul_ps( swizzle<2,0,1,3>( aA ), swizzle<1,2,0,3>( aB ) ) );
+	}
+#endif
+
+#if defined(VMLIB_AVX)
+	// Two rows of aLeft * aRight; each of aR0..aR3 holds a row of aRight in both halves
+	inline __m256 mul_rows( __m256 aRows, __m256 aR0, __m256 aR1, __m256 aR2, __m256 aR3 ) noexcept
+	{
+		__m256 r = _mm256_mul_ps( _mm256_shuffle_ps( aRows, aRows, 0x00 ), aR0 );
+#	if defined(VMLIB_FMA)
+		r = _mm256_fmadd_ps( _mm256_shuffle_ps( aRows, aRows, 0x55 ), aR1, r );
+		r = _mm256_fmadd_ps( _mm256_shuffle_ps( aRows, aRows, 0xaa ), aR2, r );
+		return _mm256_fmadd_ps( _mm256_shuffle_ps( aRows, aRows, 0xff ), aR3, r );
+#	else
+		r = _mm256_add_ps( _mm256_mul_ps( _mm256_shuffle_ps( aRows, aRows, 0x55 ), aR1 ), r );
+		r = _mm256_add_ps( _mm256_mul_ps( _mm256_shuffle_ps( aRows, aRows, 0xaa ), aR2 ), r );
+		return _mm256_add_ps( _mm256_mul_ps( _mm256_shuffle_ps( aRows, aRows, 0xff ), aR3 ), r );
+#	endif
+	}
+
+	inline __m256 both_halves( __m128 aV ) noexcept
+	{
+		return _mm256_insertf128_ps( _mm256_castps128_ps256( aV ), aV, 1 );
+	}
+#endif
+}
+
+//aLeft * aRight
+inline
+Mat44f mul_simd( const Mat44f& aLeft, const Mat44f& aRight ) noexcept
+{
+	using namespace mat44_simd_detail;
+#if defined(VMLIB_AVX)
+	__m256 r0 = both_halves( _mm_loadu_ps( aRight.v + 0 ) );
+	__m256 r1 = both_halves( _mm_loadu_ps( aRight.v + 4 ) );
+	__m256 r2 = both_halves( _mm_loadu_ps( aRight.v + 8 ) );
+	__m256 r3 = both_halves( _mm_loadu_ps( aRight.v + 12 ) );
+
+	Mat44f result;
+	_mm256_storeu_ps( result.v + 0, mul_rows( _mm256_loadu_ps( aLeft.v + 0 ), r0, r1, r2, r3 ) );
+	_mm256_storeu_ps( result.v + 8, mul_rows( _mm256_loadu_ps( aLeft.v + 8 ), r0, r1, r2, r3 ) );
+	return result;
+#elif defined(VMLIB_SSE)
+	__m128 r0 = _mm_loadu_ps( aRight.v + 0 );
+	__m128 r1 = _mm_loadu_ps( aRight.v + 4 );
+	__m128 r2 = _mm_loadu_ps( aRight.v + 8 );
+	__m128 r3 = _mm_loadu_ps( aRight.v + 12 );
+
+	Mat44f result;
+	for( std::size_t i = 0; i < 16; i += 4 )
+		_mm_storeu_ps( result.v + i, mul_row( _mm_loadu_ps( aLeft.v + i ), r0, r1, r2, r3 ) );
+	return result;
+#else
+	return aLeft * aRight;
+#endif
+}
+
+//aLeft * aRight
+inline
+Vec4f mul_simd( const Mat44f& aLeft, const Vec4f& aRight ) noexcept
+{
+#if defined(VMLIB_SSE)
+	// The products of the rows with the vector, transposed so that adding them up sums each row
+	__m128 v = _mm_loadu_ps( &aRight.x );
+	__m128 p0 = _mm_mul_ps( _mm_loadu_ps( aLeft.v + 0 ), v );
+	__m128 p1 = _mm_mul_ps( _mm_loadu_ps( aLeft.v + 4 ), v );
+	__m128 p2 = _mm_mul_ps( _mm_loadu_ps( aLeft.v + 8 ), v );
+	__m128 p3 = _mm_mul_ps( _mm_loadu_ps( aLeft.v + 12 ), v );
+	_MM_TRANSPOSE4_PS( p0, p1, p2, p3 );
+
+	Vec4f result;
+	_mm_storeu_ps( &result.x, _mm_add_ps( _mm_add_ps( p0, p1 ), _mm_add_ps( p2, p3 ) ) );
+	return result;
+#else
+	return aLeft * aRight;
+#endif
+}
+
+//Same as transpose(): a shuffle through SSE registers measured no faster than the scalar copy (see vmlib-bench), so the
+//scalar code is kept on all targets.
+inline
+Mat44f transpose_simd( const Mat44f& aM ) noexcept
+{
+	return transpose( aM );
+}
+
+//Inverse of a matrix. The matrix must be invertible (asserted in debug builds).
+//The matrix is split into 2x2 blocks, and the inverse is assembled from the adjugates and determinants of the blocks, each
+//block fitting in a register. Follows: E. Zhang. 2017. "Fast 4x4 Matrix Inverse with SSE SIMD, Explained".
+inline
+Mat44f invert_simd( const Mat44f& aM ) noexcept
+{
+	using namespace mat44_simd_detail;
+#if defined(VMLIB_SSE)
+	__m128 r0 = _mm_loadu_ps( aM.v + 0 );
+	__m128 r1 = _mm_loadu_ps( aM.v + 4 );
+	__m128 r2 = _mm_loadu_ps( aM.v + 8 );
+	__m128 r3 = _mm_loadu_ps( aM.v + 12 );
+
+	// M = | A B |
+	//     | C D |
+	__m128 a = _mm_movelh_ps( r0, r1 );
+	__m128 b = _mm_movehl_ps( r1, r0 );
+	__m128 c = _mm_movelh_ps( r2, r3 );
+	__m128 d = _mm_movehl_ps( r3, r2 );
+
+	// Determinants of the blocks, as (|A| |B| |C| |D|)
+	__m128 detSub = _mm_sub_ps(
+		_mm_mul_ps( shuffle<0,2,0,2>( r0, r2 ), shuffle<1,3,1,3>( r1, r3 ) ),
+		_mm_mul_ps( shuffle<1,3,1,3>( r0, r2 ), shuffle<0,2,0,2>( r1, r3 ) ) );
+	__m128 detA = swizzle<0,0,0,0>( detSub );
+	__m128 detB = swizzle<1,1,1,1>( detSub );
+	__m128 detC = swizzle<2,2,2,2>( detSub );
+	__m128 detD = swizzle<3,3,3,3>( detSub );
+
+	// inverse(M) = 1/|M| | X Y |, with the adjugates (#) of the blocks:
+	//                    | Z W |
+	//   X# = |D| A - B (D# C),  Y# = |B| C - D (A# B)#,  Z# = |C| B - A (D# C)#,  W# = |A| D - C (A# B)
+	__m128 dc = mat2_adj_mul( d, c );
+	__m128 ab = mat2_adj_mul( a, b );
+	__m128 x = _mm_sub_ps( _mm_mul_ps( detD, a ), mat2_mul( b, dc ) );
+	__m128 w = _mm_sub_ps( _mm_mul_ps( detA, d ), mat2_mul( c, ab ) );
+	__m128 y = _mm_sub_ps( _mm_mul_ps( detB, c ), mat2_mul_adj( d, ab ) );
+	__m128 z = _mm_sub_ps( _mm_mul_ps( detC, b ), mat2_mul_adj( a, dc ) );
+
+	// |M| = |A| |D| + |B| |C| - trace((A# B) (D# C))
+	__m128 detM = _mm_add_ps( _mm_mul_ps( detA, detD ), _mm_mul_ps( detB, detC ) );
+	detM = _mm_sub_ps( detM, sum( _mm_mul_ps( ab, swizzle<0,2,1,3>( dc ) ) ) );
+	assert( _mm_cvtss_f32( detM ) != 0.f );
+
+	// The signs of the adjugates are folded into the reciprocal, and their element swaps into the final shuffles
+	__m128 rcpDetM = _mm_div_ps( _mm_setr_ps( 1.f, -1.f, -1.f, 1.f ), detM );
+	x = _mm_mul_ps( x, rcpDetM );
+	y = _mm_mul_ps( y, rcpDetM );
+	z = _mm_mul_ps( z, rcpDetM );
+	w = _mm_mul_ps( w, rcpDetM );
+
+	Mat44f result;
+	_mm_storeu_ps( result.v + 0, shuffle<3,1,3,1>( x, y ) );
+	_mm_storeu_ps( result.v + 4, shuffle<2,0,2,0>( x, y ) );
+	_mm_storeu_ps( result.v + 8, shuffle<3,1,3,1>( z, w ) );
+	_mm_storeu_ps( result.v + 12, shuffle<2,0,2,0>( z, w ) );
+	return result;
+#else
+	return invert( aM );
+#endif
+}
+
+//Inverse of an affine matrix, i.e. one whose last row is (0,0,0,1), such as model and view matrices. The upper 3x3 block
+//may scale and shear, but must be invertible (asserted in debug builds). Cheaper than a general inverse: the inverse of the
+//3x3 block A comes from its cofactors, and the translation of the result is -inverse(A) t.
+inline
+Mat44f invert_affine( const Mat44f& aM ) noexcept
+{
+	using namespace mat44_simd_detail;
+#if defined(VMLIB_SSE)
+	__m128 r0 = _mm_loadu_ps( aM.v + 0 );
+	__m128 r1 = _mm_loadu_ps( aM.v + 4 );
+	__m128 r2 = _mm_loadu_ps( aM.v + 8 );
+
+	// The cofactors of A are the cross products of its rows; they are the columns of inverse(A) once divided by |A|.
+	// The translation is masked out of the rows first: x*y - y*x is not exactly 0 once contracted into a fused multiply-add.
+	__m128 xyz = _mm_castsi128_ps( _mm_setr_epi32( -1, -1, -1, 0 ) );
+	__m128 a0 = _mm_and_ps( r0, xyz );
+	__m128 a1 = _mm_and_ps( r1, xyz );
+	__m128 a2 = _mm_and_ps( r2, xyz );
+	__m128 c0 = cross( a1, a2 );
+	__m128 c1 = cross( a2, a0 );
+	__m128 c2 = cross( a0, a1 );
+	__m128 det = sum( _mm_mul_ps( a0, c0 ) );
+	assert( _mm_cvtss_f32( det ) != 0.f );
+
+	__m128 rcpDet = _mm_div_ps( _mm_set1_ps( 1.f ), det );
+	c0 = _mm_mul_ps( c0, rcpDet );
+	c1 = _mm_mul_ps( c1, rcpDet );
+	c2 = _mm_mul_ps( c2, rcpDet );
+
+	// Translation (the w of r0..r2), as a column, with the 1 of the last row in w
+	__m128 t = _mm_mul_ps( c0, swizzle<3,3,3,3>( r0 ) );
+	t = madd( c1, swizzle<3,3,3,3>( r1 ), t );
+	t = madd( c2, swizzle<3,3,3,3>( r2 ), t );
+	t = _mm_sub_ps( _mm_setr_ps( 0.f, 0.f, 0.f, 1.f ), t );
+
+	_MM_TRANSPOSE4_PS( c0, c1, c2, t );
+
+	Mat44f result;
+	_mm_storeu_ps( result.v + 0, c0 );
+	_mm_storeu_ps( result.v + 4, c1 );
+	_mm_storeu_ps( result.v + 8, c2 );
+	_mm_storeu_ps( result.v + 12, t );
+	return result;
+#else
+	Mat44f result = kIdentity44f;
+	result(0,0) = aM(1,1) * aM(2,2) - aM(1,2) * aM(2,1);
+	result(0,1) = aM(0,2) * aM(2,1) - aM(0,1) * aM(2,2);
+	result(0,2) = aM(0,1) * aM(1,2) - aM(0,2) * aM(1,1);
+	result(1,0) = aM(1,2) * aM(2,0) - aM(1,0) * aM(2,2);
+	result(1,1) = aM(0,0) * aM(2,2) - aM(0,2) * aM(2,0);
+	result(1,2) = aM(0,2) * aM(1,0) - aM(0,0) * aM(1,2);
+	result(2,0) = aM(1,0) * aM(2,1) - aM(1,1) * aM(2,0);
+	result(2,1) = aM(0,1) * aM(2,0) - aM(0,0) * aM(2,1);
+	result(2,2) = aM(0,0) * aM(1,1) - aM(0,1) * aM(1,0);
+
+	float det = aM(0,0) * result(0,0) + aM(0,1) * result(1,0) + aM(0,2) * result(2,0);
+	assert( det != 0.f );
+	float inv = 1.f / det;
+	for( std::size_t i = 0; i < 3; ++i )
+	{
+		for( std::size_t j = 0; j < 3; ++j )
+			result(i,j) *= inv;
+	}
+
+	for( std::size_t i = 0; i < 3; ++i )
+		result(i,3) = -(result(i,0) * aM(0,3) + result(i,1) * aM(1,3) + result(i,2) * aM(2,3));
+	return result;
+#endif
+}
+
+//Multiply a matrix by many: aOut[i] = aLeft * aRight[i], e.g. the model-view-projection matrices of a list of objects.
+//aOut may be aRight.
+inline void mul_batch( const Mat44f& aLeft, const Mat44f* aRight, std::size_t aCount, Mat44f* aOut ) noexcept
+{
+	using namespace mat44_simd_detail;
+#if defined(VMLIB_AVX)
+	__m256 l01 = _mm256_loadu_ps( aLeft.v + 0 );
+	__m256 l23 = _mm256_loadu_ps( aLeft.v + 8 );
+	for( std::size_t i = 0; i < aCount; ++i )
+	{
+		__m256 r0 = both_halves( _mm_loadu_ps( aRight[i].v + 0 ) );
+		__m256 r1 = both_halves( _mm_loadu_ps( aRight[i].v + 4 ) );
+		__m256 r2 = both_halves( _mm_loadu_ps( aRight[i].v + 8 ) );
+		__m256 r3 = both_halves( _mm_loadu_ps( aRight[i].v + 12 ) );
+		_mm256_storeu_ps( aOut[i].v + 0, mul_rows( l01, r0, r1, r2, r3 ) );
+		_mm256_storeu_ps( aOut[i].v + 8, mul_rows( l23, r0, r1, r2, r3 ) );
+	}
+#elif defined(VMLIB_SSE)
+	__m128 l0 = _mm_loadu_ps( aLeft.v + 0 );
+	__m128 l1 = _mm_loadu_ps( aLeft.v + 4 );
+	__m128 l2 = _mm_loadu_ps( aLeft.v + 8 );
+	__m128 l3 = _mm_loadu_ps( aLeft.v + 12 );
+	for( std::size_t i = 0; i < aCount; ++i )
+	{
+		__m128 r0 = _mm_loadu_ps( aRight[i].v + 0 );
+		__m128 r1 = _mm_loadu_ps( aRight[i].v + 4 );
+		__m128 r2 = _mm_loadu_ps( aRight[i].v + 8 );
+		__m128 r3 = _mm_loadu_ps( aRight[i].v + 12 );
+		_mm_storeu_ps( aOut[i].v + 0, mul_row( l0, r0, r1, r2, r3 ) );
+		_mm_storeu_ps( aOut[i].v + 4, mul_row( l1, r0, r1, r2, r3 ) );
+		_mm_storeu_ps( aOut[i].v + 8, mul_row( l2, r0, r1, r2, r3 ) );
+		_mm_storeu_ps( aOut[i].v + 12, mul_row( l3, r0, r1, r2, r3 ) );
+	}
+#else
+	for( std::size_t i = 0; i < aCount; ++i )
+		aOut[i] = aLeft * aRight[i];
+#endif
+}
+
+//Multiply matrices pairwise: aOut[i] = aLeft[i] * aRight[i], e.g. the world matrices of nodes from those of their parents
+//and their local transforms. aOut may be aLeft or aRight.
+inline void mul_batch( const Mat44f* aLeft, const Mat44f* aRight, std::size_t aCount, Mat44f* aOut ) noexcept
+{
+	for( std::size_t i = 0; i < aCount; ++i )
+		aOut[i] = mul_simd( aLeft[i], aRight[i] );
+}
+
+//Transform points: aOut[i] = aM * (aPoints[i], 1), e.g. the corners of bounding boxes into clip space for culling.
+//Input:
+// - aPoints: pointer to the position of the first point;
+// - aCount: number of points;
+// - aStride: number of bytes between consecutive positions (allows reading positions out of interleaved vertex data).
+//The compiler already vectorizes the scalar loop well: SSE and AVX versions measured within noise of it (see vmlib-bench),
+//so the scalar code is kept on all targets.
+inline void transform_points_batch( const Mat44f& aM, const Vec3f* aPoints, std::size_t aCount, Vec4f* aOut,
+	std::size_t aStride = sizeof(Vec3f) ) noexcept
+{
+	const char* bytes = reinterpret_cast<const char*>(aPoints);
+	for( std::size_t i = 0; i < aCount; ++i )
+	{
+		const Vec3f& p = *reinterpret_cast<const Vec3f*>( bytes + i * aStride );
+		aOut[i] = aM * Vec4f{ p.x, p.y, p.z, 1.f };
+	}
+}
+
+#endif // MAT44_SIMD_HPP_3C0BB7BA_51F5_4341_8D6A_40ABCAD13A87
@@ -0,0 +1,47 @@
+#ifndef SIMD_HPP_31100C32_87E0_44F1_9CD8_50DA4A3CF48A
+#define SIMD_HPP_31100C32_87E0_44F1_9CD8_50DA4A3CF48A
+
+/** Instruction set of the SIMD code in vmlib.
+ *
+ * The instruction set is picked at compile time from the target: premake5.lua
+ * builds with -march=native on gcc and clang, MSVC defines __AVX__ with
+ * /arch:AVX, and SSE2 is always there on x64. Other targets use the scalar
+ * code. Defining VMLIB_NO_SIMD forces the scalar code everywhere, e.g. to
+ * check the SIMD code against it.
+ *
+ * After including this header:
+ *  - VMLIB_SSE is defined when SSE2 can be used;
+ *  - VMLIB_AVX is defined when AVX can be used (VMLIB_SSE is then defined too);
+ *  - VMLIB_FMA is defined when fused multiply-adds can be used.
+ */
+
+#if !defined(VMLIB_NO_SIMD) && defined(__AVX__)
+#	define VMLIB_AVX 1
+#endif
+
+#if !defined(VMLIB_NO_SIMD) && (defined(__AVX__) || defined(__SSE2__) || defined(_M_X64))
+#	define VMLIB_SSE 1
+#endif
+
+#if defined(VMLIB_AVX) && defined(__FMA__)
+#	define VMLIB_FMA 1
+#endif
+
+#if defined(VMLIB_AVX)
+#	include <immintrin.h>
+#elif defined(VMLIB_SSE)
+#	include <emmintrin.h>
+#endif
+
+// Name of the instruction set in use, for reports.
+#if defined(VMLIB_FMA)
+constexpr char const* kSimdInstructionSet = "AVX+FMA";
+#elif defined(VMLIB_AVX)
+constexpr char const* kSimdInstructionSet = "AVX";
+#elif defined(VMLIB_SSE)
+constexpr char const* kSimdInstructionSet = "SSE2";
+#else
+constexpr char const* kSimdInstructionSet = "scalar";
+#endif
+
+#endif // SIMD_HPP_31100C32_87E0_44F1_9CD8_50DA4A3CF48A
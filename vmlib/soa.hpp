@@ -0,0 +1,409 @@
+#ifndef SOA_HPP_2BF44749_7B20_494B_9CC0_80FA15EBBB3E
+#define SOA_HPP_2BF44749_7B20_494B_9CC0_80FA15EBBB3E
+
+#include <cmath>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "simd.hpp"
+#include "vec3.hpp"
+#include "vec4.hpp"
+#include "bounds.hpp"
+#include "frustum.hpp"
+
+/** Vec3fSoa, Vec4fSoa: arrays of vectors, stored as a structure of arrays.
+ *
+ * Each component has an array of its own, so that the batch functions below
+ * process 8 (AVX) or 4 (SSE) vectors per iteration with plain loads of
+ * consecutive floats, rather than shuffling the components of Vec3f/Vec4f
+ * arrays around. The instruction set is picked at compile time (see
+ * simd.hpp); the vectors left over at the end, and all of them on targets
+ * without SIMD, go through the scalar code.
+ *
+ * The batch functions compute the same results as the scalar functions of
+ * vec3.hpp, vec4.hpp, bounds.hpp and frustum.hpp, up to rounding.
+ */
+struct Vec3fSoa
+{
+	std::vector<float> x, y, z;
+
+	std::size_t size() const noexcept
+	{
+		return x.size();
+	}
+	void resize( std::size_t aCount )
+	{
+		x.resize( aCount );
+		y.resize( aCount );
+		z.resize( aCount );
+	}
+	void reserve( std::size_t aCount )
+	{
+		x.reserve( aCount );
+		y.reserve( aCount );
+		z.reserve( aCount );
+	}
+	void clear() noexcept
+	{
+		x.clear();
+		y.clear();
+		z.clear();
+	}
+
+	void push_back( const Vec3f& aV )
+	{
+		x.push_back( aV.x );
+		y.push_back( aV.y );
+		z.push_back( aV.z );
+	}
+	Vec3f get( std::size_t aI ) const noexcept
+	{
+		assert( aI < size() );
+		return Vec3f{ x[aI], y[aI], z[aI] };
+	}
+	void set( std::size_t aI, const Vec3f& aV ) noexcept
+	{
+		assert( aI < size() );
+		x[aI] = aV.x;
+		y[aI] = aV.y;
+		z[aI] = aV.z;
+	}
+};
+
+struct Vec4fSoa
+{
+	std::vector<float> x, y, z, w;
+
+	std::size_t size() const noexcept
+	{
+		return x.size();
+	}
+	void resize( std::size_t aCount )
+	{
+		x.resize( aCount );
+		y.resize( aCount );
+		z.resize( aCount );
+		w.resize( aCount );
+	}
+	void reserve( std::size_t aCount )
+	{
+		x.reserve( aCount );
+		y.reserve( aCount );
+		z.reserve( aCount );
+		w.reserve( aCount );
+	}
+	void clear() noexcept
+	{
+		x.clear();
+		y.clear();
+		z.clear();
+		w.clear();
+	}
+
+	void push_back( const Vec4f& aV )
+	{
+		x.push_back( aV.x );
+		y.push_back( aV.y );
+		z.push_back( aV.z );
+		w.push_back( aV.w );
+	}
+	Vec4f get( std::size_t aI ) const noexcept
+	{
+		assert( aI < size() );
+		return Vec4f{ x[aI], y[aI], z[aI], w[aI] };
+	}
+	void set( std::size_t aI, const Vec4f& aV ) noexcept
+	{
+		assert( aI < size() );
+		x[aI] = aV.x;
+		y[aI] = aV.y;
+		z[aI] = aV.z;
+		w[aI] = aV.w;
+	}
+};
+
+//Gather a list of vectors into a structure of arrays.
+//Input:
+// - aFirst: pointer to the first vector;
+// - aCount: number of vectors;
+// - aStride: number of bytes between consecutive vectors (allows reading positions out of interleaved vertex data).
+inline Vec3fSoa make_soa( const Vec3f* aFirst, std::size_t aCount, std::size_t aStride = sizeof(Vec3f) )
+{
+	const char* bytes = reinterpret_cast<const char*>(aFirst);
+	Vec3fSoa soa;
+	soa.resize( aCount );
+	for( std::size_t i = 0; i < aCount; ++i )
+		soa.set( i, *reinterpret_cast<const Vec3f*>( bytes + i * aStride ) );
+	return soa;
+}
+
+inline Vec4fSoa make_soa( const Vec4f* aFirst, std::size_t aCount, std::size_t aStride = sizeof(Vec4f) )
+{
+	const char* bytes = reinterpret_cast<const char*>(aFirst);
+	Vec4fSoa soa;
+	soa.resize( aCount );
+	for( std::size_t i = 0; i < aCount; ++i )
+		soa.set( i, *reinterpret_cast<const Vec4f*>( bytes + i * aStride ) );
+	return soa;
+}
+
+namespace soa_detail
+{
+	// A register of floats, and the operations the batch functions need on it
+#if defined(VMLIB_AVX)
+	using Pack = __m256;
+	constexpr std::size_t kWidth = 8;
+
+	inline Pack vload( const float* aP ) noexcept { return _mm256_loadu_ps( aP ); }
+	inline void vstore( float* aP, Pack aV ) noexcept { _mm256_storeu_ps( aP, aV ); }
+	inline Pack vset1( float aV ) noexcept { return _mm256_set1_ps( aV ); }
+	inline Pack vadd( Pack aA, Pack aB ) noexcept { return _mm256_add_ps( aA, aB ); }
+	inline Pack vsub( Pack aA, Pack aB ) noexcept { return _mm256_sub_ps( aA, aB ); }
+	inline Pack vmul( Pack aA, Pack aB ) noexcept { return _mm256_mul_ps( aA, aB ); }
+	inline Pack vdiv( Pack aA, Pack aB ) noexcept { return _mm256_div_ps( aA, aB ); }
+	inline Pack vmin( Pack aA, Pack aB ) noexcept { return _mm256_min_ps( aA, aB ); }
+	inline Pack vmax( Pack aA, Pack aB ) noexcept { return _mm256_max_ps( aA, aB ); }
+	inline Pack vsqrt( Pack aA ) noexcept { return _mm256_sqrt_ps( aA ); }
+#	if defined(VMLIB_FMA)
+	inline Pack vmadd( Pack aA, Pack aB, Pack aC ) noexcept { return _mm256_fmadd_ps( aA, aB, aC ); }
+#	else
+	inline Pack vmadd( Pack aA, Pack aB, Pack aC ) noexcept { return _mm256_add_ps( _mm256_mul_ps( aA, aB ), aC ); }
+#	endif
+#elif defined(VMLIB_SSE)
+	using Pack = __m128;
+	constexpr std::size_t kWidth = 4;
+
+	inline Pack vload( const float* aP ) noexcept { return _mm_loadu_ps( aP ); }
+	inline void vstore( float* aP, Pack aV ) noexcept { _mm_storeu_ps( aP, aV ); }
+	inline Pack vset1( float aV ) noexcept { return _mm_set1_ps( aV ); }
+	inline Pack vadd( Pack aA, Pack aB ) noexcept { return _mm_add_ps( aA, aB ); }
+	inline Pack vsub( Pack aA, Pack aB ) noexcept { return _mm_sub_ps( aA, aB ); }
+	inline Pack vmul( Pack aA, Pack aB ) noexcept { return _mm_mul_ps( aA, aB ); }
+	inline Pack vdiv( Pack aA, Pack aB ) noexcept { return _mm_div_ps( aA, aB ); }
+	inline Pack vmin( Pack aA, Pack aB ) noexcept { return _mm_min_ps( aA, aB ); }
+	inline Pack vmax( Pack aA, Pack aB ) noexcept { return _mm_max_ps( aA, aB ); }
+	inline Pack vsqrt( Pack aA ) noexcept { return _mm_sqrt_ps( aA ); }
+	inline Pack vmadd( Pack aA, Pack aB, Pack aC ) noexcept { return _mm_add_ps( _mm_mul_ps( aA, aB ), aC ); }
+#endif
+
+#if defined(VMLIB_SSE)
+	// Smallest and largest element of the register
+	inline float hmin( Pack aV ) noexcept
+	{
+		float lanes[kWidth];
+		vstore( lanes, aV );
+		float m = lanes[0];
+		for( std::size_t k = 1; k < kWidth; ++k )
+			m = std::fmin( m, lanes[k] );
+		return m;
+	}
+	inline float hmax( Pack aV ) noexcept
+	{
+		float lanes[kWidth];
+		vstore( lanes, aV );
+		float m = lanes[0];
+		for( std::size_t k = 1; k < kWidth; ++k )
+			m = std::fmax( m, lanes[k] );
+		return m;
+	}
+#endif
+
+	// Smallest or largest value of an array of floats, from a starting value
+	template< bool tMax >
+	inline float reduce( const float* aV, std::size_t aCount, float aStart ) noexcept
+	{
+		float m = aStart;
+		std::size_t i = 0;
+#if defined(VMLIB_SSE)
+		if( aCount >= kWidth )
+		{
+			Pack acc = vload( aV );
+			for( i = kWidth; i + kWidth <= aCount; i += kWidth )
+				acc = tMax ? vmax( acc, vload( aV + i ) ) : vmin( acc, vload( aV + i ) );
+			m = tMax ? std::fmax( m, hmax( acc ) ) : std::fmin( m, hmin( acc ) );
+		}
+#endif
+		for( ; i < aCount; ++i )
+			m = tMax ? std::fmax( m, aV[i] ) : std::fmin( m, aV[i] );
+		return m;
+	}
+}
+
+//aOut[i] = dot( aLeft[i], aRight[i] ). aOut must hold aLeft.size() floats.
+inline void dot_batch( const Vec3fSoa& aLeft, const Vec3fSoa& aRight, float* aOut ) noexcept
+{
+	assert( aLeft.size() == aRight.size() );
+	std::size_t count = aLeft.size();
+	std::size_t i = 0;
+
+#if defined(VMLIB_SSE)
+	using namespace soa_detail;
+	for( ; i + kWidth <= count; i += kWidth )
+	{
+		Pack d = vmul( vload( aLeft.x.data() + i ), vload( aRight.x.data() + i ) );
+		d = vmadd( vload( aLeft.y.data() + i ), vload( aRight.y.data() + i ), d );
+		d = vmadd( vload( aLeft.z.data() + i ), vload( aRight.z.data() + i ), d );
+		vstore( aOut + i, d );
+	}
+#endif
+
+	for( ; i < count; ++i )
+		aOut[i] = aLeft.x[i] * aRight.x[i] + aLeft.y[i] * aRight.y[i] + aLeft.z[i] * aRight.z[i];
+}
+
+inline void dot_batch( const Vec4fSoa& aLeft, const Vec4fSoa& aRight, float* aOut ) noexcept
+{
+	assert( aLeft.size() == aRight.size() );
+	std::size_t count = aLeft.size();
+	std::size_t i = 0;
+
+#if defined(VMLIB_SSE)
+	using namespace soa_detail;
+	for( ; i + kWidth <= count; i += kWidth )
+	{
+		Pack d = vmul( vload( aLeft.x.data() + i ), vload( aRight.x.data() + i ) );
+		d = vmadd( vload( aLeft.y.data() + i ), vload( aRight.y.data() + i ), d );
+		d = vmadd( vload( aLeft.z.data() + i ), vload( aRight.z.data() + i ), d );
+		d = vmadd( vload( aLeft.w.data() + i ), vload( aRight.w.data() + i ), d );
+		vstore( aOut + i, d );
+	}
+#endif
+
+	for( ; i < count; ++i )
+		aOut[i] = aLeft.x[i] * aRight.x[i] + aLeft.y[i] * aRight.y[i] + aLeft.z[i] * aRight.z[i] + aLeft.w[i] * aRight.w[i];
+}
+
+//aOut[i] = cross( aLeft[i], aRight[i] ). aOut is resized to the size of the inputs; it may be one of them.
+inline void cross_batch( const Vec3fSoa& aLeft, const Vec3fSoa& aRight, Vec3fSoa& aOut )
+{
+	assert( aLeft.size() == aRight.size() );
+	std::size_t count = aLeft.size();
+	aOut.resize( count );
+	std::size_t i = 0;
+
+#if defined(VMLIB_SSE)
+	using namespace soa_detail;
+	for( ; i + kWidth <= count; i += kWidth )
+	{
+		Pack lx = vload( aLeft.x.data() + i ), ly = vload( aLeft.y.data() + i ), lz = vload( aLeft.z.data() + i );
+		Pack rx = vload( aRight.x.data() + i ), ry = vload( aRight.y.data() + i ), rz = vload( aRight.z.data() + i );
+		vstore( aOut.x.data() + i, vsub( vmul( ly, rz ), vmul( lz, ry ) ) );
+		vstore( aOut.y.data() + i, vsub( vmul( lz, rx ), vmul( lx, rz ) ) );
+		vstore( aOut.z.data() + i, vsub( vmul( lx, ry ), vmul( ly, rx ) ) );
+	}
+#endif
+
+	for( ; i < count; ++i )
+		aOut.set( i, cross( aLeft.get( i ), aRight.get( i ) ) );
+}
+
+//Normalize all vectors in place. Like normalize(), the vectors must not have a zero length.
+inline void normalize_batch( Vec3fSoa& aV ) noexcept
+{
+	std::size_t count = aV.size();
+	std::size_t i = 0;
+
+#if defined(VMLIB_SSE)
+	using namespace soa_detail;
+	Pack one = vset1( 1.f );
+	for( ; i + kWidth <= count; i += kWidth )
+	{
+		Pack x = vload( aV.x.data() + i ), y = vload( aV.y.data() + i ), z = vload( aV.z.data() + i );
+		Pack lenDenom = vdiv( one, vsqrt( vmadd( z, z, vmadd( y, y, vmul( x, x ) ) ) ) );
+		vstore( aV.x.data() + i, vmul( x, lenDenom ) );
+		vstore( aV.y.data() + i, vmul( y, lenDenom ) );
+		vstore( aV.z.data() + i, vmul( z, lenDenom ) );
+	}
+#endif
+
+	for( ; i < count; ++i )
+		aV.set( i, normalize( aV.get( i ) ) );
+}
+
+//Component-wise minimum and maximum of all vectors. Both are zero for an empty array.
+inline Vec3f min_batch( const Vec3fSoa& aV ) noexcept
+{
+	if( 0 == aV.size() )
+		return Vec3f{ 0.f, 0.f, 0.f };
+	using soa_detail::reduce;
+	return Vec3f{ reduce<false>( aV.x.data(), aV.size(), aV.x[0] ), reduce<false>( aV.y.data(), aV.size(), aV.y[0] ),
+		reduce<false>( aV.z.data(), aV.size(), aV.z[0] ) };
+}
+
+inline Vec3f max_batch( const Vec3fSoa& aV ) noexcept
+{
+	if( 0 == aV.size() )
+		return Vec3f{ 0.f, 0.f, 0.f };
+	using soa_detail::reduce;
+	return Vec3f{ reduce<true>( aV.x.data(), aV.size(), aV.x[0] ), reduce<true>( aV.y.data(), aV.size(), aV.y[0] ),
+		reduce<true>( aV.z.data(), aV.size(), aV.z[0] ) };
+}
+
+inline Vec4f min_batch( const Vec4fSoa& aV ) noexcept
+{
+	if( 0 == aV.size() )
+		return Vec4f{ 0.f, 0.f, 0.f, 0.f };
+	using soa_detail::reduce;
+	return Vec4f{ reduce<false>( aV.x.data(), aV.size(), aV.x[0] ), reduce<false>( aV.y.data(), aV.size(), aV.y[0] ),
+		reduce<false>( aV.z.data(), aV.size(), aV.z[0] ), reduce<false>( aV.w.data(), aV.size(), aV.w[0] ) };
+}
+
+inline Vec4f max_batch( const Vec4fSoa& aV ) noexcept
+{
+	if( 0 == aV.size() )
+		return Vec4f{ 0.f, 0.f, 0.f, 0.f };
+	using soa_detail::reduce;
+	return Vec4f{ reduce<true>( aV.x.data(), aV.size(), aV.x[0] ), reduce<true>( aV.y.data(), aV.size(), aV.y[0] ),
+		reduce<true>( aV.z.data(), aV.size(), aV.z[0] ), reduce<true>( aV.w.data(), aV.size(), aV.w[0] ) };
+}
+
+//Compute the bounding box of the points, like make_aabb() on a Vec3f array.
+inline Aabb make_aabb( const Vec3fSoa& aPoints ) noexcept
+{
+	return Aabb{ min_batch( aPoints ), max_batch( aPoints ) };
+}
+
+//Grow the box so that it contains all the points.
+inline void expand( Aabb& aBox, const Vec3fSoa& aPoints ) noexcept
+{
+	using soa_detail::reduce;
+	std::size_t count = aPoints.size();
+	aBox.min = Vec3f{ reduce<false>( aPoints.x.data(), count, aBox.min.x ), reduce<false>( aPoints.y.data(), count, aBox.min.y ),
+		reduce<false>( aPoints.z.data(), count, aBox.min.z ) };
+	aBox.max = Vec3f{ reduce<true>( aPoints.x.data(), count, aBox.max.x ), reduce<true>( aPoints.y.data(), count, aBox.max.y ),
+		reduce<true>( aPoints.z.data(), count, aBox.max.z ) };
+}
+
+//Signed distances of the points from a plane (a,b,c,d) with a unit normal, as stored in Frustum: aOut[i] is
+//dot( (a,b,c), aPoints[i] ) + d, positive on the side the normal points to. aOut must hold aPoints.size() floats.
+inline void plane_distance_batch( const Vec4f& aPlane, const Vec3fSoa& aPoints, float* aOut ) noexcept
+{
+	std::size_t count = aPoints.size();
+	std::size_t i = 0;
+
+#if defined(VMLIB_SSE)
+	using namespace soa_detail;
+	Pack a = vset1( aPlane.x ), b = vset1( aPlane.y ), c = vset1( aPlane.z ), d = vset1( aPlane.w );
+	for( ; i + kWidth <= count; i += kWidth )
+	{
+		Pack dist = vmadd( a, vload( aPoints.x.data() + i ), d );
+		dist = vmadd( b, vload( aPoints.y.data() + i ), dist );
+		dist = vmadd( c, vload( aPoints.z.data() + i ), dist );
+		vstore( aOut + i, dist );
+	}
+#endif
+
+	for( ; i < count; ++i )
+		aOut[i] = aPlane.x * aPoints.x[i] + aPlane.y * aPoints.y[i] + aPlane.z * aPoints.z[i] + aPlane.w;
+}
+
+//Test many spheres against the frustum at once; see intersects_batch() in frustum.hpp. aRadii and aVisible hold
+//aCenters.size() values.
+inline void intersects_batch( const Frustum& aFrustum, const Vec3fSoa& aCenters, const float* aRadii, std::uint8_t* aVisible ) noexcept
+{
+	intersects_batch( aFrustum, aCenters.x.data(), aCenters.y.data(), aCenters.z.data(), aRadii, aCenters.size(), aVisible );
+}
+
+#endif // SOA_HPP_2BF44749_7B20_494B_9CC0_80FA15EBBB3E